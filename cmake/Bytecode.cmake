@@ -0,0 +1,20 @@
+message(STATUS "Using bytecode interpreter")
+add_library(bytecode_backend
+	"src/backends/BytecodeEmitter.cpp"
+	"src/backends/BytecodeEmitter.h"
+	"src/backends/BytecodeVM.cpp"
+	"src/backends/BytecodeModule.cpp"
+	"src/backends/BytecodeCompiler.cpp"
+	"src/backends/BytecodeModule.h"
+	"src/backends/BytecodeCompiler.h"
+	"src/backends/Bytecode.h"
+	"src/backends/GenericEmit.h"
+	"src/backends/GenericModule.h"
+	"src/backends/GenericCodeGen.h"
+	"src/backends/CodeGenModule.h")
+
+target_link_libraries(bytecode_backend PRIVATE ${CMAKE_DL_LIBS})
+
+set_target_properties( bytecode_backend PROPERTIES FOLDER libs/emitters )
+
+set(HAVE_BYTECODE True)
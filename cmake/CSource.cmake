@@ -0,0 +1,17 @@
+message(STATUS "Using C source backend")
+add_library(csource_backend
+	"src/backends/CSourceEmitter.cpp"
+	"src/backends/CSourceEmitter.h"
+	"src/backends/CSourceModule.cpp"
+	"src/backends/CSourceCompiler.cpp"
+	"src/backends/CSourceModule.h"
+	"src/backends/CSourceCompiler.h"
+	"src/backends/CSource.h"
+	"src/backends/GenericEmit.h"
+	"src/backends/GenericModule.h"
+	"src/backends/GenericCodeGen.h"
+	"src/backends/CodeGenModule.h")
+
+set_target_properties( csource_backend PROPERTIES FOLDER libs/emitters )
+
+set(HAVE_CSOURCE True)
@@ -16,10 +16,16 @@ add_library(llvm_backend
 	"src/backends/LLVMAoT.cpp"
     "src/backends/LLVMJiT.cpp"
     "src/backends/LLVMOpt.cpp"
+    "src/backends/LLVMProfile.cpp"
+    "src/backends/LLVMTuning.cpp"
+    "src/backends/LLVMVectorMath.cpp"
 	"src/backends/LLVMCompiler.h"
 	"src/backends/LLVMModule.h"
+	"src/backends/LLVMProfile.h"
+	"src/backends/LLVMTuning.h"
 	"src/backends/LLVMSignal.h"
 	"src/backends/LLVMUtil.h"
+	"src/backends/LLVMVectorMath.h"
 )
 
 target_link_libraries( llvm_backend PRIVATE ${llvm_libs})
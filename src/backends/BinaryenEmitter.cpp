@@ -385,7 +385,7 @@ namespace K3 {
 				{
 					auto a = TmpVar(lhs), b = TmpVar(rhs);
 					return Select(BinaryOp((Opcode)UnsignedGreater, a, b),
-								  NullConst(TypeOf(a)), b);
+								  NullConst(TypeOf(a)), a);
 				}
 			case AndNot:
 				return BinaryOp(Native::And, UnaryOp(Not, lhs), rhs);
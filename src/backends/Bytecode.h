@@ -0,0 +1,17 @@
+#pragma once
+
+#include "kronos_abi.h"
+#include "kronosrt.h"
+
+namespace K3 {
+	namespace Backends {
+		// builds a class that runs on the bytecode interpreter; there is no machine code
+		// generation, so it is meant for code that runs once, such as REPL evaluations
+		krt_class* BytecodeJiT(
+			const char* engine,
+			const Kronos::ITypedGraph* itg,
+			Kronos::BuildFlags flags);
+
+		class BytecodeTransform;
+	}
+}
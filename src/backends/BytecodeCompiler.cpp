@@ -0,0 +1,51 @@
+#include "BytecodeCompiler.h"
+
+#define CODEGEN_BACKEND_EMIT BYTECODE_EMIT
+#include "GenericEmit.h"
+
+#include <cstring>
+
+namespace K3 {
+	namespace Backends {
+		static BytecodeExprRef Address(BytecodeUnitRef M, char* data) {
+			BytecodeExpr e;
+			e.kind = BytecodeExprKind::Constant;
+			e.type = BytecodeType::Ptr;
+			e.constant = true;
+			e.bits.ptr = data;
+			return M->New(std::move(e));
+		}
+
+		template <> BytecodeExprRef BytecodeModule::InternZeroBytes(const void* uid, size_t numBytes) {
+			auto f = M->zeroData.find(uid);
+			if (f == M->zeroData.end()) {
+				f = M->zeroData.emplace(uid, M->Allocate(numBytes)).first;
+			}
+			return Address(M, f->second);
+		}
+
+		template <> BytecodeExprRef BytecodeModule::InternConstantBlob(const void* data, size_t numBytes) {
+			std::string blob((const char*)data, numBytes);
+			auto f = M->constantData.find(blob);
+			if (f == M->constantData.end()) {
+				auto mem = M->Allocate(numBytes);
+				memcpy(mem, data, numBytes);
+				f = M->constantData.emplace(blob, mem).first;
+			}
+			return Address(M, f->second);
+		}
+
+		template <> BytecodeExprRef BytecodeModule::Intern(const char* str) {
+			return InternConstantBlob(str, strlen(str) + 1);
+		}
+	}
+
+	namespace Nodes {
+		namespace Native {
+			void* BytecodeConversion(Backends::BytecodeTransform& xfm, Backends::ActivityMaskVector* avm,
+									const Type& to, const Type& from, CTRef up) {
+				return (void*)GenericConversion(xfm, avm, to, from, up);
+			}
+		}
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "BytecodeEmitter.h"
+#include "GenericCodeGen.h"
+
+namespace K3 {
+	namespace Backends {
+		struct BytecodeTypes {
+			using ModuleTy = BytecodeUnitRef;
+			using FunctionTyTy = BytecodeFunctionTypeRef;
+			using FunctionTy = BytecodeFunction;
+			using TypeTy = BytecodeType;
+			using ValueTy = BytecodeExprRef;
+			using VariableTy = BytecodeValue;
+			using BuilderTy = BytecodeEmitter;
+			using BlockTy = BytecodeBlock;
+		};
+
+		using BytecodeModule = GenericEmitterModule<BytecodeTypes>;
+
+		template <> BytecodeExprRef BytecodeModule::Intern(const char*);
+		template <> BytecodeExprRef BytecodeModule::InternZeroBytes(const void* uid, size_t numBytes);
+		template <> BytecodeExprRef BytecodeModule::InternConstantBlob(const void* data, size_t numBytes);
+
+		class BytecodeTransform : public GenericEmitterValueTransform<BytecodeTypes, BytecodeTransform> {
+		public:
+			BytecodeTransform(BytecodeUnitRef M, CTRef root, IGenericCompilationPass& pass) :GenericEmitterValueTransform(M, root, pass) {}
+		};
+	}
+}
@@ -0,0 +1,733 @@
+#include "BytecodeEmitter.h"
+#include "Errors.h"
+#include "TLS.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace std {
+	size_t hash<K3::Backends::BytecodeFunctionTypeRef>::operator()(K3::Backends::BytecodeFunctionTypeRef const& fty) const {
+		auto h = (size_t)fty.returnType;
+
+		for (auto&& at : fty.argumentType) {
+			h = h * 7 + (size_t)at;
+		}
+
+		return h;
+	}
+}
+
+namespace K3 {
+	namespace Backends {
+		static const std::int64_t FrameAlignment = 64;
+
+		static bool IsInt(BytecodeType ty) {
+			return ty == BytecodeType::Int32 || ty == BytecodeType::Int64;
+		}
+
+		static bool IsFloat(BytecodeType ty) {
+			return ty == BytecodeType::Float32 || ty == BytecodeType::Float64;
+		}
+
+		static BytecodeOp Wide(BytecodeOp op32, BytecodeType ty) {
+			return (BytecodeOp)((int)op32 + (ty == BytecodeType::Int64 || ty == BytecodeType::Float64 ? 1 : 0));
+		}
+
+		static bool InRange(BytecodeOp op, BytecodeOp first, BytecodeOp last) {
+			return (int)op >= (int)first && (int)op <= (int)last;
+		}
+
+		static BytecodeExprRef Leaf(BytecodeUnitRef M, BytecodeExprKind kind, std::int32_t reg, BytecodeType ty) {
+			BytecodeExpr e;
+			e.kind = kind;
+			e.type = ty;
+			e.reg = reg;
+			return M->New(std::move(e));
+		}
+
+		bool BytecodeFunctionTypeRef::operator==(const BytecodeFunctionTypeRef& rhs) const {
+			return returnType == rhs.returnType && argumentType == rhs.argumentType;
+		}
+
+		BytecodeExprRef BytecodeUnit::New(BytecodeExpr e) {
+			exprs.emplace_back(std::move(e));
+			return &exprs.back();
+		}
+
+		std::int32_t BytecodeUnit::Global(const std::string& name, BytecodeType ty) {
+			auto f = globalIndex.find(name);
+			if (f == globalIndex.end()) {
+				BytecodeReg zero;
+				zero.i64 = 0;
+				globals.emplace_back(zero);
+				globalType.emplace_back(ty);
+				f = globalIndex.emplace(name, (std::int32_t)globals.size() - 1).first;
+			}
+			return f->second;
+		}
+
+		char* BytecodeUnit::Allocate(size_t numBytes) {
+			std::unique_ptr<char[]> block{ new char[numBytes + 16]() };
+			auto aligned = (char*)(((std::uintptr_t)block.get() + 15) & ~(std::uintptr_t)15);
+			memory.emplace_back(std::move(block));
+			return aligned;
+		}
+
+		std::int32_t BytecodeFnData::NewRegister() {
+			BytecodeReg zero;
+			zero.i64 = 0;
+			registers.emplace_back(zero);
+			return (std::int32_t)registers.size() - 1;
+		}
+
+		std::int32_t BytecodeFnData::ConstantRegister(BytecodeType ty, BytecodeReg bits) {
+			auto key = std::make_pair(ty, bits.i64);
+			auto f = constants.find(key);
+			if (f == constants.end()) {
+				auto r = NewRegister();
+				registers[r] = bits;
+				f = constants.emplace(key, r).first;
+			}
+			return f->second;
+		}
+
+		BytecodeFunction::BytecodeFunction(BytecodeUnitRef M, const std::string& nm, bool exp, BytecodeFunctionTypeRef ty)
+			:d(std::make_shared<BytecodeFnData>()) {
+			d->name = nm;
+			d->exported = exp;
+			d->ty = ty;
+			d->unit = M;
+			for (int i = 0; i < d->GetNumParams(); ++i) {
+				d->NewRegister();
+			}
+			M->functions.emplace_back(d);
+		}
+
+		void BytecodeFunction::Complete() const {
+			d->emitted = true;
+		}
+
+		int BytecodeFunction::LVar(const std::string&, BytecodeType ty) {
+			int idx = (int)d->lvars.size();
+			d->lvars.emplace_back(BytecodeLocal{ ty, d->NewRegister() });
+			return idx;
+		}
+
+		int BytecodeFunction::LVar(BytecodeExprRef expr) {
+			return LVar("", expr->type);
+		}
+
+		BytecodeValue::BytecodeValue(BytecodeFunction& fn, BytecodeBlock& b, BytecodeExprRef expr) {
+			if (!expr || expr->kind == BytecodeExprKind::Register || expr->kind == BytecodeExprKind::Constant) {
+				ref = expr;
+				return;
+			}
+			// locals may be assigned later, so their current value is copied
+			auto reg = BytecodeEmitter::Materialize(*fn.d, b, expr,
+				expr->kind == BytecodeExprKind::Local ? fn.d->NewRegister() : -1);
+			ref = reg < 0 ? nullptr : Leaf(fn.d->unit, BytecodeExprKind::Register, reg, expr->type);
+		}
+
+		BytecodeValue BytecodeValue::Local(BytecodeFunction& fn, int index) {
+			auto& lv = fn.d->lvars[index];
+			return BytecodeValue{ Leaf(fn.d->unit, BytecodeExprKind::Local, lv.reg, lv.type) };
+		}
+
+		std::int32_t BytecodeEmitter::Materialize(BytecodeFnData& fn, BytecodeBlock& b, BytecodeExprRef e, std::int32_t dst) {
+			std::int32_t r = -1;
+			switch (e->kind) {
+			case BytecodeExprKind::Register:
+			case BytecodeExprKind::Local:
+				r = e->reg;
+				break;
+			case BytecodeExprKind::Constant:
+				r = fn.ConstantRegister(e->type, e->bits);
+				break;
+			case BytecodeExprKind::Op: {
+				std::int32_t operand[3] = { 0, 0, 0 };
+				int n = 0;
+				for (int i = 0; i < e->numUp; ++i) {
+					operand[n++] = Materialize(fn, b, e->up[i]);
+				}
+				if (e->hasImm) operand[n++] = e->imm;
+				r = dst >= 0 ? dst : fn.NewRegister();
+				b.Emit(e->op, r, operand[0], operand[1], operand[2]);
+				return r;
+			}
+			case BytecodeExprKind::Call: {
+				BytecodeCallSite site{ e->callee, {} };
+				for (auto p : e->params) {
+					site.args.emplace_back(Materialize(fn, b, p));
+				}
+				if (e->type != BytecodeType::Void) {
+					r = dst >= 0 ? dst : fn.NewRegister();
+				}
+				fn.calls.emplace_back(std::move(site));
+				b.Emit(BytecodeOp::Call, r, (std::int32_t)fn.calls.size() - 1);
+				return r;
+			}
+			}
+			if (dst >= 0 && dst != r) {
+				b.Emit(BytecodeOp::Mov, dst, r);
+				return dst;
+			}
+			return r;
+		}
+
+		BytecodeExprRef BytecodeEmitter::Op(BytecodeOp op, BytecodeType ty, std::initializer_list<BytecodeExprRef> up) {
+			BytecodeExpr e;
+			e.kind = BytecodeExprKind::Op;
+			e.type = ty;
+			e.op = op;
+			for (auto u : up) e.up[e.numUp++] = u;
+			return M->New(std::move(e));
+		}
+
+		BytecodeExprRef BytecodeEmitter::OpImm(BytecodeOp op, BytecodeType ty, std::int32_t imm, std::initializer_list<BytecodeExprRef> up) {
+			BytecodeExpr e;
+			e.kind = BytecodeExprKind::Op;
+			e.type = ty;
+			e.op = op;
+			e.hasImm = true;
+			e.imm = imm;
+			for (auto u : up) e.up[e.numUp++] = u;
+			return M->New(std::move(e));
+		}
+
+		static BytecodeOp Conversion(BytecodeType from, BytecodeType to) {
+			using T = BytecodeType;
+			using O = BytecodeOp;
+			switch (from) {
+			case T::Int32:
+				switch (to) {
+				case T::Int64: return O::Int32ToInt64;
+				case T::Float32: return O::Int32ToFloat32;
+				case T::Float64: return O::Int32ToFloat64;
+				case T::Ptr: return O::Int32ToPtr;
+				default: break;
+				}
+				break;
+			case T::Int64:
+				switch (to) {
+				case T::Int32: return O::Int64ToInt32;
+				case T::Float32: return O::Int64ToFloat32;
+				case T::Float64: return O::Int64ToFloat64;
+				case T::Ptr: return O::Int64ToPtr;
+				default: break;
+				}
+				break;
+			case T::Float32:
+				switch (to) {
+				case T::Int32: return O::Float32ToInt32;
+				case T::Int64: return O::Float32ToInt64;
+				case T::Float64: return O::Float32ToFloat64;
+				default: break;
+				}
+				break;
+			case T::Float64:
+				switch (to) {
+				case T::Int32: return O::Float64ToInt32;
+				case T::Int64: return O::Float64ToInt64;
+				case T::Float32: return O::Float64ToFloat32;
+				default: break;
+				}
+				break;
+			case T::Ptr:
+				switch (to) {
+				case T::Int32: return O::PtrToInt32;
+				case T::Int64: return O::PtrToInt64;
+				default: break;
+				}
+				break;
+			default:
+				break;
+			}
+			INTERNAL_ERROR("Invalid type conversion in bytecode emitter");
+		}
+
+		BytecodeExprRef BytecodeEmitter::Adapt(BytecodeExprRef e, BytecodeType ty) {
+			if (ty == BytecodeType::Void || e->type == ty) return e;
+			if (e->kind == BytecodeExprKind::Constant && IsInt(e->type) && IsInt(ty)) {
+				return ty == BytecodeType::Int32 ? Const((std::int32_t)e->value) : Const64(e->value);
+			}
+			return Op(Conversion(e->type, ty), ty, { e });
+		}
+
+		BytecodeExprRef BytecodeEmitter::Truth(BytecodeExprRef x) {
+			return x->type == BytecodeType::Int32 ? x : NonZero(x);
+		}
+
+		BytecodeExprRef BytecodeEmitter::Int(BytecodeOp op32, BytecodeType ty, BytecodeExprRef a, BytecodeExprRef b) {
+			a = Adapt(a, ty); b = Adapt(b, ty);
+
+			if (a->kind == BytecodeExprKind::Constant && b->kind == BytecodeExprKind::Constant) {
+				std::uint64_t x = (std::uint64_t)a->value, y = (std::uint64_t)b->value, r;
+				switch (op32) {
+				case BytecodeOp::AddInt32: r = x + y; break;
+				case BytecodeOp::SubInt32: r = x - y; break;
+				case BytecodeOp::MulInt32: r = x * y; break;
+				default: goto no_fold;
+				}
+				return ty == BytecodeType::Int64 ? Const64((std::int64_t)r) : Const((std::int32_t)r);
+			}
+		no_fold:
+			bool compare = InRange(op32, BytecodeOp::EqInt32, BytecodeOp::GtUInt32);
+			return Op(Wide(op32, ty), compare ? BytecodeType::Int32 : ty, { a, b });
+		}
+
+		BytecodeExprRef BytecodeEmitter::Float(BytecodeOp op32, BytecodeExprRef a, BytecodeExprRef b) {
+			auto ty = a->type;
+			if (!IsFloat(ty)) {
+				return Coerce(ty, Float(op32, Coerce(BytecodeType::Float64, a), Coerce(BytecodeType::Float64, b)));
+			}
+			bool compare = InRange(op32, BytecodeOp::EqFloat32, BytecodeOp::GeFloat32);
+			return Op(Wide(op32, ty), compare ? BytecodeType::Int32 : ty, { a, Adapt(b, ty) });
+		}
+
+		BytecodeExprRef BytecodeEmitter::Float(BytecodeOp op32, BytecodeExprRef a) {
+			auto ty = a->type;
+			if (!IsFloat(ty)) {
+				return Coerce(ty, Float(op32, Coerce(BytecodeType::Float64, a)));
+			}
+			return Op(Wide(op32, ty), ty, { a });
+		}
+
+		BytecodeExprRef BytecodeEmitter::Compare(BytecodeOp intOp32, BytecodeOp floatOp32, BytecodeExprRef a, BytecodeExprRef b) {
+			switch (a->type) {
+			case BytecodeType::Float32:
+			case BytecodeType::Float64:
+				return Float(floatOp32, a, b);
+			case BytecodeType::Ptr:
+				return Int(intOp32, BytecodeType::Int64, a, b);
+			default:
+				return Int(intOp32, a->type, a, b);
+			}
+		}
+
+		BytecodeExprRef BytecodeEmitter::NonZero(BytecodeExprRef v) {
+			switch (v->type) {
+			case BytecodeType::Float32:
+			case BytecodeType::Float64:
+				return Float(BytecodeOp::NeFloat32, v, NullConst(v->type));
+			case BytecodeType::Int32:
+				return NeInt32(v, Const(0));
+			default:
+				return NeInt64(v, Const64(0));
+			}
+		}
+
+		BytecodeExprRef BytecodeEmitter::Const(std::int32_t v) {
+			BytecodeExpr e;
+			e.kind = BytecodeExprKind::Constant;
+			e.type = BytecodeType::Int32;
+			e.constant = true;
+			e.value = v;
+			e.bits.i64 = 0;
+			e.bits.i32 = v;
+			return M->New(std::move(e));
+		}
+
+		BytecodeExprRef BytecodeEmitter::Const64(std::int64_t v) {
+			BytecodeExpr e;
+			e.kind = BytecodeExprKind::Constant;
+			e.type = BytecodeType::Int64;
+			e.constant = true;
+			e.value = v;
+			e.bits.i64 = v;
+			return M->New(std::move(e));
+		}
+
+		BytecodeExprRef BytecodeEmitter::NullConst(BytecodeType ty) {
+			switch (ty) {
+			case BytecodeType::Int32: return Const(0);
+			case BytecodeType::Int64: return Const64(0);
+			case BytecodeType::Float32:
+			case BytecodeType::Float64:
+			case BytecodeType::Ptr: {
+				BytecodeExpr e;
+				e.kind = BytecodeExprKind::Constant;
+				e.type = ty;
+				e.constant = true;
+				e.bits.i64 = 0;
+				return M->New(std::move(e));
+			}
+			default: KRONOS_UNREACHABLE;
+			}
+		}
+
+		BytecodeExprRef BytecodeEmitter::AllOnesConst(BytecodeType ty) {
+			switch (ty) {
+			case BytecodeType::Int32: return Const(-1);
+			case BytecodeType::Int64: return Const64(-1);
+			case BytecodeType::Float32: return BitCast(ty, Const(-1));
+			case BytecodeType::Float64: return BitCast(ty, Const64(-1));
+			default: KRONOS_UNREACHABLE;
+			}
+		}
+
+		void BytecodeEmitter::Ret(BytecodeExprRef v) {
+			auto retTy = fn.d->ty.returnType;
+			if (retTy == BytecodeType::Void) {
+				b->Emit(BytecodeOp::RetVoid);
+			} else {
+				b->Emit(BytecodeOp::Ret, Reg(v ? Adapt(v, retTy) : NullConst(retTy)));
+			}
+		}
+
+		BytecodeExprRef BytecodeEmitter::Constant(const void* data, BytecodeType ty) {
+			switch (ty) {
+			case BytecodeType::Int32: return Const(*(const std::int32_t*)data);
+			case BytecodeType::Int64: return Const64(*(const std::int64_t*)data);
+			case BytecodeType::Float32:
+			case BytecodeType::Float64: {
+				BytecodeExpr e;
+				e.kind = BytecodeExprKind::Constant;
+				e.type = ty;
+				e.constant = true;
+				e.bits.i64 = 0;
+				memcpy(&e.bits, data, ty == BytecodeType::Float32 ? sizeof(float) : sizeof(double));
+				return M->New(std::move(e));
+			}
+			default:
+				INTERNAL_ERROR("Unsupported constant type in bytecode emitter");
+			}
+		}
+
+		BytecodeExprRef BytecodeEmitter::FnArg(int index) {
+			if (index < 0 || index >= (int)fn.d->ty.argumentType.size()) {
+				INTERNAL_ERROR("Function argument out of range in bytecode emitter");
+			}
+			return Leaf(M, BytecodeExprKind::Register, index, fn.d->ty.argumentType[index]);
+		}
+
+		BytecodeExprRef BytecodeEmitter::GetSlot(int index) {
+			return OpImm(BytecodeOp::GetSlot, BytecodeType::Ptr, index);
+		}
+
+		void BytecodeEmitter::SetSlot(int index, BytecodeExprRef val) {
+			b->Emit(BytecodeOp::SetSlot, index, Reg(Adapt(val, BytecodeType::Ptr)));
+		}
+
+		BytecodeExprRef BytecodeEmitter::PtrToInt(BytecodeExprRef ptr) {
+			return Adapt(ptr, BytecodeType::Int32);
+		}
+
+		BytecodeExprRef BytecodeEmitter::IntToPtr(BytecodeExprRef i) {
+			return Adapt(i, BytecodeType::Ptr);
+		}
+
+		BytecodeExprRef BytecodeEmitter::Offset(BytecodeExprRef ptr, BytecodeExprRef offset) {
+			if (offset->kind == BytecodeExprKind::Constant && IsInt(offset->type) && offset->value == 0) {
+				return Adapt(ptr, BytecodeType::Ptr);
+			}
+			if (offset->type != BytecodeType::Int32) offset = Adapt(offset, BytecodeType::Int64);
+			return Op(offset->type == BytecodeType::Int32 ? BytecodeOp::OffsetInt32 : BytecodeOp::OffsetInt64,
+					  BytecodeType::Ptr, { Adapt(ptr, BytecodeType::Ptr), offset });
+		}
+
+		BytecodeExprRef BytecodeEmitter::Call(const BytecodeFunction& callee, const std::vector<BytecodeExprRef>& params, bool) {
+			auto call = PureCall(callee, params, true);
+			if (call->type == BytecodeType::Void) {
+				Reg(call);
+				return nullptr;
+			}
+			return TmpVar(call);
+		}
+
+		BytecodeExprRef BytecodeEmitter::PureCall(const BytecodeFunction& callee, const std::vector<BytecodeExprRef>& params, bool) {
+			if (callee.d != fn.d) callee.Complete();
+			auto& ty = callee.d->ty;
+			BytecodeExpr e;
+			e.kind = BytecodeExprKind::Call;
+			e.type = ty.returnType;
+			e.callee = callee.d.get();
+			for (size_t i = 0; i < params.size(); ++i) {
+				e.params.emplace_back(Adapt(params[i], ty.argumentType[i]));
+			}
+			return M->New(std::move(e));
+		}
+
+		void BytecodeEmitter::TCO(BytecodeExprRef cond, const std::vector<BytecodeValue>& params) {
+			auto& d = *fn.d;
+			If(cond, [&](BytecodeEmitter& tco) {
+				// evaluate every argument before any parameter is overwritten
+				std::vector<BytecodeExprRef> next;
+				for (size_t i = 0; i < params.size(); ++i) {
+					auto p = tco.Adapt(params[i].ref, d.ty.argumentType[i]);
+					if (p->kind != BytecodeExprKind::Constant) {
+						p = Leaf(M, BytecodeExprKind::Register, Materialize(d, *tco.b, p, d.NewRegister()), p->type);
+					}
+					next.emplace_back(p);
+				}
+				for (size_t i = 0; i < params.size(); ++i) {
+					Materialize(d, *tco.b, next[i], (std::int32_t)i);
+				}
+				tco.b->Emit(BytecodeOp::Restart);
+			});
+		}
+
+		BytecodeExprRef BytecodeEmitter::GVar(const std::string& name, BytecodeType ty) {
+			auto idx = M->Global(name, ty);
+			return OpImm(BytecodeOp::GetGlobal, M->globalType[idx], idx);
+		}
+
+		void BytecodeEmitter::SetGVar(const std::string& name, BytecodeExprRef value, bool soleAssignment) {
+			if (soleAssignment && value->kind == BytecodeExprKind::Constant && M->globalIndex.count(name) == 0) {
+				M->globals[M->Global(name, value->type)] = value->bits;
+				return;
+			}
+			auto idx = M->Global(name, value->type);
+			b->Emit(BytecodeOp::SetGlobal, idx, Reg(Adapt(value, M->globalType[idx])));
+		}
+
+		BytecodeExprRef BytecodeEmitter::Alloca(BytecodeExprRef sz, int align) {
+			if (align < 1) align = 1;
+			if (sz->kind == BytecodeExprKind::Constant && IsInt(sz->type) && align <= FrameAlignment) {
+				// constant sized buffers live in the frame of the function
+				auto& d = *fn.d;
+				auto offset = (d.frameSize + align - 1) & ~(std::int64_t)(align - 1);
+				d.frameSize = offset + std::max<std::int64_t>(sz->value, 1);
+				if (d.frameSize <= INT32_MAX) {
+					return OpImm(BytecodeOp::FrameAddr, BytecodeType::Ptr, (std::int32_t)offset);
+				}
+			}
+			return TmpVar(OpImm(BytecodeOp::Alloca, BytecodeType::Ptr, align, { Adapt(sz, BytecodeType::Int64) }));
+		}
+
+		BytecodeExprRef BytecodeEmitter::GlobalExternal(BytecodeType ty, const std::string& importModule, const std::string& sym) {
+			if (importModule == "asset" && ty == BytecodeType::Ptr) {
+				BytecodeExpr e;
+				e.kind = BytecodeExprKind::Constant;
+				e.type = ty;
+				e.constant = true;
+				e.bits.ptr = (char*)TLS::GetCurrentInstance()->GetAsset(sym).memory.get();
+				return M->New(std::move(e));
+			}
+			INTERNAL_ERROR("The bytecode interpreter can not import '" + importModule + ":" + sym + "'");
+		}
+
+		BytecodeExprRef BytecodeEmitter::CallExternal(BytecodeType returnType, const std::string& sym, const std::vector<BytecodeExprRef>& params) {
+			BytecodeForeignSite site{ BytecodeForeignSymbol(sym), sym, returnType, {}, {} };
+			if (!site.address) {
+				INTERNAL_ERROR("Foreign function '" + sym + "' is not loaded in this process");
+			}
+			for (auto p : params) {
+				site.argumentType.emplace_back(p->type);
+			}
+			if (!BytecodeForeignCallable(returnType, site.argumentType)) {
+				INTERNAL_ERROR("The bytecode interpreter can not call foreign function '" + sym + "' on this platform");
+			}
+			for (auto p : params) {
+				site.args.emplace_back(Reg(p));
+			}
+			fn.d->foreign.emplace_back(std::move(site));
+
+			auto dst = returnType == BytecodeType::Void ? -1 : fn.d->NewRegister();
+			b->Emit(BytecodeOp::CallExternal, dst, (std::int32_t)fn.d->foreign.size() - 1);
+
+			if (returnType == BytecodeType::Void) return Const(0);
+			return Leaf(M, BytecodeExprKind::Register, dst, returnType);
+		}
+
+		void BytecodeEmitter::MemCpy(BytecodeExprRef dst, BytecodeExprRef src, BytecodeExprRef sz, int) {
+			if (sz->kind == BytecodeExprKind::Constant && sz->value <= 0) return;
+			b->Emit(BytecodeOp::MemCpy,
+					Reg(Adapt(dst, BytecodeType::Ptr)),
+					Reg(Adapt(src, BytecodeType::Ptr)),
+					Reg(Adapt(sz, BytecodeType::Int64)));
+		}
+
+		void BytecodeEmitter::MemSet(BytecodeExprRef dst, BytecodeExprRef word, BytecodeExprRef sz) {
+			b->Emit(BytecodeOp::MemSet,
+					Reg(Adapt(dst, BytecodeType::Ptr)),
+					Reg(Adapt(word, BytecodeType::Int32)),
+					Reg(Adapt(sz, BytecodeType::Int64)));
+		}
+
+		void BytecodeEmitter::Set(int i, BytecodeExprRef val) {
+			auto& lv = fn.d->lvars[i];
+			// integer locals that receive addresses become pointers
+			if (lv.type == BytecodeType::Int32 && val->type == BytecodeType::Ptr) {
+				lv.type = BytecodeType::Ptr;
+			}
+			auto reg = lv.reg;
+			Materialize(*fn.d, *b, Adapt(val, lv.type), reg);
+		}
+
+		void BytecodeEmitter::Switch(BytecodeExprRef c, const std::vector<BytecodeBlock>& blocks) {
+			if (blocks.empty()) return;
+			auto cond = Reg(Adapt(c, BytecodeType::Int32));
+			// jump offsets of each case; the last entry is taken for values out of range.
+			// cases fall through as in the C source backend.
+			std::vector<std::int32_t> table;
+			std::int32_t at = 1;
+			for (auto& blk : blocks) {
+				table.emplace_back(at);
+				at += blk.Size();
+			}
+			table.emplace_back(at);
+			fn.d->switches.emplace_back(std::move(table));
+			b->Emit(BytecodeOp::Switch, cond, (std::int32_t)fn.d->switches.size() - 1);
+			for (auto& blk : blocks) {
+				b->Append(blk);
+			}
+		}
+
+		BytecodeExprRef BytecodeEmitter::GetSignalMaskWord(int bitIdx, int& outSubIdx) {
+			outSubIdx = bitIdx % 32;
+			return OpImm(BytecodeOp::GetMask, BytecodeType::Int32, -1 - bitIdx / 32);
+		}
+
+		void BytecodeEmitter::StoreSignalMaskWord(int bitIdx, BytecodeExprRef word) {
+			b->Emit(BytecodeOp::SetMask, -1 - bitIdx / 32, Reg(Adapt(word, BytecodeType::Int32)));
+		}
+
+		BytecodeExprRef BytecodeEmitter::BitCast(BytecodeType to, BytecodeExprRef val) {
+			if (to == val->type) return val;
+			if (val->kind == BytecodeExprKind::Constant) {
+				BytecodeExpr e{ *val };
+				e.type = to;
+				e.value = to == BytecodeType::Int32 ? e.bits.i32 : e.bits.i64;
+				return M->New(std::move(e));
+			}
+			return Op(BytecodeOp::Mov, to, { val });
+		}
+
+		BytecodeExprRef BytecodeEmitter::BitCastInt(BytecodeExprRef val) {
+			switch (val->type) {
+			case BytecodeType::Float32: return BitCast(BytecodeType::Int32, val);
+			case BytecodeType::Float64: return BitCast(BytecodeType::Int64, val);
+			default: return val;
+			}
+		}
+
+		BytecodeExprRef BytecodeEmitter::Coerce(BytecodeType to, BytecodeExprRef from) {
+			if (to == BytecodeType::Ptr || from->type == BytecodeType::Ptr) {
+				INTERNAL_ERROR("Invalid type conversion");
+			}
+			return Adapt(from, to);
+		}
+
+		BytecodeExprRef BytecodeEmitter::LogicResult(BytecodeExprRef truth, BytecodeType ty) {
+			switch (ty) {
+			case BytecodeType::Int32: return SubInt32(Const(0), truth);
+			case BytecodeType::Int64: return SubInt64(Const64(0), truth);
+			case BytecodeType::Float32: return BitCast(ty, SubInt32(Const(0), truth));
+			case BytecodeType::Float64: return BitCast(ty, SubInt64(Const64(0), truth));
+			default: KRONOS_UNREACHABLE;
+			}
+		}
+
+		static BytecodeOp LoadOp(BytecodeType ty) {
+			switch (ty) {
+#define MEM(T, M) case BytecodeType::T: return BytecodeOp::Load ## T;
+				BYTECODE_MEMORY(MEM)
+#undef MEM
+			default: KRONOS_UNREACHABLE;
+			}
+		}
+
+		static BytecodeOp StoreOp(BytecodeType ty) {
+			switch (ty) {
+#define MEM(T, M) case BytecodeType::T: return BytecodeOp::Store ## T;
+				BYTECODE_MEMORY(MEM)
+#undef MEM
+			default: KRONOS_UNREACHABLE;
+			}
+		}
+
+		BytecodeExprRef BytecodeEmitter::Load(BytecodeExprRef ptr, BytecodeType ty, int) {
+			return Op(LoadOp(ty), ty, { Adapt(ptr, BytecodeType::Ptr) });
+		}
+
+		void BytecodeEmitter::Store(BytecodeExprRef ptr, BytecodeExprRef value, int) {
+			b->Emit(StoreOp(value->type), Reg(Adapt(ptr, BytecodeType::Ptr)), Reg(value));
+		}
+
+		BytecodeExprRef BytecodeEmitter::BinaryOp(Nodes::Native::Opcode op, BytecodeExprRef lhs, BytecodeExprRef rhs) {
+			namespace N = Nodes::Native;
+			using O = BytecodeOp;
+			auto ty = lhs->type;
+			auto Arith = [&](O intOp, O floatOp) {
+				return IsInt(ty) ? Int(intOp, ty, lhs, rhs) : Float(floatOp, lhs, rhs);
+			};
+			auto Cmp = [&](O intOp, O floatOp) {
+				return LogicResult(Compare(intOp, floatOp, lhs, rhs), ty);
+			};
+			auto Bits = [&](O intOp) {
+				if (IsInt(ty)) return Int(intOp, ty, lhs, rhs);
+				return BitCast(ty, BinaryOp(op, BitCastInt(lhs), BitCastInt(rhs)));
+			};
+
+			switch (op) {
+			case N::Add: return Arith(O::AddInt32, O::AddFloat32);
+			case N::Sub: return Arith(O::SubInt32, O::SubFloat32);
+			case N::Mul: return Arith(O::MulInt32, O::MulFloat32);
+			case N::Div: return Arith(O::DivSInt32, O::DivFloat32);
+			case N::Equal: return Cmp(O::EqInt32, O::EqFloat32);
+			case N::Not_Equal: return Cmp(O::NeInt32, O::NeFloat32);
+			case N::Greater: return Cmp(O::GtSInt32, O::GtFloat32);
+			case N::Greater_Equal: return Cmp(O::GeSInt32, O::GeFloat32);
+			case N::Less: return Cmp(O::LtSInt32, O::LtFloat32);
+			case N::Less_Equal: return Cmp(O::LeSInt32, O::LeFloat32);
+			case N::And: return Bits(O::AndInt32);
+			case N::Or: return Bits(O::OrInt32);
+			case N::Xor: return Bits(O::XorInt32);
+			case N::AndNot: return BinaryOp(N::And, UnaryOp(N::Not, lhs), rhs);
+			case N::BitShiftLeft: return Bits(O::ShlInt32);
+			case N::BitShiftRight: return Bits(O::ShrSInt32);
+			case N::LogicalShiftRight: return Bits(O::ShrUInt32);
+			case N::Modulo:
+				if (!IsInt(ty)) break;
+				return Int(O::ModInt32, ty, lhs, rhs);
+			case N::Max:
+			case N::Min: {
+				auto x = TmpVar(lhs), y = TmpVar(rhs);
+				return Select(op == N::Max ? Compare(O::GtSInt32, O::GtFloat32, x, y) : Compare(O::LtSInt32, O::LtFloat32, x, y), x, y);
+			}
+			case N::ClampIndex: {
+				if (!IsInt(ty)) break;
+				auto x = TmpVar(lhs), y = TmpVar(rhs);
+				return Select(Int(O::GtUInt32, ty, x, y), NullConst(ty), x);
+			}
+			case N::Pow: return Float(O::PowFloat32, lhs, rhs);
+			case N::Atan2: return Float(O::Atan2Float32, lhs, rhs);
+			default: break;
+			}
+			INTERNAL_ERROR("Unsupported binary operator in bytecode emitter");
+		}
+
+		BytecodeExprRef BytecodeEmitter::UnaryOp(Nodes::Native::Opcode op, BytecodeExprRef up) {
+			namespace N = Nodes::Native;
+			using O = BytecodeOp;
+			auto ty = up->type;
+			switch (op) {
+			case N::Neg:
+				if (IsInt(ty)) return Int(O::SubInt32, ty, NullConst(ty), up);
+				return Float(O::NegFloat32, up);
+			case N::Abs:
+				if (IsInt(ty)) {
+					auto x = TmpVar(up);
+					return Select(Int(O::LtSInt32, ty, x, NullConst(ty)), Int(O::SubInt32, ty, NullConst(ty), x), x);
+				}
+				return Float(O::AbsFloat32, up);
+			case N::Not:
+				if (IsInt(ty)) return Int(O::XorInt32, ty, up, AllOnesConst(ty));
+				return BitCast(ty, UnaryOp(op, BitCastInt(up)));
+			case N::Truncate: return Float(O::TruncFloat32, up);
+			case N::Round: return Float(O::RoundFloat32, up);
+			case N::Ceil: return Float(O::CeilFloat32, up);
+			case N::Floor: return Float(O::FloorFloat32, up);
+			case N::Sqrt: return Float(O::SqrtFloat32, up);
+			case N::Cos: return Float(O::CosFloat32, up);
+			case N::Sin: return Float(O::SinFloat32, up);
+			case N::Exp: return Float(O::ExpFloat32, up);
+			case N::Log: return Float(O::LogFloat32, up);
+			case N::Log10: return Float(O::Log10Float32, up);
+			case N::Log2: return Float(O::Log2Float32, up);
+			default: break;
+			}
+			INTERNAL_ERROR("Unsupported unary operator in bytecode emitter");
+		}
+	}
+}
@@ -0,0 +1,447 @@
+#pragma once
+
+#include "Native.h"
+#include "CodeGenCompiler.h"
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace K3 {
+	namespace Backends {
+		enum class BytecodeType {
+			Void,
+			Int32,
+			Int64,
+			Float32,
+			Float64,
+			Ptr
+		};
+
+		union BytecodeReg {
+			std::int32_t i32;
+			std::int64_t i64;
+			float f32;
+			double f64;
+			char* ptr;
+		};
+
+#define BYTECODE_INT_BINARY(F) F(Add) F(Sub) F(Mul) F(DivS) F(RemS) F(RemU) F(And) F(Or) F(Xor) F(Shl) F(ShrS) F(ShrU) F(Mod)
+#define BYTECODE_INT_COMPARE(F) F(Eq) F(Ne) F(LtS) F(LeS) F(GtS) F(GeS) F(GtU)
+#define BYTECODE_FLOAT_BINARY(F) F(Add) F(Sub) F(Mul) F(Div) F(Pow) F(Atan2)
+#define BYTECODE_FLOAT_COMPARE(F) F(Eq) F(Ne) F(Lt) F(Le) F(Gt) F(Ge)
+#define BYTECODE_FLOAT_UNARY(F) F(Neg) F(Abs) F(Trunc) F(Round) F(Ceil) F(Floor) F(Sqrt) F(Cos) F(Sin) F(Exp) F(Log) F(Log10) F(Log2)
+#define BYTECODE_MEMORY(F) F(Int32, i32) F(Int64, i64) F(Float32, f32) F(Float64, f64) F(Ptr, ptr)
+
+		// every arithmetic op comes in a 32-bit and a 64-bit flavor; the wide one directly follows
+		enum class BytecodeOp : std::uint16_t {
+#define INT(OP) OP ## Int32, OP ## Int64,
+#define FLOAT(OP) OP ## Float32, OP ## Float64,
+			BYTECODE_INT_BINARY(INT)
+			BYTECODE_INT_COMPARE(INT)
+			BYTECODE_FLOAT_BINARY(FLOAT)
+			BYTECODE_FLOAT_COMPARE(FLOAT)
+			BYTECODE_FLOAT_UNARY(FLOAT)
+#undef INT
+#undef FLOAT
+#define MEM(T, M) Load ## T, Store ## T,
+			BYTECODE_MEMORY(MEM)
+#undef MEM
+			Int32ToInt64, Int32ToFloat32, Int32ToFloat64, Int32ToPtr,
+			Int64ToInt32, Int64ToFloat32, Int64ToFloat64, Int64ToPtr,
+			Float32ToInt32, Float32ToInt64, Float32ToFloat64,
+			Float64ToInt32, Float64ToInt64, Float64ToFloat32,
+			PtrToInt32, PtrToInt64,
+			Mov, Select, OffsetInt32, OffsetInt64,
+			GetSlot, SetSlot, GetMask, SetMask, GetGlobal, SetGlobal,
+			FrameAddr, Alloca, MemCpy, MemSet,
+			Jump, JumpIfZero, JumpIfGeS, Switch,
+			Call, CallExternal, Ret, RetVoid, Restart
+		};
+
+		// a = destination or first operand, b..d = operands or immediates; jumps are relative
+		struct BytecodeInstr {
+			BytecodeOp op;
+			std::int32_t a = 0, b = 0, c = 0, d = 0;
+		};
+
+		struct BytecodeFnData;
+
+		enum class BytecodeExprKind {
+			// reads a register that is never written after its definition
+			Register,
+			// reads a local variable at the point of use
+			Local,
+			Constant,
+			Op,
+			Call
+		};
+
+		// expressions are lazy, like source text: they are materialized into
+		// instructions where a statement, branch or temporary needs them
+		struct BytecodeExpr {
+			BytecodeExprKind kind;
+			BytecodeType type;
+			BytecodeOp op = BytecodeOp::Mov;
+			const BytecodeExpr* up[3] = { nullptr, nullptr, nullptr };
+			int numUp = 0;
+			bool hasImm = false;
+			std::int32_t imm = 0;
+			std::int32_t reg = -1;
+			bool constant = false;
+			std::int64_t value = 0;
+			BytecodeReg bits;
+			const BytecodeFnData* callee = nullptr;
+			std::vector<const BytecodeExpr*> params;
+		};
+
+		using BytecodeExprRef = const BytecodeExpr*;
+
+		struct BytecodeFunctionTypeRef {
+			std::vector<BytecodeType> argumentType;
+			BytecodeType returnType;
+
+			bool operator==(const BytecodeFunctionTypeRef&) const;
+		};
+
+		struct BytecodeBlock {
+			std::string name;
+			std::vector<BytecodeInstr> code;
+			BytecodeBlock(const std::string& nm) :name(nm) {}
+			BytecodeBlock() {}
+
+			void Emit(BytecodeOp op, std::int32_t a = 0, std::int32_t b = 0, std::int32_t c = 0, std::int32_t d = 0) {
+				code.push_back(BytecodeInstr{ op, a, b, c, d });
+			}
+
+			void Append(const BytecodeBlock& nested) {
+				code.insert(code.end(), nested.code.begin(), nested.code.end());
+			}
+
+			std::int32_t Size() const {
+				return (std::int32_t)code.size();
+			}
+		};
+
+		struct BytecodeCallSite {
+			const BytecodeFnData* callee;
+			std::vector<std::int32_t> args;
+		};
+
+		struct BytecodeForeignSite {
+			void* address;
+			std::string sym;
+			BytecodeType result;
+			std::vector<BytecodeType> argumentType;
+			std::vector<std::int32_t> args;
+		};
+
+		// the code of a class; owns every expression, function and constant
+		struct BytecodeUnit {
+			std::deque<BytecodeExpr> exprs;
+			std::vector<std::shared_ptr<BytecodeFnData>> functions;
+			std::vector<BytecodeReg> globals;
+			std::vector<BytecodeType> globalType;
+			std::unordered_map<std::string, std::int32_t> globalIndex;
+			std::vector<std::unique_ptr<char[]>> memory;
+			std::unordered_map<std::string, char*> constantData;
+			std::unordered_map<const void*, char*> zeroData;
+
+			BytecodeExprRef New(BytecodeExpr e);
+			std::int32_t Global(const std::string& name, BytecodeType ty);
+			// zero filled and 16-byte aligned
+			char* Allocate(size_t numBytes);
+		};
+
+		using BytecodeUnitRef = BytecodeUnit*;
+
+		struct BytecodeLocal {
+			BytecodeType type;
+			std::int32_t reg;
+		};
+
+		struct BytecodeFnData {
+			std::string name;
+			bool exported;
+			BytecodeFunctionTypeRef ty;
+			BytecodeUnitRef unit;
+			// initial register file: parameters first, then constants, locals and temporaries
+			std::vector<BytecodeReg> registers;
+			std::map<std::pair<BytecodeType, std::int64_t>, std::int32_t> constants;
+			std::vector<BytecodeLocal> lvars;
+			std::vector<BytecodeCallSite> calls;
+			std::vector<BytecodeForeignSite> foreign;
+			std::vector<std::vector<std::int32_t>> switches;
+			std::int64_t frameSize = 0;
+			BytecodeBlock body;
+			bool emitted = false;
+
+			int GetNumParams() const {
+				return (int)ty.argumentType.size();
+			}
+
+			std::int32_t NewRegister();
+			std::int32_t ConstantRegister(BytecodeType, BytecodeReg);
+		};
+
+		// runs 'fn' with the parameters read from 'args' at register indices 'argRegs'
+		BytecodeReg Interpret(const BytecodeFnData& fn, void** self, const BytecodeReg* args, const std::int32_t* argRegs);
+
+		// address of a process symbol for CallExternal, or null if it is not loaded
+		void* BytecodeForeignSymbol(const std::string& sym);
+		// whether Interpret can pass these types to a native function on this platform
+		bool BytecodeForeignCallable(BytecodeType result, const std::vector<BytecodeType>& argumentType);
+
+		struct BytecodeFunction {
+			std::shared_ptr<BytecodeFnData> d;
+
+			void NoInline() {}
+			void NoThrow() {}
+			void FastCConv() {}
+
+			BytecodeFunction(BytecodeUnitRef M, const std::string& nm, bool exp, BytecodeFunctionTypeRef ty);
+			BytecodeFunction() {}
+			void Complete() const;
+
+			BytecodeFunctionTypeRef TypeOf() {
+				return d->ty;
+			}
+
+			int LVar(const std::string&, BytecodeType ty);
+			int LVar(BytecodeExprRef);
+
+			operator bool() const {
+				return d.operator bool();
+			}
+		};
+
+		struct BytecodeValue {
+			BytecodeExprRef ref = nullptr;
+			BytecodeValue() {}
+			explicit BytecodeValue(BytecodeExprRef atom) :ref(atom) {}
+			BytecodeValue(BytecodeFunction& fn, BytecodeExprRef expr) :BytecodeValue(fn, fn.d->body, expr) {}
+			BytecodeValue(BytecodeFunction& fn, BytecodeBlock& b, BytecodeExprRef expr);
+			static BytecodeValue Local(BytecodeFunction& fn, int index);
+
+			operator BytecodeExprRef() const {
+				return ref;
+			}
+		};
+
+		class BytecodeEmitter {
+			BytecodeFunction fn;
+			BytecodeUnitRef M;
+			BytecodeBlock* b;
+
+			BytecodeExprRef Op(BytecodeOp, BytecodeType, std::initializer_list<BytecodeExprRef> up);
+			BytecodeExprRef OpImm(BytecodeOp, BytecodeType, std::int32_t imm, std::initializer_list<BytecodeExprRef> up = {});
+			BytecodeExprRef Int(BytecodeOp op32, BytecodeType, BytecodeExprRef, BytecodeExprRef);
+			BytecodeExprRef Float(BytecodeOp op32, BytecodeExprRef, BytecodeExprRef);
+			BytecodeExprRef Float(BytecodeOp op32, BytecodeExprRef);
+			BytecodeExprRef Compare(BytecodeOp intOp32, BytecodeOp floatOp32, BytecodeExprRef, BytecodeExprRef);
+			BytecodeExprRef Adapt(BytecodeExprRef, BytecodeType);
+			BytecodeExprRef Truth(BytecodeExprRef);
+			std::int32_t Reg(BytecodeExprRef e) { return Materialize(*fn.d, *b, e); }
+
+		public:
+			// emits the instructions that compute 'e' into 'b' and returns the register that holds it
+			static std::int32_t Materialize(BytecodeFnData& fn, BytecodeBlock& b, BytecodeExprRef e, std::int32_t dst = -1);
+
+			BytecodeEmitter() :M(nullptr), b(nullptr) {}
+			BytecodeEmitter(BytecodeFunction& fn) :fn(fn), M(fn.d->unit), b(&fn.d->body) {}
+			BytecodeEmitter(BytecodeFunction& fn, BytecodeBlock& b) :fn(fn), M(fn.d->unit), b(&b) {}
+
+#define IB(SYM) \
+			BytecodeExprRef SYM ## Int32(BytecodeExprRef lhs, BytecodeExprRef rhs) { return Int(BytecodeOp::SYM ## Int32, BytecodeType::Int32, lhs, rhs); } \
+			BytecodeExprRef SYM ## Int64(BytecodeExprRef lhs, BytecodeExprRef rhs) { return Int(BytecodeOp::SYM ## Int32, BytecodeType::Int64, lhs, rhs); }
+			IB(Add)
+			IB(Sub)
+			IB(Mul)
+			IB(DivS)
+			IB(RemS)
+			IB(RemU)
+			IB(And)
+			IB(Or)
+			IB(Xor)
+			IB(Shl)
+			IB(ShrS)
+			IB(ShrU)
+			IB(Eq)
+			IB(Ne)
+			IB(LtS)
+			IB(LeS)
+			IB(GtS)
+			IB(GeS)
+#undef IB
+			BytecodeExprRef And(BytecodeExprRef lhs, BytecodeExprRef rhs) {
+				return AndInt32(lhs, rhs);
+			}
+
+			BytecodeExprRef Or(BytecodeExprRef lhs, BytecodeExprRef rhs) {
+				return OrInt32(lhs, rhs);
+			}
+
+			BytecodeExprRef LogicalNot(BytecodeExprRef x) {
+				return EqInt32(Truth(x), Const(0));
+			}
+
+			BytecodeExprRef Select(BytecodeExprRef which, BytecodeExprRef whenTrue, BytecodeExprRef whenFalse) {
+				return Op(BytecodeOp::Select, whenTrue->type, { Truth(which), whenTrue, Adapt(whenFalse, whenTrue->type) });
+			}
+
+			BytecodeExprRef NonZero(BytecodeExprRef expr);
+
+			BytecodeExprRef Const(std::int32_t v);
+			BytecodeExprRef Const64(std::int64_t v);
+			BytecodeExprRef NullConst(BytecodeType ty);
+			BytecodeExprRef AllOnesConst(BytecodeType ty);
+
+			BytecodeExprRef UndefConst(BytecodeType ty) {
+				return NullConst(ty);
+			}
+
+			BytecodeExprRef PassiveValue(BytecodeType ty, const std::string& label) {
+				return UndefConst(ty);
+			}
+
+			void Ret(BytecodeExprRef v = nullptr);
+
+			void RetNoUnwind(BytecodeExprRef v = nullptr) {
+				Ret(v);
+			}
+
+			BytecodeExprRef Constant(const void* data, BytecodeType ty);
+
+			BytecodeExprRef FnArg(int index);
+			BytecodeExprRef FnArg(int index, BytecodeType ty) { return FnArg(index); }
+			int NumFnArgs() { return fn.d->GetNumParams(); }
+
+			BytecodeType FnArgTy(BytecodeFunctionTypeRef const& fty, int index) { return fty.argumentType[index]; }
+			int NumFnArgs(BytecodeFunctionTypeRef const& fty) { return (int)fty.argumentType.size(); }
+
+			BytecodeExprRef GetSlot(int index);
+			void SetSlot(int index, BytecodeExprRef val);
+
+			BytecodeExprRef PtrToInt(BytecodeExprRef ptr);
+			BytecodeExprRef IntToPtr(BytecodeExprRef i);
+			BytecodeExprRef Offset(BytecodeExprRef ptr, BytecodeExprRef byteOffset);
+			BytecodeExprRef Call(const BytecodeFunction& fn, const std::vector<BytecodeExprRef>& params, bool internalCconv);
+			BytecodeExprRef PureCall(const BytecodeFunction& fn, const std::vector<BytecodeExprRef>& params, bool internalCconv);
+			void TCO(BytecodeExprRef cond, const std::vector<BytecodeValue>& params);
+
+			template <typename TTrue, typename TFalse> void If(BytecodeExprRef pred, TTrue t, TFalse f) {
+				BytecodeBlock trueBlk, falseBlk;
+				BytecodeEmitter trueB{ fn, trueBlk }, falseB{ fn, falseBlk };
+				t(trueB);
+				f(falseB);
+				auto cond = Reg(Truth(pred));
+				bool hasElse = falseBlk.Size() > 0;
+				b->Emit(BytecodeOp::JumpIfZero, cond, 1 + trueBlk.Size() + (hasElse ? 1 : 0));
+				b->Append(trueBlk);
+				if (hasElse) {
+					b->Emit(BytecodeOp::Jump, 1 + falseBlk.Size());
+					b->Append(falseBlk);
+				}
+			}
+
+			template <typename TTrue> void If(BytecodeExprRef pred, TTrue t) {
+				If(pred, t, [](auto&) {});
+			}
+
+			BytecodeBlock* CurrentBlock() {
+				return b;
+			}
+
+			template <typename TBody> void Loop(TBody tb) {
+				BytecodeBlock body;
+				BytecodeEmitter bodyB{ fn, body };
+				std::string breakLabel{ "break" };
+				tb(breakLabel, bodyB);
+				b->Append(body);
+				b->Emit(BytecodeOp::Jump, -body.Size());
+			}
+
+			template <typename TBody> void Loop(BytecodeExprRef loopCount, TBody tb) {
+				auto count = Reg(TmpVar(Adapt(loopCount, BytecodeType::Int32)));
+				auto counter = LVar("i", BytecodeType::Int32);
+				Set(counter, Const(0));
+				BytecodeBlock body;
+				BytecodeEmitter bodyB{ fn, body };
+				std::string breakLabel{ "break" };
+				tb(breakLabel, bodyB, Get(counter));
+				auto i = fn.d->lvars[counter].reg;
+				b->Emit(BytecodeOp::JumpIfGeS, i, count, body.Size() + 3);
+				b->Append(body);
+				b->Emit(BytecodeOp::AddInt32, i, i, Reg(Const(1)));
+				b->Emit(BytecodeOp::Jump, -(body.Size() + 2));
+			}
+
+			BytecodeExprRef GVar(const std::string& name, BytecodeType ty);
+			void SetGVar(const std::string& name, BytecodeExprRef value, bool soleAssignment = false);
+			BytecodeExprRef Alloca(BytecodeExprRef sz, int align);
+
+			BytecodeExprRef GlobalExternal(BytecodeType ty, const std::string& importModule, const std::string& sym);
+			BytecodeExprRef CallExternal(BytecodeType returnType, const std::string& sym, const std::vector<BytecodeExprRef>&);
+			void MemCpy(BytecodeExprRef dst, BytecodeExprRef src, BytecodeExprRef sz, int align);
+			void MemSet(BytecodeExprRef dst, BytecodeExprRef word, BytecodeExprRef sz);
+
+			int LVar(const std::string& name, BytecodeType ty) { return fn.LVar(name, ty); }
+			int LVar(BytecodeExprRef expr) { return fn.LVar(expr); }
+
+			BytecodeValue TmpVar(BytecodeExprRef val) {
+				return { fn, *b, val };
+			}
+
+			void Set(int i, BytecodeExprRef val);
+
+			BytecodeExprRef Get(int i, BytecodeType) {
+				return Get(i);
+			}
+
+			BytecodeExprRef Get(int i) {
+				return BytecodeValue::Local(fn, i);
+			}
+
+			BytecodeExprRef False() { return Const(0); }
+
+			void Switch(BytecodeExprRef c, const std::vector<BytecodeBlock>& blocks);
+
+			BytecodeExprRef GetSignalMaskWord(int bitIdx, int& outSubIdx);
+			void StoreSignalMaskWord(int bitIdx, BytecodeExprRef word);
+
+			BytecodeType TypeOf(BytecodeExprRef expr) {
+				return expr->type;
+			}
+
+			BytecodeFunctionTypeRef TypeOf(BytecodeFunction fn) {
+				return fn.d->ty;
+			}
+
+			BytecodeExprRef BitCast(BytecodeType to, BytecodeExprRef value);
+			BytecodeExprRef BitCastInt(BytecodeExprRef value);
+
+			BytecodeExprRef Coerce(BytecodeType to, BytecodeExprRef from);
+			BytecodeExprRef LogicResult(BytecodeExprRef truthValue, BytecodeType resultType);
+
+			BytecodeExprRef SizeOfPointer() {
+				return Const64((std::int64_t)sizeof(void*));
+			}
+
+			BytecodeExprRef Load(BytecodeExprRef pointer, BytecodeType, int align = 0);
+			void Store(BytecodeExprRef pointer, BytecodeExprRef value, int align = 0);
+
+			BytecodeExprRef BinaryOp(Nodes::Native::Opcode, BytecodeExprRef lhs, BytecodeExprRef rhs);
+			BytecodeExprRef UnaryOp(Nodes::Native::Opcode, BytecodeExprRef up);
+		};
+	}
+}
+
+namespace std {
+	template <> struct hash<K3::Backends::BytecodeFunctionTypeRef> {
+		size_t operator()(const K3::Backends::BytecodeFunctionTypeRef& r) const;
+	};
+}
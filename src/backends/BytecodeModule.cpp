@@ -0,0 +1,367 @@
+#include "BytecodeModule.h"
+#include "Bytecode.h"
+#include "Native.h"
+#include "SideEffectCompiler.h"
+#include "TLS.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <utility>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <xmmintrin.h>
+#define HAS_MXCSR 1
+#endif
+
+namespace K3 {
+	namespace Backends {
+		krt_class* BytecodeJiT(
+			const char* engine,
+			const Kronos::ITypedGraph* itg,
+			Kronos::BuildFlags flags) {
+
+			Bytecode compiler(new BytecodeUnit, itg->Get(), *itg->_InternalTypeOfArgument(), *itg->_InternalTypeOfResult());
+			return compiler.JIT(flags);
+		}
+
+		namespace {
+			// krt_class entry points carry no class pointer, so each interpreted class
+			// binds one of a fixed set of native entry points
+			static const int MaxClasses = 128;
+			static const int MaxDrivers = 8;
+
+			struct BytecodeProgram {
+				std::unique_ptr<BytecodeUnit> unit;
+				std::shared_ptr<BytecodeFnData> init, size, eval;
+				std::vector<std::shared_ptr<BytecodeFnData>> drivers;
+				std::int32_t sizeOfState = -1;
+				std::int64_t bitmaskSize = 0;
+				std::int64_t numSymbols = 0;
+				int numInit = 0;
+				int argumentIndex = -1;
+				size_t resultSize = 0;
+				bool flushDenormals = false;
+				// configuration slots with room for the signal mask below them; also
+				// stands in for the instance symbol table during the sizing pass
+				std::vector<void*> configuration;
+				size_t configurationBase = 0;
+				std::deque<std::string> strings;
+				std::vector<char> classData;
+				int binding = -1;
+
+				std::int64_t SymbolOffset(std::int64_t index) const {
+					auto& g = unit->globals[sizeOfState];
+					std::int64_t sz = unit->globalType[sizeOfState] == BytecodeType::Int32 ? g.i32 : g.i64;
+					return ((sz + bitmaskSize + 31) & ~(std::int64_t)31) + index * (std::int64_t)sizeof(void*);
+				}
+
+				void** Self(krt_instance inst) const {
+					return (void**)((char*)inst + SymbolOffset(0));
+				}
+
+				void** Configuration() {
+					return configuration.data() + configurationBase;
+				}
+
+				const char* String(const std::string& str) {
+					strings.emplace_back(str);
+					return strings.back().c_str();
+				}
+			};
+
+			static std::mutex bindingLock;
+			static BytecodeProgram* bound[MaxClasses] = {};
+
+			static const std::int32_t argRegs[] = { 0, 1, 2 };
+
+			// flush-to-zero for driver calls, as in the LLVM backend; only the
+			// FTZ and DAZ bits are restored on exit
+			struct DenormalScope {
+#if HAS_MXCSR
+				unsigned saved;
+				bool active;
+				DenormalScope(bool flush) :active(flush) {
+					if (active) {
+						saved = _mm_getcsr();
+						_mm_setcsr(saved | 0x8040);
+					}
+				}
+				~DenormalScope() {
+					if (active) _mm_setcsr((_mm_getcsr() & ~0x8040u) | (saved & 0x8040u));
+				}
+#else
+				DenormalScope(bool) {}
+#endif
+			};
+
+			template <int I> struct Entry {
+				static BytecodeProgram& P() {
+					return *bound[I];
+				}
+
+				static void Configure(std::int32_t slot, const void* data) {
+					auto& p = P();
+					if (slot >= 0 && slot < p.numSymbols) p.Configuration()[slot] = (void*)data;
+				}
+
+				static std::int64_t GetSize() {
+					auto& p = P();
+					BytecodeReg args[3];
+					for (auto& a : args) a.ptr = nullptr;
+					Interpret(*p.size, p.Configuration(), args, argRegs);
+					return p.SymbolOffset(p.numSymbols);
+				}
+
+				static void Construct(krt_instance inst, const void* input) {
+					auto& p = P();
+					auto self = p.Self(inst);
+					for (int i = 0; i < p.numInit; ++i) if (!self[i]) self[i] = p.Configuration()[i];
+					if (p.argumentIndex >= 0) self[p.argumentIndex] = (void*)input;
+					std::vector<std::uint64_t> output((std::max<size_t>(p.resultSize, 1) + 7) / 8);
+					BytecodeReg args[3];
+					args[0].ptr = (char*)inst;
+					args[1].ptr = (char*)input;
+					args[2].ptr = (char*)output.data();
+					Interpret(*p.init, self, args, argRegs);
+				}
+
+				static void** Var(krt_instance inst, std::int32_t slot) {
+					return (void**)((char*)inst + P().SymbolOffset(slot));
+				}
+
+				static void Eval(krt_instance inst, const void* input, void* output) {
+					auto& p = P();
+					BytecodeReg args[3];
+					args[0].ptr = (char*)inst;
+					args[1].ptr = (char*)input;
+					args[2].ptr = (char*)output;
+					Interpret(*p.eval, p.Self(inst), args, argRegs);
+				}
+
+				static void Destruct(krt_instance) { }
+
+				template <int J> static void Process(krt_instance inst, void* output, std::int32_t numFrames) {
+					auto& p = P();
+					DenormalScope flush{ p.flushDenormals };
+					BytecodeReg args[3];
+					args[0].ptr = (char*)inst;
+					args[1].ptr = (char*)output;
+					args[2].i64 = 0;
+					args[2].i32 = numFrames;
+					Interpret(*p.drivers[J], p.Self(inst), args, argRegs);
+				}
+			};
+
+			struct EntryPoints {
+				krt_configure_call configure;
+				krt_get_size_call get_size;
+				krt_constructor_call construct;
+				krt_get_slot_call var;
+				krt_evaluate_call eval;
+				krt_destructor_call destruct;
+				krt_process_call process[MaxDrivers];
+			};
+
+			template <int I, size_t... J> static EntryPoints MakeEntryPoints(std::index_sequence<J...>) {
+				return {
+					&Entry<I>::Configure, &Entry<I>::GetSize, &Entry<I>::Construct,
+					&Entry<I>::Var, &Entry<I>::Eval, &Entry<I>::Destruct,
+					{ &Entry<I>::template Process<(int)J>... }
+				};
+			}
+
+			template <size_t... I> static std::array<EntryPoints, MaxClasses> MakeEntryTable(std::index_sequence<I...>) {
+				return { { MakeEntryPoints<(int)I>(std::make_index_sequence<MaxDrivers>())... } };
+			}
+
+			static const std::array<EntryPoints, MaxClasses> entryPoints = MakeEntryTable(std::make_index_sequence<MaxClasses>());
+
+			static void DisposeProgram(krt_class* cls) {
+				auto p = (BytecodeProgram*)cls->pimpl;
+				{
+					std::lock_guard<std::mutex> lock{ bindingLock };
+					bound[p->binding] = nullptr;
+				}
+				delete p;
+			}
+		}
+
+		krt_class* BytecodeSpec::JIT(Kronos::BuildFlags flags) {
+			RegionAllocator alloc;
+			StandardBuild(AST, GetArgumentType(), GetResultType());
+
+			intermediateAST = Graph<Typed>(Backends::SideEffectTransform::Compile(
+				*this, intermediateAST, GetArgumentType(), GetResultType()));
+
+			Backends::AnalyzeCallGraph(0, intermediateAST, cgmap);
+
+			std::unique_ptr<BytecodeProgram> program{ new BytecodeProgram };
+
+			DriverSet initDrv;
+			initDrv.insert(DriverSignature(Type(&Reactive::InitializationDriver)));
+			auto initProc = CompilePass("Init", BuilderPass::Initialization, initDrv);
+			auto sizeProc = CompilePass("SizeOf", BuilderPass::Sizing, initDrv);
+			initProc.Complete();
+			sizeProc.Complete();
+			program->init = initProc.d;
+			program->size = sizeProc.d;
+
+			if ((flags & Kronos::OmitEvaluate) == 0) {
+				DriverSet evalDrv;
+				evalDrv.insert(DriverSignature(Type(&Reactive::ArgumentDriver)));
+				for (auto d : drivers) evalDrv.insert(d);
+				auto evalProc = CompilePass("Eval", BuilderPass::Evaluation, evalDrv);
+				evalProc.Complete();
+				program->eval = evalProc.d;
+			}
+
+			std::unordered_map<Type, int> inputCall;
+			if ((flags & Kronos::OmitReactiveDrivers) == 0) {
+				std::unordered_set<Type> DriverSignatures;
+				for (auto driver : drivers) {
+					DriverSignature sig(driver);
+					if (sig.GetMetadata().IsNil() == false) {
+						DriverSignatures.insert(sig.GetMetadata());
+					}
+				}
+
+				if (DriverSignatures.size() > MaxDrivers) {
+					INTERNAL_ERROR("The bytecode interpreter supports up to " + std::to_string(MaxDrivers) + " drivers per class");
+				}
+
+				for (auto driver : DriverSignatures) {
+					std::stringstream name;
+					name << driver;
+					std::string dn(name.str());
+
+					if (dn.size()) dn[0] = toupper(dn[0]);
+
+					for (unsigned i(1); i < dn.size(); ++i) {
+						if (!isalpha(dn[i - 1]) && isalpha(dn[i]))
+							dn[i] = toupper(dn[i]);
+					}
+
+					dn.erase(std::remove_if(dn.begin(), dn.end(), [](char c) {return !isalnum(c); }), dn.end());
+
+					FunctionTy callable{ GetActivation("Tick" + dn, intermediateAST, driver) };
+					inputCall.emplace(driver, (int)program->drivers.size());
+					program->drivers.emplace_back(callable.d);
+				}
+			}
+
+			size_t asz = GetArgumentType().GetSize(), rsz = GetResultType().GetSize();
+
+			// symbol table, as in the LLVM backend
+			auto methods = globalKeyTable;
+			for (auto& ic : inputCall) {
+				if (methods.find(ic.first) == methods.end()) {
+					methods.emplace(ic.first, GlobalVarData{
+						nullptr,
+						K3::Type::Nil,
+						Nodes::GlobalVarType::External,
+						std::make_pair(1, 1),
+						K3::Type::Nil
+					});
+				}
+			}
+
+			methods.erase(Type::Pair(Type("unsafe"), Type("accumulator")));
+			int maxNoDefaultSlot = -1;
+			std::vector<krt_sym> symbols;
+			std::vector<int> symbolDriver;
+			for (auto& gv : methods) {
+				std::stringstream sym;
+				sym << gv.first;
+				if (sym.str() == "arg") continue;
+
+				auto trigger = inputCall.find(gv.first);
+				std::stringstream descr;
+				gv.second.data.OutputJSONTemplate(descr, false);
+
+				auto slotI = globalSymbolTable.find(gv.second.uid);
+				auto slotIndex = slotI != globalSymbolTable.end() ? std::int32_t(slotI->second) : -1;
+
+				bool constructorParameter =
+					((gv.second.varType == Nodes::GlobalVarType::External ||
+					  gv.second.varType == Nodes::GlobalVarType::Configuration)
+					 && globalKeyTable.find(gv.first) != globalKeyTable.end());
+
+				bool noDefaultVal = constructorParameter || gv.second.varType == Nodes::GlobalVarType::UnsafeExternal;
+
+				krt_sym entry;
+				entry.sym = program->String(sym.str());
+				entry.type_descriptor = program->String(descr.str());
+				entry.process = nullptr;
+				entry.size = (std::int64_t)gv.second.data.GetSize();
+				entry.slot_index = slotIndex;
+				entry.flags = (noDefaultVal ? KRT_FLAG_NO_DEFAULT : 0) |
+					(gv.second.varType == Nodes::GlobalVarType::Stream ? KRT_FLAG_BLOCK_INPUT : 0);
+				symbols.emplace_back(entry);
+				symbolDriver.emplace_back(trigger != inputCall.end() ? trigger->second : -1);
+
+				if (noDefaultVal && slotIndex > maxNoDefaultSlot) {
+					maxNoDefaultSlot = slotIndex;
+				}
+			}
+
+			program->sizeOfState = M->Global("sizeof_" + std::to_string((std::uintptr_t)(CTRef)intermediateAST), Int64Ty());
+			program->bitmaskSize = GetBitmaskSize();
+			program->numSymbols = GetNumSymbols();
+			program->numInit = maxNoDefaultSlot + 1;
+			program->argumentIndex = asz ? GetArgumentIndex() : -1;
+			program->resultSize = rsz;
+			program->flushDenormals = (flags & Kronos::FlushDenormals) != 0;
+			program->configurationBase = (size_t)(program->bitmaskSize + sizeof(void*) - 1) / sizeof(void*) + 1;
+			program->configuration.resize(program->configurationBase + program->numSymbols + 1);
+
+			std::stringstream evalArg, resultTy;
+			GetArgumentType().OutputJSONTemplate(evalArg, false);
+			GetResultType().OutputJSONTemplate(resultTy, false);
+
+			{
+				std::lock_guard<std::mutex> lock{ bindingLock };
+				for (int i = 0; i < MaxClasses; ++i) {
+					if (!bound[i]) {
+						program->binding = i;
+						break;
+					}
+				}
+				if (program->binding < 0) {
+					INTERNAL_ERROR("Too many live bytecode classes");
+				}
+				bound[program->binding] = program.get();
+			}
+
+			auto& entry = entryPoints[program->binding];
+			program->classData.resize(sizeof(krt_class) + sizeof(krt_sym) * symbols.size());
+			auto cls = (krt_class*)program->classData.data();
+			cls->configure = entry.configure;
+			cls->get_size = entry.get_size;
+			cls->construct = entry.construct;
+			cls->var = entry.var;
+			cls->eval = program->eval ? entry.eval : nullptr;
+			cls->destruct = entry.destruct;
+			cls->dispose_class = DisposeProgram;
+			cls->eval_arg_type_descriptor = program->String(evalArg.str());
+			cls->result_type_descriptor = program->String(resultTy.str());
+			cls->eval_arg_size = (std::int64_t)asz;
+			cls->result_type_size = (std::int64_t)rsz;
+			cls->state_layout = GetStateLayout();
+			cls->num_symbols = (std::int32_t)symbols.size();
+			for (size_t i = 0; i < symbols.size(); ++i) {
+				if (symbolDriver[i] >= 0) symbols[i].process = entry.process[symbolDriver[i]];
+				memcpy(&cls->symbols[i], &symbols[i], sizeof(krt_sym));
+			}
+
+			program->unit.reset(M);
+			M = nullptr;
+			cls->pimpl = program.release();
+			return cls;
+		}
+	}
+}
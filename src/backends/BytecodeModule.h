@@ -0,0 +1,22 @@
+#pragma once
+#include "kronosrt.h"
+#include "GenericModule.h"
+#include "Reactive.h"
+#include "BytecodeCompiler.h"
+
+namespace K3 {
+	namespace Backends {
+		using K3::Reactive::DriverSet;
+
+		// the unit is handed over to the class built by JIT
+		struct BytecodeSpec : public GenericEmitterSpec<BytecodeTypes, BytecodeTransform> {
+			BytecodeSpec(BytecodeUnitRef M, CTRef AST, const Type& arg, const Type& res) :GenericEmitterSpec(M, AST, arg, res) {}
+
+			void AoT(const char *prefix, const char *fileType, std::ostream& writeToStream, Kronos::BuildFlags flags, const char* triple, const char *mcpu, const char *march, const char *mfeat) override { KRONOS_UNREACHABLE; }
+
+			krt_class* JIT(Kronos::BuildFlags flags) override;
+		};
+
+		using Bytecode = GenericCodeGen<BytecodeSpec>;
+	}
+}
@@ -0,0 +1,320 @@
+#include "BytecodeEmitter.h"
+#include "Errors.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include "config/system.h"
+#ifdef HAVE_ALLOCA_H
+#include <alloca.h>
+#elif defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+// native calls with floating point arguments need a calling convention that
+// assigns integer and floating point registers independently
+#if (defined(__x86_64__) && !defined(_WIN32)) || defined(__aarch64__)
+#define BYTECODE_MIXED_FOREIGN_CALLS 1
+#endif
+
+namespace K3 {
+	namespace Backends {
+		static const int MaxForeignArgs = 8;
+
+		template <typename T> struct IntOps {
+			using U = typename std::make_unsigned<T>::type;
+			static const int Bits = sizeof(T) * 8;
+			static T Add(T a, T b) { return (T)((U)a + (U)b); }
+			static T Sub(T a, T b) { return (T)((U)a - (U)b); }
+			static T Mul(T a, T b) { return (T)((U)a * (U)b); }
+			// division by zero and overflow produce zero instead of a trap
+			static T DivS(T a, T b) { return b == 0 || (b == -1 && a == std::numeric_limits<T>::min()) ? (T)(b ? Sub(0, a) : 0) : a / b; }
+			static T RemS(T a, T b) { return b == 0 || b == -1 ? 0 : a % b; }
+			static T RemU(T a, T b) { return b == 0 ? 0 : (T)((U)a % (U)b); }
+			static T And(T a, T b) { return a & b; }
+			static T Or(T a, T b) { return a | b; }
+			static T Xor(T a, T b) { return a ^ b; }
+			static T Shl(T a, T b) { return (T)((U)a << (b & (Bits - 1))); }
+			static T ShrS(T a, T b) { return a >> (b & (Bits - 1)); }
+			static T ShrU(T a, T b) { return (T)((U)a >> (b & (Bits - 1))); }
+			static T Mod(T a, T b) {
+				U ub = (U)b;
+				if (ub == 0) return 0;
+				return (T)(((U)a + ub * (((U)1 << (Bits - 1)) / ub)) % ub);
+			}
+			static std::int32_t Eq(T a, T b) { return a == b; }
+			static std::int32_t Ne(T a, T b) { return a != b; }
+			static std::int32_t LtS(T a, T b) { return a < b; }
+			static std::int32_t LeS(T a, T b) { return a <= b; }
+			static std::int32_t GtS(T a, T b) { return a > b; }
+			static std::int32_t GeS(T a, T b) { return a >= b; }
+			static std::int32_t GtU(T a, T b) { return (U)a > (U)b; }
+		};
+
+		template <typename T> struct FloatOps {
+			static T Add(T a, T b) { return a + b; }
+			static T Sub(T a, T b) { return a - b; }
+			static T Mul(T a, T b) { return a * b; }
+			static T Div(T a, T b) { return a / b; }
+			static T Pow(T a, T b) { return std::pow(a, b); }
+			static T Atan2(T a, T b) { return std::atan2(a, b); }
+			static std::int32_t Eq(T a, T b) { return a == b; }
+			static std::int32_t Ne(T a, T b) { return a != b; }
+			static std::int32_t Lt(T a, T b) { return a < b; }
+			static std::int32_t Le(T a, T b) { return a <= b; }
+			static std::int32_t Gt(T a, T b) { return a > b; }
+			static std::int32_t Ge(T a, T b) { return a >= b; }
+			static T Neg(T a) { return -a; }
+			static T Abs(T a) { return std::fabs(a); }
+			static T Trunc(T a) { return std::trunc(a); }
+			static T Round(T a) { return std::nearbyint(a); }
+			static T Ceil(T a) { return std::ceil(a); }
+			static T Floor(T a) { return std::floor(a); }
+			static T Sqrt(T a) { return std::sqrt(a); }
+			static T Cos(T a) { return std::cos(a); }
+			static T Sin(T a) { return std::sin(a); }
+			static T Exp(T a) { return std::exp(a); }
+			static T Log(T a) { return std::log(a); }
+			static T Log10(T a) { return std::log10(a); }
+			static T Log2(T a) { return std::log2(a); }
+		};
+
+		void* BytecodeForeignSymbol(const std::string& sym) {
+#ifdef _WIN32
+			return (void*)GetProcAddress(GetModuleHandleA(nullptr), sym.c_str());
+#else
+			return dlsym(RTLD_DEFAULT, sym.c_str());
+#endif
+		}
+
+		static bool IsFloat(BytecodeType ty) {
+			return ty == BytecodeType::Float32 || ty == BytecodeType::Float64;
+		}
+
+		bool BytecodeForeignCallable(BytecodeType result, const std::vector<BytecodeType>& argumentType) {
+			int ints = 0, floats = 0;
+			for (auto t : argumentType) {
+				if (IsFloat(t)) ++floats;
+				else ++ints;
+			}
+			if (ints > MaxForeignArgs || floats > MaxForeignArgs) return false;
+#ifdef BYTECODE_MIXED_FOREIGN_CALLS
+			return true;
+#else
+			return floats == 0 && !IsFloat(result);
+#endif
+		}
+
+		// calls through a prototype with more parameters than the callee declares; the
+		// surplus registers are ignored by the callee
+		static BytecodeReg CallForeign(const BytecodeForeignSite& site, const BytecodeReg* R) {
+			using I = std::int64_t;
+			I ia[MaxForeignArgs] = {};
+			int ni = 0;
+			BytecodeReg result;
+			result.i64 = 0;
+
+#ifdef BYTECODE_MIXED_FOREIGN_CALLS
+			double fa[MaxForeignArgs] = {};
+			int nf = 0;
+#endif
+			for (size_t i = 0; i < site.args.size(); ++i) {
+				auto& r = R[site.args[i]];
+				switch (site.argumentType[i]) {
+				case BytecodeType::Int32: ia[ni++] = r.i32; break;
+				case BytecodeType::Int64: ia[ni++] = r.i64; break;
+				case BytecodeType::Ptr: ia[ni++] = (I)(std::intptr_t)r.ptr; break;
+#ifdef BYTECODE_MIXED_FOREIGN_CALLS
+				// single precision travels in the low half of the register
+				case BytecodeType::Float32: memcpy(fa + nf++, &r.f32, sizeof(float)); break;
+				case BytecodeType::Float64: fa[nf++] = r.f64; break;
+#endif
+				default: KRONOS_UNREACHABLE;
+				}
+			}
+
+#ifdef BYTECODE_MIXED_FOREIGN_CALLS
+			if (nf || IsFloat(site.result)) {
+				using D = double;
+				if (IsFloat(site.result)) {
+					auto f = (D(*)(I, I, I, I, I, I, I, I, D, D, D, D, D, D, D, D))site.address;
+					auto r = f(ia[0], ia[1], ia[2], ia[3], ia[4], ia[5], ia[6], ia[7],
+							   fa[0], fa[1], fa[2], fa[3], fa[4], fa[5], fa[6], fa[7]);
+					memcpy(&result, &r, sizeof(double));
+				} else {
+					auto f = (I(*)(I, I, I, I, I, I, I, I, D, D, D, D, D, D, D, D))site.address;
+					result.i64 = f(ia[0], ia[1], ia[2], ia[3], ia[4], ia[5], ia[6], ia[7],
+								   fa[0], fa[1], fa[2], fa[3], fa[4], fa[5], fa[6], fa[7]);
+				}
+			} else
+#endif
+			{
+				auto f = (I(*)(I, I, I, I, I, I, I, I))site.address;
+				result.i64 = f(ia[0], ia[1], ia[2], ia[3], ia[4], ia[5], ia[6], ia[7]);
+			}
+
+			switch (site.result) {
+			case BytecodeType::Int32: result.i64 = result.i32; break;
+			case BytecodeType::Ptr: result.ptr = (char*)(std::intptr_t)result.i64; break;
+			default: break;
+			}
+			return result;
+		}
+
+		BytecodeReg Interpret(const BytecodeFnData& fn, void** self, const BytecodeReg* args, const std::int32_t* argRegs) {
+			using O = BytecodeOp;
+			const auto numRegs = fn.registers.size();
+			auto R = (BytecodeReg*)alloca(sizeof(BytecodeReg) * (numRegs ? numRegs : 1));
+			memcpy(R, fn.registers.data(), sizeof(BytecodeReg) * numRegs);
+			for (int i = 0; i < fn.GetNumParams(); ++i) {
+				R[i] = args[argRegs[i]];
+			}
+
+			char* frame = nullptr;
+			if (fn.frameSize) {
+				auto mem = (char*)alloca((size_t)fn.frameSize + 63);
+				frame = (char*)(((std::uintptr_t)mem + 63) & ~(std::uintptr_t)63);
+			}
+
+			auto mask = (std::int32_t*)self;
+			auto& globals = fn.unit->globals;
+			const BytecodeInstr* const code = fn.body.code.data();
+			const BytecodeInstr* ip = code;
+
+			for (;;) {
+				const BytecodeInstr& in = *ip;
+				switch (in.op) {
+#define INT_OP(OP) \
+				case O::OP ## Int32: R[in.a].i32 = IntOps<std::int32_t>::OP(R[in.b].i32, R[in.c].i32); break; \
+				case O::OP ## Int64: R[in.a].i64 = IntOps<std::int64_t>::OP(R[in.b].i64, R[in.c].i64); break;
+#define INT_CMP(OP) \
+				case O::OP ## Int32: R[in.a].i32 = IntOps<std::int32_t>::OP(R[in.b].i32, R[in.c].i32); break; \
+				case O::OP ## Int64: R[in.a].i32 = IntOps<std::int64_t>::OP(R[in.b].i64, R[in.c].i64); break;
+#define FLOAT_OP(OP) \
+				case O::OP ## Float32: R[in.a].f32 = FloatOps<float>::OP(R[in.b].f32, R[in.c].f32); break; \
+				case O::OP ## Float64: R[in.a].f64 = FloatOps<double>::OP(R[in.b].f64, R[in.c].f64); break;
+#define FLOAT_CMP(OP) \
+				case O::OP ## Float32: R[in.a].i32 = FloatOps<float>::OP(R[in.b].f32, R[in.c].f32); break; \
+				case O::OP ## Float64: R[in.a].i32 = FloatOps<double>::OP(R[in.b].f64, R[in.c].f64); break;
+#define FLOAT_UNARY(OP) \
+				case O::OP ## Float32: R[in.a].f32 = FloatOps<float>::OP(R[in.b].f32); break; \
+				case O::OP ## Float64: R[in.a].f64 = FloatOps<double>::OP(R[in.b].f64); break;
+				BYTECODE_INT_BINARY(INT_OP)
+				BYTECODE_INT_COMPARE(INT_CMP)
+				BYTECODE_FLOAT_BINARY(FLOAT_OP)
+				BYTECODE_FLOAT_COMPARE(FLOAT_CMP)
+				BYTECODE_FLOAT_UNARY(FLOAT_UNARY)
+#undef INT_OP
+#undef INT_CMP
+#undef FLOAT_OP
+#undef FLOAT_CMP
+#undef FLOAT_UNARY
+
+#define MEM(T, M) \
+				case O::Load ## T: memcpy(&R[in.a].M, R[in.b].ptr, sizeof(R[in.a].M)); break; \
+				case O::Store ## T: memcpy(R[in.a].ptr, &R[in.b].M, sizeof(R[in.b].M)); break;
+				BYTECODE_MEMORY(MEM)
+#undef MEM
+
+				case O::Int32ToInt64: R[in.a].i64 = R[in.b].i32; break;
+				case O::Int32ToFloat32: R[in.a].f32 = (float)R[in.b].i32; break;
+				case O::Int32ToFloat64: R[in.a].f64 = R[in.b].i32; break;
+				case O::Int32ToPtr: R[in.a].ptr = (char*)(std::intptr_t)R[in.b].i32; break;
+				case O::Int64ToInt32: R[in.a].i64 = (std::int32_t)R[in.b].i64; break;
+				case O::Int64ToFloat32: R[in.a].f32 = (float)R[in.b].i64; break;
+				case O::Int64ToFloat64: R[in.a].f64 = (double)R[in.b].i64; break;
+				case O::Int64ToPtr: R[in.a].ptr = (char*)(std::intptr_t)R[in.b].i64; break;
+				case O::Float32ToInt32: R[in.a].i64 = (std::int32_t)R[in.b].f32; break;
+				case O::Float32ToInt64: R[in.a].i64 = (std::int64_t)R[in.b].f32; break;
+				case O::Float32ToFloat64: R[in.a].f64 = R[in.b].f32; break;
+				case O::Float64ToInt32: R[in.a].i64 = (std::int32_t)R[in.b].f64; break;
+				case O::Float64ToInt64: R[in.a].i64 = (std::int64_t)R[in.b].f64; break;
+				case O::Float64ToFloat32: R[in.a].f32 = (float)R[in.b].f64; break;
+				case O::PtrToInt32: R[in.a].i64 = (std::int32_t)(std::intptr_t)R[in.b].ptr; break;
+				case O::PtrToInt64: R[in.a].i64 = (std::int64_t)(std::intptr_t)R[in.b].ptr; break;
+
+				case O::Mov: R[in.a] = R[in.b]; break;
+				case O::Select: R[in.a] = R[in.b].i32 ? R[in.c] : R[in.d]; break;
+				case O::OffsetInt32: R[in.a].ptr = R[in.b].ptr + R[in.c].i32; break;
+				case O::OffsetInt64: R[in.a].ptr = R[in.b].ptr + R[in.c].i64; break;
+
+				case O::GetSlot: R[in.a].ptr = (char*)self[in.b]; break;
+				case O::SetSlot: self[in.a] = R[in.b].ptr; break;
+				case O::GetMask: R[in.a].i64 = mask[in.b]; break;
+				case O::SetMask: mask[in.a] = R[in.b].i32; break;
+				case O::GetGlobal: R[in.a] = globals[in.b]; break;
+				case O::SetGlobal: globals[in.a] = R[in.b]; break;
+
+				case O::FrameAddr: R[in.a].ptr = frame + in.b; break;
+				case O::Alloca: {
+					std::uintptr_t align = in.c;
+					auto mem = (std::uintptr_t)alloca((size_t)R[in.b].i64 + align - 1);
+					R[in.a].ptr = (char*)((mem + align - 1) & ~(align - 1));
+					break;
+				}
+				case O::MemCpy: memcpy(R[in.a].ptr, R[in.b].ptr, (size_t)R[in.c].i64); break;
+				case O::MemSet: {
+					auto dst = R[in.a].ptr;
+					auto word = R[in.b].i32;
+					auto sz = R[in.c].i64;
+					if (word == 0) {
+						if (sz > 0) memset(dst, 0, (size_t)sz);
+					} else {
+						for (std::int64_t i = 0; i + 4 <= sz; i += 4) memcpy(dst + i, &word, 4);
+					}
+					break;
+				}
+
+				case O::Jump: ip += in.a; continue;
+				case O::JumpIfZero:
+					if (R[in.a].i32 == 0) {
+						ip += in.b;
+						continue;
+					}
+					break;
+				case O::JumpIfGeS:
+					if (R[in.a].i32 >= R[in.b].i32) {
+						ip += in.c;
+						continue;
+					}
+					break;
+				case O::Switch: {
+					auto& table = fn.switches[in.b];
+					auto which = (std::uint32_t)R[in.a].i32;
+					ip += which < table.size() - 1 ? table[which] : table.back();
+					continue;
+				}
+
+				case O::Call: {
+					auto& site = fn.calls[in.b];
+					auto r = Interpret(*site.callee, self, R, site.args.data());
+					if (in.a >= 0) R[in.a] = r;
+					break;
+				}
+				case O::CallExternal: {
+					auto r = CallForeign(fn.foreign[in.b], R);
+					if (in.a >= 0) R[in.a] = r;
+					break;
+				}
+				case O::Ret: return R[in.a];
+				case O::RetVoid: {
+					BytecodeReg none;
+					none.i64 = 0;
+					return none;
+				}
+				case O::Restart: ip = code; continue;
+				}
+				++ip;
+			}
+		}
+	}
+}
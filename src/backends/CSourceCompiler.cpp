@@ -0,0 +1,56 @@
+#include "CSourceCompiler.h"
+
+#define CODEGEN_BACKEND_EMIT CSOURCE_EMIT
+#include "GenericEmit.h"
+
+#include <cstring>
+
+namespace K3 {
+	namespace Backends {
+		static std::string ByteArray(const std::uint8_t* data, size_t numBytes) {
+			std::stringstream ss;
+			ss << "{";
+			for (size_t i = 0; i < numBytes; ++i) {
+				if (i % 16 == 0) ss << "\n\t";
+				ss << (int)data[i] << ",";
+			}
+			ss << "\n}";
+			return ss.str();
+		}
+
+		template <> CSourceExprRef CSourceModule::InternZeroBytes(const void* uid, size_t numBytes) {
+			auto f = M->zeroData.find(uid);
+			if (f == M->zeroData.end()) {
+				auto name = M->Symbol("zero" + std::to_string(M->nextId++));
+				M->Declare(name, "static KRT_ALIGN(16) char " + name + "[" + std::to_string(numBytes ? numBytes : 1) + "];");
+				f = M->zeroData.emplace(uid, name).first;
+			}
+			return M->New(f->second, CSourceType::Ptr, true);
+		}
+
+		template <> CSourceExprRef CSourceModule::InternConstantBlob(const void* data, size_t numBytes) {
+			std::string blob((const char*)data, numBytes);
+			auto f = M->constantData.find(blob);
+			if (f == M->constantData.end()) {
+				auto name = M->Symbol("data" + std::to_string(M->nextId++));
+				M->Declare(name, "static KRT_ALIGN(16) const unsigned char " + name + "[" + std::to_string(numBytes ? numBytes : 1) + "] = " +
+						   ByteArray((const std::uint8_t*)data, numBytes) + ";");
+				f = M->constantData.emplace(blob, name).first;
+			}
+			return M->New("((char*)" + f->second + ")", CSourceType::Ptr, true);
+		}
+
+		template <> CSourceExprRef CSourceModule::Intern(const char* str) {
+			return InternConstantBlob(str, strlen(str) + 1);
+		}
+	}
+
+	namespace Nodes {
+		namespace Native {
+			void* CSourceConversion(Backends::CSourceTransform& xfm, Backends::ActivityMaskVector* avm,
+									const Type& to, const Type& from, CTRef up) {
+				return (void*)GenericConversion(xfm, avm, to, from, up);
+			}
+		}
+	}
+}
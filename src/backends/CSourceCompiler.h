@@ -0,0 +1,30 @@
+#pragma once
+
+#include "CSourceEmitter.h"
+#include "GenericCodeGen.h"
+
+namespace K3 {
+	namespace Backends {
+		struct CSourceTypes {
+			using ModuleTy = CSourceUnitRef;
+			using FunctionTyTy = CSourceFunctionTypeRef;
+			using FunctionTy = CSourceFunction;
+			using TypeTy = CSourceType;
+			using ValueTy = CSourceExprRef;
+			using VariableTy = CSourceValue;
+			using BuilderTy = CSourceEmitter;
+			using BlockTy = CSourceBlock;
+		};
+
+		using CSourceModule = GenericEmitterModule<CSourceTypes>;
+
+		template <> CSourceExprRef CSourceModule::Intern(const char*);
+		template <> CSourceExprRef CSourceModule::InternZeroBytes(const void* uid, size_t numBytes);
+		template <> CSourceExprRef CSourceModule::InternConstantBlob(const void* data, size_t numBytes);
+
+		class CSourceTransform : public GenericEmitterValueTransform<CSourceTypes, CSourceTransform> {
+		public:
+			CSourceTransform(CSourceUnitRef M, CTRef root, IGenericCompilationPass& pass) :GenericEmitterValueTransform(M, root, pass) {}
+		};
+	}
+}
@@ -0,0 +1,759 @@
+#include "CSourceEmitter.h"
+#include "Errors.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+namespace std {
+	size_t hash<K3::Backends::CSourceFunctionTypeRef>::operator()(K3::Backends::CSourceFunctionTypeRef const& fty) const {
+		auto h = (size_t)fty.returnType;
+
+		for (auto&& at : fty.argumentType) {
+			h = h * 7 + (size_t)at;
+		}
+
+		return h;
+	}
+}
+
+namespace K3 {
+	namespace Backends {
+		const char* CTypeName(CSourceType ty) {
+			switch (ty) {
+			case CSourceType::Void: return "void";
+			case CSourceType::Int32: return "int32_t";
+			case CSourceType::Int64: return "int64_t";
+			case CSourceType::Float32: return "float";
+			case CSourceType::Float64: return "double";
+			case CSourceType::Ptr: return "char*";
+			}
+			KRONOS_UNREACHABLE;
+		}
+
+		static bool IsInt(CSourceType ty) {
+			return ty == CSourceType::Int32 || ty == CSourceType::Int64;
+		}
+
+		static std::string Sanitize(const std::string& name) {
+			std::string s;
+			for (auto c : name) {
+				s.push_back(isalnum((unsigned char)c) ? c : '_');
+			}
+			if (s.empty() || isdigit((unsigned char)s.front())) s = "_" + s;
+			return s;
+		}
+
+		bool CSourceFunctionTypeRef::operator==(const CSourceFunctionTypeRef& rhs) const {
+			return returnType == rhs.returnType && argumentType == rhs.argumentType;
+		}
+
+		void CSourceBlock::Append(const CSourceBlock& nested) {
+			for (auto& l : nested.lines) {
+				lines.emplace_back("\t" + l);
+			}
+		}
+
+		CSourceExprRef CSourceUnit::New(CSourceExpr e) {
+			exprs.emplace_back(std::move(e));
+			return &exprs.back();
+		}
+
+		CSourceExprRef CSourceUnit::New(std::string code, CSourceType ty, bool atom) {
+			CSourceExpr e;
+			e.code = std::move(code);
+			e.type = ty;
+			e.atom = atom;
+			return New(std::move(e));
+		}
+
+		std::string CSourceUnit::UniqueFunctionName(const std::string& nm) {
+			auto base = Symbol(Sanitize(nm));
+			auto name = base;
+			for (int i = 1; functionNames.count(name) || declared.count(name); ++i) {
+				name = base + "_" + std::to_string(i);
+			}
+			functionNames.emplace(name);
+			return name;
+		}
+
+		bool CSourceUnit::Declare(const std::string& name, const std::string& declaration, bool external) {
+			if (declared.emplace(name).second) {
+				(external ? externs : globals).emplace_back(declaration);
+				return true;
+			}
+			return false;
+		}
+
+		CSourceExprRef CSourceUnit::Global(const std::string& name, CSourceType ty, CSourceExprRef init) {
+			auto sym = Symbol(Sanitize(name));
+			auto gt = globalType.find(sym);
+			if (gt == globalType.end()) {
+				gt = globalType.emplace(sym, ty).first;
+				std::string decl = "static " + std::string(CTypeName(ty)) + " " + sym;
+				if (init) decl += " = " + init->code;
+				Declare(sym, decl + ";");
+			}
+			return New(sym, gt->second);
+		}
+
+		void CSourceUnit::WritePrelude(std::ostream& os) {
+			os <<
+				"#ifndef KRT_PRELUDE_DEFINED\n"
+				"#define KRT_PRELUDE_DEFINED\n"
+				"#include <stdint.h>\n"
+				"#include <string.h>\n"
+				"#include <math.h>\n"
+				"\n"
+				"#if defined(_MSC_VER)\n"
+				"#include <malloc.h>\n"
+				"#define KRT_INLINE __inline\n"
+				"#define KRT_NOINLINE __declspec(noinline)\n"
+				"#define KRT_ALIGN(n) __declspec(align(n))\n"
+				"#ifndef KRT_ALLOCA\n"
+				"#define KRT_ALLOCA(sz) _alloca(sz)\n"
+				"#endif\n"
+				"#elif defined(__GNUC__)\n"
+				"#define KRT_INLINE inline\n"
+				"#define KRT_NOINLINE __attribute__((noinline))\n"
+				"#define KRT_ALIGN(n) __attribute__((aligned(n)))\n"
+				"#ifndef KRT_ALLOCA\n"
+				"#define KRT_ALLOCA(sz) __builtin_alloca(sz)\n"
+				"#endif\n"
+				"#else\n"
+				"#define KRT_INLINE inline\n"
+				"#define KRT_NOINLINE\n"
+				"#define KRT_ALIGN(n)\n"
+				"#endif\n"
+				"\n"
+				"#define KRT_ALIGN_PTR(p, n) ((char*)(((uintptr_t)(p) + ((n) - 1)) & ~(uintptr_t)((n) - 1)))\n"
+				"\n"
+				"typedef union { float f; int32_t i; } krt_f32_bits;\n"
+				"typedef union { double f; int64_t i; } krt_f64_bits;\n"
+				"static KRT_INLINE int32_t krt_f2i(float f) { krt_f32_bits u; u.f = f; return u.i; }\n"
+				"static KRT_INLINE float krt_i2f(int32_t i) { krt_f32_bits u; u.i = i; return u.f; }\n"
+				"static KRT_INLINE int64_t krt_d2l(double f) { krt_f64_bits u; u.f = f; return u.i; }\n"
+				"static KRT_INLINE double krt_l2d(int64_t i) { krt_f64_bits u; u.i = i; return u.f; }\n"
+				"\n"
+				"#define KRT_LDST(T, N) \\\n"
+				"static KRT_INLINE T krt_ld_##N(const char* p) { T v; memcpy(&v, p, sizeof(T)); return v; } \\\n"
+				"static KRT_INLINE void krt_st_##N(char* p, T v) { memcpy(p, &v, sizeof(T)); }\n"
+				"KRT_LDST(int32_t, i32)\n"
+				"KRT_LDST(int64_t, i64)\n"
+				"KRT_LDST(float, f32)\n"
+				"KRT_LDST(double, f64)\n"
+				"KRT_LDST(char*, ptr)\n"
+				"#undef KRT_LDST\n"
+				"\n"
+				"static KRT_INLINE int32_t krt_mod_i32(int32_t a, int32_t b) {\n"
+				"\tuint32_t ub = (uint32_t)b;\n"
+				"\treturn (int32_t)(((uint32_t)a + ub * (0x80000000u / ub)) % ub);\n"
+				"}\n"
+				"static KRT_INLINE int64_t krt_mod_i64(int64_t a, int64_t b) {\n"
+				"\tuint64_t ub = (uint64_t)b;\n"
+				"\treturn (int64_t)(((uint64_t)a + ub * (0x8000000000000000ull / ub)) % ub);\n"
+				"}\n"
+				"static KRT_INLINE void krt_fill_i32(char* p, int32_t w, int64_t sz) {\n"
+				"\tint64_t i;\n"
+				"\tfor (i = 0; i + 4 <= sz; i += 4) krt_st_i32(p + i, w);\n"
+				"}\n"
+				"#endif\n\n";
+		}
+
+		void CSourceFnData::Write(std::ostream& os, bool prototype) const {
+			if (!exported) os << "static ";
+			if (noInline) os << "KRT_NOINLINE ";
+			os << CTypeName(ty.returnType) << " " << name << "(";
+			bool first = true;
+			if (!exported) {
+				os << "void** self";
+				first = false;
+			}
+			for (int i = 0; i < GetNumParams(); ++i) {
+				if (!first) os << ", ";
+				os << CTypeName(ty.argumentType[i]) << " p" << i;
+				first = false;
+			}
+			if (first) os << "void";
+			os << ")";
+
+			if (prototype) {
+				os << ";\n";
+				return;
+			}
+
+			os << " {\n";
+			if (exported) {
+				if (GetNumParams() && ty.argumentType[0] == CSourceType::Ptr) {
+					os << "\tvoid** self = (void**)(p0 + " << unit->Symbol("GetSymbolOffset") << "(0));\n";
+				} else {
+					os << "\tvoid** self = 0;\n";
+				}
+				os << "\t(void)self;\n";
+			}
+			for (auto& lv : lvars) {
+				if (lv.declaration.size()) os << "\t" << lv.declaration << "\n";
+				else os << "\t" << CTypeName(lv.type) << " " << lv.name << " = 0;\n";
+			}
+			if (hasTco) os << "tail_call:\n";
+			for (auto& l : body.lines) {
+				os << "\t" << l << "\n";
+			}
+			os << "}\n\n";
+		}
+
+		void CSourceUnit::Write(std::ostream& os) const {
+			for (auto& e : externs) os << e << "\n";
+			if (externs.size()) os << "\n";
+			for (auto& g : globals) os << g << "\n";
+			if (globals.size()) os << "\n";
+
+			os << "int64_t " << Symbol("GetSymbolOffset") << "(int64_t);\n";
+			for (auto& f : functions) {
+				if (f->emitted) f->Write(os, true);
+			}
+			os << "\n";
+			for (auto& f : functions) {
+				if (f->emitted) f->Write(os, false);
+			}
+		}
+
+		CSourceFunction::CSourceFunction(CSourceUnitRef M, const std::string& nm, bool exp, CSourceFunctionTypeRef ty)
+			:d(std::make_shared<CSourceFnData>()) {
+			d->name = exp ? M->Symbol(nm) : M->UniqueFunctionName(nm);
+			if (exp) M->functionNames.emplace(d->name);
+			d->exported = exp;
+			d->ty = ty;
+			d->unit = M;
+			M->functions.emplace_back(d);
+		}
+
+		void CSourceFunction::Complete() const {
+			d->emitted = true;
+		}
+
+		int CSourceFunction::LVar(const std::string&, CSourceType ty) {
+			int idx = (int)d->lvars.size();
+			d->lvars.emplace_back(CSourceLocal{ ty, "v" + std::to_string(idx) });
+			return idx;
+		}
+
+		int CSourceFunction::LVar(CSourceExprRef expr) {
+			return LVar("", expr->type);
+		}
+
+		CSourceValue::CSourceValue(CSourceFunction& fn, CSourceBlock& b, CSourceExprRef expr) {
+			if (!expr || expr->atom) {
+				ref = expr;
+				return;
+			}
+			auto idx = fn.LVar(expr);
+			b.lines.emplace_back(fn.d->lvars[idx].name + " = " + expr->code + ";");
+			ref = Local(fn, idx).ref;
+		}
+
+		CSourceValue CSourceValue::Local(CSourceFunction& fn, int index) {
+			auto& lv = fn.d->lvars[index];
+			CSourceValue v;
+			v.ref = fn.d->unit->New(lv.name, lv.type);
+			return v;
+		}
+
+		CSourceExprRef CSourceEmitter::Adapt(CSourceExprRef e, CSourceType ty) {
+			if (ty == CSourceType::Void || e->type == ty) return e;
+			if (e->constant && IsInt(ty)) {
+				return ty == CSourceType::Int32 ? Const((std::int32_t)e->value) : Const64(e->value);
+			}
+			if (ty == CSourceType::Ptr) {
+				return Expr("((char*)(intptr_t)" + e->code + ")", ty);
+			}
+			if (e->type == CSourceType::Ptr) {
+				return Expr("((" + std::string(CTypeName(ty)) + ")(intptr_t)" + e->code + ")", ty);
+			}
+			return Expr("((" + std::string(CTypeName(ty)) + ")" + e->code + ")", ty);
+		}
+
+		CSourceExprRef CSourceEmitter::Int(IntOp op, CSourceType ty, CSourceExprRef a, CSourceExprRef b) {
+			bool wide = ty == CSourceType::Int64;
+			a = Adapt(a, ty); b = Adapt(b, ty);
+
+			if (a->constant && b->constant) {
+				std::uint64_t x = (std::uint64_t)a->value, y = (std::uint64_t)b->value;
+				std::uint64_t r;
+				switch (op) {
+				case IntOp::Add: r = x + y; break;
+				case IntOp::Sub: r = x - y; break;
+				case IntOp::Mul: r = x * y; break;
+				default: goto no_fold;
+				}
+				return wide ? Const64((std::int64_t)r) : Const((std::int32_t)r);
+			}
+		no_fold:
+			std::string T = wide ? "int64_t" : "int32_t";
+			std::string U = wide ? "(uint64_t)" : "(uint32_t)";
+			std::string mask = wide ? " & 63)" : " & 31)";
+			auto A = a->code, B = b->code;
+
+			auto wrap = [&](const char* o) {
+				return Expr("((" + T + ")(" + U + A + " " + o + " " + U + B + "))", ty);
+			};
+
+			auto cmp = [&](const char* o) {
+				return Expr("((int32_t)(" + A + " " + o + " " + B + "))", CSourceType::Int32);
+			};
+
+			auto plain = [&](const char* o) {
+				return Expr("(" + A + " " + o + " " + B + ")", ty);
+			};
+
+			switch (op) {
+			case IntOp::Add: return wrap("+");
+			case IntOp::Sub: return wrap("-");
+			case IntOp::Mul: return wrap("*");
+			case IntOp::DivS: return plain("/");
+			case IntOp::RemS: return plain("%");
+			case IntOp::RemU: return Expr("((" + T + ")(" + U + A + " % " + U + B + "))", ty);
+			case IntOp::And: return plain("&");
+			case IntOp::Or: return plain("|");
+			case IntOp::Xor: return plain("^");
+			case IntOp::Shl: return Expr("((" + T + ")(" + U + A + " << (" + B + mask + "))", ty);
+			case IntOp::ShrS: return Expr("(" + A + " >> (" + B + mask + ")", ty);
+			case IntOp::ShrU: return Expr("((" + T + ")(" + U + A + " >> (" + B + mask + "))", ty);
+			case IntOp::Eq: return cmp("==");
+			case IntOp::Ne: return cmp("!=");
+			case IntOp::LtS: return cmp("<");
+			case IntOp::LeS: return cmp("<=");
+			case IntOp::GtS: return cmp(">");
+			case IntOp::GeS: return cmp(">=");
+			}
+			KRONOS_UNREACHABLE;
+		}
+
+		CSourceExprRef CSourceEmitter::NonZero(CSourceExprRef v) {
+			switch (v->type) {
+			case CSourceType::Float32: return Expr("((int32_t)(" + v->code + " != 0.f))", CSourceType::Int32);
+			case CSourceType::Float64: return Expr("((int32_t)(" + v->code + " != 0.0))", CSourceType::Int32);
+			default: return Expr("((int32_t)(" + v->code + " != 0))", CSourceType::Int32);
+			}
+		}
+
+		CSourceExprRef CSourceEmitter::Const(std::int32_t v) {
+			CSourceExpr e;
+			e.code = v == INT32_MIN ? "(-2147483647-1)" : v < 0 ? "(" + std::to_string(v) + ")" : std::to_string(v);
+			e.type = CSourceType::Int32;
+			e.atom = e.constant = true;
+			e.value = v;
+			return M->New(std::move(e));
+		}
+
+		CSourceExprRef CSourceEmitter::Const64(std::int64_t v) {
+			CSourceExpr e;
+			e.code = v == INT64_MIN ? "((int64_t)(-9223372036854775807LL-1))" : "((int64_t)" + std::to_string(v) + "LL)";
+			e.type = CSourceType::Int64;
+			e.atom = e.constant = true;
+			e.value = v;
+			return M->New(std::move(e));
+		}
+
+		CSourceExprRef CSourceEmitter::NullConst(CSourceType ty) {
+			switch (ty) {
+			case CSourceType::Int32: return Const(0);
+			case CSourceType::Int64: return Const64(0);
+			case CSourceType::Float32: return M->New("0.f", ty, true);
+			case CSourceType::Float64: return M->New("0.0", ty, true);
+			case CSourceType::Ptr: return M->New("((char*)0)", ty, true);
+			default: KRONOS_UNREACHABLE;
+			}
+		}
+
+		CSourceExprRef CSourceEmitter::AllOnesConst(CSourceType ty) {
+			switch (ty) {
+			case CSourceType::Int32: return Const(-1);
+			case CSourceType::Int64: return Const64(-1);
+			case CSourceType::Float32: return Expr("krt_i2f(-1)", ty);
+			case CSourceType::Float64: return Expr("krt_l2d(-1)", ty);
+			default: KRONOS_UNREACHABLE;
+			}
+		}
+
+		void CSourceEmitter::Ret(CSourceExprRef v) {
+			auto retTy = fn.d->ty.returnType;
+			if (retTy == CSourceType::Void || !v) {
+				b->lines.emplace_back(retTy == CSourceType::Void ? "return;" : "return 0;");
+			} else {
+				b->lines.emplace_back("return " + Adapt(v, retTy)->code + ";");
+			}
+		}
+
+		CSourceExprRef CSourceEmitter::Constant(const void* data, CSourceType ty) {
+			switch (ty) {
+			case CSourceType::Int32: return Const(*(const std::int32_t*)data);
+			case CSourceType::Int64: return Const64(*(const std::int64_t*)data);
+			case CSourceType::Float32:
+			case CSourceType::Float64: {
+				double v = ty == CSourceType::Float32 ? (double)*(const float*)data : *(const double*)data;
+				if (!std::isfinite(v)) {
+					return ty == CSourceType::Float32
+						? M->New("krt_i2f(" + std::to_string(*(const std::int32_t*)data) + ")", ty, true)
+						: M->New("krt_l2d(" + std::to_string(*(const std::int64_t*)data) + "LL)", ty, true);
+				}
+				std::stringstream lit;
+				lit << std::hexfloat << v;
+				auto code = lit.str();
+				if (ty == CSourceType::Float32) code += "f";
+				if (code.front() == '-') code = "(" + code + ")";
+				CSourceExpr e;
+				e.code = code;
+				e.type = ty;
+				e.atom = e.constant = true;
+				return M->New(std::move(e));
+			}
+			default:
+				INTERNAL_ERROR("Unsupported constant type in C source emitter");
+			}
+		}
+
+		CSourceExprRef CSourceEmitter::FnArg(int index) {
+			return M->New("p" + std::to_string(index), fn.d->ty.argumentType[index]);
+		}
+
+		CSourceExprRef CSourceEmitter::GetSlot(int index) {
+			return Expr("((char*)self[" + std::to_string(index) + "])", CSourceType::Ptr);
+		}
+
+		void CSourceEmitter::SetSlot(int index, CSourceExprRef val) {
+			Sfx("self[" + std::to_string(index) + "] = (void*)" + Adapt(val, CSourceType::Ptr)->code);
+		}
+
+		CSourceExprRef CSourceEmitter::PtrToInt(CSourceExprRef ptr) {
+			return Adapt(ptr, CSourceType::Int32);
+		}
+
+		CSourceExprRef CSourceEmitter::IntToPtr(CSourceExprRef i) {
+			return Adapt(i, CSourceType::Ptr);
+		}
+
+		CSourceExprRef CSourceEmitter::Offset(CSourceExprRef ptr, CSourceExprRef offset) {
+			if (offset->constant && offset->value == 0) return Adapt(ptr, CSourceType::Ptr);
+			return Expr("(" + Adapt(ptr, CSourceType::Ptr)->code + " + " + offset->code + ")", CSourceType::Ptr);
+		}
+
+		CSourceExprRef CSourceEmitter::Call(const CSourceFunction& callee, const std::vector<CSourceExprRef>& params, bool) {
+			auto call = PureCall(callee, params, true);
+			if (call->type == CSourceType::Void) {
+				Sfx(call->code);
+				return nullptr;
+			}
+			return TmpVar(call);
+		}
+
+		CSourceExprRef CSourceEmitter::PureCall(const CSourceFunction& callee, const std::vector<CSourceExprRef>& params, bool) {
+			if (callee.d != fn.d) callee.Complete();
+			auto& ty = callee.d->ty;
+			std::string code = callee.d->name + "(";
+			bool first = true;
+			if (!callee.d->exported) {
+				code += "self";
+				first = false;
+			}
+			for (size_t i = 0; i < params.size(); ++i) {
+				if (!first) code += ", ";
+				code += Adapt(params[i], ty.argumentType[i])->code;
+				first = false;
+			}
+			return Expr(code + ")", ty.returnType);
+		}
+
+		void CSourceEmitter::TCO(CSourceExprRef cond, const std::vector<CSourceValue>& params) {
+			fn.d->hasTco = true;
+			If(cond, [&](CSourceEmitter& tco) {
+				// evaluate every argument before any parameter is overwritten
+				std::vector<CSourceExprRef> next;
+				for (size_t i = 0; i < params.size(); ++i) {
+					auto p = params[i].ref;
+					if (p->constant) {
+						next.emplace_back(p);
+					} else {
+						auto tmp = tco.LVar(p);
+						tco.Set(tmp, p);
+						next.emplace_back(tco.Get(tmp));
+					}
+				}
+				for (size_t i = 0; i < params.size(); ++i) {
+					tco.Sfx("p" + std::to_string(i) + " = " + Adapt(next[i], fn.d->ty.argumentType[i])->code);
+				}
+				tco.Sfx("goto tail_call");
+			});
+		}
+
+		CSourceExprRef CSourceEmitter::GVar(const std::string& name, CSourceType ty) {
+			return M->Global(name, ty);
+		}
+
+		void CSourceEmitter::SetGVar(const std::string& name, CSourceExprRef value, bool soleAssignment) {
+			if (soleAssignment && value->constant && M->globalType.count(M->Symbol(Sanitize(name))) == 0) {
+				M->Global(name, value->type, value);
+				return;
+			}
+			auto gv = M->Global(name, value->type);
+			Sfx(gv->code + " = " + Adapt(value, gv->type)->code);
+		}
+
+		CSourceExprRef CSourceEmitter::Alloca(CSourceExprRef sz, int align) {
+			if (align < 1) align = 1;
+			if (sz->constant) {
+				auto idx = fn.LVar("buf", CSourceType::Ptr);
+				auto& lv = fn.d->lvars[idx];
+				lv.name = "buf" + std::to_string(idx);
+				lv.declaration = "KRT_ALIGN(" + std::to_string(align) + ") char " + lv.name +
+					"[" + std::to_string(sz->value > 0 ? sz->value : 1) + "];";
+				return M->New(lv.name, CSourceType::Ptr, true);
+			}
+			auto bytes = "(size_t)" + sz->code + " + " + std::to_string(align - 1);
+			return TmpVar(Expr("KRT_ALIGN_PTR(KRT_ALLOCA(" + bytes + "), " + std::to_string(align) + ")", CSourceType::Ptr));
+		}
+
+		CSourceExprRef CSourceEmitter::GlobalExternal(CSourceType ty, const std::string& importModule, const std::string& sym) {
+			auto name = Sanitize("krt_" + importModule + "_" + sym);
+			M->Declare(name, "extern " + std::string(CTypeName(ty)) + " " + name + ";", true);
+			return M->New(name, ty);
+		}
+
+		CSourceExprRef CSourceEmitter::CallExternal(CSourceType returnType, const std::string& sym, const std::vector<CSourceExprRef>& params) {
+			std::string proto = "extern " + std::string(CTypeName(returnType)) + " " + sym + "(";
+			std::string call = sym + "(";
+			for (size_t i = 0; i < params.size(); ++i) {
+				if (i) {
+					proto += ", ";
+					call += ", ";
+				}
+				proto += CTypeName(params[i]->type);
+				call += params[i]->code;
+			}
+			if (params.empty()) proto += "void";
+			M->Declare(sym, proto + ");", true);
+			call += ")";
+
+			if (returnType == CSourceType::Void) {
+				Sfx(call);
+				return Const(0);
+			}
+			return Expr(call, returnType);
+		}
+
+		void CSourceEmitter::MemCpy(CSourceExprRef dst, CSourceExprRef src, CSourceExprRef sz, int) {
+			if (sz->constant && sz->value <= 0) return;
+			Sfx("memcpy(" + dst->code + ", " + src->code + ", (size_t)" + sz->code + ")");
+		}
+
+		void CSourceEmitter::MemSet(CSourceExprRef dst, CSourceExprRef word, CSourceExprRef sz) {
+			if (word->constant && word->value == 0) {
+				Sfx("memset(" + dst->code + ", 0, (size_t)" + sz->code + ")");
+			} else {
+				Sfx("krt_fill_i32(" + dst->code + ", " + Adapt(word, CSourceType::Int32)->code + ", " + sz->code + ")");
+			}
+		}
+
+		void CSourceEmitter::Set(int i, CSourceExprRef val) {
+			auto& lv = fn.d->lvars[i];
+			// integer locals that receive addresses become pointers
+			if (lv.type == CSourceType::Int32 && val->type == CSourceType::Ptr) {
+				lv.type = CSourceType::Ptr;
+			}
+			Sfx(lv.name + " = " + Adapt(val, lv.type)->code);
+		}
+
+		void CSourceEmitter::Switch(CSourceExprRef c, const std::vector<CSourceBlock>& blocks) {
+			if (blocks.empty()) return;
+			b->lines.emplace_back("switch (" + c->code + ") {");
+			for (size_t i = 0; i < blocks.size(); ++i) {
+				b->lines.emplace_back("case " + std::to_string(i) + ": {");
+				b->Append(blocks[i]);
+				b->lines.emplace_back("}");
+			}
+			b->lines.emplace_back("}");
+		}
+
+		static std::string SignalMaskWord(int bitIdx) {
+			return "((int32_t*)self)[" + std::to_string(-1 - bitIdx / 32) + "]";
+		}
+
+		CSourceExprRef CSourceEmitter::GetSignalMaskWord(int bitIdx, int& outSubIdx) {
+			outSubIdx = bitIdx % 32;
+			return Expr(SignalMaskWord(bitIdx), CSourceType::Int32);
+		}
+
+		void CSourceEmitter::StoreSignalMaskWord(int bitIdx, CSourceExprRef word) {
+			Sfx(SignalMaskWord(bitIdx) + " = " + word->code);
+		}
+
+		CSourceExprRef CSourceEmitter::BitCast(CSourceType to, CSourceExprRef val) {
+			if (to == val->type) return val;
+			// addresses are reinterpreted as integers for alignment arithmetic
+			if (val->type == CSourceType::Ptr || to == CSourceType::Ptr) {
+				return Expr(std::string(to == CSourceType::Ptr ? "(char*)" : "(int64_t)") + "(intptr_t)(" + val->code + ")", to);
+			}
+			switch (to) {
+			case CSourceType::Int32: return Expr("krt_f2i(" + val->code + ")", to);
+			case CSourceType::Int64: return Expr("krt_d2l(" + val->code + ")", to);
+			case CSourceType::Float32: return Expr("krt_i2f(" + val->code + ")", to);
+			case CSourceType::Float64: return Expr("krt_l2d(" + val->code + ")", to);
+			default: KRONOS_UNREACHABLE;
+			}
+		}
+
+		CSourceExprRef CSourceEmitter::BitCastInt(CSourceExprRef val) {
+			switch (val->type) {
+			case CSourceType::Float32: return BitCast(CSourceType::Int32, val);
+			case CSourceType::Float64: return BitCast(CSourceType::Int64, val);
+			default: return val;
+			}
+		}
+
+		CSourceExprRef CSourceEmitter::MathFn(const char* name, CSourceExprRef a, CSourceExprRef b) {
+			switch (a->type) {
+			case CSourceType::Float32: return Expr(std::string(name) + "f(" + a->code + ", " + b->code + ")", a->type);
+			case CSourceType::Float64: return Expr(std::string(name) + "(" + a->code + ", " + b->code + ")", a->type);
+			default:
+				return Coerce(a->type, MathFn(name, Coerce(CSourceType::Float64, a), Coerce(CSourceType::Float64, b)));
+			}
+		}
+
+		CSourceExprRef CSourceEmitter::MathFn(const char* name, CSourceExprRef a) {
+			switch (a->type) {
+			case CSourceType::Float32: return Expr(std::string(name) + "f(" + a->code + ")", a->type);
+			case CSourceType::Float64: return Expr(std::string(name) + "(" + a->code + ")", a->type);
+			default:
+				return Coerce(a->type, MathFn(name, Coerce(CSourceType::Float64, a)));
+			}
+		}
+
+		CSourceExprRef CSourceEmitter::Coerce(CSourceType to, CSourceExprRef from) {
+			if (to == CSourceType::Ptr || from->type == CSourceType::Ptr) {
+				INTERNAL_ERROR("Invalid type conversion");
+			}
+			return Adapt(from, to);
+		}
+
+		CSourceExprRef CSourceEmitter::LogicResult(CSourceExprRef truth, CSourceType ty) {
+			switch (ty) {
+			case CSourceType::Int32: return Expr("(-" + truth->code + ")", ty);
+			case CSourceType::Int64: return Expr("(-(int64_t)" + truth->code + ")", ty);
+			case CSourceType::Float32: return Expr("krt_i2f(-" + truth->code + ")", ty);
+			case CSourceType::Float64: return Expr("krt_l2d(-(int64_t)" + truth->code + ")", ty);
+			default: KRONOS_UNREACHABLE;
+			}
+		}
+
+		static const char* MemSuffix(CSourceType ty) {
+			switch (ty) {
+			case CSourceType::Int32: return "i32";
+			case CSourceType::Int64: return "i64";
+			case CSourceType::Float32: return "f32";
+			case CSourceType::Float64: return "f64";
+			case CSourceType::Ptr: return "ptr";
+			default: KRONOS_UNREACHABLE;
+			}
+		}
+
+		CSourceExprRef CSourceEmitter::Load(CSourceExprRef ptr, CSourceType ty, int) {
+			return Expr("krt_ld_" + std::string(MemSuffix(ty)) + "(" + Adapt(ptr, CSourceType::Ptr)->code + ")", ty);
+		}
+
+		void CSourceEmitter::Store(CSourceExprRef ptr, CSourceExprRef value, int) {
+			Sfx("krt_st_" + std::string(MemSuffix(value->type)) + "(" + Adapt(ptr, CSourceType::Ptr)->code + ", " + value->code + ")");
+		}
+
+		CSourceExprRef CSourceEmitter::BinaryOp(Nodes::Native::Opcode op, CSourceExprRef lhs, CSourceExprRef rhs) {
+			namespace N = Nodes::Native;
+			auto ty = lhs->type;
+			bool i64 = ty == CSourceType::Int64;
+			auto I = [&](IntOp iop) {
+				return Int(iop, ty, lhs, rhs);
+			};
+			auto F = [&](const char* o) {
+				return Expr("(" + lhs->code + " " + o + " " + rhs->code + ")", ty);
+			};
+			auto Cmp = [&](IntOp iop, const char* o) {
+				if (IsInt(ty)) return LogicResult(Int(iop, ty, lhs, rhs), ty);
+				return LogicResult(Expr("((int32_t)(" + lhs->code + " " + o + " " + rhs->code + "))", CSourceType::Int32), ty);
+			};
+			auto Bits = [&](IntOp iop) {
+				if (IsInt(ty)) return I(iop);
+				return BitCast(ty, BinaryOp(op, BitCastInt(lhs), BitCastInt(rhs)));
+			};
+
+			switch (op) {
+			case N::Add: return IsInt(ty) ? I(IntOp::Add) : F("+");
+			case N::Sub: return IsInt(ty) ? I(IntOp::Sub) : F("-");
+			case N::Mul: return IsInt(ty) ? I(IntOp::Mul) : F("*");
+			case N::Div: return IsInt(ty) ? I(IntOp::DivS) : F("/");
+			case N::Equal: return Cmp(IntOp::Eq, "==");
+			case N::Not_Equal: return Cmp(IntOp::Ne, "!=");
+			case N::Greater: return Cmp(IntOp::GtS, ">");
+			case N::Greater_Equal: return Cmp(IntOp::GeS, ">=");
+			case N::Less: return Cmp(IntOp::LtS, "<");
+			case N::Less_Equal: return Cmp(IntOp::LeS, "<=");
+			case N::And: return Bits(IntOp::And);
+			case N::Or: return Bits(IntOp::Or);
+			case N::Xor: return Bits(IntOp::Xor);
+			case N::AndNot: return BinaryOp(N::And, UnaryOp(N::Not, lhs), rhs);
+			case N::BitShiftLeft: return Bits(IntOp::Shl);
+			case N::BitShiftRight: return Bits(IntOp::ShrS);
+			case N::LogicalShiftRight: return Bits(IntOp::ShrU);
+			case N::Modulo:
+				if (!IsInt(ty)) break;
+				return Expr(std::string(i64 ? "krt_mod_i64(" : "krt_mod_i32(") + lhs->code + ", " + rhs->code + ")", ty);
+			case N::Max:
+			case N::Min: {
+				auto a = TmpVar(lhs), b = TmpVar(rhs);
+				return Select(Expr("(" + a.ref->code + (op == N::Max ? " > " : " < ") + b.ref->code + ")", CSourceType::Int32), a, b);
+			}
+			case N::ClampIndex: {
+				if (!IsInt(ty)) break;
+				auto a = TmpVar(lhs), b = TmpVar(rhs);
+				std::string U = i64 ? "(uint64_t)" : "(uint32_t)";
+				return Select(Expr("(" + U + a.ref->code + " > " + U + b.ref->code + ")", CSourceType::Int32), NullConst(ty), a);
+			}
+			case N::Pow: return MathFn("pow", lhs, rhs);
+			case N::Atan2: return MathFn("atan2", lhs, rhs);
+			default: break;
+			}
+			INTERNAL_ERROR("Unsupported binary operator in C source emitter");
+		}
+
+		CSourceExprRef CSourceEmitter::UnaryOp(Nodes::Native::Opcode op, CSourceExprRef up) {
+			namespace N = Nodes::Native;
+			auto ty = up->type;
+			switch (op) {
+			case N::Neg:
+				if (IsInt(ty)) return Int(IntOp::Sub, ty, NullConst(ty), up);
+				return Expr("(-" + up->code + ")", ty);
+			case N::Abs:
+				if (IsInt(ty)) {
+					auto x = TmpVar(up);
+					return Select(Int(IntOp::LtS, ty, x, NullConst(ty)), Int(IntOp::Sub, ty, NullConst(ty), x), x);
+				}
+				return MathFn("fabs", up);
+			case N::Not:
+				if (IsInt(ty)) return Expr("(~" + up->code + ")", ty);
+				return BitCast(ty, UnaryOp(op, BitCastInt(up)));
+			case N::Truncate: return MathFn("trunc", up);
+			case N::Round: return MathFn("nearbyint", up);
+			case N::Ceil: return MathFn("ceil", up);
+			case N::Floor: return MathFn("floor", up);
+			case N::Sqrt: return MathFn("sqrt", up);
+			case N::Cos: return MathFn("cos", up);
+			case N::Sin: return MathFn("sin", up);
+			case N::Exp: return MathFn("exp", up);
+			case N::Log: return MathFn("log", up);
+			case N::Log10: return MathFn("log10", up);
+			case N::Log2: return MathFn("log2", up);
+			default: break;
+			}
+			INTERNAL_ERROR("Unsupported unary operator in C source emitter");
+		}
+	}
+}
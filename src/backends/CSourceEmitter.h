@@ -0,0 +1,355 @@
+#pragma once
+
+#include "Native.h"
+#include "CodeGenCompiler.h"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace K3 {
+	namespace Backends {
+		enum class CSourceType {
+			Void,
+			Int32,
+			Int64,
+			Float32,
+			Float64,
+			Ptr
+		};
+
+		const char* CTypeName(CSourceType);
+
+		struct CSourceExpr {
+			std::string code;
+			CSourceType type;
+			// atoms never change value, so they are referenced instead of copied into temporaries
+			bool atom = false;
+			bool constant = false;
+			std::int64_t value = 0;
+		};
+
+		using CSourceExprRef = const CSourceExpr*;
+
+		struct CSourceFunctionTypeRef {
+			std::vector<CSourceType> argumentType;
+			CSourceType returnType;
+
+			bool operator==(const CSourceFunctionTypeRef&) const;
+		};
+
+		struct CSourceBlock {
+			std::string name;
+			std::vector<std::string> lines;
+			CSourceBlock(const std::string& nm) :name(nm) {}
+			CSourceBlock() {}
+			void Append(const CSourceBlock& nested);
+		};
+
+		struct CSourceFnData;
+
+		// translation unit under construction; owns every expression and function
+		struct CSourceUnit {
+			std::string prefix;
+			std::deque<CSourceExpr> exprs;
+			std::vector<std::string> externs;
+			std::vector<std::string> globals;
+			std::unordered_map<std::string, CSourceType> globalType;
+			std::unordered_set<std::string> declared;
+			std::unordered_set<std::string> functionNames;
+			std::vector<std::shared_ptr<CSourceFnData>> functions;
+			std::unordered_map<std::string, std::string> constantData;
+			std::unordered_map<const void*, std::string> zeroData;
+			int nextId = 0;
+
+			CSourceExprRef New(CSourceExpr e);
+			CSourceExprRef New(std::string code, CSourceType ty, bool atom = false);
+			std::string Symbol(const std::string& name) const { return prefix + name; }
+			std::string UniqueFunctionName(const std::string&);
+			bool Declare(const std::string& name, const std::string& declaration, bool external = false);
+			CSourceExprRef Global(const std::string& name, CSourceType ty, CSourceExprRef init = nullptr);
+
+			static void WritePrelude(std::ostream&);
+			void Write(std::ostream&) const;
+		};
+
+		using CSourceUnitRef = CSourceUnit*;
+
+		struct CSourceLocal {
+			CSourceType type;
+			std::string name;
+			std::string declaration;
+		};
+
+		struct CSourceFnData {
+			std::string name;
+			bool exported;
+			CSourceFunctionTypeRef ty;
+			CSourceUnitRef unit;
+			std::vector<CSourceLocal> lvars;
+			CSourceBlock body;
+			bool emitted = false;
+			bool hasTco = false;
+			bool noInline = false;
+
+			int GetNumParams() const {
+				return (int)ty.argumentType.size();
+			}
+
+			void Write(std::ostream&, bool prototype) const;
+		};
+
+		struct CSourceFunction {
+			std::shared_ptr<CSourceFnData> d;
+
+			void NoInline() { d->noInline = true; }
+			void NoThrow() {}
+			void FastCConv() {}
+
+			CSourceFunction(CSourceUnitRef M, const std::string& nm, bool exp, CSourceFunctionTypeRef ty);
+			CSourceFunction() {}
+			void Complete() const;
+
+			CSourceFunctionTypeRef TypeOf() {
+				return d->ty;
+			}
+
+			int LVar(const std::string&, CSourceType ty);
+			int LVar(CSourceExprRef);
+
+			operator bool() const {
+				return d.operator bool();
+			}
+		};
+
+		struct CSourceValue {
+			CSourceExprRef ref = nullptr;
+			CSourceValue() {}
+			explicit CSourceValue(CSourceExprRef atom) :ref(atom) {}
+			CSourceValue(CSourceFunction& fn, CSourceExprRef expr) :CSourceValue(fn, fn.d->body, expr) {}
+			CSourceValue(CSourceFunction& fn, CSourceBlock& b, CSourceExprRef expr);
+			static CSourceValue Local(CSourceFunction& fn, int index);
+
+			operator CSourceExprRef() const {
+				return ref;
+			}
+		};
+
+		class CSourceEmitter {
+			CSourceFunction fn;
+			CSourceUnitRef M;
+			CSourceBlock* b;
+
+			enum class IntOp {
+				Add, Sub, Mul, DivS, RemS, RemU, And, Or, Xor, Shl, ShrS, ShrU,
+				Eq, Ne, LtS, LeS, GtS, GeS
+			};
+
+			CSourceExprRef Expr(std::string code, CSourceType ty) { return M->New(std::move(code), ty); }
+			CSourceExprRef Int(IntOp, CSourceType, CSourceExprRef, CSourceExprRef);
+			CSourceExprRef Adapt(CSourceExprRef, CSourceType);
+			std::string Local(int i) { return fn.d->lvars[i].name; }
+			std::string BlockName(const std::string& tmpl) { return tmpl + std::to_string(M->nextId++); }
+
+		public:
+			CSourceEmitter() :M(nullptr), b(nullptr) {}
+			CSourceEmitter(CSourceFunction& fn) :fn(fn), M(fn.d->unit), b(&fn.d->body) {}
+			CSourceEmitter(CSourceFunction& fn, CSourceBlock& b) :fn(fn), M(fn.d->unit), b(&b) {}
+
+			void Sfx(const std::string& statement) { b->lines.emplace_back(statement + ";"); }
+
+#define IB(SYM) \
+			CSourceExprRef SYM ## Int32(CSourceExprRef lhs, CSourceExprRef rhs) { return Int(IntOp::SYM, CSourceType::Int32, lhs, rhs); } \
+			CSourceExprRef SYM ## Int64(CSourceExprRef lhs, CSourceExprRef rhs) { return Int(IntOp::SYM, CSourceType::Int64, lhs, rhs); }
+			IB(Add)
+			IB(Sub)
+			IB(Mul)
+			IB(DivS)
+			IB(RemS)
+			IB(RemU)
+			IB(And)
+			IB(Or)
+			IB(Xor)
+			IB(Shl)
+			IB(ShrS)
+			IB(ShrU)
+			IB(Eq)
+			IB(Ne)
+			IB(LtS)
+			IB(LeS)
+			IB(GtS)
+			IB(GeS)
+#undef IB
+			CSourceExprRef And(CSourceExprRef lhs, CSourceExprRef rhs) {
+				return AndInt32(lhs, rhs);
+			}
+
+			CSourceExprRef Or(CSourceExprRef lhs, CSourceExprRef rhs) {
+				return OrInt32(lhs, rhs);
+			}
+
+			CSourceExprRef LogicalNot(CSourceExprRef x) {
+				return Expr("((int32_t)!" + x->code + ")", CSourceType::Int32);
+			}
+
+			CSourceExprRef Select(CSourceExprRef which, CSourceExprRef whenTrue, CSourceExprRef whenFalse) {
+				return Expr("(" + which->code + " ? " + whenTrue->code + " : " + Adapt(whenFalse, whenTrue->type)->code + ")", whenTrue->type);
+			}
+
+			CSourceExprRef NonZero(CSourceExprRef expr);
+
+			CSourceExprRef Const(std::int32_t v);
+			CSourceExprRef Const64(std::int64_t v);
+			CSourceExprRef NullConst(CSourceType ty);
+			CSourceExprRef AllOnesConst(CSourceType ty);
+
+			CSourceExprRef UndefConst(CSourceType ty) {
+				return NullConst(ty);
+			}
+
+			CSourceExprRef PassiveValue(CSourceType ty, const std::string& label) {
+				return UndefConst(ty);
+			}
+
+			void Ret(CSourceExprRef v = nullptr);
+
+			void RetNoUnwind(CSourceExprRef v = nullptr) {
+				Ret(v);
+			}
+
+			CSourceExprRef Constant(const void* data, CSourceType ty);
+
+			CSourceExprRef FnArg(int index);
+			CSourceExprRef FnArg(int index, CSourceType ty) { return FnArg(index); }
+			int NumFnArgs() { return fn.d->GetNumParams(); }
+
+			CSourceType FnArgTy(CSourceFunctionTypeRef const& fty, int index) { return fty.argumentType[index]; }
+			int NumFnArgs(CSourceFunctionTypeRef const& fty) { return (int)fty.argumentType.size(); }
+
+			CSourceExprRef GetSlot(int index);
+			void SetSlot(int index, CSourceExprRef val);
+
+			CSourceExprRef PtrToInt(CSourceExprRef ptr);
+			CSourceExprRef IntToPtr(CSourceExprRef i);
+			CSourceExprRef Offset(CSourceExprRef ptr, CSourceExprRef byteOffset);
+			CSourceExprRef Call(const CSourceFunction& fn, const std::vector<CSourceExprRef>& params, bool internalCconv);
+			CSourceExprRef PureCall(const CSourceFunction& fn, const std::vector<CSourceExprRef>& params, bool internalCconv);
+			void TCO(CSourceExprRef cond, const std::vector<CSourceValue>& params);
+
+			template <typename TTrue, typename TFalse> void If(CSourceExprRef pred, TTrue t, TFalse f) {
+				CSourceBlock trueBlk, falseBlk;
+				CSourceEmitter trueB{ fn, trueBlk }, falseB{ fn, falseBlk };
+				t(trueB);
+				f(falseB);
+				b->lines.emplace_back("if (" + pred->code + ") {");
+				b->Append(trueBlk);
+				if (falseBlk.lines.size()) {
+					b->lines.emplace_back("} else {");
+					b->Append(falseBlk);
+				}
+				b->lines.emplace_back("}");
+			}
+
+			template <typename TTrue> void If(CSourceExprRef pred, TTrue t) {
+				If(pred, t, [](auto&) {});
+			}
+
+			CSourceBlock* CurrentBlock() {
+				return b;
+			}
+
+			template <typename TBody> void Loop(TBody tb) {
+				CSourceBlock body;
+				CSourceEmitter bodyB{ fn, body };
+				auto breakLabel = BlockName("break");
+				tb(breakLabel, bodyB);
+				b->lines.emplace_back("for (;;) {");
+				b->Append(body);
+				b->lines.emplace_back("}");
+			}
+
+			template <typename TBody> void Loop(CSourceExprRef loopCount, TBody tb) {
+				auto count = TmpVar(Adapt(loopCount, CSourceType::Int32));
+				auto counter = LVar("i", CSourceType::Int32);
+				CSourceBlock body;
+				CSourceEmitter bodyB{ fn, body };
+				auto breakLabel = BlockName("break");
+				tb(breakLabel, bodyB, Get(counter));
+				auto i = Local(counter);
+				b->lines.emplace_back("for (" + i + " = 0; " + i + " < " + count.ref->code + "; ++" + i + ") {");
+				b->Append(body);
+				b->lines.emplace_back("}");
+			}
+
+			CSourceExprRef GVar(const std::string& name, CSourceType ty);
+			void SetGVar(const std::string& name, CSourceExprRef value, bool soleAssignment = false);
+			CSourceExprRef Alloca(CSourceExprRef sz, int align);
+
+			CSourceExprRef GlobalExternal(CSourceType ty, const std::string& importModule, const std::string& sym);
+			CSourceExprRef CallExternal(CSourceType returnType, const std::string& sym, const std::vector<CSourceExprRef>&);
+			void MemCpy(CSourceExprRef dst, CSourceExprRef src, CSourceExprRef sz, int align);
+			void MemSet(CSourceExprRef dst, CSourceExprRef word, CSourceExprRef sz);
+
+			int LVar(const std::string& name, CSourceType ty) { return fn.LVar(name, ty); }
+			int LVar(CSourceExprRef expr) { return fn.LVar(expr); }
+
+			CSourceValue TmpVar(CSourceExprRef val) {
+				return { fn, *b, val };
+			}
+
+			void Set(int i, CSourceExprRef val);
+
+			CSourceExprRef Get(int i, CSourceType) {
+				return Get(i);
+			}
+
+			CSourceExprRef Get(int i) {
+				return CSourceValue::Local(fn, i);
+			}
+
+			CSourceExprRef False() { return Const(0); }
+
+			void Switch(CSourceExprRef c, const std::vector<CSourceBlock>& blocks);
+
+			CSourceExprRef GetSignalMaskWord(int bitIdx, int& outSubIdx);
+			void StoreSignalMaskWord(int bitIdx, CSourceExprRef word);
+
+			CSourceType TypeOf(CSourceExprRef expr) {
+				return expr->type;
+			}
+
+			CSourceFunctionTypeRef TypeOf(CSourceFunction fn) {
+				return fn.d->ty;
+			}
+
+			CSourceExprRef BitCast(CSourceType to, CSourceExprRef value);
+			CSourceExprRef BitCastInt(CSourceExprRef value);
+			CSourceExprRef MathFn(const char* basename, CSourceExprRef lhs, CSourceExprRef rhs);
+			CSourceExprRef MathFn(const char* basename, CSourceExprRef up);
+
+			CSourceExprRef Coerce(CSourceType to, CSourceExprRef from);
+			CSourceExprRef LogicResult(CSourceExprRef truthValue, CSourceType resultType);
+
+			CSourceExprRef SizeOfPointer() {
+				return Expr("((int64_t)sizeof(void*))", CSourceType::Int64);
+			}
+
+			CSourceExprRef Load(CSourceExprRef pointer, CSourceType, int align = 0);
+			void Store(CSourceExprRef pointer, CSourceExprRef value, int align = 0);
+
+			CSourceExprRef BinaryOp(Nodes::Native::Opcode, CSourceExprRef lhs, CSourceExprRef rhs);
+			CSourceExprRef UnaryOp(Nodes::Native::Opcode, CSourceExprRef up);
+		};
+	}
+}
+
+namespace std {
+	template <> struct hash<K3::Backends::CSourceFunctionTypeRef> {
+		size_t operator()(const K3::Backends::CSourceFunctionTypeRef& r) const;
+	};
+}
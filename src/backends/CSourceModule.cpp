@@ -0,0 +1,279 @@
+#include "CSourceModule.h"
+#include "CSource.h"
+#include "Native.h"
+#include "SideEffectCompiler.h"
+#include "TLS.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace K3 {
+	namespace Backends {
+		int CSourceAoT(
+			const char* prefix,
+			const char* fileType,
+			std::ostream& object,
+			const char* engine,
+			const Kronos::ITypedGraph* itg,
+			const char* triple,
+			const char* mcpu,
+			const char* march,
+			const char* targetFeatures,
+			Kronos::BuildFlags flags) {
+
+			CSource compiler(new CSourceUnit, itg->Get(), *itg->_InternalTypeOfArgument(), *itg->_InternalTypeOfResult());
+			compiler.AoT(prefix, fileType, object, flags, triple, mcpu, march, targetFeatures);
+			return 1;
+		}
+
+		static std::string CString(const std::string& str) {
+			std::stringstream lit;
+			lit << "\"";
+			for (auto c : str) {
+				switch (c) {
+				case '"': lit << "\\\""; break;
+				case '\\': lit << "\\\\"; break;
+				case '\n': lit << "\\n"; break;
+				case '\t': lit << "\\t"; break;
+				default:
+					if (c >= ' ' && c < 127) lit << c;
+					else lit << "\\" << std::oct << ((int)c & 0xff) / 64 << ((int)c & 0x3f) / 8 << ((int)c & 7) << std::dec;
+				}
+			}
+			lit << "\"";
+			return lit.str();
+		}
+
+		static void WriteClassTypes(std::ostream& os) {
+#define F(T, L) "\t" #T " " #L ";\n"
+			os <<
+				"#ifndef KRT_CLASS_DEFINED\n"
+				"#define KRT_CLASS_DEFINED\n"
+				"typedef void* krt_instance;\n"
+				"struct krt_class;\n"
+				"typedef void(*krt_process_call)(krt_instance, void* output, int32_t numFrames);\n"
+				"typedef int64_t(*krt_get_size_call)(void);\n"
+				"typedef void(*krt_evaluate_call)(krt_instance, const void* input, void* output);\n"
+				"typedef void(*krt_constructor_call)(krt_instance, const void* input);\n"
+				"typedef void(*krt_destructor_call)(krt_instance);\n"
+				"typedef void**(*krt_get_slot_call)(krt_instance, int32_t slot_index);\n"
+				"typedef void(*krt_dispose_class_call)(struct krt_class*);\n"
+				"typedef void(*krt_configure_call)(int32_t slot_index, const void* data);\n"
+				"#pragma pack(push, 1)\n"
+				"struct krt_sym {\n" KRT_SYM_SPEC() "};\n"
+				"struct krt_class {\n" KRT_CLASS_SPEC() "\tstruct krt_sym symbols[];\n};\n"
+				"#pragma pack(pop)\n"
+				"#endif\n\n";
+#undef F
+		}
+
+		void CSourceSpec::AoT(const char *prefix, const char *fileType, std::ostream& os, Kronos::BuildFlags flags, const char* triple, const char *mcpu, const char *march, const char *mfeat) {
+			std::string pfx = prefix ? prefix : "";
+			M->prefix = pfx;
+
+			RegionAllocator alloc;
+			StandardBuild(AST, GetArgumentType(), GetResultType());
+
+			intermediateAST = Graph<Typed>(Backends::SideEffectTransform::Compile(
+				*this, intermediateAST, GetArgumentType(), GetResultType()));
+
+			Backends::AnalyzeCallGraph(0, intermediateAST, cgmap);
+
+			FunctionTy evalProc, initProc, sizeProc;
+
+			DriverSet initDrv;
+			initDrv.insert(DriverSignature(Type(&Reactive::InitializationDriver)));
+			initProc = CompilePass("Init", BuilderPass::Initialization, initDrv);
+			sizeProc = CompilePass("SizeOf", BuilderPass::Sizing, initDrv);
+			initProc.Complete();
+			sizeProc.Complete();
+
+			if ((flags & Kronos::OmitEvaluate) == 0) {
+				DriverSet evalDrv;
+				evalDrv.insert(DriverSignature(Type(&Reactive::ArgumentDriver)));
+				for (auto d : drivers) evalDrv.insert(d);
+				evalProc = CompilePass("Eval", BuilderPass::Evaluation, evalDrv);
+				evalProc.Complete();
+			}
+
+			std::unordered_map<Type, std::string> inputCall;
+			if ((flags & Kronos::OmitReactiveDrivers) == 0) {
+				std::unordered_set<Type> DriverSignatures;
+				for (auto driver : drivers) {
+					DriverSignature sig(driver);
+					if (sig.GetMetadata().IsNil() == false) {
+						DriverSignatures.insert(sig.GetMetadata());
+					}
+				}
+
+				for (auto driver : DriverSignatures) {
+					std::stringstream name;
+					name << driver;
+					std::string dn(name.str());
+
+					if (dn.size()) dn[0] = toupper(dn[0]);
+
+					for (unsigned i(1); i < dn.size(); ++i) {
+						if (!isalpha(dn[i - 1]) && isalpha(dn[i]))
+							dn[i] = toupper(dn[i]);
+					}
+
+					dn.erase(std::remove_if(dn.begin(), dn.end(), [](char c) {return !isalnum(c); }), dn.end());
+
+					FunctionTy callable{ GetActivation("Tick" + dn, intermediateAST, driver) };
+					inputCall.emplace(driver, callable.d->name);
+				}
+			}
+
+			size_t asz = GetArgumentType().GetSize(), rsz = GetResultType().GetSize();
+			int argumentIndex = asz ? GetArgumentIndex() : -1;
+
+			// symbol table, as in the LLVM backend
+			auto methods = globalKeyTable;
+			for (auto& ic : inputCall) {
+				if (methods.find(ic.first) == methods.end()) {
+					methods.emplace(ic.first, GlobalVarData{
+						nullptr,
+						K3::Type::Nil,
+						Nodes::GlobalVarType::External,
+						std::make_pair(1, 1),
+						K3::Type::Nil
+					});
+				}
+			}
+
+			methods.erase(Type::Pair(Type("unsafe"), Type("accumulator")));
+			int maxNoDefaultSlot = -1;
+			std::vector<std::string> symTableEntry;
+			for (auto& gv : methods) {
+				std::stringstream sym;
+				sym << gv.first;
+				if (sym.str() == "arg") continue;
+
+				auto trigger = inputCall.find(gv.first);
+				std::stringstream descr;
+				gv.second.data.OutputJSONTemplate(descr, false);
+
+				auto slotI = globalSymbolTable.find(gv.second.uid);
+				auto slotIndex = slotI != globalSymbolTable.end() ? std::int32_t(slotI->second) : -1;
+
+				bool constructorParameter =
+					((gv.second.varType == Nodes::GlobalVarType::External ||
+					  gv.second.varType == Nodes::GlobalVarType::Configuration)
+					 && globalKeyTable.find(gv.first) != globalKeyTable.end());
+
+				bool noDefaultVal = constructorParameter || gv.second.varType == Nodes::GlobalVarType::UnsafeExternal;
+
+				std::stringstream entry;
+				entry << "{ " << CString(sym.str()) << ", " << CString(descr.str()) << ", "
+					<< (trigger != inputCall.end() ? "(krt_process_call)" + trigger->second : "0") << ", "
+					<< gv.second.data.GetSize() << "LL, " << slotIndex << ", "
+					<< ((noDefaultVal ? KRT_FLAG_NO_DEFAULT : 0) |
+						(gv.second.varType == Nodes::GlobalVarType::Stream ? KRT_FLAG_BLOCK_INPUT : 0)) << " }";
+				symTableEntry.emplace_back(entry.str());
+
+				if (noDefaultVal && slotIndex > maxNoDefaultSlot) {
+					maxNoDefaultSlot = slotIndex;
+				}
+			}
+
+			auto sizeOfState = M->Global("sizeof_" + std::to_string((std::uintptr_t)(CTRef)intermediateAST), Int64Ty());
+			auto Sym = [&](const char* name) { return M->Symbol(name); };
+
+			std::stringstream evalArg, resultTy;
+			GetArgumentType().OutputJSONTemplate(evalArg, false);
+			GetResultType().OutputJSONTemplate(resultTy, false);
+
+			os << "/* Generated by the Kronos C source backend. */\n\n";
+			CSourceUnit::WritePrelude(os);
+			WriteClassTypes(os);
+			M->Write(os);
+
+			os << "int64_t " << Sym("GetSymbolOffset") << "(int64_t index) {\n"
+				<< "\treturn ((" << sizeOfState->code << " + " << GetBitmaskSize() << " + 31) & ~(int64_t)31) + index * (int64_t)sizeof(void*);\n"
+				<< "}\n\n";
+
+			os << "int64_t " << Sym("GetSize") << "(void) {\n"
+				<< "\t" << sizeProc.d->name << "((void**)0, (char*)0, (char*)0, (char*)0);\n"
+				<< "\treturn " << Sym("GetSymbolOffset") << "(" << GetNumSymbols() << ");\n"
+				<< "}\n\n";
+
+			int numInit = maxNoDefaultSlot + 1;
+			if (numInit) {
+				os << "static void* " << Sym("ExternalInit") << "[" << numInit << "];\n\n";
+			}
+
+			os << "void " << Sym("SetConfigurationSlot") << "(int32_t slot_index, const void* data) {\n";
+			if (numInit) {
+				os << "\tif (slot_index >= 0 && slot_index < " << numInit << ") " << Sym("ExternalInit") << "[slot_index] = (void*)data;\n";
+			} else {
+				os << "\t(void)slot_index; (void)data;\n";
+			}
+			os << "}\n\n";
+
+			os << "void " << Sym("Initialize") << "(krt_instance instance, const void* input) {\n"
+				<< "\tvoid** self = (void**)((char*)instance + " << Sym("GetSymbolOffset") << "(0));\n"
+				<< "\tKRT_ALIGN(16) char output[" << std::max<size_t>(rsz, 1) << "];\n";
+			if (numInit) {
+				os << "\tint32_t i;\n"
+					<< "\tfor (i = 0; i < " << numInit << "; ++i) if (!self[i]) self[i] = " << Sym("ExternalInit") << "[i];\n";
+			}
+			if (argumentIndex >= 0) {
+				os << "\tself[" << argumentIndex << "] = (void*)input;\n";
+			}
+			os << "\t" << initProc.d->name << "(self, (char*)instance, (char*)input, output);\n"
+				<< "}\n\n";
+
+			os << "void** " << Sym("GetValue") << "(krt_instance instance, int32_t slot_index) {\n"
+				<< "\treturn (void**)((char*)instance + " << Sym("GetSymbolOffset") << "(slot_index));\n"
+				<< "}\n\n";
+
+			if (evalProc) {
+				os << "void " << Sym("Evaluate") << "(krt_instance instance, const void* input, void* output) {\n"
+					<< "\tvoid** self = (void**)((char*)instance + " << Sym("GetSymbolOffset") << "(0));\n"
+					<< "\t" << evalProc.d->name << "(self, (char*)instance, (char*)input, (char*)output);\n"
+					<< "}\n\n";
+			}
+
+			os << "void " << Sym("Deinitialize") << "(krt_instance instance) {\n"
+				<< "\t(void)instance;\n"
+				<< "}\n\n";
+
+			os << "#pragma pack(push, 1)\n"
+				<< "static struct {\n";
+#define F(T, L) "\t" #T " " #L ";\n"
+			os << KRT_CLASS_SPEC();
+#undef F
+			os << "\tstruct krt_sym symbols[" << std::max<size_t>(symTableEntry.size(), 1) << "];\n"
+				<< "} " << Sym("Class") << " = {\n"
+				<< "\t" << Sym("SetConfigurationSlot") << ",\n"
+				<< "\t" << Sym("GetSize") << ",\n"
+				<< "\t" << Sym("Initialize") << ",\n"
+				<< "\t" << Sym("GetValue") << ",\n"
+				<< "\t" << (evalProc ? Sym("Evaluate") : "0") << ",\n"
+				<< "\t" << Sym("Deinitialize") << ",\n"
+				<< "\t0,\n"
+				<< "\t" << CString(evalArg.str()) << ",\n"
+				<< "\t" << CString(resultTy.str()) << ",\n"
+				<< "\t0,\n"
+				<< "\t" << asz << "LL,\n"
+				<< "\t" << rsz << "LL,\n"
+				<< "\t" << GetStateLayout() << "LL,\n"
+				<< "\t" << symTableEntry.size() << ",\n"
+				<< "\t{\n";
+			for (auto& e : symTableEntry) {
+				os << "\t\t" << e << ",\n";
+			}
+			if (symTableEntry.empty()) {
+				os << "\t\t{ 0 }\n";
+			}
+			os << "\t}\n"
+				<< "};\n"
+				<< "#pragma pack(pop)\n\n";
+
+			os << "struct krt_class* " << Sym("GetClassData")  << "(void) {\n"
+				<< "\treturn (struct krt_class*)&" << Sym("Class") << ";\n"
+				<< "}\n";
+		}
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "kronosrt.h"
+#include "GenericModule.h"
+#include "Reactive.h"
+#include "CSourceCompiler.h"
+
+namespace K3 {
+	namespace Backends {
+		using K3::Reactive::DriverSet;
+
+		struct CSourceSpec : public GenericEmitterSpec<CSourceTypes, CSourceTransform> {
+			CSourceSpec(CSourceUnitRef M, CTRef AST, const Type& arg, const Type& res) :GenericEmitterSpec(M, AST, arg, res) {}
+
+			void AoT(const char *prefix, const char *fileType, std::ostream& writeToStream, Kronos::BuildFlags flags, const char* triple, const char *mcpu, const char *march, const char *mfeat) override;
+
+			krt_class* JIT(Kronos::BuildFlags flags) override { KRONOS_UNREACHABLE; }
+		};
+
+		using CSource = GenericCodeGen<CSourceSpec>;
+	}
+}
@@ -61,12 +61,7 @@ namespace K3 {
 
 		struct dshash {
 			size_t operator()(const Reactive::DriverSet& ds) const {
-				// drivers may be stored in different order for small sets.
-				// thus use a crappy xor hash combinator to ensure order
-				// is transparent to hash.
-				size_t hash(0);
-				ds.for_each([&](const Type& t) { hash ^= t.GetHash(); });
-				return hash;
+				return ds.Hash();
 			}
 		};
 	};
@@ -1,7 +1,258 @@
 #pragma once
 
+#include "backends/GenericCompiler.h"
+#include "CodeGenModule.h"
+#include "Reactive.h"
+#include "Transform.h"
+#include "TLS.h"
+
+#include <unordered_map>
+#include <vector>
+
 namespace K3 {
 	namespace Backends {
+		/* Scaffolding shared by the emitters that build their own code representation
+		   rather than LLVM IR. TEmit names the emitter types:
+
+		   ModuleTy, FunctionTyTy, FunctionTy, TypeTy, ValueTy, VariableTy, BuilderTy, BlockTy
+
+		   TypeTy must enumerate Ptr, Void, Int32, Int64, Float32 and Float64. */
+		template <typename TEmit> struct GenericEmitterModule {
+			using ModuleTy = typename TEmit::ModuleTy;
+			using FunctionTyTy = typename TEmit::FunctionTyTy;
+			using FunctionTy = typename TEmit::FunctionTy;
+			using TypeTy = typename TEmit::TypeTy;
+			using ValueTy = typename TEmit::ValueTy;
+			using VariableTy = typename TEmit::VariableTy;
+			using BuilderTy = typename TEmit::BuilderTy;
+			using BlockTy = typename TEmit::BlockTy;
+
+			ModuleTy M;
+
+			GenericEmitterModule(ModuleTy M) :M(M) {}
+
+			FunctionTyTy CreateFunctionTy(TypeTy ret, const std::vector<TypeTy>& params) {
+				return { params, ret };
+			}
+
+			FunctionTy CreateFunction(const std::string& name, FunctionTyTy ty, bool externalLinkage) {
+				return { M, name, externalLinkage, ty };
+			}
+
+			FunctionTy CreateFunction(const std::string& name, TypeTy ret, const std::vector<TypeTy>& params, bool externalLinkage) {
+				return { M, name, externalLinkage, CreateFunctionTy(ret, params) };
+			}
+
+			FunctionTyTy GetFunctionTy(FunctionTy fn) {
+				return fn.d->ty;
+			}
+
+			// defined by each emitter
+			ValueTy Intern(const char*);
+			ValueTy InternZeroBytes(const void* uid, size_t numBytes);
+			ValueTy InternConstantBlob(const void* data, size_t numBytes);
+
+			TypeTy PtrTy() { return TypeTy::Ptr; }
+			TypeTy VoidTy() { return TypeTy::Void; }
+			TypeTy Int32Ty() { return TypeTy::Int32; }
+			TypeTy Int64Ty() { return TypeTy::Int64; }
+			TypeTy Float32Ty() { return TypeTy::Float32; }
+			TypeTy Float64Ty() { return TypeTy::Float64; }
+			TypeTy BoolTy() { return Int32Ty(); }
+		};
+
+		template <typename TEmit> struct GenericEmitterBase : public GenericEmitterModule<TEmit>, public CodeGenTransformBase {
+			using ValueTy = typename TEmit::ValueTy;
+			GenericEmitterBase(CTRef root, typename TEmit::ModuleTy M, ICompilationPass& gp) :GenericEmitterModule<TEmit>(M), CodeGenTransformBase(gp) {}
+			virtual ValueTy operator()(CTRef n) = 0;
+			virtual void OpenBranch() = 0;
+			virtual void CloseBranch() = 0;
+		};
+
+		/* Tracks the value of each node, once for straight line code and once more for the
+		   active branch of a driver. TTransform is the concrete transform that nodes
+		   dispatch their code generation on. */
+		template <typename TEmit, typename TTransform> class GenericEmitterValueTransform : public GenericEmitterTransform<GenericEmitterBase<TEmit>> {
+			using BaseTy = GenericEmitterTransform<GenericEmitterBase<TEmit>>;
+
+			struct ValueState {
+				typename TEmit::VariableTy var;
+				int idx = -1;
+				bool completed[2] = { false,false };
+			};
+
+			using StateMapTy = std::unordered_map<CTRef, ValueState>;
+			StateMapTy values;
+			bool inBranch = false;
+		public:
+			using ModuleTy = typename TEmit::ModuleTy;
+			using FunctionTyTy = typename TEmit::FunctionTyTy;
+			using FunctionTy = typename TEmit::FunctionTy;
+			using TypeTy = typename TEmit::TypeTy;
+			using ValueTy = typename TEmit::ValueTy;
+			using BuilderTy = typename TEmit::BuilderTy;
+			using BlockTy = typename TEmit::BlockTy;
+			using IGenericCompilationPass = typename BaseTy::IGenericCompilationPass;
+			using DriverFilterTy = typename BaseTy::GenericDriverActivityFilter;
+
+			void OpenBranch() override {
+				assert(!inBranch);
+				inBranch = true;
+				for (auto& v : values) {
+					v.second.completed[0] = v.second.completed[1] = true;
+				}
+			}
+
+			void CloseBranch() override {
+				inBranch = false;
+				for (auto& v : values) {
+					v.second.completed[0] = v.second.completed[1] = true;
+				}
+			}
+
+			ValueTy operator()(CTRef n) override {
+				// flatten deps to avoid redundant lvar chains
+				if (IsOfExactType<Deps>(n)) {
+					n = n->GetUp(0);
+				}
+
+				auto& state{ values[n] };
+				auto& current{ this->current };
+
+				int activeI = (inBranch && this->currentActivityMask != nullptr) ? 1 : 0;
+
+				if (state.completed[activeI]) {
+					return state.var;
+				}
+
+				ValueTy val = (ValueTy)n->Compile(static_cast<TTransform&>(*this), this->currentActivityMask);
+				if (!val) return val;
+
+				if (inBranch) {
+					// values computed in both the active and passive branch share a local
+					if (!state.completed[0] && !state.completed[1]) {
+						state.idx = current.LVar(n->GetLabel(), val->type);
+					}
+					current.Set(state.idx, val);
+					state.var = typename TEmit::VariableTy{ current.Get(state.idx) };
+				} else {
+					state.var = current.TmpVar(val);
+				}
+
+				state.completed[activeI] = true;
+				return state.var;
+			}
+
+			ValueTy operator()(CTRef n, ActivityMaskVector* avm) {
+				this->currentActivityMask = avm; auto tmp = (*this)(n);
+				return tmp;
+			}
+
+			GenericEmitterValueTransform(ModuleTy M, CTRef root, IGenericCompilationPass& pass) :BaseTy(pass, root, M) {}
+
+			FunctionTy Build(const char *label, CTRef body, const std::vector<TypeTy>& params) override {
+				auto buildType{ this->CreateFunctionTy(this->PtrTy(), params) };
+
+				auto memoized{ this->GetCompilationPass().GetMemoized(body, buildType) };
+				if (memoized) return memoized;
+
+				auto build = this->CreateFunction(this->GetCompilationPass().GetCompilationPassName() + "_" + label, buildType, false);
+
+				DriverFilterTy knownActiveMasks{ this->compilation, this->currentActivityMask };
+
+				TTransform subroutineBuilder{
+					this->compilation.GetModule(),
+					body,
+					(this->currentActivityMask && this->currentActivityMask->size()) ? knownActiveMasks : this->GetCompilationPass()
+				};
+
+				return TLS::WithNewStack([&]() {
+					subroutineBuilder.BuildSubroutineBody(build, label, body, params);
+					return build;
+				});
+			}
+		};
+
+		/* Compiles the passes of a class with TTransform. The emitter specific class
+		   builder derives from this and implements AoT or JIT. */
+		template <typename TEmit, typename TTransform> struct GenericEmitterSpec : public CodeGenModule, public GenericEmitterModule<TEmit> {
+			using ModuleTy = typename TEmit::ModuleTy;
+			using FunctionTyTy = typename TEmit::FunctionTyTy;
+			using FunctionTy = typename TEmit::FunctionTy;
+			using TypeTy = typename TEmit::TypeTy;
+
+			CTRef AST;
+
+			GenericEmitterSpec(ModuleTy M, CTRef AST, const Type& arg, const Type& res) :CodeGenModule(arg, res), GenericEmitterModule<TEmit>(M), AST(AST) {}
+
+			~GenericEmitterSpec() {
+				delete this->M;
+			}
+
+			FunctionTy CompilePass(const std::string& name, Backends::BuilderPass passCategory, const Reactive::DriverSet& drivers) {
+				CounterIndiceSet emptySet;
+				return CompilePass(name, passCategory, drivers, emptySet);
+			}
+
+			FunctionTy CompilePass(const std::string& name, Backends::BuilderPass passCategory, const Reactive::DriverSet& drivers, const CounterIndiceSet& counters) {
+				using FunctionKey = std::tuple<Graph<const Typed>, FunctionTyTy>;
+
+				struct FunctionKeyHash {
+					size_t operator()(const FunctionKey& fk) const {
+						return std::get<Graph<const Typed>>(fk)->GetHash() ^ std::hash<FunctionTyTy>()(std::get<FunctionTyTy>(fk));
+					}
+				};
+
+				struct Pass : TTransform::IGenericCompilationPass, CodeGenPass {
+					GenericEmitterSpec& build;
+					Backends::BuilderPass passType;
+
+					using FunctionCacheTy = std::unordered_map<FunctionKey, FunctionTy, FunctionKeyHash>;
+					FunctionCacheTy cache;
+
+					Pass(CTRef ast, GenericEmitterSpec& s, const std::string& l, Backends::BuilderPass pt, const CounterIndiceSet& counters) :build(s), CodeGenPass(l, ast, counters), passType(pt) {}
+
+					ModuleTy& GetModule() override {
+						return build.M;
+					}
+
+					FunctionTy GetMemoized(CTRef body, FunctionTyTy fty) override {
+						auto f{ cache.find(FunctionKey{body, fty}) };
+						return f != cache.end() ? f->second : FunctionTy{};
+					}
+
+					void Memoize(CTRef body, FunctionTyTy fty, FunctionTy fn) override {
+						cache.emplace(FunctionKey{ Graph<const Typed>{body}, fty }, fn);
+					}
+
+					DriverActivity IsDriverActive(const K3::Type& driverID) override {
+						return CodeGenPass::IsDriverActive(driverID);
+					}
+
+					Backends::BuilderPass GetPassType() override {
+						return passType;
+					}
+
+					void SetPassType(Backends::BuilderPass bp) override {
+						passType = bp;
+					}
+
+					const Backends::CallGraphNode* GetCallGraphAnalysis(const Subroutine* subr) override { return build.GetCallGraphData(subr); }
+
+					const std::string& GetCompilationPassName() override { return label; }
+
+				} codeGenPass{ intermediateAST, *this, name, passCategory, counters };
+
+				drivers.for_each([&codeGenPass](const Type& d) {
+					codeGenPass.insert(d);
+				});
+
+				TTransform codeGen{ this->M, intermediateAST, codeGenPass };
+				std::vector<TypeTy> paramTys(3, this->PtrTy());
+				return codeGen.Build(name.c_str(), intermediateAST, paramTys);
+			}
 
+			virtual FunctionTy GetActivation(const std::string& nameTemplate, CTRef graph, const Type& signature) = 0;
+		};
 	}
-}
\ No newline at end of file
+}
@@ -140,6 +140,14 @@ namespace K3 {
 
 			FunctionTy CurrentFunction() { return currentFn; }
 
+			// runs 'body' with the transform emitting into 'b', for nodes that build their own blocks
+			template <typename TBody> void EmitInto(BuilderTy& b, TBody body) {
+				auto old = current;
+				current = b;
+				body();
+				current = old;
+			}
+
 			template <typename... TArgs>
 			GenericEmitterTransform(IGenericCompilationPass& gp, CTRef root, ModuleTy M) :compilation(gp), TCodeGen(root, M, gp) {}
 			GenericEmitterTransform(const GenericEmitterTransform& parent, CTRef root) :compilation(parent.compilation), TCodeGen(root, parent) {}
@@ -20,12 +20,7 @@ namespace K3 {
 
 			struct dshash {
 				size_t operator()(const Reactive::DriverSet& ds) const {
-					                                    // drivers may be stored in different order for small sets.
-					                                    // thus use a crappy xor hash combinator to ensure order
-						                                // is transparent to hash.
-					size_t hash(0);
-					ds.for_each([&](const Type& t) { hash ^= t.GetHash(); });
-					return hash;
+					return ds.Hash();
 				}
 			};		
 
@@ -224,12 +219,12 @@ namespace K3 {
 
 									stub.If(test, [=](BuilderTy& then_) {
 										then_.SetSlot(slotIndex,
-													  then_.AddInt32(then_.PtrToInt(then_.GetSlot(slotIndex)),
+													  then_.Offset(then_.GetSlot(slotIndex),
 																then_.Const((int)vk.second.data.GetSize())));
 									});
 								} else {
 									stub.SetSlot(slotIndex,
-												  stub.AddInt32(stub.PtrToInt(stub.GetSlot(slotIndex)),
+												  stub.Offset(stub.GetSlot(slotIndex),
 															stub.Const((int)vk.second.data.GetSize())));
 								}
 							}
@@ -364,7 +359,7 @@ namespace K3 {
 
 						auto subpVar = b.LVar("subphase", Int32Ty());
 						auto counter = b.LVar("remainderCount", Int32Ty());
-						auto outFrame = b.LVar("outFrame", Int32Ty());
+						auto outFrame = b.LVar("outFrame", PtrTy());
 						b.Set(counter, b.Const(0));
 						b.Set(subpVar, initSubPhase);
 						b.Set(outFrame, output);
@@ -380,7 +375,7 @@ namespace K3 {
 									[=](BuilderTy& done) {
 										done.Ret();
 								});
-								auto frameOut = frame.TmpVar(frame.Get(outFrame, Int32Ty()));
+								auto frameOut = frame.TmpVar(frame.Get(outFrame, PtrTy()));
 								frame.Set(outFrame, frame.Offset(frameOut, frame.Const((int)GetResultType().GetSize())));
 
 								if (mixBusKey != globalKeyTable.end()) {
@@ -21,5 +21,8 @@ namespace K3 {
 		krt_class* LLVMJiT(const char* engine,
 						   const Kronos::ITypedGraph* itg,
 						   Kronos::BuildFlags flags);
+
+		// -1 if the class is not profile instrumented, 0 while collecting, 1 when ready to rebuild
+		int LLVMProfileStatus(const krt_class*);
 	}
 }
\ No newline at end of file
@@ -95,6 +95,10 @@ namespace K3 {
 			std::unique_ptr<llvm::Module> M;
 			std::swap(M, GetModule());
 
+			if (flags & Kronos::FlushDenormals) {
+				FlushDenormalsOnEntry(*M, Triple(smtriple));
+			}
+
 			LLVMOptimize(*M, (llvm::CodeGenOpt::Level)CL::OptLevel());
 
 			if (prefix) {
@@ -5,5 +5,8 @@
 namespace CL {
 	extern CmdLine::Option<int> OptLevel;
     extern CmdLine::Option<string> LlvmHeader;
+    extern CmdLine::Option<int> JitPGO;
+    extern CmdLine::Option<int> JitTune;
+    extern CmdLine::Option<int> MathUlp;
 };
 
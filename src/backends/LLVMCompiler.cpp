@@ -2,6 +2,7 @@
 #include "common/PlatformUtils.h"
 
 #include "LLVMCompiler.h"
+#include "LLVMVectorMath.h"
 #include "Native.h"
 #include "NativeVector.h"
 #include "Reactive.h"
@@ -1265,15 +1266,19 @@ namespace K3 {
 					return Val(b.CreateCall(
 						Intrinsic::getDeclaration(lt.GetModule().get(), Intrinsic::sqrt, lt.GetType(FixedResult())), up, "sqrt"));
 				case Cos:
+					if (auto vm = VectorMath::Get(*lt.GetModule(), "cos", lt.GetType(FixedResult()))) return Val(b.CreateCall(vm, up, "cos"));
 					return Val(b.CreateCall(
 						Intrinsic::getDeclaration(lt.GetModule().get(), Intrinsic::cos, lt.GetType(FixedResult())), up, "cos"));
 				case Sin:
+					if (auto vm = VectorMath::Get(*lt.GetModule(), "sin", lt.GetType(FixedResult()))) return Val(b.CreateCall(vm, up, "sin"));
 					return Val(b.CreateCall(
 						Intrinsic::getDeclaration(lt.GetModule().get(), Intrinsic::sin, lt.GetType(FixedResult())), up, "sin"));
 				case Exp:
+					if (auto vm = VectorMath::Get(*lt.GetModule(), "exp", lt.GetType(FixedResult()))) return Val(b.CreateCall(vm, up, "exp"));
 					return Val(b.CreateCall(
 						Intrinsic::getDeclaration(lt.GetModule().get(), Intrinsic::exp, lt.GetType(FixedResult())), up, "exp"));
 				case Log:
+					if (auto vm = VectorMath::Get(*lt.GetModule(), "log", lt.GetType(FixedResult()))) return Val(b.CreateCall(vm, up, "log"));
 					return Val(b.CreateCall(
 						Intrinsic::getDeclaration(lt.GetModule().get(), Intrinsic::log, lt.GetType(FixedResult())), up, "log"));
 				case Log10:
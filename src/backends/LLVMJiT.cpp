@@ -6,12 +6,17 @@
 #include "llvm/Support/TargetRegistry.h"
 
 #include "LLVMCmdLine.h"
+#include "LLVMProfile.h"
+#include "LLVMTuning.h"
+#include "CompilerProfile.h"
 
 #define DUMP_JIT_IR 0
 //#define DUMP_JIT_GENERATED
 
 namespace CL {
     extern CmdLine::Option<int> OptLevel;
+	CmdLine::Option<int> JitPGO(0, "--jit-pgo", "-pgo", "<blocks>", "instrument JiT builds for <blocks> driver activations, then rebuild with the measured branch weights");
+	CmdLine::Option<int> JitTune(0, "--jit-tune", "-tune", "<blocks>", "time candidate inlining, unrolling and vectorization settings over <blocks> audio blocks and JiT each class with the fastest; choices are cached per typed graph");
 }
 
 llvm::TargetOptions GetTargetOptions(Kronos::BuildFlags flags);
@@ -26,9 +31,9 @@ namespace K3 {
             std::clog << "\n -- " << label << "\n" << str;
         }
         
-        void LLVMOptimize(llvm::Module& m, llvm::CodeGenOpt::Level optLevel);
+        void LLVMOptimize(llvm::Module& m, llvm::CodeGenOpt::Level optLevel, const Tuning::Parameters&);
 
-        krt_class* LLVM::JIT(Kronos::BuildFlags flags) {
+        krt_class* LLVM::JIT(Kronos::BuildFlags flags, int optLevel, const Tuning::Parameters* tuning) {
             using namespace llvm;
             
             if (!GetModule()) return nullptr;
@@ -51,7 +56,28 @@ namespace K3 {
             std::swap(consumeModule, GetModule());
             
             consumeModule->setTargetTriple(llvm::sys::getProcessTriple());
-			LLVMOptimize(*consumeModule, (CodeGenOpt::Level)CL::OptLevel());
+
+			if (flags & Kronos::FlushDenormals) {
+				FlushDenormalsOnEntry(*consumeModule, Triple(consumeModule->getTargetTriple()));
+			}
+
+			bool instrumented = false;
+			std::uint64_t profileKey = 0;
+			size_t numEdges = 0;
+			if (CL::JitPGO() > 0 && optLevel > 0) {
+				profileKey = PGO::ModuleKey(*consumeModule, graphHash);
+				if (PGO::IsComplete(profileKey)) {
+					PGO::AttachBranchWeights(*consumeModule, profileKey);
+				} else {
+					std::vector<llvm::Function*> drivers;
+					for (auto& ic : inputCall) drivers.emplace_back(ic.second);
+					numEdges = PGO::Instrument(*consumeModule, drivers);
+					instrumented = true;
+				}
+			}
+
+			LLVMOptimize(*consumeModule, (CodeGenOpt::Level)optLevel,
+						 tuning ? *tuning : Tuning::Parameters::ForOptLevel(optLevel));
 
 #if DUMP_JIT_IR
 			Dump("jit", *consumeModule);
@@ -69,13 +95,14 @@ namespace K3 {
             
 			builder.setTargetOptions(opts);
             
-            switch(CL::OptLevel()) {
+            switch(optLevel) {
                 default: builder.setOptLevel(CodeGenOpt::None); break;
                 case 1: builder.setOptLevel(CodeGenOpt::Less); break;
                 case 2: builder.setOptLevel(CodeGenOpt::Default); break;
                 case 3: builder.setOptLevel(CodeGenOpt::Aggressive); break;
             }
             
+            Profile::Phase profile("llvm", "MCJIT");
             auto jit = builder.create();
             if (!jit) {
                 throw std::runtime_error("LLVM Execution Engine error: " + builderError);
@@ -95,6 +122,17 @@ namespace K3 {
                 auto ee = (llvm::ExecutionEngine*)c->pimpl;
                 delete ee;
             };
+
+			if (instrumented) {
+				PGO::Register(profileKey, jitClass,
+							  (const std::uint64_t*)jit->getGlobalValueAddress("ProfileEdgeCounters"), numEdges,
+							  (const std::uint64_t*)jit->getGlobalValueAddress("ProfileBlockCounter"));
+				jitClass->dispose_class = [](struct krt_class *c) {
+					PGO::Retire(c);
+					auto ee = (llvm::ExecutionEngine*)c->pimpl;
+					delete ee;
+				};
+			}
             
             RTDyldMM->invalidateInstructionCache();
             
@@ -1,6 +1,7 @@
 #pragma warning(disable: 4267 4244 4146)
 #include "llvm/Support/Host.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/IR/Intrinsics.h"
 #include "LLVMUtil.h"
 #include "llvm/Support/raw_os_ostream.h"
 
@@ -21,6 +22,8 @@
 #include "kronosrt.h"
 
 #include "LLVMCmdLine.h"
+#include "LLVMProfile.h"
+#include "LLVMTuning.h"
 
 namespace CL {
 	CmdLine::Option<string> LlvmHeader(std::string(""), "--llvm-header", "-H", "<path>", "write a C/C++ header for the LLVM-generated object to <path>, '-' for stdout");
@@ -352,7 +355,7 @@ namespace K3 {
 					}
 							
 					if (trigger != inputCall.end()) {
-						cppHeader.DeclareDriver(trigger->second->getName());
+						cppHeader.DeclareDriver(sym.str(), trigger->second->getName());
 					}
                     
                     bool noDefaultVal = constructorParameter || gv.second.varType == UnsafeExternal;
@@ -431,6 +434,7 @@ namespace K3 {
 					ir.nullConstant<void*>(),
 					ir.constant(std::int64_t(GetArgumentType().GetSize())),
 					ir.constant(std::int64_t(GetResultType().GetSize())),
+					ir.constant(GetStateLayout()),
 					ir.constant(std::int32_t(symTableEntry.size())),
 					symTableInit
 				});
@@ -1046,8 +1050,46 @@ namespace K3 {
 			intermediateAST = Graph<Typed>(Backends::SideEffectTransform::Compile(
 				*this, intermediateAST, GetArgumentType(), GetResultType()));
 			//cout << "[Generating LLVM IR]\n";
+			Profile::Phase profile("llvm", "MakeIR");
 			MakeIR(flags);
 		}
+
+		void LLVM::FlushDenormalsOnEntry(llvm::Module& m, const llvm::Triple& target) {
+			using namespace llvm;
+			// MXCSR.FTZ | MXCSR.DAZ
+			const std::uint32_t flushBits = 0x8040;
+			if (target.getArch() != Triple::x86 && target.getArch() != Triple::x86_64) return;
+
+			auto stmxcsr = Intrinsic::getDeclaration(&m, Intrinsic::x86_sse_stmxcsr);
+			auto ldmxcsr = Intrinsic::getDeclaration(&m, Intrinsic::x86_sse_ldmxcsr);
+
+			for (auto& ic : inputCall) {
+				auto driver = ic.second;
+				if (driver->isDeclaration()) continue;
+
+				IRBuilder<> b(&*driver->getEntryBlock().getFirstInsertionPt());
+				auto saved = b.CreateAlloca(b.getInt32Ty(), nullptr, "mxcsr");
+				auto flushing = b.CreateAlloca(b.getInt32Ty(), nullptr, "mxcsr_flush");
+				auto current = b.CreateAlloca(b.getInt32Ty(), nullptr, "mxcsr_exit");
+				b.CreateCall(stmxcsr, { b.CreateBitCast(saved, b.getInt8PtrTy()) });
+				b.CreateStore(b.CreateOr(b.CreateLoad(saved), b.getInt32(flushBits)), flushing);
+				b.CreateCall(ldmxcsr, { b.CreateBitCast(flushing, b.getInt8PtrTy()) });
+
+				// restore the caller's FTZ/DAZ bits on every exit, keeping any other
+				// MXCSR changes such as sticky exception flags raised by the driver
+				for (auto& bb : *driver) {
+					if (auto ret = dyn_cast<ReturnInst>(bb.getTerminator())) {
+						IRBuilder<> r(ret);
+						r.CreateCall(stmxcsr, { r.CreateBitCast(current, r.getInt8PtrTy()) });
+						auto restored = r.CreateOr(
+							r.CreateAnd(r.CreateLoad(current), r.getInt32(~flushBits)),
+							r.CreateAnd(r.CreateLoad(saved), r.getInt32(flushBits)));
+						r.CreateStore(restored, current);
+						r.CreateCall(ldmxcsr, { r.CreateBitCast(current, r.getInt8PtrTy()) });
+					}
+				}
+			}
+		}
       
 		int LLVMAoT(
 			const char* prefix,
@@ -1065,11 +1107,50 @@ namespace K3 {
 			return 1;
 		}
 
+		// builds 'itg' once per candidate setting, times each, and keeps the fastest
+		static krt_class* TunedJiT(const Kronos::ITypedGraph* itg, Kronos::BuildFlags flags, int optLevel) {
+			auto build = [&](const Tuning::Parameters& p) {
+				K3::Backends::LLVM compiler(itg->Get(), *itg->_InternalTypeOfArgument(), *itg->_InternalTypeOfResult());
+				compiler.SetGraphHash(itg->_GetGraphHash());
+				return compiler.JIT(flags, optLevel, &p);
+			};
+
+			auto key = (itg->_GetGraphHash() ^ (std::uint64_t)flags) * 0x100000001b3ull + (std::uint64_t)optLevel;
+			Tuning::Parameters chosen;
+			if (!Tuning::Lookup(key, chosen)) {
+				chosen = Tuning::Parameters::ForOptLevel(optLevel);
+				double best = -1;
+				for (auto& candidate : Tuning::Candidates(optLevel)) {
+					auto cls = build(candidate);
+					auto ns = Tuning::Measure(cls, CL::JitTune());
+					cls->dispose_class(cls);
+					// without an audio driver there is nothing to measure
+					if (ns < 0) break;
+					if (best < 0 || ns < best) {
+						best = ns;
+						chosen = candidate;
+					}
+				}
+				Tuning::Record(key, chosen, best);
+			}
+			return build(chosen);
+		}
+
 		krt_class* LLVMJiT(const char* engine,
 						   const Kronos::ITypedGraph* itg,
 						   Kronos::BuildFlags flags) {
-			K3::Backends::LLVM compiler(itg->Get(), *itg->_InternalTypeOfArgument(), *itg->_InternalTypeOfResult());			
-			return compiler.JIT(flags);
-		}        
+			// the quick engine trades code quality for build latency; meant for code that runs once
+			bool quick = std::string(engine) == "llvm-quick";
+			int optLevel = quick ? 0 : CL::OptLevel();
+			if (optLevel > 0 && CL::JitTune() > 0) return TunedJiT(itg, flags, optLevel);
+
+			K3::Backends::LLVM compiler(itg->Get(), *itg->_InternalTypeOfArgument(), *itg->_InternalTypeOfResult());
+			compiler.SetGraphHash(itg->_GetGraphHash());
+			return compiler.JIT(flags, optLevel);
+		}
+
+		int LLVMProfileStatus(const krt_class* cls) {
+			return PGO::Status(cls);
+		}
 	}
 }
@@ -3,8 +3,10 @@
 #include "CodeGenCompiler.h"
 #pragma warning (disable: 4146)
 #include "LLVMCompiler.h"
+#include "LLVMTuning.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/ADT/Triple.h"
 #include "llvm/ExecutionEngine/MCJIT.h"
 
 #include <fstream>
@@ -49,6 +51,17 @@ namespace K3 {
 				std::string name;
 			};
 
+			// block processing wrapper; only generated for programs with an all-float audio driver
+			std::string audioDriver, audioInput, sampleRate;
+			bool sampleRateIsConfiguration = false;
+			int numAudioInputs = 0, numAudioOutputs = 0;
+			bool floatOutput = false;
+
+			static bool AllFloat(const std::vector<std::string>& members) {
+				for (auto& m : members) if (m != "float") return false;
+				return true;
+			}
+
 		public:
 			
 			void Open(std::string path, std::string prefix, const Type& input, const Type& output) {
@@ -64,6 +77,11 @@ namespace K3 {
 				argumentType = GenerateType(prefix + "InputType", input);
 				resultType = GenerateType(prefix + "OutputType", output);
 
+				std::vector<std::string> outputMembers;
+				GenerateMembers(output, outputMembers);
+				numAudioOutputs = (int)outputMembers.size();
+				floatOutput = numAudioOutputs > 0 && AllFloat(outputMembers);
+
 				header << "\ntypedef void* " << opaqueInstance << ";\n\n";
 
 				header
@@ -143,16 +161,23 @@ namespace K3 {
 						header << cv.name;
 					}
 
-					header << "); }\n\t~" << wrapperName << "() { if (instance) free(instance); }\n"
+					// the block processor owns frame buffers and a sample rate the instance points to
+					bool blockProcess = audioDriver.size() && floatOutput;
+
+					header << "); }\n\t~" << wrapperName << "() { if (instance) free(instance);" << (blockProcess ? " releaseFrames();" : "") << " }\n"
 						//<< "#if __cplusplus > 199711L\n"
 						<< "\t"
 						<< wrapperName << "(" << wrapperName << " const&) = delete;\n\t"
-						<< wrapperName << "(" << wrapperName << "&& from) { instance = from.instance; from.instance = nullptr; };\n\t"
+						<< wrapperName << "(" << wrapperName << "&& from) { instance = from.instance; from.instance = nullptr;" << (blockProcess ? " swapFrames(from);" : "") << " };\n\t"
 						<< "void operator=(" << wrapperName << " const&) = delete;\n\t"
-						<< wrapperName << "& operator=(" << wrapperName << "&& from) { auto tmp = from.instance; from.instance = instance; instance = tmp; return *this; }\n"
+						<< wrapperName << "& operator=(" << wrapperName << "&& from) { auto tmp = from.instance; from.instance = instance; instance = tmp;" << (blockProcess ? " swapFrames(from);" : "") << " return *this; }\n"
 						// << "#endif\n"
 						"\n";
 
+					if (blockProcess) {
+						DeclareBlockProcess(wrapperName);
+					}
+
 					header 
 						<< classWrapper.rdbuf() << "};\n";
 					
@@ -228,7 +253,91 @@ namespace K3 {
 				}
 			}
 
-			void DeclareDriver(std::string linkerSymbol) {
+			void DeclareBlockProcess(const std::string& wrapperName) {
+				bool instanceRate = sampleRate.size() && !sampleRateIsConfiguration;
+				classWrapper
+					<< "\n\t// block processing with planar buffers; prepare allocates, process does not\n"
+					<< "\tstatic const int NumInputs = " << numAudioInputs << ", NumOutputs = " << numAudioOutputs << ";\n"
+					<< "private:\n"
+					<< "\tint maxFrames = 0;\n"
+					<< "\tfloat* inputFrames = nullptr;\n"
+					<< "\tfloat* outputFrames = nullptr;\n";
+				if (instanceRate) {
+					classWrapper
+						<< "\tfloat sampleRateValue = 44100.f;\n"
+						<< "\tvoid bindSampleRate() { if (instance) ::" << className << "Set" << sampleRate << "(instance, &sampleRateValue); }\n";
+				} else if (sampleRate.size()) {
+					classWrapper
+						<< "\t// configuration is class-wide, so every instance shares this rate\n"
+						<< "\tstatic float& classSampleRate() { static float rate = 44100.f; return rate; }\n";
+				}
+				classWrapper
+					<< "\tvoid releaseFrames() { free(inputFrames); free(outputFrames); inputFrames = outputFrames = nullptr; maxFrames = 0; }\n"
+					<< "\t// instances point at the sample rate of their wrapper, so it moves along with them\n"
+					<< "\tvoid swapFrames(" << wrapperName << "& other) {\n"
+					<< "\t\tint mf = maxFrames; maxFrames = other.maxFrames; other.maxFrames = mf;\n"
+					<< "\t\tfloat* in = inputFrames; inputFrames = other.inputFrames; other.inputFrames = in;\n"
+					<< "\t\tfloat* out = outputFrames; outputFrames = other.outputFrames; other.outputFrames = out;\n";
+				if (instanceRate) {
+					classWrapper
+						<< "\t\tfloat sr = sampleRateValue; sampleRateValue = other.sampleRateValue; other.sampleRateValue = sr;\n"
+						<< "\t\tbindSampleRate(); other.bindSampleRate();\n";
+				}
+				classWrapper
+					<< "\t}\n"
+					<< "public:\n"
+					<< "\tvoid prepare(float sampleRate, int maxBlock) {\n"
+					<< "\t\tif (maxBlock < 1) maxBlock = 1;\n"
+					<< "\t\tif (maxBlock != maxFrames) {\n"
+					<< "\t\t\treleaseFrames();\n";
+				if (numAudioInputs) {
+					classWrapper << "\t\t\tinputFrames = (float*)malloc(sizeof(float) * maxBlock * NumInputs);\n";
+				}
+				classWrapper
+					<< "\t\t\toutputFrames = (float*)malloc(sizeof(float) * maxBlock * NumOutputs);\n"
+					<< "\t\t\tmaxFrames = maxBlock;\n"
+					<< "\t\t}\n";
+				if (instanceRate) {
+					classWrapper
+						<< "\t\tsampleRateValue = sampleRate;\n"
+						<< "\t\tbindSampleRate();\n";
+				} else if (sampleRate.size()) {
+					classWrapper
+						<< "\t\tclassSampleRate() = sampleRate;\n"
+						<< "\t\t::" << className << "Configure" << sampleRate << "(&classSampleRate());\n";
+				} else {
+					classWrapper << "\t\t(void)sampleRate;\n";
+				}
+				classWrapper
+					<< "\t\t::" << className << "Initialize(instance, NULL);\n"
+					<< "\t}\n\n"
+					<< "\t// one driver call per block of up to maxBlock frames\n"
+					<< "\tvoid process(float** in, float** out, int numFrames) {\n"
+					<< "\t\tif (maxFrames < 1) { // not prepared\n"
+					<< "\t\t\tfor (int c = 0; c < NumOutputs; ++c) for (int i = 0; i < numFrames; ++i) out[c][i] = 0.f;\n"
+					<< "\t\t\treturn;\n"
+					<< "\t\t}\n"
+					<< "\t\tfor (int done = 0; done < numFrames;) {\n"
+					<< "\t\t\tint todo = numFrames - done < maxFrames ? numFrames - done : maxFrames;\n";
+				if (numAudioInputs) {
+					classWrapper
+						<< "\t\t\tfor (int i = 0; i < todo; ++i)\n"
+						<< "\t\t\t\tfor (int c = 0; c < NumInputs; ++c) inputFrames[i * NumInputs + c] = in[c][done + i];\n"
+						<< "\t\t\t*::" << className << "GetValue(instance, " << audioInput << ") = (void*)inputFrames;\n";
+				} else {
+					classWrapper << "\t\t\t(void)in;\n";
+				}
+				classWrapper
+					<< "\t\t\t::" << className << audioDriver << "(instance, (" << resultType << "*)outputFrames, todo);\n"
+					<< "\t\t\tfor (int i = 0; i < todo; ++i)\n"
+					<< "\t\t\t\tfor (int c = 0; c < NumOutputs; ++c) out[c][done + i] = outputFrames[i * NumOutputs + c];\n"
+					<< "\t\t\tdone += todo;\n"
+					<< "\t\t}\n"
+					<< "\t}\n";
+			}
+
+			void DeclareDriver(std::string symbol, std::string linkerSymbol) {
+				if (symbol == "audio") audioDriver = linkerSymbol;
 				header << "void " << className << linkerSymbol << "(" << className << "InstancePtr, " << resultType << "* outputBuffer, int32_t numFrames);\n";
 				classWrapper << "\tvoid " << linkerSymbol << "(" << resultType << "* outputBuffer, int32_t numFrames = 1) { ::"
 					<< className << linkerSymbol << "(instance, outputBuffer, numFrames); }\n";
@@ -241,6 +350,18 @@ namespace K3 {
 					auto typeName = GenerateType(className + slotName + "InputType", inputType);
 					auto cName = CSymbolize(slotName);
 
+					if (slotName == "audio" && !constructorParameter) {
+						std::vector<std::string> members;
+						GenerateMembers(inputType, members);
+						if (AllFloat(members)) {
+							numAudioInputs = (int)members.size();
+							audioInput = std::to_string(slotIndex);
+						}
+					} else if (slotName == "#Rate{audio}" && typeName == "float") {
+						sampleRate = cName;
+						sampleRateIsConfiguration = constructorParameter;
+					}
+
 					if (constructorParameter) {
 						header << "\n// You must set this before calling `" << className << "Initialize()`\n";
 						configSlots.push_back(ConfigValue{ typeName, cName });
@@ -275,11 +396,14 @@ namespace K3 {
 			llvm::Function * CombineSubActivations(const std::string & name, const std::vector<llvm::Function*>& superClockFrames);
 			llvm::Function* GetActivation(const std::string& nameTemplate, CTRef graph, const Type& signature, llvm::Function *sizeOfStateStub, llvm::Function *sizeOfStub);
 			int firstCounterBitMaskIndex = 0;
+			std::uint64_t graphHash = 0;
 		protected:
 			CppHeader cppHeader;
 			std::unordered_map<Type, llvm::Function*> inputCall;
 			std::unique_ptr<llvm::Module> M;
 			void MakeIR(Kronos::BuildFlags);
+			// drivers switch the host to flush-to-zero and denormals-are-zero while they run
+			void FlushDenormalsOnEntry(llvm::Module&, const llvm::Triple&);
 			void Optimize(int level, std::string mcpu, std::string march, std::string mfeat);
 		public:
 			LLVM(CTRef AST, const Type& argType, const Type& resType);
@@ -287,8 +411,10 @@ namespace K3 {
 
 			llvm::LLVMContext& GetContext();
 			std::unique_ptr<llvm::Module>& GetModule() { return M; }
+			// identifies the typed graph for caches keyed across builds
+			void SetGraphHash(std::uint64_t h) { graphHash = h; }
 			void Build(Kronos::BuildFlags flags);
-			krt_class* JIT(Kronos::BuildFlags flags);
+			krt_class* JIT(Kronos::BuildFlags flags, int optLevel, const Tuning::Parameters* tuning = nullptr);
 			virtual void AoT(const char *prefix, const char *fileType, std::ostream& writeToStream, Kronos::BuildFlags flags, const char* triple, const char *mcpu, const char *march, const char *mfeat);
 		};
 	};
@@ -2,9 +2,14 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/LinkAllPasses.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "LLVMVectorMath.h"
+#include "CompilerProfile.h"
+#include "LLVMTuning.h"
 #include <memory>
 #include <iostream>
-#include <chrono>
+#include <vector>
 
 namespace K3 {
 	namespace Backends {
@@ -16,11 +21,18 @@ namespace K3 {
 			std::clog << "\n -- " << label << "\n" << str;
 		}
 
-		void LLVMOptimize(Module& mod, llvm::CodeGenOpt::Level lvl) {
-			legacy::PassManager mpm;
-			auto start = std::chrono::high_resolution_clock::now();
+		struct ModulePassList : public std::vector<Pass*> {
+			void add(Pass* p) { push_back(p); }
+		};
+
+		void LLVMOptimize(Module& mod, llvm::CodeGenOpt::Level lvl, const Tuning::Parameters& tuning) {
+			ModulePassList mpm;
+
+			TargetLibraryInfoImpl tlii(Triple(mod.getTargetTriple()));
+			VectorMath::AddVectorizableFunctions(tlii);
 
 			if (lvl) {
+				Profile::Phase profileFpm("llvm", "FunctionPasses");
 				legacy::FunctionPassManager fpm(&mod);
 				for (auto pass : {
 					createCFGSimplificationPass()
@@ -36,18 +48,7 @@ namespace K3 {
 
 				// alias analysis and target library info
 				mpm.add(createMergeFunctionsPass());
-				switch (lvl) {
-				case CodeGenOpt::Level::None: break;
-				case CodeGenOpt::Level::Less:
-					mpm.add(createFunctionInliningPass(10));
-					break;
-				case CodeGenOpt::Level::Default:
-					mpm.add(createFunctionInliningPass(40));
-					break;
-				case CodeGenOpt::Level::Aggressive:
-					mpm.add(createFunctionInliningPass(100));
-					break;
-				}
+				mpm.add(createFunctionInliningPass(tuning.inlineThreshold));
 				mpm.add(createScopedNoAliasAAWrapperPass());
 
 				mpm.add(createIPSCCPPass());
@@ -80,7 +81,7 @@ namespace K3 {
 				mpm.add(createIndVarSimplifyPass());
 				mpm.add(createLoopInterchangePass());
 
-				if (lvl > 2) {
+				if (tuning.vectorize) {
 					mpm.add(createLoopRotatePass(-1));
 					mpm.add(createLoopVectorizePass());
 					mpm.add(createLoopLoadEliminationPass());
@@ -92,7 +93,7 @@ namespace K3 {
 					mpm.add(createEarlyCSEPass());
 					mpm.add(createCorrelatedValuePropagationPass());
 					mpm.add(createCFGSimplificationPass(1, true, true, false, true));
-					mpm.add(createLoopUnrollPass(lvl));
+					mpm.add(createLoopUnrollPass(lvl, tuning.unrollThreshold));
 
 					mpm.add(createInstructionCombiningPass(lvl > 2));
 				}
@@ -111,18 +112,17 @@ namespace K3 {
 			} else {
 				mpm.add(createMergeFunctionsPass());
 			}
-			auto mpmstart = std::chrono::high_resolution_clock::now();
-			mpm.run(mod);
-			auto end = std::chrono::high_resolution_clock::now();
-            
-            (void)mpmstart; (void)end; (void)start;
-
-/*			auto fpmtime = std::chrono::duration_cast<std::chrono::milliseconds>(mpmstart - start);
-			auto mpmtime = std::chrono::duration_cast<std::chrono::milliseconds>(end - mpmstart);
-			auto totaltime = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-
-			std::clog << "Opt: " << totaltime.count() << "\nFPM: " << fpmtime.count() << "\nMPM: " << mpmtime.count() << "\n";*/
-			
+
+			legacy::PassManager pm;
+			pm.add(new TargetLibraryInfoWrapperPass(tlii));
+			for (auto p : mpm) pm.add(p);
+
+			Profile::Phase profileMpm("llvm", "ModulePasses");
+			pm.run(mod);
+		}
+
+		void LLVMOptimize(Module& mod, llvm::CodeGenOpt::Level lvl) {
+			LLVMOptimize(mod, lvl, Tuning::Parameters::ForOptLevel(lvl));
 		}
 	}
 }
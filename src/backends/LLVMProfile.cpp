@@ -0,0 +1,246 @@
+#pragma warning(disable: 4146 4267 4244)
+#include "LLVMProfile.h"
+#include "LLVMCmdLine.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <unordered_map>
+
+namespace K3 {
+	namespace Backends {
+		namespace PGO {
+			using namespace llvm;
+
+			static const char* EdgeCounters = "ProfileEdgeCounters";
+			static const char* BlockCounter = "ProfileBlockCounter";
+
+			static size_t Combine(size_t h, size_t v) {
+				return h ^ (v + 0x9e3779b9 + (h << 6) + (h >> 2));
+			}
+
+			static size_t TypeKey(size_t h, llvm::Type* t, int depth = 3) {
+				h = Combine(h, t->getTypeID());
+				if (t->isIntegerTy()) return Combine(h, t->getIntegerBitWidth());
+				if (auto a = dyn_cast<ArrayType>(t)) h = Combine(h, a->getNumElements());
+				if (auto v = dyn_cast<VectorType>(t)) h = Combine(h, v->getNumElements());
+				if (depth > 0) {
+					for (auto sub : t->subtypes()) h = TypeKey(h, sub, depth - 1);
+				}
+				return h;
+			}
+
+			static size_t ValueKey(size_t h, Value* v, const std::unordered_map<const Function*, size_t>& index) {
+				h = TypeKey(h, v->getType());
+				if (auto ci = dyn_cast<ConstantInt>(v)) {
+					h = Combine(h, (size_t)ci->getValue().getLimitedValue());
+				} else if (auto cf = dyn_cast<ConstantFP>(v)) {
+					h = Combine(h, (size_t)cf->getValueAPF().bitcastToAPInt().getLimitedValue());
+				} else if (auto f = dyn_cast<Function>(v)) {
+					// callees by intrinsic or by position in the module, not by name
+					if (f->getIntrinsicID()) h = Combine(h, f->getIntrinsicID());
+					else {
+						auto i = index.find(f);
+						h = Combine(h, i == index.end() ? 0 : i->second + 1);
+					}
+				}
+				return h;
+			}
+
+			std::uint64_t ModuleKey(Module& M, std::uint64_t graphHash) {
+				// names of types and functions are not stable between builds, shapes and constants are
+				std::unordered_map<const Function*, size_t> index;
+				for (auto& F : M) index.emplace(&F, index.size());
+
+				size_t h = (size_t)graphHash;
+				for (auto& F : M) {
+					if (F.isDeclaration()) continue;
+					h = TypeKey(h, F.getFunctionType());
+					for (auto& BB : F) {
+						for (auto& I : BB) {
+							h = Combine(h, I.getOpcode());
+							h = Combine(h, I.getNumOperands());
+							h = TypeKey(h, I.getType());
+							for (auto& op : I.operands()) h = ValueKey(h, op.get(), index);
+						}
+					}
+				}
+				return h;
+			}
+
+			using Terminator = std::remove_pointer_t<decltype(std::declval<BasicBlock&>().getTerminator())>;
+
+			template <typename FN> static void ForEachBranch(Module& M, FN&& fn) {
+				for (auto& F : M) {
+					if (F.isDeclaration()) continue;
+					std::vector<Terminator*> branches;
+					for (auto& BB : F) {
+						auto T = BB.getTerminator();
+						if (T && T->getNumSuccessors() > 1 && (isa<BranchInst>(T) || isa<SwitchInst>(T))) {
+							branches.emplace_back(T);
+						}
+					}
+					for (auto T : branches) fn(T);
+				}
+			}
+
+			static size_t CountEdges(Module& M) {
+				size_t numEdges = 0;
+				ForEachBranch(M, [&](Terminator* T) { numEdges += T->getNumSuccessors(); });
+				return numEdges;
+			}
+
+			static void Increment(IRBuilder<>& b, Value* counter) {
+				// drivers of one class may run on several threads at once
+				b.CreateAtomicRMW(AtomicRMWInst::Add, counter, b.getInt64(1), AtomicOrdering::Monotonic);
+			}
+
+			size_t Instrument(Module& M, const std::vector<Function*>& drivers) {
+				auto& ctx = M.getContext();
+				auto i64 = llvm::Type::getInt64Ty(ctx);
+				auto numEdges = CountEdges(M);
+
+				auto edgeTy = ArrayType::get(i64, std::max<size_t>(numEdges, 1));
+				auto edges = new GlobalVariable(M, edgeTy, false, GlobalValue::ExternalLinkage,
+												ConstantAggregateZero::get(edgeTy), EdgeCounters);
+				auto blocks = new GlobalVariable(M, i64, false, GlobalValue::ExternalLinkage,
+												 ConstantInt::get(i64, 0), BlockCounter);
+
+				size_t edgeIndex = 0;
+				ForEachBranch(M, [&](Terminator* T) {
+					auto from = T->getParent();
+					for (unsigned i = 0; i < T->getNumSuccessors(); ++i) {
+						auto to = T->getSuccessor(i);
+						auto edge = BasicBlock::Create(ctx, "pgo.edge", from->getParent(), to);
+						IRBuilder<> b(edge);
+						Increment(b, b.CreateConstInBoundsGEP2_64(edges, 0, edgeIndex++));
+						b.CreateBr(to);
+						T->setSuccessor(i, edge);
+
+						// each edge owns one of the incoming entries for 'from'
+						for (auto I = to->begin(); auto phi = dyn_cast<PHINode>(I); ++I) {
+							auto idx = phi->getBasicBlockIndex(from);
+							if (idx >= 0) phi->setIncomingBlock(idx, edge);
+						}
+					}
+				});
+
+				for (auto d : drivers) {
+					if (d->isDeclaration()) continue;
+					IRBuilder<> b(&*d->getEntryBlock().getFirstInsertionPt());
+					Increment(b, blocks);
+				}
+				return numEdges;
+			}
+
+			struct Profile {
+				std::vector<std::uint64_t> edges;
+				std::uint64_t blocks = 0;
+				struct Live {
+					const krt_class* cls;
+					const std::uint64_t* edges;
+					size_t numEdges;
+					const std::uint64_t* blocks;
+				};
+				std::vector<Live> live;
+
+				void Fold(const Live& l) {
+					if (edges.size() < l.numEdges) edges.resize(l.numEdges);
+					for (size_t i = 0; i < l.numEdges; ++i) edges[i] += l.edges[i];
+					blocks += *l.blocks;
+				}
+
+				Profile Snapshot() const {
+					Profile s;
+					s.edges = edges;
+					s.blocks = blocks;
+					for (auto& l : live) s.Fold(l);
+					return s;
+				}
+			};
+
+			static struct {
+				std::mutex lock;
+				std::unordered_map<std::uint64_t, Profile> profiles;
+				std::unordered_map<const krt_class*, std::uint64_t> instrumented;
+			} Store;
+
+			static bool Complete(const Profile& p) {
+				return CL::JitPGO() > 0 && p.blocks >= (std::uint64_t)CL::JitPGO();
+			}
+
+			bool IsComplete(std::uint64_t key) {
+				std::lock_guard<std::mutex> lg{ Store.lock };
+				auto p = Store.profiles.find(key);
+				return p != Store.profiles.end() && Complete(p->second.Snapshot());
+			}
+
+			bool AttachBranchWeights(Module& M, std::uint64_t key) {
+				Profile profile;
+				{
+					std::lock_guard<std::mutex> lg{ Store.lock };
+					auto p = Store.profiles.find(key);
+					if (p == Store.profiles.end()) return false;
+					profile = p->second.Snapshot();
+				}
+
+				if (profile.edges.size() != CountEdges(M)) return false;
+
+				MDBuilder md(M.getContext());
+				size_t edgeIndex = 0;
+				ForEachBranch(M, [&](Terminator* T) {
+					auto counts = profile.edges.data() + edgeIndex;
+					auto num = T->getNumSuccessors();
+					edgeIndex += num;
+
+					auto peak = *std::max_element(counts, counts + num);
+					std::uint64_t scale = peak / std::numeric_limits<std::uint32_t>::max() + 1;
+
+					std::vector<std::uint32_t> weights(num);
+					for (unsigned i = 0; i < num; ++i) {
+						// never taken edges stay possible
+						weights[i] = (std::uint32_t)std::max<std::uint64_t>(counts[i] / scale, 1);
+					}
+					T->setMetadata(LLVMContext::MD_prof, md.createBranchWeights(weights));
+				});
+				return true;
+			}
+
+			void Register(std::uint64_t key, const krt_class* cls, const std::uint64_t* edges, size_t numEdges, const std::uint64_t* blocks) {
+				std::lock_guard<std::mutex> lg{ Store.lock };
+				Store.profiles[key].live.emplace_back(Profile::Live{ cls, edges, numEdges, blocks });
+				Store.instrumented[cls] = key;
+			}
+
+			void Retire(const krt_class* cls) {
+				std::lock_guard<std::mutex> lg{ Store.lock };
+				auto i = Store.instrumented.find(cls);
+				if (i == Store.instrumented.end()) return;
+				auto& p = Store.profiles[i->second];
+				for (auto l = p.live.begin(); l != p.live.end();) {
+					if (l->cls == cls) {
+						p.Fold(*l);
+						l = p.live.erase(l);
+					} else ++l;
+				}
+				Store.instrumented.erase(i);
+			}
+
+			int Status(const krt_class* cls) {
+				std::lock_guard<std::mutex> lg{ Store.lock };
+				auto i = Store.instrumented.find(cls);
+				if (i == Store.instrumented.end()) return -1;
+				return Complete(Store.profiles[i->second].Snapshot()) ? 1 : 0;
+			}
+		}
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "kronosrt.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace llvm {
+	class Module;
+	class Function;
+}
+
+namespace K3 {
+	namespace Backends {
+		namespace PGO {
+			// hash of unoptimized IR and the typed graph it was built from;
+			// equal keys enumerate branch edges identically
+			std::uint64_t ModuleKey(llvm::Module&, std::uint64_t graphHash);
+
+			// adds a counter to every edge of every conditional branch and switch,
+			// and a counter that is bumped at the entry of each driver. Returns the number of edges.
+			size_t Instrument(llvm::Module&, const std::vector<llvm::Function*>& drivers);
+
+			// attaches accumulated edge counts as branch weights; false if no usable profile
+			bool AttachBranchWeights(llvm::Module&, std::uint64_t key);
+
+			// true once the instrumented builds of 'key' have run the required number of blocks
+			bool IsComplete(std::uint64_t key);
+
+			// ties the counters of a JiT instrumented module to its class
+			void Register(std::uint64_t key, const krt_class*, const std::uint64_t* edges, size_t numEdges, const std::uint64_t* blocks);
+
+			// folds the counters of an instrumented class into the profile before it is freed
+			void Retire(const krt_class*);
+
+			// -1 if the class is not instrumented, 0 while collecting, 1 when the profile is complete
+			int Status(const krt_class*);
+		}
+	}
+}
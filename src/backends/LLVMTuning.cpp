@@ -0,0 +1,161 @@
+#include "LLVMTuning.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace K3 {
+	namespace Backends {
+		namespace Tuning {
+			Parameters Parameters::ForOptLevel(int optLevel) {
+				Parameters p;
+				switch (optLevel) {
+				case 1: p.inlineThreshold = 10; break;
+				case 2: p.inlineThreshold = 40; break;
+				default: p.inlineThreshold = 100; break;
+				}
+				p.vectorize = optLevel > 2;
+				return p;
+			}
+
+			template <typename OP> static double TimeOp(OP&& op) {
+				// a dependent chain, so the latency of 'op' is measured
+				const int N = 1 << 20;
+				volatile float seed = 1.0001f;
+				float x = seed;
+				auto beg = std::chrono::steady_clock::now();
+				for (int i = 0; i < N; ++i) x = op(x);
+				auto end = std::chrono::steady_clock::now();
+				seed = x;
+				return std::chrono::duration<double, std::nano>(end - beg).count() / N;
+			}
+
+			static float AddOne(float x) { return x + 1e-7f; }
+
+			const HostCosts& Calibrate() {
+				static const HostCosts costs = []() {
+					float(*volatile indirect)(float) = AddOne;
+					HostCosts c;
+					c.add = TimeOp([](float x) { return x + 1e-7f; });
+					c.mul = TimeOp([](float x) { return x * 1.0000001f; });
+					c.div = TimeOp([](float x) { return 1.0001f / x; });
+					c.sqrt = std::max(TimeOp([](float x) { return std::sqrt(x + 1.f); }) - c.add, 0.0);
+					c.call = std::max(TimeOp([indirect](float x) { return indirect(x); }) - c.add, 0.0);
+					return c;
+				}();
+				return costs;
+			}
+
+			std::vector<Parameters> Candidates(int optLevel) {
+				auto base = Parameters::ForOptLevel(optLevel);
+				auto& host = Calibrate();
+
+				// inlining pays off in proportion to what a call costs in arithmetic
+				double callWeight = host.call / std::max(host.add, 0.01) / 4.0;
+				Parameters guess = base;
+				guess.inlineThreshold = (int)std::lround(base.inlineThreshold * std::min(std::max(callWeight, 0.5), 4.0));
+
+				std::vector<Parameters> cands{ guess, base };
+				for (int t : { 10, 40, 100, 250 }) {
+					Parameters p = base;
+					p.inlineThreshold = t;
+					cands.emplace_back(p);
+				}
+
+				Parameters unrolled = guess;
+				unrolled.unrollThreshold = 600;
+				cands.emplace_back(unrolled);
+
+				Parameters flipped = guess;
+				flipped.vectorize = !guess.vectorize;
+				cands.emplace_back(flipped);
+
+				auto same = [](const Parameters& a, const Parameters& b) {
+					return a.inlineThreshold == b.inlineThreshold &&
+						a.unrollThreshold == b.unrollThreshold &&
+						a.vectorize == b.vectorize;
+				};
+
+				std::vector<Parameters> unique;
+				for (auto& c : cands) {
+					if (std::none_of(unique.begin(), unique.end(), [&](const Parameters& u) { return same(u, c); })) {
+						unique.emplace_back(c);
+					}
+				}
+				return unique;
+			}
+
+			double Measure(const krt_class* cls, int blocks) {
+				const int blockFrames = 256;
+				const krt_sym* audio = nullptr;
+				size_t inputBytes = sizeof(float);
+				for (int i = 0; i < cls->num_symbols; ++i) {
+					auto& sym = cls->symbols[i];
+					if (!strcmp(sym.sym, "audio") && sym.process) audio = &sym;
+					inputBytes = std::max(inputBytes, (size_t)sym.size);
+				}
+				if (!audio || blocks < 1) return -1;
+
+				// external inputs read silence at the usual sample rate
+				std::vector<char> silence(inputBytes * blockFrames);
+				float sampleRate = 44100.f;
+				auto inputFor = [&](const krt_sym& sym) -> void* {
+					if (!strcmp(sym.sym, "#Rate{audio}")) return &sampleRate;
+					return silence.data();
+				};
+
+				for (int i = 0; i < cls->num_symbols; ++i) {
+					auto& sym = cls->symbols[i];
+					if (sym.slot_index >= 0 && (sym.flags & KRT_FLAG_NO_DEFAULT)) {
+						cls->configure(sym.slot_index, inputFor(sym));
+					}
+				}
+
+				std::vector<char> instance((size_t)cls->get_size());
+				std::vector<char> arg((size_t)std::max<std::int64_t>(cls->eval_arg_size, 1));
+				std::vector<char> output((size_t)cls->result_type_size * blockFrames);
+				cls->construct(instance.data(), arg.data());
+
+				// every input slot must point somewhere before the driver runs
+				for (int i = 0; i < cls->num_symbols; ++i) {
+					auto& sym = cls->symbols[i];
+					if (sym.slot_index >= 0) {
+						*cls->var(instance.data(), sym.slot_index) = inputFor(sym);
+					}
+				}
+
+				audio->process(instance.data(), output.data(), blockFrames);
+				auto beg = std::chrono::steady_clock::now();
+				for (int b = 0; b < blocks; ++b) {
+					audio->process(instance.data(), output.data(), blockFrames);
+				}
+				auto end = std::chrono::steady_clock::now();
+				cls->destruct(instance.data());
+
+				return std::chrono::duration<double, std::nano>(end - beg).count() / ((double)blocks * blockFrames);
+			}
+
+			static struct {
+				std::mutex lock;
+				std::unordered_map<std::uint64_t, std::pair<Parameters, double>> choices;
+			} Store;
+
+			bool Lookup(std::uint64_t key, Parameters& p) {
+				std::lock_guard<std::mutex> lg{ Store.lock };
+				auto c = Store.choices.find(key);
+				if (c == Store.choices.end()) return false;
+				p = c->second.first;
+				return true;
+			}
+
+			void Record(std::uint64_t key, const Parameters& p, double nsPerFrame) {
+				std::lock_guard<std::mutex> lg{ Store.lock };
+				Store.choices[key] = std::make_pair(p, nsPerFrame);
+			}
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "kronosrt.h"
+#include <cstdint>
+#include <vector>
+
+namespace K3 {
+	namespace Backends {
+		namespace Tuning {
+			// optimizer settings otherwise implied by the optimization level
+			struct Parameters {
+				int inlineThreshold = 40;
+				int unrollThreshold = -1;
+				bool vectorize = false;
+
+				static Parameters ForOptLevel(int optLevel);
+			};
+
+			// per-operation costs of the host in nanoseconds, measured once per process
+			struct HostCosts {
+				double add, mul, div, sqrt, call;
+			};
+
+			const HostCosts& Calibrate();
+
+			// settings worth timing for 'optLevel', best calibrated guess first
+			std::vector<Parameters> Candidates(int optLevel);
+
+			// nanoseconds per frame of the audio driver of 'cls' over 'blocks' blocks,
+			// or negative if the class has no audio driver
+			double Measure(const krt_class* cls, int blocks);
+
+			// settings previously chosen for a typed graph
+			bool Lookup(std::uint64_t key, Parameters&);
+			void Record(std::uint64_t key, const Parameters&, double nsPerFrame);
+		}
+	}
+}
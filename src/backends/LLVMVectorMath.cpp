@@ -0,0 +1,229 @@
+#pragma warning(disable: 4146 4267 4244)
+#include "LLVMVectorMath.h"
+#include "LLVMCmdLine.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+
+#include <initializer_list>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace CL {
+	CmdLine::Option<int> MathUlp(0, "--math-ulp", "-mu", "<ulp>", "accept up to <ulp> units of error from transcendental functions; 4 or more selects the bundled vectorizable library over libm");
+}
+
+namespace K3 {
+	namespace Backends {
+		namespace VectorMath {
+			using namespace llvm;
+
+			/* polynomials and range reductions follow the single precision Cephes library */
+
+			static Value* Const(Value* like, double v) {
+				return ConstantFP::get(like->getType(), v);
+			}
+
+			static Value* Int(llvm::Type* ity, std::uint32_t v) {
+				return ConstantInt::get(ity, v);
+			}
+
+			static Value* Horner(IRBuilder<>& b, Value* x, std::initializer_list<double> coefficients) {
+				Value* acc = nullptr;
+				for (auto c : coefficients) {
+					acc = acc ? b.CreateFAdd(b.CreateFMul(acc, x), Const(x, c)) : Const(x, c);
+				}
+				return acc;
+			}
+
+			static llvm::Type* IntTypeFor(llvm::Type* ty) {
+				auto i32 = llvm::Type::getInt32Ty(ty->getContext());
+				return ty->isVectorTy() ? (llvm::Type*)VectorType::get(i32, ty->getVectorNumElements()) : i32;
+			}
+
+			struct Reduced {
+				Value *j, *r;
+			};
+
+			// |x| = j * pi/4 + r, with j even and |r| <= pi/4. Accuracy degrades past |x| ~ 8192.
+			static Reduced ReduceQuadrant(IRBuilder<>& b, Value* ax) {
+				auto ity = IntTypeFor(ax->getType());
+				auto limit = Const(ax, 1.0e9);
+				// keeps fptosi defined for nan and huge arguments
+				auto clamped = b.CreateSelect(b.CreateFCmpOLE(ax, limit), ax, limit);
+				auto j = b.CreateFPToSI(b.CreateFMul(clamped, Const(ax, 1.27323954473516)), ity);
+				j = b.CreateAnd(b.CreateAdd(j, Int(ity, 1)), Int(ity, ~1u));
+				auto y = b.CreateSIToFP(j, ax->getType());
+				auto r = b.CreateFSub(ax, b.CreateFMul(y, Const(ax, 0.78515625)));
+				r = b.CreateFSub(r, b.CreateFMul(y, Const(ax, 2.4187564849853515625e-4)));
+				r = b.CreateFSub(r, b.CreateFMul(y, Const(ax, 3.77489497744594108e-8)));
+				return { j, r };
+			}
+
+			static Value* SinPoly(IRBuilder<>& b, Value* r, Value* z) {
+				auto p = Horner(b, z, { -1.9515295891e-4, 8.3321608736e-3, -1.6666654611e-1 });
+				return b.CreateFAdd(b.CreateFMul(b.CreateFMul(p, z), r), r);
+			}
+
+			static Value* CosPoly(IRBuilder<>& b, Value* z) {
+				auto p = Horner(b, z, { 2.443315711809948e-5, -1.388731625493765e-3, 4.166664568298827e-2 });
+				p = b.CreateFMul(b.CreateFMul(p, z), z);
+				return b.CreateFAdd(b.CreateFSub(p, b.CreateFMul(z, Const(z, 0.5))), Const(z, 1.0));
+			}
+
+			static Value* FlipSign(IRBuilder<>& b, Value* x, Value* signBits) {
+				auto ity = IntTypeFor(x->getType());
+				return b.CreateBitCast(b.CreateXor(b.CreateBitCast(x, ity), signBits), x->getType());
+			}
+
+			static Value* Sin(IRBuilder<>& b, Value* x) {
+				auto ity = IntTypeFor(x->getType());
+				auto xi = b.CreateBitCast(x, ity);
+				auto sign = b.CreateAnd(xi, Int(ity, 0x80000000u));
+				auto ax = b.CreateBitCast(b.CreateAnd(xi, Int(ity, 0x7fffffffu)), x->getType());
+				auto q = ReduceQuadrant(b, ax);
+				auto z = b.CreateFMul(q.r, q.r);
+				auto useCos = b.CreateICmpNE(b.CreateAnd(q.j, Int(ity, 2)), Int(ity, 0));
+				auto poly = b.CreateSelect(useCos, CosPoly(b, z), SinPoly(b, q.r, z));
+				sign = b.CreateXor(sign, b.CreateShl(b.CreateAnd(q.j, Int(ity, 4)), Int(ity, 29)));
+				return FlipSign(b, poly, sign);
+			}
+
+			static Value* Cos(IRBuilder<>& b, Value* x) {
+				auto ity = IntTypeFor(x->getType());
+				auto ax = b.CreateBitCast(b.CreateAnd(b.CreateBitCast(x, ity), Int(ity, 0x7fffffffu)), x->getType());
+				auto q = ReduceQuadrant(b, ax);
+				auto z = b.CreateFMul(q.r, q.r);
+				auto useSin = b.CreateICmpNE(b.CreateAnd(q.j, Int(ity, 2)), Int(ity, 0));
+				auto poly = b.CreateSelect(useSin, SinPoly(b, q.r, z), CosPoly(b, z));
+				auto sign = b.CreateShl(b.CreateAnd(b.CreateAdd(q.j, Int(ity, 2)), Int(ity, 4)), Int(ity, 29));
+				return FlipSign(b, poly, sign);
+			}
+
+			static Value* Exp(IRBuilder<>& b, Value* x) {
+				auto ity = IntTypeFor(x->getType());
+				auto lo = Const(x, -88.3762626647949), hi = Const(x, 88.3762626647949);
+				// nan clamps to 'lo' here and is restored at the end
+				auto xc = b.CreateSelect(b.CreateFCmpOGE(x, lo), x, lo);
+				xc = b.CreateSelect(b.CreateFCmpOLE(xc, hi), xc, hi);
+
+				auto fx = b.CreateFAdd(b.CreateFMul(xc, Const(x, 1.44269504088896341)), Const(x, 0.5));
+				auto n = b.CreateSIToFP(b.CreateFPToSI(fx, ity), x->getType());
+				n = b.CreateSelect(b.CreateFCmpOGT(n, fx), b.CreateFSub(n, Const(x, 1.0)), n);
+
+				auto r = b.CreateFSub(xc, b.CreateFMul(n, Const(x, 0.693359375)));
+				r = b.CreateFSub(r, b.CreateFMul(n, Const(x, -2.12194440e-4)));
+				auto z = b.CreateFMul(r, r);
+				auto p = Horner(b, r, { 1.9875691500e-4, 1.3981999507e-3, 8.3334519073e-3, 4.1665795894e-2, 1.6666665459e-1, 5.0000001201e-1 });
+				p = b.CreateFAdd(b.CreateFAdd(b.CreateFMul(p, z), r), Const(x, 1.0));
+
+				auto pow2n = b.CreateShl(b.CreateAdd(b.CreateFPToSI(n, ity), Int(ity, 127)), Int(ity, 23));
+				auto result = b.CreateFMul(p, b.CreateBitCast(pow2n, x->getType()));
+
+				// the clamped polynomial stays finite; overflow and underflow like libm
+				result = b.CreateSelect(b.CreateFCmpOGT(x, hi), Const(x, std::numeric_limits<double>::infinity()), result);
+				result = b.CreateSelect(b.CreateFCmpOLT(x, lo), Const(x, 0.0), result);
+				return b.CreateSelect(b.CreateFCmpUNO(x, x), x, result);
+			}
+
+			static Value* Log(IRBuilder<>& b, Value* x) {
+				auto ity = IntTypeFor(x->getType());
+				// bring denormals into the normal range
+				auto denormal = b.CreateFCmpOLT(x, Const(x, std::numeric_limits<float>::min()));
+				auto xs = b.CreateSelect(denormal, b.CreateFMul(x, Const(x, 33554432.0)), x);
+				auto bias = b.CreateSelect(denormal, Const(x, 25.0), Const(x, 0.0));
+
+				auto xi = b.CreateBitCast(xs, ity);
+				auto e = b.CreateSIToFP(b.CreateSub(b.CreateLShr(xi, Int(ity, 23)), Int(ity, 126)), x->getType());
+				e = b.CreateFSub(e, bias);
+				auto m = b.CreateBitCast(b.CreateOr(b.CreateAnd(xi, Int(ity, 0x807fffffu)), Int(ity, 0x3f000000u)), x->getType());
+
+				auto low = b.CreateFCmpOLT(m, Const(x, 0.707106781186547524));
+				e = b.CreateSelect(low, b.CreateFSub(e, Const(x, 1.0)), e);
+				m = b.CreateFSub(b.CreateSelect(low, b.CreateFAdd(m, m), m), Const(x, 1.0));
+
+				auto z = b.CreateFMul(m, m);
+				auto y = Horner(b, m, { 7.0376836292e-2, -1.1514610310e-1, 1.1676998740e-1, -1.2420140846e-1,
+										1.4249322787e-1, -1.6668057665e-1, 2.0000714765e-1, -2.4999993993e-1,
+										3.3333331174e-1 });
+				y = b.CreateFMul(b.CreateFMul(y, m), z);
+				y = b.CreateFAdd(y, b.CreateFMul(e, Const(x, -2.12194440e-4)));
+				y = b.CreateFSub(y, b.CreateFMul(z, Const(x, 0.5)));
+				auto result = b.CreateFAdd(b.CreateFAdd(m, y), b.CreateFMul(e, Const(x, 0.693359375)));
+
+				auto inf = std::numeric_limits<double>::infinity();
+				result = b.CreateSelect(b.CreateFCmpOEQ(x, Const(x, inf)), x, result);
+				result = b.CreateSelect(b.CreateFCmpOEQ(x, Const(x, 0.0)), Const(x, -inf), result);
+				return b.CreateSelect(b.CreateFCmpULT(x, Const(x, 0.0)), Const(x, std::numeric_limits<double>::quiet_NaN()), result);
+			}
+
+			using Builder = Value*(*)(IRBuilder<>&, Value*);
+
+			static const struct {
+				const char* name;
+				Builder build;
+				const char* symbols[4];
+			} Library[] = {
+				{ "sin", Sin, { "kvm_sinf", "kvm_sinf_v4", "kvm_sinf_v8", "kvm_sinf_v16" } },
+				{ "cos", Cos, { "kvm_cosf", "kvm_cosf_v4", "kvm_cosf_v8", "kvm_cosf_v16" } },
+				{ "exp", Exp, { "kvm_expf", "kvm_expf_v4", "kvm_expf_v8", "kvm_expf_v16" } },
+				{ "log", Log, { "kvm_logf", "kvm_logf_v4", "kvm_logf_v8", "kvm_logf_v16" } },
+			};
+
+			static bool Enabled() {
+				return CL::MathUlp() >= LibraryUlp;
+			}
+
+			static Function* Define(Module& M, Builder build, const std::string& symbol, llvm::Type* ty) {
+				if (auto existing = M.getFunction(symbol)) {
+					if (!existing->isDeclaration()) return existing;
+				}
+				auto fn = cast<Function>(M.getOrInsertFunction(symbol, FunctionType::get(ty, { ty }, false)));
+				// weak keeps the unused widths alive until the loop vectorizer had a chance to use them
+				fn->setLinkage(GlobalValue::WeakODRLinkage);
+				fn->addFnAttr(Attribute::ReadNone);
+				fn->addFnAttr(Attribute::NoUnwind);
+				fn->addFnAttr(Attribute::InlineHint);
+
+				IRBuilder<> b(BasicBlock::Create(M.getContext(), "entry", fn));
+				b.CreateRet(build(b, &*fn->arg_begin()));
+				return fn;
+			}
+
+			Function* Get(Module& M, const char* name, llvm::Type* ty) {
+				if (!Enabled() || !ty->getScalarType()->isFloatTy()) return nullptr;
+				for (auto& entry : Library) {
+					if (std::string(entry.name) != name) continue;
+					if (!ty->isVectorTy()) {
+						for (unsigned lanes = 4, i = 1; lanes <= 16; lanes *= 2, ++i) {
+							Define(M, entry.build, entry.symbols[i], VectorType::get(ty, lanes));
+						}
+						return Define(M, entry.build, entry.symbols[0], ty);
+					}
+					auto lanes = ty->getVectorNumElements();
+					if (lanes == 4) return Define(M, entry.build, entry.symbols[1], ty);
+					if (lanes == 8) return Define(M, entry.build, entry.symbols[2], ty);
+					if (lanes == 16) return Define(M, entry.build, entry.symbols[3], ty);
+					return Define(M, entry.build, entry.symbols[0] + ("_v" + std::to_string(lanes)), ty);
+				}
+				return nullptr;
+			}
+
+			void AddVectorizableFunctions(TargetLibraryInfoImpl& tlii) {
+				if (!Enabled()) return;
+				static const std::vector<VecDesc> descs = []() {
+					std::vector<VecDesc> d;
+					for (auto& entry : Library) {
+						for (unsigned lanes = 4, i = 1; lanes <= 16; lanes *= 2, ++i) {
+							d.push_back({ entry.symbols[0], entry.symbols[i], lanes });
+						}
+					}
+					return d;
+				}();
+				tlii.addVectorizableFunctions(descs);
+			}
+		}
+	}
+}
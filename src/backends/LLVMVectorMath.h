@@ -0,0 +1,24 @@
+#pragma once
+
+namespace llvm {
+	class Module;
+	class Function;
+	class Type;
+	class TargetLibraryInfoImpl;
+}
+
+namespace K3 {
+	namespace Backends {
+		namespace VectorMath {
+			// worst case error of the bundled single precision functions
+			static const int LibraryUlp = 4;
+
+			// returns a definition of 'sin', 'cos', 'exp' or 'log' for a float32 scalar or vector type,
+			// or nullptr when the type is not supported or the accuracy setting requires libm
+			llvm::Function* Get(llvm::Module&, const char* name, llvm::Type*);
+
+			// lets the loop vectorizer widen scalar calls to the 4, 8 and 16 lane variants
+			void AddVectorizableFunctions(llvm::TargetLibraryInfoImpl&);
+		}
+	}
+}
@@ -633,11 +633,38 @@ namespace K3
 			}
 #endif
 
-			complete->Connect(SubroutineMeta::New(allocatesState, mutatesGVars));
+			complete->Connect(SubroutineMeta::New(allocatesState, mutatesGVars, opaqueState ? 0 : stateLayout));
 
 			return cache.PostProcess(complete);
 		}
 
+		void SideEffectTransform::AccumulateStateLayout(CTRef ptr, const Type& content, StateSlot kind) {
+			// allocations are fixed-size offsets or nested subroutine frames; anything
+			// else, like dispatch or recursion, makes the layout opaque.
+			std::uint64_t h = 0;
+			Offset* offs;
+			SubroutineStateAllocation* subrAlloc;
+			if (ptr->Cast(offs)) {
+				// equal sizes are not enough: a slot must hold the same type in the same role
+				h = offs->GetUp(1)->GetHash();
+				h = (h ^ content.GetHash()) * 0x100000001b3ull;
+				h = (h ^ (std::uint64_t)kind) * 0x100000001b3ull;
+			} else if (ptr->Cast(subrAlloc) && subrAlloc->GetSubroutine()->GetBody()) {
+				h = GetStateLayout(subrAlloc->GetSubroutine()->GetBody());
+			}
+			if (h == 0) opaqueState = true;
+			stateLayout = (stateLayout ^ h) * 0x100000001b3ull;
+		}
+
+		std::uint64_t SideEffectTransform::GetStateLayout(CTRef compiledBody) {
+			Deps* d;
+			SubroutineMeta* sm;
+			if (compiledBody->Cast(d) && d->GetUp(d->GetNumCons() - 1)->Cast(sm)) {
+				return sm->StateLayout;
+			}
+			return 0;
+		}
+
 		CTRef SideEffectTransform::GetDataLayout(CTRef graph) {
 			Deps *m;
 			for (;;) {
@@ -880,9 +907,12 @@ namespace K3
 		Graph<Typed> SideEffectTransform::Compile(IInstanceSymbolTable& symbols, const CTRef pureBody, const CTRef arguments, const CTRef results, const char *l, const Type& argTy, const Type& resTy) {
 			auto result = Graph<Typed>{};
 			if (symbols.GetMemoized(std::make_tuple(pureBody, arguments, results), result)) {
+				Profile::CacheHit();
 				return result;
 			}
+			Profile::CacheMiss();
 
+			Profile::Phase profile("compiler", "SideEffectTransform");
 			RegionAllocator compilationAllocator;
 			CopyElisionTransform::ElisionMap emap;
 			CopyElisionTransform elision(results, emap);
@@ -895,7 +925,10 @@ namespace K3
 			//std::clog << "[w/arg] : " << *body << std::endl;
 			//std::cout << "[out  ]: " << *results << std::endl;
 
-			elision(body);
+			{
+				Profile::Phase profile("compiler", "CopyElision");
+				elision(body);
+			}
 
 			SideEffectTransform::map_t cache;
 			SideEffectTransform sfx(symbols, body, arguments, results, cache, elision);
@@ -1082,7 +1115,7 @@ namespace K3
 			strm << "<" << type << ">";
 		}
 
-		unsigned SubroutineArgument::ComputeLocalHash() const {
+		size_t SubroutineArgument::ComputeLocalHash() const {
 			size_t h(DisposableTypedLeaf::ComputeLocalHash());
 			HASHER(h, ID);
 			HASHER(h, type.GetHash());
@@ -1091,7 +1124,7 @@ namespace K3
 			//bool isOutput;
 			//Type type;
 			//bool isReference;
-			return unsigned(h);
+			return h;
 		}
 
 		CTRef Dereference::New(CTRef upstream, CRRef rx) { 
@@ -1639,7 +1672,8 @@ namespace K3
 
 			auto bufferPtr(sfx.GetLocalStatePointer());
 			auto buffer(DataSource::New(bufferPtr, Reference::New(upstreamType)));
-			sfx.SetLocalStatePointer(Offset::New(bufferPtr, buffer->Dereference(nullptr)->SizeOf()));
+			ResultTypeWithNoArgument bufferType(upstreamType);
+			sfx.SetLocalStatePointer(Offset::New(bufferPtr, buffer->Dereference(nullptr)->SizeOf()), upstreamType->Result(bufferType));
 
 			const DataSource *up_ds;
 			if (upstream->Cast(up_ds) && up_ds->IsReference()) {
@@ -1732,7 +1766,7 @@ namespace K3
 			auto buffer(DataSource::New(bufferPtr, Reference::New(Native::Constant::New(FixedResult(),nullptr))));
 			CTRef output = Deps::New(buffer);
 			auto rx = GetReactivity();
-			sfx.SetStatePointer(Offset::New(bufferPtr, buffer->Dereference(rx)->SizeOf()));
+			sfx.SetStatePointer(Offset::New(bufferPtr, buffer->Dereference(rx)->SizeOf()), FixedResult());
 
 			for (unsigned i(0);i < GetNumCons();++i) {
 				auto upstream(sfx(GetUp(i)));
@@ -1941,13 +1975,17 @@ namespace K3
 			return NI32(Sub, limit, offset);
 		}
 
+		// runtime instances are allocated on this boundary
+		static const std::int64_t CacheLine = 64;
+
 		CTRef RingBuffer::SideEffects(SideEffectTransform& sfx) const {
 			CTRef evictPtr, bufferPtr, rover, statePtr(sfx.GetLocalStatePointer());
+			CTRef bufferBase = statePtr;
 			CTRef bufferLen = nullptr;
 			if (!lenConfigurator && len < 2) {
 				bufferPtr = evictPtr = statePtr;
 				rover = Native::Constant::New(int32_t(0));
-				sfx.SetLocalStatePointer(Offset::New(statePtr, Native::Constant::New(int64_t(elementType.GetSize()))));
+				sfx.SetLocalStatePointer(Offset::New(statePtr, Native::Constant::New(int64_t(elementType.GetSize()))), elementType);
 
 				/* emit initializer code */
 				auto initializer(sfx.CopyData(
@@ -2002,9 +2040,34 @@ namespace K3
 
 				auto elSz = Native::Constant::New((int32_t)elementType.GetSize());
 				auto bufferSz = NI32(Mul, bufferLen, elSz);
-				auto indexPtr = Offset::New(bufferPtr, bufferSz);
-
-				sfx.SetLocalStatePointer(Offset::New(indexPtr, Native::Constant::New((int64_t)Type::Int32.GetSize())));
+				const auto fixedSz = len * elementType.GetSize();
+
+				CTRef indexPtr;
+				if (lenConfigurator || (std::int64_t)fixedSz >= CacheLine) {
+					// the index word is written every sample; give it a line of its own
+					// ahead of a line aligned buffer body. The pad depends on the
+					// runtime address, so the worst case is always reserved to keep the
+					// state size independent of where the instance lives.
+					std::int64_t reserve = CacheLine;
+					IAlignmentTrackerNode *at;
+					if (statePtr->Cast(at) && at->GetAlignment() >= CacheLine) {
+						indexPtr = statePtr;
+					} else {
+						auto pad = NI64(And, 
+										Native::MakeInt64("neg", Native::Neg, BitCast::New(Type::Int64, 1, statePtr)),
+										Native::Constant::New(CacheLine - 1));
+						indexPtr = Offset::New(statePtr, pad);
+						reserve += CacheLine - 1;
+					}
+					bufferBase = bufferPtr = Offset::New(indexPtr, Native::Constant::New(CacheLine));
+					sfx.SetLocalStatePointer(
+						Offset::New(Offset::New(statePtr, Native::Constant::New(reserve)), bufferSz),
+						elementType, StateSlot::RingIndex);
+				} else {
+					indexPtr = Offset::New(bufferPtr, bufferSz);
+					sfx.SetLocalStatePointer(Offset::New(indexPtr, Native::Constant::New((int64_t)Type::Int32.GetSize())), 
+											 elementType, StateSlot::RingIndex);
+				}
 
 				auto initIndex = Copy::New(indexPtr, Native::Constant::New(int32_t(0 - elementType.GetSize( ))),
 					Native::Constant::New(int32_t(4)), Copy::Store,
@@ -2029,12 +2092,24 @@ namespace K3
 						NI32(Sub, bufferLen, Native::Constant::New((int32_t)1)), true, true);
 
 				auto index = Dereference::New(indexPtr, GetReactivity(), Type::Int32);
-				auto newIdx = NI32(Add, index, elSz);
-				newIdx->SetReactivity(GetReactivity());
-				newIdx = Native::Select::New(newIdx, newIdx, 
-											 NI32(Mul, 
-												  bufferLen,
-												  Native::Constant::New(int32_t(0 - elementType.GetSize()))));
+				Typed* newIdx;
+
+				// the index runs from -bufferSz up to zero; with a power of two byte size,
+				// every index has the high bits of -bufferSz set after a single mask.
+				// Otherwise the buffer offset is range checked, which also recovers an
+				// index migrated from an instance whose buffer had a different length.
+				const bool pow2 = !lenConfigurator && len >= 2 && (fixedSz & (fixedSz - 1)) == 0 && fixedSz < INT32_MAX;
+				if (pow2) {
+					auto step = NI32(Add, index, elSz);
+					step->SetReactivity(GetReactivity());
+					newIdx = NI32(Or, step, Native::Constant::New(int32_t(0 - (std::int64_t)fixedSz)));
+				} else {
+					auto step = NI32(Add, index, NI32(Add, bufferSz, elSz));
+					step->SetReactivity(GetReactivity());
+					auto offset = NI32(ClampIndex, step, NI32(Sub, bufferSz, elSz));
+					offset->SetReactivity(GetReactivity());
+					newIdx = NI32(Sub, offset, bufferSz);
+				}
 				newIdx->SetReactivity(GetReactivity());
 
 				auto updatedIndex(Deps::New(newIdx, 
@@ -2046,13 +2121,22 @@ namespace K3
 				auto bufferOffset = NI32(Add, updatedIndex, bufferSz);
 				evictPtr = Offset::New(bufferPtr, bufferOffset);
 
-				rover = NI32(Div, bufferOffset, elSz);					
+				auto elBytes = elementType.GetSize();
+				if (elBytes && (elBytes & (elBytes - 1)) == 0) {
+					// bufferOffset is never negative
+					int shift = 0;
+					while ((1ull << shift) < elBytes) ++shift;
+					rover = NI32(LogicalShiftRight, bufferOffset, Native::Constant::New((int32_t)shift));
+				} else {
+					rover = NI32(Div, bufferOffset, elSz);
+				}
 				const_cast<Typed*>(rover)->SetReactivity(GetReactivity());
 			}
 
 			auto output(DataSource::New(evictPtr, Reference::New(Native::Constant::New(elementType, 0))));
 
-			sfx.AddSideEffect(output, GetUp(1), statePtr, GetReactivity(), elementType.GetSize());
+			// hazards are tracked relative to the start of the buffer body
+			sfx.AddSideEffect(output, GetUp(1), bufferBase, GetReactivity(), elementType.GetSize());
 
 			CTRef bufferView;
 			if (lenConfigurator) {
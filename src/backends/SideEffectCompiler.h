@@ -48,6 +48,9 @@ namespace K3 {
 			virtual const Reactive::Node* GetInitializerReactivity() const = 0;
 		};
 
+		// a ring index is only meaningful alongside its buffer length
+		enum class StateSlot { Data, RingIndex };
+
 		class SideEffectTransform : public CachedTransformBase<const Typed,const Typed*>{			
 			struct SideEffect {
 				CTRef WritePointer;
@@ -63,6 +66,9 @@ namespace K3 {
 			IInstanceSymbolTable& symbols;
 			Subroutine* recursiveBranch = nullptr;
 			bool allocatesState = false, mutatesGVars = false;
+			std::uint64_t stateLayout = 0xcbf29ce484222325ull;
+			bool opaqueState = false;
+			void AccumulateStateLayout(CTRef newStatePointer, const Type& content, StateSlot kind);
 		#ifndef NDEBUG
 			std::unordered_set<const Nodes::FunctionBase*> visitedFunctions;
 		#endif
@@ -88,10 +94,14 @@ namespace K3 {
 			static CTRef GetDereferencedAccessor(CTRef graph);
 			static CTRef GetDereferencedAccessor(CTRef graph, CRRef rx);
 
+			// content and kind of an allocation are part of the state layout
 			CTRef GetLocalStatePointer() { return localStatePointer; }
-			void SetLocalStatePointer(CTRef newLocalState) { localStatePointer = newLocalState; AllocatesState(); }
+			void SetLocalStatePointer(CTRef newLocalState, const Type& content, StateSlot kind = StateSlot::Data) { AccumulateStateLayout(newLocalState, content, kind); localStatePointer = newLocalState; AllocatesState(); }
 			CTRef GetStatePointer() { return statePointer; }
-			void SetStatePointer(CTRef newStatePointer) { statePointer=newStatePointer; }
+			void SetStatePointer(CTRef newStatePointer, const Type& content = Type::Nil, StateSlot kind = StateSlot::Data) { AccumulateStateLayout(newStatePointer, content, kind); statePointer=newStatePointer; }
+
+			// instances of two compiled bodies with equal, nonzero layouts can exchange state
+			static std::uint64_t GetStateLayout(CTRef compiledBody);
 
 			CTRef CopyData(CTRef dst, CTRef src, const Reactive::Node* reactivity, bool byValue, bool mutatesState, bool doesInit);
 			const Typed* operate(CTRef src);
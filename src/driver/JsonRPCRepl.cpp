@@ -4,6 +4,7 @@
 
 #include "JsonRPCRepl.h"
 #include "package.h"
+#include "runtime/loadmeter.h"
 
 #include "config/system.h"
 
@@ -149,9 +150,15 @@ namespace Kronos {
 
 		running.test_and_set();
 		messageRelay = std::thread([this]() { StartRelay(); });
+
+		c.SetProfileCallback([this](std::int64_t closureTy) {
+			if (closureTy == sndClosureTy) RestartSnd();
+			else ReplaceAll(closureTy);
+		});
 	}
 
 	RPCRepl::~RPCRepl() {
+		JiT.SetProfileCallback({});
 		running.clear();
 		if (messageRelay.joinable()) messageRelay.join();
 	}
@@ -285,10 +292,12 @@ namespace Kronos {
     }
             
     void RPCRepl::RestartSnd() {
+        std::lock_guard<std::mutex> lg{ sndLock };
         if (sndInstance) {
-            Stop(sndInstance);
+            sndInstance = Replace(sndInstance, sndClosureTy, 0, 0);
+        } else {
+            sndInstance = Start(sndClosureTy, 0, 0);
         }
-        sndInstance = Start(sndClosureTy, 0, 0);
     }
 
 	void RPCRepl::Invalidate(std::int64_t closureTy) {
@@ -464,6 +473,28 @@ namespace Kronos {
 			return repl.PullMessages((int)r.get<double>());
 		};
 
+		replEp["load_meter"] = [&](const picojson::value& r) {
+			picojson::array meters;
+			auto cps = IO::LoadMeter::CyclesPerSecond();
+			for (auto& m : IO::LoadMeter::Collect()) {
+				std::stringstream instance;
+				if (m.instance) instance << m.instance;
+				picojson::array histogram;
+				for (auto count : m.buckets) histogram.emplace_back((double)count);
+				meters.emplace_back(picojson::object{
+					{ "subject", m.subject },
+					{ "instance", instance.str() },
+					{ "calls", (double)m.calls },
+					{ "load", m.Load() },
+					{ "peak_seconds", m.peak / cps },
+					{ "overruns", (double)m.overruns },
+					{ "denormal_blocks", (double)m.denormals },
+					{ "log2_cycles_histogram", histogram }
+				});
+			}
+			return meters;
+		};
+
 		replEp["library"] = [&](const picojson::value& r) {
 			std::stringstream ss;
 			repl.ExportLibraryMetadata(ss);
@@ -36,6 +36,7 @@ namespace Kronos {
 
 	class RPCRepl : public REPL::JiTEnvironment {
 		int64_t sndClosureTy = 0, sndInstance = 0;
+		std::mutex sndLock;
 		OutputFunctionTy out;
 		MessageQueue messageQueue;
 		std::thread messageRelay;
@@ -2,6 +2,7 @@
 #include "runtime/scheduler.h"
 #include "ReplEnvironment.h"
 #include "llvm/Support/DynamicLibrary.h"
+#include <algorithm>
 #include <cstdint>
 #include <iostream>
 #include <memory>
@@ -29,34 +30,48 @@ namespace Kronos {
 				char *ptr = (char*)str->data();
 				auto token = ptr;
 
+				std::unordered_map<std::int64_t, TypedGraph> respecialized;
+
 				while (*ptr) {
 					if (*ptr++ == ' ') {
 						auto sym = std::make_unique<std::string>(token, ptr - 1);
                         changeCallback(*sym, 0);
-						dependencies.update_in(*sym, [&](auto bks) -> pcoll::optional<pcoll::llist<BuildKey>> {
-							if (bks.has_value) {
-								pcoll::llist<BuildKey> nbks;
-								for (auto &bk : *bks) {
-									bool didRemove = false;
-
-									buildCache.update_in(bk, [&didRemove](const auto& val) {
-										didRemove = val.has_value;
-										return pcoll::none{};
-									});
-
-									if (didRemove) {
+						auto bks = dependencies[*sym];
+						if (bks.has_value) {
+							std::vector<BuildKey> evicted;
+							for (auto &bk : *bks) {
+								if (!buildCache[bk].has_value || Revalidate(bk, respecialized)) continue;
+
+								bool didRemove = false;
+								buildCache.update_in(bk, [&didRemove](const auto& val) {
+									didRemove = val.has_value;
+									return pcoll::none{};
+								});
+
+								if (didRemove) {
 #if CHANGE_LOGGING
-                                        std::clog << "* Invalidated " << bk << " (" << sym << ")\n";
+                                    std::clog << "* Invalidated " << bk << " (" << sym << ")\n";
 #endif
-										changeCallback(*sym, std::get<std::int64_t>(bk));
-									} else {
-										nbks.push_front(bk);
-									}
+									evicted.emplace_back(bk);
+									changeCallback(*sym, std::get<std::int64_t>(bk));
 								}
-								bks = nbks;
 							}
-							return bks;
-						});
+
+							if (evicted.size()) {
+								dependencies.update_in(*sym, [&](auto bks) -> pcoll::optional<pcoll::llist<BuildKey>> {
+									if (bks.has_value) {
+										pcoll::llist<BuildKey> nbks;
+										for (auto &bk : *bks) {
+											if (std::find(evicted.begin(), evicted.end(), bk) == evicted.end()) {
+												nbks.push_front(bk);
+											}
+										}
+										bks = nbks;
+									}
+									return bks;
+								});
+							}
+						}
 						token = ptr;
 					}
 				}
@@ -65,6 +80,55 @@ namespace Kronos {
 				return results;
 			}
 
+			bool Compiler::Revalidate(const BuildKey& bk, std::unordered_map<std::int64_t, TypedGraph>& respecialized) {
+				auto known = typedGraphs[bk];
+				if (!known.has_value) return false;
+
+				auto closureUid = std::get<std::int64_t>(bk);
+				auto f = respecialized.find(closureUid);
+				if (f == respecialized.end()) {
+					std::lock_guard<std::recursive_mutex> lg(contextLock);
+					TypedGraph typed;
+					revalidating = true;
+					try {
+						auto closureType = closureUid ? cx.TypeFromUID(closureUid) : GetNil();
+						typed = cx.Specialize(evaluatorGraph, closureType, nullptr, 0);
+						RecordDependencies(bk, cx.GetResolutionTrace()->c_str());
+					} catch (...) {
+						// let the rebuild report the error
+					}
+					revalidating = false;
+					f = respecialized.emplace(closureUid, typed).first;
+				}
+
+				// the hash only rules out changes; equal hashes are confirmed structurally
+				bool unchanged = !f->second.Empty() &&
+					f->second.GetGraphHash() == (*known).GetGraphHash() &&
+					f->second.Equal(*known);
+#if CACHE_LOGGING
+				if (unchanged) std::clog << "= " << closureUid << " is unchanged\n";
+#endif
+				return unchanged;
+			}
+
+			void Compiler::RecordDependencies(const BuildKey& buildKey, const std::string& trace) {
+				std::istringstream tokenStream(trace);
+				std::string token;
+				for (;std::getline(tokenStream, token, ' ');) {
+					dependencies.update_in(token, [&](pcoll::optional<pcoll::llist<BuildKey>> deps) {
+						pcoll::llist<BuildKey> ds;
+#if CACHE_LOGGING
+                        std::clog << "+ " << std::get<0>(buildKey) << " depends on " << token << "\n";
+#endif
+						if (deps.has_value) {
+							ds = *deps;
+							for (auto& bk : ds) if (bk == buildKey) return ds;
+						}
+						return ds.push_front(buildKey);
+					});
+				}
+			}
+
 			static const char *strchr0(const char *ptr, char delimiter) {
 				while (*ptr && *ptr != delimiter) ++ptr;
 				return ptr;
@@ -75,11 +139,15 @@ namespace Kronos {
 					? cx.TypeFromUID(buildTask.closureUid)
 					: GetNil();
 
-                // having these on stack triggers a strange
+                // having this on stack triggers a strange
                 // crash on MSVC. Memory corruption?
-                auto token = std::make_unique<std::string>();
                 auto traceStr = std::make_unique<std::string>();
 
+				// forget the previous graph until this build succeeds
+				typedGraphs.update_in({ buildTask.closureUid, buildTask.flags }, [](auto) {
+					return pcoll::none{};
+				});
+
                 try {
 
 					parentTask = &buildTask;
@@ -88,7 +156,26 @@ namespace Kronos {
 #endif
 					auto typed = cx.Specialize(evaluatorGraph, closureType, nullptr, 0);
 
-					auto code = std::make_shared<Runtime::ClassCode>(cx.Make("llvm", typed, buildTask.flags));
+					// evaluations run once; latency matters more than code quality, so they are
+					// interpreted unless the interpreter lacks something the graph needs
+					std::shared_ptr<Runtime::ClassCode> code;
+					if ((int)buildTask.flags & OmitReactiveDrivers) {
+						try {
+							code = std::make_shared<Runtime::ClassCode>(cx.Make("interpreter", typed, buildTask.flags));
+						} catch (Kronos::IError&) {
+							code = std::make_shared<Runtime::ClassCode>(cx.Make("llvm-quick", typed, buildTask.flags));
+						}
+					} else {
+						code = std::make_shared<Runtime::ClassCode>(cx.Make("llvm", typed, buildTask.flags));
+					}
+
+					if (cx.GetProfileStatus(code->classData.get()) >= 0) {
+						std::lock_guard<std::mutex> lg{ profilingLock };
+						profiling.emplace_back(BuildKey{ buildTask.closureUid, buildTask.flags }, code);
+						if (!profileMonitor.joinable()) {
+							profileMonitor = std::thread([this]() { MonitorProfiles(); });
+						}
+					}
 
 					// call environment to finalize
 					buildTask.postProcessor(*code);
@@ -106,6 +193,9 @@ namespace Kronos {
 #if COMPILER_LOGGING
 					std::clog << "<< Fulfilled " << std::hex << buildTask.closureUid << " >>\n" << std::dec;
 #endif
+					typedGraphs.update_in({ buildTask.closureUid, buildTask.flags }, [&typed](auto) {
+						return typed;
+					});
 					buildTask.promise->set_value(code);
 				} catch (Kronos::IProgramError&) {
 					std::stringstream log;
@@ -137,31 +227,48 @@ namespace Kronos {
 					buildTask.promise->set_exception(std::current_exception());
 				}
 				// mark symbol dependencies for invalidation
-				auto buildKey = BuildKey{
-					buildTask.closureUid,
-					buildTask.flags
-				};
-
-				std::istringstream tokenStream(*traceStr);
-				for (;std::getline(tokenStream, *token, ' ');) {
-					dependencies.update_in(*token, [&](pcoll::optional<pcoll::llist<BuildKey>> deps) {
-						pcoll::llist<BuildKey> ds;
-#if CACHE_LOGGING
-                        std::clog << "+ " << std::get<0>(buildKey) << " depends on " << *token << "\n";
-#endif
-						if (deps.has_value) ds = *deps;
-						return ds.push_front(buildKey);
-					});
-				}
+				RecordDependencies({ buildTask.closureUid, buildTask.flags }, *traceStr);
 			}
 
 			void Compiler::Invalidate(std::int64_t buildTy, BuildFlags flags) {
 				std::lock_guard<std::recursive_mutex> lg(contextLock);
+				typedGraphs.update_in({ buildTy, flags }, [](auto v) {
+					return pcoll::none{};
+				});
 				buildCache.update_in({ buildTy, flags }, [](auto v) {
 					return pcoll::none{};
 				});
 			}
 
+			void Compiler::MonitorProfiles() {
+				std::unique_lock<std::mutex> ul{ profilingLock };
+				while (!profilingShutdown) {
+					profilingWake.wait_for(ul, std::chrono::milliseconds(100));
+
+					std::vector<BuildKey> complete;
+					for (auto i = profiling.begin(); i != profiling.end();) {
+						auto code = i->second.lock();
+						if (!code) {
+							i = profiling.erase(i);
+						} else if (cx.GetProfileStatus(code->classData.get()) > 0) {
+							complete.emplace_back(i->first);
+							i = profiling.erase(i);
+						} else ++i;
+					}
+
+					if (complete.empty()) continue;
+
+					// the callback may block on builds, which need profilingLock
+					ul.unlock();
+					for (auto& bk : complete) {
+						Invalidate(std::get<std::int64_t>(bk), std::get<BuildFlags>(bk));
+						std::lock_guard<std::mutex> lg{ profileCallbackLock };
+						if (profileCallback) profileCallback(std::get<std::int64_t>(bk));
+					}
+					ul.lock();
+				}
+			}
+
 			void Compiler::AdditionalBuild(const Build& parentTask, int64_t closureUid, int flags) {
 #if COMPILER_LOGGING
 				std::clog << "<< Additionally " << closureUid << " >>\n";
@@ -178,7 +285,7 @@ namespace Kronos {
 				cx.RegisterSpecializationCallback("kvm_anticipate_after", [](void *ptr, KRONOS_INT, const IType* tyPtr, int64_t tyUid) {
 					auto self = (Compiler*)ptr;
 					
-					if (tyUid == 0) return;
+					if (tyUid == 0 || self->revalidating) return;
 
 					if (true || (self->parentTask->flags & DeterministicBuild) == DeterministicBuild) {
 						self->AdditionalBuild(*self->parentTask, tyUid, self->parentTask->flags);
@@ -188,8 +295,8 @@ namespace Kronos {
 				}, this);
 
 				cx.RegisterSpecializationCallback("kvm_anticipate_start", [](void* ptr, KRONOS_INT, const IType* tyPtr, int64_t tyUid) {
-					if (tyUid == 0) return;
 					auto self = (Compiler*)ptr;
+					if (tyUid == 0 || self->revalidating) return;
 					int flags = (int)self->parentTask->flags;
 					flags |= OmitEvaluate;
 					flags &= ~OmitReactiveDrivers;
@@ -276,6 +383,14 @@ namespace Kronos {
 					}
 					worker.join();
 				}
+				if (profileMonitor.joinable()) {
+					{
+						LGuard lg{ profilingLock };
+						profilingShutdown = true;
+						profilingWake.notify_one();
+					}
+					profileMonitor.join();
+				}
 			}
 		}
 
@@ -319,6 +434,19 @@ namespace Kronos {
 			JiT.Parse("snd = nil");
 			sndClosureTy = ParseToUID(sndMagic.str());
 			instanceHandle = Start(sndClosureTy, 0, 0);
+			JiT.SetProfileCallback([this](std::int64_t closureTy) {
+				if (closureTy == sndClosureTy) RestartSnd();
+				else ReplaceAll(closureTy);
+			});
+		}
+
+		void Console::RestartSnd() {
+			std::lock_guard<std::mutex> lg{ sndLock };
+			if (instanceHandle) {
+				instanceHandle = Replace(instanceHandle, sndClosureTy, 0, 0);
+			} else {
+				instanceHandle = Start(sndClosureTy, 0, 0);
+			}
 		}
 
 
@@ -346,12 +474,7 @@ namespace Kronos {
 						Parse(*GetHost(), replOutput, expr + "\"ok\")");
 					}
 
-					if (recompileSnd) {
-						if (instanceHandle) {
-							Stop(instanceHandle);
-						}
-						instanceHandle = Start(sndClosureTy, 0, 0);
-					}
+					if (recompileSnd) RestartSnd();
 				} catch (Kronos::IProgramError& pe) {
 					auto log = pe.GetErrorLog();
 					ToErr(pe, log ? log : "");
@@ -362,6 +485,8 @@ namespace Kronos {
 		}
 
 		void Console::Shutdown() {
+			JiT.SetProfileCallback({});
+			std::lock_guard<std::mutex> lg{ sndLock };
 			if (instanceHandle) {
 				Stop(instanceHandle);
 			}
@@ -418,6 +543,20 @@ namespace Kronos {
 			return 0;
 		}
 
+		int64_t JiTEnvironment::Replace(int64_t instanceId, int64_t closureType, const void *closureData, size_t closureSz) {
+			try {
+				return Runtime::Environment::Replace(instanceId, closureType, closureData, closureSz);
+			} catch (Kronos::IProgramError& pe) {
+				JiT.Invalidate(closureType, OmitEvaluate);
+				auto log = pe.GetErrorLog();
+				ToErr(pe, log ? log : "");
+			} catch (Kronos::IError &ie) {
+				JiT.Invalidate(closureType, OmitEvaluate);
+				ToErr(ie);
+			}
+			return instanceId;
+		}
+
 
 		std::string Console::ReadLine() {
 			return buffer.ReadLine();
@@ -89,6 +89,22 @@ namespace Kronos {
 				pcoll::hamt<BuildKey, BuildResultFuture, BuildKey::Hash> buildCache;
 				pcoll::hamt<std::string, pcoll::llist<BuildKey>> dependencies;
 
+				// typed graph of each completed build; a changed symbol only
+				// evicts builds whose closure now specializes differently
+				pcoll::hamt<BuildKey, Kronos::TypedGraph, BuildKey::Hash> typedGraphs;
+				bool revalidating = false;
+				void RecordDependencies(const BuildKey&, const std::string& trace);
+				bool Revalidate(const BuildKey&, std::unordered_map<std::int64_t, Kronos::TypedGraph>& respecialized);
+
+				// builds that are collecting a profile; rebuilt once the profile is complete
+				std::mutex profilingLock, profileCallbackLock;
+				std::condition_variable profilingWake;
+				std::vector<std::pair<BuildKey, std::weak_ptr<ClassCode>>> profiling;
+				std::function<void(std::int64_t)> profileCallback;
+				bool profilingShutdown = false;
+				std::thread profileMonitor;
+				void MonitorProfiles();
+
 				void Compile(const Build&);
 				BuildResultFuture MakeBuildTask(BuildPostProcessor pp, int64_t priority, int64_t closureUid, int flags, std::function<void(const Build&)> perform);
 
@@ -112,6 +128,13 @@ namespace Kronos {
 
 				void Invalidate(int64_t buildGraphTy, BuildFlags);
 
+				// called with the closure type of a build whose profile is complete and that was
+				// evicted from the cache; never called from the compiler thread
+				void SetProfileCallback(std::function<void(std::int64_t)> cb) {
+					std::lock_guard<std::mutex> lg{ profileCallbackLock };
+					profileCallback = std::move(cb);
+				}
+
 				void SetDebugTrace(std::string flt) {
 					std::lock_guard<std::recursive_mutex> lg(contextLock);
 					cx.SetCompilerDebugTraceFilter(flt.c_str());
@@ -148,6 +171,8 @@ namespace Kronos {
 			}
 			std::int64_t MakeInstance(const std::string& innerCode);
 			int64_t Start(int64_t closureType, const void *closureData, size_t closureSz) override;
+			// keeps the running instance if the replacement fails to build
+			int64_t Replace(int64_t instanceId, int64_t closureType, const void *closureData, size_t closureSz) override;
 			void SetCompilerDebugTrace(std::string filter);
 		};
 
@@ -163,6 +188,8 @@ namespace Kronos {
 			EntryBuffer buffer;
 			std::int64_t instanceHandle = 0;
 			std::int64_t sndClosureTy = 0;
+			std::mutex sndLock;
+			void RestartSnd();
 		public:
 			Console(IO::IHierarchy* io, JiT::Compiler& c);
 			std::string ReadLine();
@@ -2,6 +2,7 @@
 #include "TestInstrumentation.h"
 #include "common/bitstream.h"
 #include "paf/PAF.h"
+#include "runtime/fpenv.h"
 
 #include <iostream>
 #include <cstring>
@@ -122,6 +123,7 @@ public:
 		const int blockSize = 1024;
 		float scratch[blockSize * 8];
 		current = this;
+		FPEnv::FlushScope flushDenormals;
 
 		auto tp = FakeClock();
 		dump.reserve(dumpChannels * dumpFrames + blockSize);
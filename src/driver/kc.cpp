@@ -13,7 +13,8 @@
 
 #ifdef HAVE_LLVM
 #define LLVM_PARAMS \
-	F(emit_llvm, ll, false, "", "export symbolic assembly in the LLVM IR format") 
+	F(emit_llvm, ll, false, "", "export symbolic assembly in the LLVM IR format") \
+	F(bundle, b, std::string(""), "<lib>", "build a shared library (.so, .dylib) or static archive (.a) and a C++ header with a block processing wrapper") 
 #else
 #define LLVM_PARAMS 
 #endif
@@ -27,6 +28,13 @@
 #define BINARYEN_PARAMS 
 #endif
 
+#ifdef HAVE_CSOURCE
+#define CSOURCE_PARAMS \
+	F(emit_c, c, false, "", "export portable C99 source") 
+#else
+#define CSOURCE_PARAMS 
+#endif
+
 #define EXPAND_PARAMS \
 	F(input, i, std::string(""), "<path>", "input source file name; '-' for stdin") \
 	F(output, o, std::string(""), "<path>", "output file name, '-' for stdout") \
@@ -35,11 +43,12 @@
 	F(arg, a, std::string("nil"), "<expr>", "Kronos expression that determines the type of the external argument to main") \
 	F(assembly, S, false, "", "emit symbolic assembly") \
 	F(prefix, P, std::string(""), "<sym>", "prefix; namespace for exported symbols") \
-	LLVM_PARAMS BINARYEN_PARAMS \
+	LLVM_PARAMS BINARYEN_PARAMS CSOURCE_PARAMS \
 	F(backend, G, std::string(""), "<backend>", "Select backend; default is 'llvm'.") \
 	F(mcpu, C, std::string(""), "<cpu>", "engine-specific string describing the target cpu") \
 	F(mtriple, T, std::string("host"), "<triple>", "target triple to compile for") \
 	F(quiet, q, false, "", "quiet mode; suppress logging to stdout") \
+	F(flush_denormals, fd, false, "", "generated drivers run with flush-to-zero and denormals-are-zero, restoring the caller's mode on return") \
 	F(diagnostic, D, false, "", "dump specialization diagnostic trace as XML") \
 	F(help, h, false, "", "display this user guide") 
 
@@ -48,12 +57,34 @@ namespace CL {
 #define F(LONG, SHORT, DEFAULT, LABEL, DESCRIPTION) Option<decltype(DEFAULT)> LONG(DEFAULT, "--" #LONG, "-" #SHORT, LABEL, DESCRIPTION);
 	EXPAND_PARAMS
 #undef F
+	// spelled with a hyphen, unlike the options generated above
+	Option<std::string> profile_compiler("", "--profile-compiler", "-pc", "<path>", "write compiler phase timings to <path> in the Chrome trace format");
 }
 
 using namespace std;
 
 void FormatErrors(const char *xml, std::ostream& out, Kronos::Context& cx, int indent = 0);
 
+#ifdef HAVE_LLVM
+static std::string FromEnvironment(const char *var, const char *fallback) {
+	auto val = getenv(var);
+	return val && *val ? val : fallback;
+}
+
+// links the object file into a library that depends on nothing but libc and libm
+static void LinkBundle(const std::string& object, const std::string& library) {
+	std::string command;
+	if (library.size() > 2 && library.substr(library.size() - 2) == ".a") {
+		command = FromEnvironment("AR", "ar") + " rcs \"" + library + "\" \"" + object + "\"";
+	} else {
+		command = FromEnvironment("CC", "cc") + " -shared -o \"" + library + "\" \"" + object + "\" -lm";
+	}
+	if (system(command.c_str())) {
+		throw std::runtime_error("Linking the bundle failed: " + command);
+	}
+}
+#endif
+
 bool hasEnding(std::string const &fullString, std::string const &ending) {
 	if (fullString.length( ) >= ending.length( )) {
 		return (0 == fullString.compare(fullString.length( ) - ending.length( ), ending.length( ), ending));
@@ -78,6 +109,22 @@ int main(int n, const char *carg[]) {
 			throw std::invalid_argument("Unknown command line option: "s + badOption);
 		}
 
+#ifdef HAVE_LLVM
+		std::string bundleBase, bundleHeader, bundleObject;
+		if (CL::bundle().size()) {
+			bundleBase = CL::bundle();
+			// only an extension of the file name, not a dot in a directory such as ./out/lib
+			auto ext = bundleBase.find_last_of('.');
+			auto sep = bundleBase.find_last_of("/\\");
+			if (ext != bundleBase.npos && (sep == bundleBase.npos || ext > sep)) bundleBase.erase(ext);
+			bundleHeader = bundleBase + ".h";
+			bundleObject = bundleBase + ".o";
+			std::list<const char*> headerOption{ "-H", bundleHeader.c_str() };
+			CL::Registry().Parse(headerOption);
+			CL::output = bundleObject;
+		}
+#endif
+
 		if (CL::help()) {
 			CL::Registry().ShowHelp(std::cout,
 				"KC; Kronos " KRONOS_PACKAGE_VERSION " Static Compiler \n"
@@ -88,6 +135,7 @@ int main(int n, const char *carg[]) {
 
 		Context myContext = CreateContext(Packages::DefaultClient::ResolverCallback, &bbClient); {
 			cx = myContext;
+			if (CL::profile_compiler().size()) myContext.SetCompilerProfiling(true);
 
 			for (auto p : args) {
 				myContext.ImportFile(p);
@@ -138,6 +186,12 @@ int main(int n, const char *carg[]) {
 				symbolicAsm = true;
 			}
 #endif
+#ifdef HAVE_CSOURCE
+			else if (CL::emit_c()) {
+				ext = ".c";
+				symbolicAsm = true;
+			}
+#endif
 
 			if (CL::output.Get().empty( )) {
 				if (symbolicAsm) CL::output = "-";
@@ -182,13 +236,30 @@ int main(int n, const char *carg[]) {
 			myContext.Make(CL::prefix().c_str(), ext.c_str(), 
 				*stream,
 				CL::backend().c_str(), specialization,
-				Kronos::Default,
+				CL::flush_denormals() ? Kronos::FlushDenormals : Kronos::Default,
 				CL::mtriple().c_str(),
 				CL::mcpu().c_str());
 
 			stream->flush();
 
 			if (CL::quiet() == false && stream != &cout) std::cout << "OK\n";
+
+#ifdef HAVE_LLVM
+			if (CL::bundle().size()) {
+				file.close();
+				if (CL::quiet() == false) clog << "Linking " << CL::bundle() << "... ";
+				LinkBundle(bundleObject, CL::bundle());
+				if (CL::quiet() == false) std::cout << "OK\n";
+			}
+#endif
+
+			if (CL::profile_compiler().size()) {
+				ofstream profile(CL::profile_compiler());
+				if (!profile.is_open()) {
+					throw std::runtime_error("Can't open '"s + CL::profile_compiler() + "' for writing."s);
+				}
+				myContext.GetCompilerProfileAsJSON(profile);
+			}
 		}
 	} catch (Kronos::IProgramError& pe) {
 		std::cerr << "* Program Error E" << pe.GetErrorCode( ) << ": " << pe.GetSourceFilePosition( ) << "; " << pe.GetErrorMessage( ) << " *\n";
@@ -1,151 +1,665 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <list>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <map>
+#include <atomic>
+#include <filesystem>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <csignal>
+#include "kronos.h"
+#include "CmdLineOpts.h"
+#include "config/system.h"
+#include "driver/package.h"
+#include "paf/PAF.h"
+
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
 #define EXPAND_PARAMS \
 	F(input, i, std::string(""), "<path>", "input soundfile") \
 	F(output, o, std::string(""), "<path>", "output soundfile") \
-	F(tail, t, 0, "<samples>", "set output file length padding relative to input") \
+	F(tail, t, 0, "<samples>", "set output file length padding relative to input; -1 streams until the output pipe is closed") \
 	F(bitdepth, b, 0, "", "override bit depth for output file") \
 	F(bitrate, br, 0, "", "override bitrate for output file") \
 	F(samplerate, sr, 0, "", "override sample rate for output file") \
 	F(expr, e, std::string("Main"), "<expr>", "function to apply to the soundfile") \
 	F(quiet, q, false, "", "quiet mode; suppress logging to stdout") \
+	F(stream, s, false, "", "streaming mode; constant memory, double buffered reads and writes. '-' as input or output pipes raw 32-bit float PCM through stdin or stdout") \
+	F(block, bs, 4096, "<frames>", "block size for streaming mode") \
+	F(channels, ch, 2, "<num>", "channel count of raw PCM read from stdin") \
+	F(batch, ba, std::string(""), "<list|pattern>", "batch mode; process every file named in a list file or matching a wildcard pattern into the --output directory") \
+	F(jobs, j, 0, "<num>", "worker threads for batch mode; 0 uses every core") \
+	F(flush_denormals, fd, false, "", "compile the processor to run with flush-to-zero and denormals-are-zero") \
 	F(import_path, ip, std::list<std::string>(),"<path>", "Add paths to look for imports in") \
-	F(help, h, false, "", "display this user guide") 
+	F(help, h, false, "", "display this user guide")
 
-#include "CmdLineMacro.h"
-#include "kronos.h"
-#include "PAF.h"
-
-#include <fstream>
-#include <sstream>
-#include <vector>
-#include <algorithm>
+namespace CL {
+	using namespace CmdLine;
+#define F(LONG, SHORT, DEFAULT, LABEL, DESCRIPTION) Option<decltype(DEFAULT)> LONG(DEFAULT, "--" #LONG, "-" #SHORT, LABEL, DESCRIPTION);
+	EXPAND_PARAMS
+#undef F
+}
 
 using namespace std;
 
-void FormatErrors(const std::string& xml, std::ostream& out, Kronos::Context& cx);
-void GetRequestedIOConfig(const Kronos::StaticClass& cls, int& numIns, int& numOuts);
+void FormatErrors(const char *xml, std::ostream& out, Kronos::Context& cx, int indent = 0);
+
+static void SetBinaryMode(FILE* f) {
+#ifdef WIN32
+	_setmode(_fileno(f), _O_BINARY);
+#endif
+}
+
+// Hands fixed size blocks between the processing loop and an I/O thread.
+// Two blocks are allocated up front, so memory use does not depend on stream length.
+class BlockPipe {
+	std::vector<float> blocks[2];
+	int fill[2] = { 0, 0 };
+	bool full[2] = { false, false };
+	int head = 0, tail = 0;
+	bool closed = false;
+	std::mutex lock;
+	std::condition_variable cv;
+public:
+	BlockPipe(size_t blockSize) {
+		for (auto& b : blocks) b.resize(blockSize);
+	}
 
-int main(int n, const char *carg[]) {
-	using namespace Kronos;
-	stringstream log;
-	Context cx;
+	// an empty block to fill, or null if the consumer has given up
+	float* Acquire() {
+		std::unique_lock<std::mutex> lg(lock);
+		cv.wait(lg, [this]() { return closed || !full[head]; });
+		return closed ? nullptr : blocks[head].data();
+	}
 
-	try {
-		cx = Kronos::CreateContext( );
+	// hand the acquired block over; zero samples signals end of stream
+	void Publish(int samples) {
+		std::lock_guard<std::mutex> lg(lock);
+		fill[head] = samples;
+		full[head] = true;
+		head ^= 1;
+		cv.notify_all();
+	}
 
-		std::list<std::string> args;
-		for (int i(1);i < n;++i) args.emplace_back(carg[i]);
-		CmdLineParser ci(args);
+	const float* Receive(int& samples) {
+		std::unique_lock<std::mutex> lg(lock);
+		cv.wait(lg, [this]() { return full[tail]; });
+		samples = fill[tail];
+		return blocks[tail].data();
+	}
 
-		if (ci.help) {
-			ci.ShowHelp(
-				"KPIPE; Kronos " KRONOS_PACKAGE_VERSION " Soundfile Processor\n(c) 2015 Vesa Norilo, University of Arts Helsinki\n\n"
-				"PARAMETERS\n\n");
-			return 0;
+	void Release() {
+		std::lock_guard<std::mutex> lg(lock);
+		full[tail] = false;
+		tail ^= 1;
+		cv.notify_all();
+	}
+
+	void Close() {
+		std::lock_guard<std::mutex> lg(lock);
+		closed = true;
+		cv.notify_all();
+	}
+};
+
+struct PipeStats {
+	int64_t frames = 0;
+	double seconds = 0;
+	bool outputClosed = false;
+};
+
+// true if the type descriptor describes nothing but 32-bit floats
+static bool IsFloatFrame(const char* descriptor) {
+	for (auto c = descriptor; *c; ++c) {
+		if (*c == '%') {
+			++c;
+			if (*c == '[') {
+				while (*c && *c != ':') ++c;
+				if (!*c) return false;
+			} else if (*c != 'f' && *c != ']') return false;
+		} else if (!strchr("() ", *c)) return false;
+	}
+	return true;
+}
+
+// A compiled processor. The class is configured once, before anything is
+// instantiated, because the state size is derived from the configuration.
+struct Processor {
+	Kronos::Class cls;
+	const krt_sym* audio = nullptr;
+	const krt_sym* rate = nullptr;
+	int numOuts = 0;
+	float sampleRate;
+	std::vector<char> zeros;
+
+	Processor(Kronos::Class c, float sampleRate) :cls(std::move(c)), sampleRate(sampleRate) {
+		size_t inputBytes = sizeof(float);
+		for (int i = 0; i < cls->num_symbols; ++i) {
+			auto& sym = cls->symbols[i];
+			if (!strcmp(sym.sym, "audio") && sym.process) audio = &sym;
+			else if (!strcmp(sym.sym, "#Rate{audio}")) rate = &sym;
+			inputBytes = std::max(inputBytes, (size_t)sym.size);
 		}
 
-		for (auto&& file : ci.positional) {
-			cx.ImportFile( file );
+		if (!audio) throw std::runtime_error("The processor is not driven by the audio clock");
+
+		numOuts = (int)(cls->result_type_size / sizeof(float));
+		if (numOuts == 0 || !IsFloatFrame(cls->result_type_descriptor)) {
+			throw std::runtime_error("Type of processor output, "s + cls->result_type_descriptor + ", is invalid");
 		}
 
-		PAF::AudioFileReader soundFileIn(ci.input.c_str( ));
-		PAF::AudioFileWriter soundFileOut(ci.output.c_str( ));
-		std::stringstream src, log;
+		// inputs without a default read silence
+		zeros.resize(inputBytes);
+		for (int i = 0; i < cls->num_symbols; ++i) {
+			auto& sym = cls->symbols[i];
+			if ((sym.flags & KRT_FLAG_NO_DEFAULT) && sym.slot_index >= 0) {
+				cls->configure(sym.slot_index, &sym == rate ? (const void*)&this->sampleRate : zeros.data());
+			}
+		}
+	}
 
-		int numIns = 0;
+	Processor(const Processor&) = delete;
+	Processor& operator=(const Processor&) = delete;
+};
+
+// the state of one processor instance
+class Instance {
+	const Processor& p;
+	std::vector<char> state;
+	float rate;
+public:
+	Instance(const Processor& p, float sampleRate) :p(p), state((size_t)p.cls->get_size()), rate(sampleRate) {
+		// bound before construction, so the instance never reads another one's rate
+		if (p.rate && p.rate->slot_index >= 0) *p.cls->var(state.data(), p.rate->slot_index) = &rate;
+		std::vector<char> arg((size_t)std::max<int64_t>(p.cls->eval_arg_size, 1));
+		p.cls->construct(state.data(), arg.data());
+	}
 
-		if (!soundFileOut) throw std::runtime_error("Couldn't open output file");
+	~Instance() {
+		p.cls->destruct(state.data());
+	}
 
-		if (soundFileIn) {
-			if (soundFileOut->Has(PAF::BitDepth)) {
-				if (soundFileIn->Has(PAF::BitDepth)) soundFileOut->Set(PAF::BitDepth, soundFileIn[PAF::BitDepth]);
-				if (ci.bitdepth) soundFileOut->Set(PAF::BitDepth, ci.bitdepth);
-			}
+	Instance(const Instance&) = delete;
+	Instance& operator=(const Instance&) = delete;
+
+	// the stream driver advances the input pointer, so it is rebound for every block
+	void Render(const float* input, float* output, int frames) {
+		if (p.audio->slot_index >= 0) *p.cls->var(state.data(), p.audio->slot_index) = (void*)input;
+		p.audio->process(state.data(), output, frames);
+	}
+};
+
+static void ConfigureOutput(PAF::AudioFileWriter& out, PAF::AudioFileReader* in, int64_t sampleRate) {
+	if (out->Has(PAF::BitDepth)) {
+		if (in && (*in)->Has(PAF::BitDepth)) out->Set(PAF::BitDepth, (*in)[PAF::BitDepth]);
+		if (CL::bitdepth() || !in) out->Set(PAF::BitDepth, CL::bitdepth() ? CL::bitdepth() : 16);
+	}
+	if (out->Has(PAF::BitRate)) {
+		if (in && (*in)->Has(PAF::BitRate)) out->Set(PAF::BitRate, (*in)[PAF::BitRate]);
+		if (CL::bitrate() || !in) out->Set(PAF::BitRate, CL::bitrate() ? CL::bitrate() : 192000);
+	}
+	if (out->Has(PAF::SampleRate)) out->Set(PAF::SampleRate, sampleRate);
+}
+
+// numIns is the channel count of the input stream, or -1 for a processor without input
+static std::unique_ptr<Processor> CompilePipe(Kronos::Context& cx, const std::string& expr, int numIns, int64_t sampleRate, bool flushDenormals, std::ostream& log) {
+	std::stringstream src;
+	if (numIns > 0) {
+		src << "Eval(" << expr << " Audio:Input(";
+		for (int i(0);i < numIns;++i) src << (i ? " 0" : "0");
+		src << "))";
+	} else {
+		src << "Eval(" << expr << " nil)";
+	}
 
-			if (soundFileOut->Has(PAF::BitRate)) {
-				if (soundFileIn->Has(PAF::BitRate)) soundFileOut->Set(PAF::BitRate, soundFileIn[PAF::BitRate]);
-				if (ci.bitrate) soundFileOut->Set(PAF::BitRate, ci.bitrate);
+	auto cls = cx.Make("llvm", src.str().c_str(), Kronos::GetNil( ), &log, 0, flushDenormals ? Kronos::FlushDenormals : Kronos::Default);
+	return std::make_unique<Processor>(std::move(cls), (float)sampleRate);
+}
+
+// renders 'proc' from readInput to writeOutput in blocks, overlapping both with processing
+static PipeStats RunPipe(Instance& proc, const std::function<int(float*, int)>& readInput,
+						 const std::function<bool(const float*, int)>& writeOutput,
+						 int inChannels, int numOuts, int blockFrames, int64_t tail, bool detachReader) {
+	std::vector<float> silence(blockFrames * std::max(inChannels, 1));
+	BlockPipe inPipe(silence.size()), outPipe(blockFrames * numOuts);
+	PipeStats stats;
+
+	std::thread reader;
+	if (readInput) {
+		reader = std::thread([&]() {
+			// whole frames only, so a short read never splits a frame
+			int blockSamples = blockFrames * inChannels;
+			while (float* buf = inPipe.Acquire()) {
+				int got = readInput(buf, blockSamples);
+				got -= got % std::max(inChannels, 1);
+				inPipe.Publish(got);
+				if (got == 0) break;
 			}
+		});
+	}
 
-			if (soundFileIn->Has(PAF::SampleRate) && soundFileOut->Has(PAF::SampleRate)) {
-				soundFileOut->Set(PAF::SampleRate, soundFileIn[PAF::SampleRate]);
-				if (ci.samplerate) soundFileOut->Set(PAF::SampleRate, ci.samplerate);
+	std::thread writer([&]() {
+		for (;;) {
+			int samples;
+			auto buf = outPipe.Receive(samples);
+			if (samples == 0) break;
+			if (!writeOutput(buf, samples)) {
+				stats.outputClosed = true;
+				outPipe.Close();
+				break;
+			}
+			outPipe.Release();
+		}
+	});
+
+	auto beg = std::chrono::steady_clock::now();
+	int64_t tailLeft = tail;
+	bool inputLive = (bool)readInput;
+
+	for (;;) {
+		const float* in = silence.data();
+		int frames = blockFrames;
+
+		if (inputLive) {
+			int got;
+			in = inPipe.Receive(got);
+			if (got == 0) {
+				inPipe.Release();
+				inputLive = false;
+				in = silence.data();
+			} else {
+				frames = inChannels ? got / inChannels : blockFrames;
 			}
+		}
 
-			numIns = (int)soundFileIn[PAF::NumChannels];
-			src << "Eval(" << ci.expr << " External-Stream(\"soundfile\"";
-			for (int i(0);i < numIns;++i) {
-				src << " 0";
+		if (!inputLive) {
+			if (tailLeft == 0) break;
+			if (tailLeft > 0) {
+				frames = (int)std::min<int64_t>(tailLeft, blockFrames);
+				tailLeft -= frames;
 			}
-			src << ") )";
-		} else {
-			src << "Eval(" << ci.expr << " nil)";
-			if (ci.bitdepth == 0) ci.bitdepth = 16;
-			if (ci.bitrate == 0) ci.bitrate = 192000;
-			if (ci.samplerate == 0) ci.samplerate = 44100;
+		}
 
-			if (soundFileOut->Has(PAF::BitDepth))	soundFileOut->Set(PAF::BitDepth, ci.bitdepth);
-			if (soundFileOut->Has(PAF::BitRate))	soundFileOut->Set(PAF::BitRate, ci.bitrate);
-			if (soundFileOut->Has(PAF::SampleRate)) soundFileOut->Set(PAF::SampleRate, ci.samplerate);
+		float* out = outPipe.Acquire();
+		if (!out) {
+			if (inputLive) inPipe.Release();
+			break;
 		}
 
-		auto soundFileProcTy = cx.Make("llvm", src.str().c_str(), Kronos::GetNil( ), &log, 0, Kronos::Default, "host", "host", "host");
-		int numOuts(0);
-		GetRequestedIOConfig(soundFileProcTy, numIns, numOuts);
+		proc.Render(in, out, frames);
+		if (inputLive) inPipe.Release();
+
+		outPipe.Publish(frames * numOuts);
+		stats.frames += frames;
+	}
 
-		std::vector<float> scratchSpace(numIns);
-		if (soundFileProcTy.HasVar(Kronos::GetString("soundfile"))) 
-			soundFileProcTy.SetVar(Kronos::GetString("soundfile"), scratchSpace.data( ));
+	// end of stream marker; the writer has already exited if the pipe closed
+	if (outPipe.Acquire()) outPipe.Publish(0);
+	writer.join();
+	inPipe.Close();
+	if (reader.joinable()) {
+		// a reader blocked on stdin would outlive a closed output; the process is about to exit
+		if (detachReader && stats.outputClosed) reader.detach();
+		else reader.join();
+	}
 
-		if (numOuts == 0) {
-			throw std::runtime_error("Type of processor output, " + soundFileProcTy.TypeOfResult( ).AsString( ) + ", is invalid");
-		}
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - beg).count();
+	return stats;
+}
 
-		soundFileOut->Set(PAF::NumChannels, numOuts);
+static void ReportThroughput(std::ostream& out, const PipeStats& stats, int64_t sampleRate) {
+	double audioSeconds = (double)stats.frames / sampleRate;
+	out << stats.frames << " frames (" << audioSeconds << "s) in " << stats.seconds << "s; "
+		<< (stats.seconds > 0 ? audioSeconds / stats.seconds : 0.0) << "x real-time";
+}
 
-		size_t numFrames = soundFileIn ? soundFileIn[PAF::NumSampleFrames] : 0;
-		numFrames += ci.tail;
+static void CheckInputLayout(const Processor& p, int inChannels) {
+	if (p.audio->size && p.audio->size != (int64_t)(inChannels * sizeof(float))) {
+		throw std::runtime_error("The processor reads " + std::to_string(p.audio->size / sizeof(float)) +
+								 " channels from a stream of " + std::to_string(inChannels));
+	}
+}
+
+// whole file rendering; the output codec pulls blocks from the processor
+static int FilePipe(Kronos::Context& cx, std::ostream& log) {
+	PAF::AudioFileReader in(CL::input().c_str( ));
+	PAF::AudioFileWriter out(CL::output().c_str( ));
+	if (!out) throw std::runtime_error("Couldn't open output file");
+
+	int numIns = -1;
+	int64_t sampleRate = CL::samplerate() ? CL::samplerate() : 44100;
+	if (in) {
+		numIns = (int)in[PAF::NumChannels];
+		if (!CL::samplerate() && in->Has(PAF::SampleRate)) sampleRate = in[PAF::SampleRate];
+	}
+	ConfigureOutput(out, in ? &in : nullptr, sampleRate);
+
+	int inChannels = std::max(numIns, 0);
+	auto p = CompilePipe(cx, CL::expr(), numIns, sampleRate, CL::flush_denormals(), log);
+	CheckInputLayout(*p, inChannels);
+	out->Set(PAF::NumChannels, p->numOuts);
+
+	Instance proc(*p, (float)sampleRate);
+	std::vector<float> workspace;
+	int64_t tailLeft = std::max(CL::tail(), 0);
+
+	out->Stream([&](float *buffer, int samples) {
+		int frames = samples / p->numOuts;
+		workspace.assign(frames * std::max(inChannels, 1), 0.f);
+		if (in) {
+			int didRead = in(workspace.data( ), frames * inChannels);
+			if (!didRead) in.Close( );
+		}
 
-		float sampleRate(0.f); 
-		auto rateKey = GetPair(GetString("audio"), GetString("Rate"));
-		if (soundFileProcTy.HasVar(rateKey)) {
-			sampleRate = (float)soundFileOut[PAF::SampleRate];
-			soundFileProcTy.SetVar(rateKey, &sampleRate);
+		if (!in) {
+			frames = (int)std::min<int64_t>(tailLeft, frames);
+			tailLeft -= frames;
 		}
 
-		auto soundFileProc = soundFileProcTy.Cons( );
-		auto soundFileSig = soundFileProc.GetVar(GetString("audio"));
-		auto soundFileTrig = soundFileProc.GetTrigger(GetString("audio"));
-		std::vector<float> workspace;
-		int tailLeft(ci.tail);
+		if (frames) proc.Render(workspace.data( ), buffer, frames);
+		return frames * p->numOuts;
+	});
 
-		soundFileOut->Stream([&](float *buffer, int samples) {
-			if (soundFileIn) {
-				workspace.resize(samples * soundFileIn[PAF::NumChannels] / numOuts);
-				int didRead = soundFileIn(workspace.data( ), (int)workspace.size( ));
-				for (int i(didRead); i < workspace.size( ); ++i) workspace[i] = 0;
-				if (!didRead) soundFileIn.Close( );
-			}
+	out.Close( );
+	return 0;
+}
+
+static int StreamPipe(Kronos::Context& cx, std::ostream& log) {
+	bool rawIn = CL::input() == "-", rawOut = CL::output() == "-";
+	if (CL::block() < 1) throw std::runtime_error("Block size must be positive");
+
+	// PAF handles are opened only for actual files; pipes bypass them
+	std::unique_ptr<PAF::AudioFileReader> fileIn;
+	std::unique_ptr<PAF::AudioFileWriter> fileOut;
+	std::function<int(float*, int)> readInput;
+	std::function<bool(const float*, int)> writeOutput;
+
+	int numIns = -1;
+	int64_t sampleRate = CL::samplerate() ? CL::samplerate() : 44100;
+
+	if (rawIn) {
+		SetBinaryMode(stdin);
+		numIns = CL::channels();
+		readInput = [](float* buf, int samples) {
+			return (int)fread(buf, sizeof(float), samples, stdin);
+		};
+	} else if (CL::input().size()) {
+		fileIn.reset(new PAF::AudioFileReader(CL::input().c_str()));
+		auto& in(*fileIn);
+		if (!in) throw std::runtime_error("Couldn't open input file");
+		numIns = (int)in[PAF::NumChannels];
+		if (!CL::samplerate() && in->Has(PAF::SampleRate)) sampleRate = in[PAF::SampleRate];
+		readInput = [&in](float* buf, int samples) {
+			return in(buf, samples);
+		};
+	}
 
-			if (!soundFileIn) {
-				samples = std::min(tailLeft, samples);
-				tailLeft -= samples;
-			}
+	if (rawOut) {
+		SetBinaryMode(stdout);
+#ifndef WIN32
+		// a closed downstream pipe ends the stream instead of the process
+		signal(SIGPIPE, SIG_IGN);
+#endif
+		writeOutput = [](const float* buf, int samples) {
+			return fwrite(buf, sizeof(float), samples, stdout) == (size_t)samples;
+		};
+	} else {
+		fileOut.reset(new PAF::AudioFileWriter(CL::output().c_str()));
+		auto& out(*fileOut);
+		if (!out) throw std::runtime_error("Couldn't open output file");
+		ConfigureOutput(out, fileIn.get(), sampleRate);
+		writeOutput = [&out](const float* buf, int samples) {
+			return out(buf, samples) == samples;
+		};
+	}
+
+	// the processor may ignore its input; the reader still needs the stream layout
+	int inChannels = std::max(numIns, 0);
+	auto p = CompilePipe(cx, CL::expr(), numIns, sampleRate, CL::flush_denormals(), log);
+	CheckInputLayout(*p, inChannels);
+
+	if (fileOut) (*fileOut)->Set(PAF::NumChannels, p->numOuts);
+
+	PipeStats stats;
+	{
+		Instance proc(*p, (float)sampleRate);
+		stats = RunPipe(proc, readInput, writeOutput, inChannels, p->numOuts, CL::block(), CL::tail(), rawIn);
+	}
+
+	if (fileOut) fileOut->Close();
+	if (rawOut) fflush(stdout);
 
-			if (samples) {
-				if (soundFileSig) soundFileSig.SetData( workspace.data( ) );
-				if (soundFileTrig) soundFileTrig.Go(buffer, samples / numOuts);
+	if (!CL::quiet()) {
+		// stdout may be carrying the audio
+		std::cerr << "* ";
+		ReportThroughput(std::cerr, stats, sampleRate);
+		std::cerr << (stats.outputClosed ? ", output closed" : "") << " *\n";
+	}
+	return 0;
+}
+
+static bool WildcardMatch(const char* pattern, const char* str) {
+	for (; *pattern; ++pattern, ++str) {
+		if (*pattern == '*') {
+			for (;; ++str) {
+				if (WildcardMatch(pattern + 1, str)) return true;
+				if (!*str) return false;
 			}
+		}
+		if (!*str || (*pattern != '?' && *pattern != *str)) return false;
+	}
+	return *str == 0;
+}
+
+// a text file listing one input per line, or a wildcard pattern in its last path component
+static std::vector<std::string> ExpandBatch(const std::string& spec) {
+	namespace fs = std::filesystem;
+	std::vector<std::string> files;
+	if (spec.find_first_of("*?") == spec.npos) {
+		std::ifstream list(spec);
+		if (!list) throw std::runtime_error("Couldn't open batch list " + spec);
+		for (std::string line; std::getline(list, line);) {
+			while (line.size() && isspace((unsigned char)line.back())) line.pop_back();
+			if (line.size() && line.front() != '#') files.emplace_back(line);
+		}
+	} else {
+		fs::path p(spec);
+		auto dir = p.has_parent_path() ? p.parent_path() : fs::path(".");
+		auto pattern = p.filename().string();
+		for (auto& entry : fs::directory_iterator(dir)) {
+			if (entry.is_regular_file() && WildcardMatch(pattern.c_str(), entry.path().filename().string().c_str())) {
+				files.emplace_back(entry.path().string());
+			}
+		}
+		std::sort(files.begin(), files.end());
+	}
+	return files;
+}
+
+// compiles one class per distinct input layout and renders files on worker threads,
+// each file with its own instance
+static int BatchPipe(Kronos::Context& cx, std::ostream& log) {
+	namespace fs = std::filesystem;
+	if (CL::block() < 1) throw std::runtime_error("Block size must be positive");
+	if (CL::output().empty()) throw std::runtime_error("Batch mode requires an output directory");
+	fs::create_directories(CL::output());
+
+	struct Job {
+		std::string input, output;
+		int channels = 0;
+		int64_t sampleRate = 0;
+		PipeStats stats;
+		std::string error;
+	};
+
+	std::vector<Job> jobs;
+	for (auto& f : ExpandBatch(CL::batch())) {
+		Job j;
+		j.input = f;
+		j.output = (fs::path(CL::output()) / fs::path(f).filename()).string();
+		jobs.emplace_back(std::move(j));
+	}
+
+	// probe headers and compile up front; the compiler stays on this thread.
+	// The sample rate is class configuration that state sizes derive from,
+	// so files at different rates never share a class.
+	using Layout = std::pair<int, int64_t>;
+	std::map<Layout, std::unique_ptr<Processor>> processors;
+	std::map<Layout, std::string> compileErrors;
+	for (auto& j : jobs) {
+		try {
+			std::error_code ec;
+			if (fs::equivalent(j.input, j.output, ec)) throw std::runtime_error("output would overwrite the input");
+			PAF::AudioFileReader in(j.input.c_str());
+			if (!in) throw std::runtime_error("Couldn't open input file");
+			j.channels = (int)in[PAF::NumChannels];
+			j.sampleRate = CL::samplerate() ? CL::samplerate() : in->Has(PAF::SampleRate) ? in[PAF::SampleRate] : 44100;
+		} catch (std::exception& e) {
+			j.error = e.what();
+			continue;
+		}
+
+		Layout layout{ j.channels, j.sampleRate };
+		if (processors.count(layout) || compileErrors.count(layout)) continue;
+
+		try {
+			auto p = CompilePipe(cx, CL::expr(), j.channels, j.sampleRate, CL::flush_denormals(), log);
+			CheckInputLayout(*p, j.channels);
+			processors.emplace(layout, std::move(p));
+		} catch (Kronos::IProgramError& pe) {
+			compileErrors[layout] = "E" + std::to_string(pe.GetErrorCode()) + ": " + pe.GetErrorMessage();
+		} catch (Kronos::IError& e) {
+			compileErrors[layout] = e.GetErrorMessage();
+		} catch (std::exception& e) {
+			compileErrors[layout] = e.what();
+		}
+	}
+
+	auto process = [&](Job& j) {
+		if (j.error.size()) return;
+		Layout layout{ j.channels, j.sampleRate };
+		auto ce = compileErrors.find(layout);
+		if (ce != compileErrors.end()) {
+			j.error = ce->second;
+			return;
+		}
 
-			return samples;
+		auto& p(*processors.find(layout)->second);
+		PAF::AudioFileReader in(j.input.c_str());
+		PAF::AudioFileWriter out(j.output.c_str());
+		if (!out) throw std::runtime_error("Couldn't open output file");
+		ConfigureOutput(out, &in, j.sampleRate);
+		out->Set(PAF::NumChannels, p.numOuts);
+
+		std::function<int(float*, int)> readInput = [&in](float* buf, int samples) {
+			return in(buf, samples);
+		};
+		std::function<bool(const float*, int)> writeOutput = [&out](const float* buf, int samples) {
+			return out(buf, samples) == samples;
+		};
+
+		{
+			// the instance holds its own copy of the rate until it is destroyed
+			Instance proc(p, (float)j.sampleRate);
+			j.stats = RunPipe(proc, readInput, writeOutput, j.channels, p.numOuts, CL::block(), std::max(CL::tail(), 0), false);
+		}
+		out.Close();
+		if (j.stats.outputClosed) j.error = "write failed";
+	};
+
+	int numWorkers = CL::jobs() > 0 ? CL::jobs() : (int)std::max(1u, std::thread::hardware_concurrency());
+	std::atomic<size_t> next{ 0 };
+	std::vector<std::thread> workers;
+	auto beg = std::chrono::steady_clock::now();
+	for (int w = 0; w < numWorkers; ++w) {
+		workers.emplace_back([&]() {
+			for (size_t i; (i = next++) < jobs.size();) {
+				try {
+					process(jobs[i]);
+				} catch (Kronos::IError& e) {
+					jobs[i].error = e.GetErrorMessage();
+				} catch (std::exception& e) {
+					jobs[i].error = e.what();
+				}
+			}
 		});
+	}
+	for (auto& w : workers) w.join();
+	auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - beg).count();
+
+	double audioSeconds = 0;
+	int failed = 0;
+	for (auto& j : jobs) {
+		if (j.error.size()) {
+			++failed;
+			std::cerr << "* " << j.input << ": " << j.error << " *\n";
+			continue;
+		}
+		audioSeconds += (double)j.stats.frames / j.sampleRate;
+		if (!CL::quiet()) {
+			std::cout << j.input << ": ";
+			ReportThroughput(std::cout, j.stats, j.sampleRate);
+			std::cout << "\n";
+		}
+	}
+
+	if (!CL::quiet()) {
+		std::cout << "* " << (jobs.size() - failed) << " of " << jobs.size() << " files, "
+			<< processors.size() << " classes compiled, " << numWorkers << " workers; "
+			<< audioSeconds << "s of audio in " << seconds << "s, "
+			<< (seconds > 0 ? audioSeconds / seconds : 0.0) << "x real-time *\n";
+	}
+	return failed ? -1 : 0;
+}
+
+int main(int n, const char *carg[]) {
+	using namespace Kronos;
+	stringstream log;
+	Context cx;
 
-		soundFileOut.Close( );
+	Packages::DefaultClient bbClient;
 
+	try {
+		std::list<const char*> args;
+		Kronos::AddBackendCmdLineOpts(CmdLine::Registry());
+		for (int i(1);i < n;++i) args.emplace_back(carg[i]);
+		if (auto badOption = CL::Registry().Parse(args)) {
+			throw std::invalid_argument("Unknown command line option: "s + badOption);
+		}
 
+		if (CL::help()) {
+			CL::Registry().ShowHelp(std::cout,
+				"KPIPE; Kronos " KRONOS_PACKAGE_VERSION " Soundfile Processor\n"
+				"(c) 2015-" KRONOS_BUILD_YEAR " Vesa Norilo, University of Arts Helsinki\n\n"
+				"PARAMETERS\n\n");
+			return 0;
+		}
+
+		cx = CreateContext(Packages::DefaultClient::ResolverCallback, &bbClient);
 
+		for (auto file : args) {
+			cx.ImportFile(file);
+		}
+
+		if (CL::batch().size()) return BatchPipe(cx, log);
+		if (CL::stream()) return StreamPipe(cx, log);
+		return FilePipe(cx, log);
 	} catch (Kronos::IProgramError& pe) {
 		std::cerr << "* Program Error E" << pe.GetErrorCode( ) << ": " << pe.GetSourceFilePosition( ) << "; " << pe.GetErrorMessage( ) << " *\n";
-		if (cx) FormatErrors(log.str( ), cerr, cx);
+		if (cx) FormatErrors(log.str( ).c_str(), cerr, cx);
 		return pe.GetErrorCode( );
 	} catch (Kronos::IError &e) {
 		cerr << "* Compiler Error: " << e.GetErrorMessage( ) << " *" << endl;
@@ -154,5 +668,4 @@ int main(int n, const char *carg[]) {
 		cerr << "* Runtime error: " << e.what( ) << " *" << endl;
 		return -1;
 	}
-	return 0;
-}
\ No newline at end of file
+}
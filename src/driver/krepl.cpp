@@ -14,6 +14,8 @@
 #include "TestInstrumentation.h"
 #include "ReplEnvironment.h"
 #include "runtime/inout.h"
+#include "runtime/oscdriver.h"
+#include "runtime/fpenv.h"
 
 using namespace std::string_literals;
 
@@ -22,6 +24,8 @@ using namespace std::string_literals;
 	F(interactive, I, false, "", "Prompt the user for additional expressions to evaluate") \
 	F(type_diagnostics, d, ""s, "<file.xml>", "Dump type error diagnostics as a detailed XML trace") \
 	F(import, i, std::list<std::string>(), "<module>", "Import source file <module>" ) \
+	F(osc_benchmark, ob, 0, "<msgs/s>", "Measure OSC message-to-dispatch latency over loopback at <msgs/s> and exit") \
+	F(flush_denormals, fd, false, "", "Run audio, rendering and test capture threads with flush-to-zero and denormals-are-zero") \
 	F(help, h, false, "", "help; display this user guide")
 
 Kronos::Context cx;
@@ -29,12 +33,14 @@ namespace CL {
 	#define F(LONG, SHORT, DEFAULT, LABEL, DESCR) static CmdLine::Option<decltype(DEFAULT)> LONG;
 	EXPAND_PARAMS
 	#undef F
+	static CmdLine::Option<std::string> profile_compiler;
 
 	static void SetRegistry(CmdLine::IRegistry& reg) {
 	#define F(LONG, SHORT, DEFAULT, LABEL, DESCRIPTION) \
 	LONG.Init(DEFAULT, "--" #LONG, "-" #SHORT, LABEL, DESCRIPTION, &reg); 
 	EXPAND_PARAMS
 	#undef F
+	profile_compiler.Init(""s, "--profile-compiler", "-pc", "<file.json>", "Write compiler phase timings in the Chrome trace format", &reg);
 	}
 };
 
@@ -57,6 +63,8 @@ int krepl_main(CmdLine::IRegistry& CLOpts, Kronos::IO::IConfiguringHierarchy* io
 		if (auto badOption = CLOpts.Parse(args)) {
 			throw std::invalid_argument("Unknown command line option: "s + badOption);
 		}
+
+		IO::FPEnv::SetFlushDenormals(CL::flush_denormals());
         
         std::unique_ptr<IO::IConfiguringHierarchy> ownedHierarchy;
         if (io == nullptr) {
@@ -80,9 +88,14 @@ int krepl_main(CmdLine::IRegistry& CLOpts, Kronos::IO::IConfiguringHierarchy* io
 			return 0;
 		}
 
+		if (CL::osc_benchmark() > 0) {
+			return IO::osc::LoopbackBenchmark(std::cout, CL::osc_benchmark(), 5);
+		}
+
 		if (repl_args.size() < 1) CL::interactive = true;
 
 		cx = CreateContext(Packages::DefaultClient::ResolverCallback, &bbClient);
+		if (CL::profile_compiler().size()) cx.SetCompilerProfiling(true);
 
 		for (auto import : CL::import()) {
 			std::ifstream file{ import };
@@ -145,6 +158,14 @@ int krepl_main(CmdLine::IRegistry& CLOpts, Kronos::IO::IConfiguringHierarchy* io
 		}
 
 		rootEnv.Shutdown();
+
+		if (CL::profile_compiler().size()) {
+			std::ofstream profile{ CL::profile_compiler() };
+			if (!profile.is_open()) {
+				throw std::runtime_error("Can't open '"s + CL::profile_compiler() + "' for writing.");
+			}
+			cx.GetCompilerProfileAsJSON(profile);
+		}
 	} catch (Kronos::IError &e) {
 		std::cerr << "* Compiler Error: " << e.GetErrorMessage( ) << " *" << std::endl;
 		if (cx) {
@@ -5,6 +5,7 @@
 #include "driver/package.h"
 #include "config/corelib.h"
 #include "JsonRPCRepl.h"
+#include "runtime/loadmeter.h"
 #include "paf/PAF.h"
 
 #include <iostream>
@@ -135,6 +136,14 @@ int main(int argn, const char* carg[]) {
 				} 
 			}) }, 
 			{ "asset", PostAsset },
+			{ "metrics", [](Socket&, const std::string&, const http::Request&, http::Response& resp) {
+				std::stringstream metrics;
+				IO::LoadMeter::WriteOpenMetrics(metrics);
+				auto text = metrics.str();
+				resp.ResultCode = resp.OK;
+				resp.Headers["Content-Type"] = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+				resp.Body = { text.data(), text.data() + text.size() };
+			} },
 			{ "repl",
 			Responders::Websocket([&](Responders::IWebsocketStream& wss) {
 				std::vector<char> buf;
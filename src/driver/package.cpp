@@ -1,4 +1,5 @@
 #include "package.h"
+#include "CmdLineOpts.h"
 #include "common/PlatformUtils.h"
 #include "config/system.h"
 
@@ -7,6 +8,7 @@
 #include <chrono>
 #include <memory>
 #include <thread>
+#include <atomic>
 #include <regex>
 
 #define KRONOS_USER_AGENT "Kronos WebRequest/" KRONOS_PACKAGE_VERSION
@@ -196,12 +198,16 @@ namespace {
 	}
 }
 #define CHECK(expr) { CURLcode err = expr; if (err != CURLE_OK) throw std::runtime_error("libCURL error " __FILE__ ":" + std::to_string(__LINE__) + " " + curl_easy_strerror(err)); }
-WebResponse WebRequest(std::string method, std::string server, std::string page, const void* body, size_t bodySize, const std::unordered_set<std::string>& extraHeaders) {
+static void CurlGlobalInit() {
 	static bool curl_global = false;
     if (!curl_global) {
         curl_global_init(CURL_GLOBAL_DEFAULT);
         curl_global = true;
     }
+}
+
+WebResponse WebRequest(std::string method, std::string server, std::string page, const void* body, size_t bodySize, const std::unordered_set<std::string>& extraHeaders) {
+	CurlGlobalInit();
     auto curl = Wrap(curl_easy_init());
     if (curl) {
 //		curl_easy_setopt(curl.get(), CURLOPT_VERBOSE, 1L);
@@ -247,6 +253,77 @@ WebResponse WebRequest(std::string method, std::string server, std::string page,
         throw std::runtime_error("Could not initialize libcurl");
     }
 }
+
+std::vector<WebResponse> WebRequestMany(const std::vector<std::string>& urls, int maxConnections) {
+	CurlGlobalInit();
+	std::vector<WebResponse> responses(urls.size());
+	if (urls.empty()) return responses;
+
+	std::unique_ptr<CURLM, CURLMcode(*)(CURLM*)> multi{ curl_multi_init(), curl_multi_cleanup };
+	if (!multi) throw std::runtime_error("Could not initialize libcurl");
+
+	// transfers beyond the connection limit are queued and reuse finished connections
+	curl_multi_setopt(multi.get(), CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)maxConnections);
+	curl_multi_setopt(multi.get(), CURLMOPT_MAX_HOST_CONNECTIONS, (long)maxConnections);
+	curl_multi_setopt(multi.get(), CURLMOPT_PIPELINING, (long)CURLPIPE_MULTIPLEX);
+
+	std::vector<std::unique_ptr<CURL, void(*)(CURL*)>> transfers;
+	for (size_t i = 0; i < urls.size(); ++i) {
+		auto curl = Wrap(curl_easy_init());
+		if (!curl) throw std::runtime_error("Could not initialize libcurl");
+		responses[i].code = 0;
+		responses[i].uri = urls[i];
+		CHECK(curl_easy_setopt(curl.get(), CURLOPT_URL, urls[i].c_str()));
+		CHECK(curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION, curl_write));
+		CHECK(curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &responses[i].data));
+		CHECK(curl_easy_setopt(curl.get(), CURLOPT_USERAGENT, KRONOS_USER_AGENT " (libCURL)"));
+		CHECK(curl_easy_setopt(curl.get(), CURLOPT_FOLLOWLOCATION, 1L));
+		CHECK(curl_easy_setopt(curl.get(), CURLOPT_PRIVATE, (void*)&responses[i]));
+		curl_multi_add_handle(multi.get(), curl.get());
+		transfers.emplace_back(std::move(curl));
+	}
+
+	int running = 0;
+	do {
+		if (curl_multi_perform(multi.get(), &running) != CURLM_OK) break;
+		if (running) curl_multi_wait(multi.get(), nullptr, 0, 1000, nullptr);
+	} while (running);
+
+	int queued = 0;
+	while (CURLMsg* msg = curl_multi_info_read(multi.get(), &queued)) {
+		if (msg->msg == CURLMSG_DONE && msg->data.result == CURLE_OK) {
+			WebResponse* response = nullptr;
+			long http_code = 0;
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&response);
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &http_code);
+			if (response) response->code = (int)http_code;
+		}
+	}
+
+	for (auto& t : transfers) curl_multi_remove_handle(multi.get(), t.get());
+	return responses;
+}
+#else
+std::vector<WebResponse> WebRequestMany(const std::vector<std::string>& urls, int maxConnections) {
+	std::vector<WebResponse> responses(urls.size());
+	std::atomic<size_t> next{ 0 };
+	std::vector<std::thread> workers;
+	for (int w = 0; w < maxConnections && w < (int)urls.size(); ++w) {
+		workers.emplace_back([&]() {
+			for (size_t i; (i = next++) < urls.size();) {
+				auto& url(urls[i]);
+				auto hostEnd = url.find('/', url.find("://") + 3);
+				try {
+					responses[i] = WebRequest("GET", url.substr(0, hostEnd), hostEnd == url.npos ? "/" : url.substr(hostEnd));
+				} catch (std::exception&) {
+					responses[i] = WebResponse{ 0, url, {} };
+				}
+			}
+		});
+	}
+	for (auto& w : workers) w.join();
+	return responses;
+}
 #endif
 
 namespace Packages {
@@ -254,6 +331,11 @@ namespace Packages {
 		return ((CloudClient*)self)->Resolve(pack, file, ver);
 	}
 
+	// cache.json key for the content hashes of local package files
+	static const char* FileHashesKey = "#files";
+
+	static CmdLine::Option<std::string> PackageMirror(getenv("KRONOS_PACKAGE_MIRROR") ? getenv("KRONOS_PACKAGE_MIRROR") : "", "--package-mirror", "-pm", "<dir|url>", "fetch packages from <dir|url>, laid out like the local package cache, instead of the package host; defaults to $KRONOS_PACKAGE_MIRROR");
+
 	CloudClient::CloudClient() {
 		using namespace std::string_literals;
 		fileSystemLocation = GetCachePath() + "/";
@@ -263,6 +345,21 @@ namespace Packages {
 			picojson::value parsed;
 			picojson::parse(parsed, cacheFile);
 			if (parsed.is<picojson::object>()) cacheData = parsed.get<picojson::object>();
+			auto hashes = cacheData.find(FileHashesKey);
+			if (hashes != cacheData.end()) {
+				if (hashes->second.is<picojson::object>()) fileHashes = hashes->second.get<picojson::object>();
+				cacheData.erase(hashes);
+			}
+		}
+	}
+
+	void CloudClient::SaveCache() const {
+		std::lock_guard<std::recursive_mutex> lg{ lock };
+		auto data = cacheData;
+		data[FileHashesKey] = picojson::value{ fileHashes };
+		std::ofstream cacheFile{ fileSystemLocation + "cache.json" };
+		if (cacheFile.is_open()) {
+			cacheFile << picojson::value{ data }.serialize();
 		}
 	}
 
@@ -276,10 +373,7 @@ namespace Packages {
 
 		if (versions[version] != hash) {
 			versions[version] = hash;
-			std::ofstream cacheFile{ fileSystemLocation + "cache.json" };
-			if (cacheFile.is_open()) {
-				cacheFile << picojson::value{ cacheData }.serialize();
-			}
+			SaveCache();
 		}
 	}
     
@@ -304,19 +398,189 @@ namespace Packages {
 		return (_stat(file_in.c_str(), &buf) == 0);
 	}
 
+	static bool IsRemote(const std::string& uri) {
+		return uri.compare(0, 7, "http://") == 0 || uri.compare(0, 8, "https://") == 0;
+	}
+
+	static std::vector<WebResponse> Fetch(const std::vector<std::string>& uris) {
+		if (uris.empty() || IsRemote(uris.front())) return WebRequestMany(uris);
+		std::vector<WebResponse> local;
+		for (auto& path : uris) {
+			std::ifstream read{ utf8filename(path), std::ios_base::binary };
+			local.emplace_back(WebResponse{ read.is_open() ? 200 : 404, path,
+				std::vector<char>{ std::istreambuf_iterator<char>(read), std::istreambuf_iterator<char>() } });
+		}
+		return local;
+	}
+
+	static void MakeReadOnly(const std::string& path) {
+#ifdef WIN32
+		_wchmod(utf8filename(path.c_str()).c_str(), _S_IREAD);
+#else 
+		chmod(path.c_str(), S_IRUSR | S_IRGRP);
+#endif
+	}
+
+	static std::string ContentHash(const std::vector<char>& content) {
+		return fnv1a(content.data(), content.size()).to_str();
+	}
+
+	void CloudClient::Store(const std::string& dest, const std::vector<char>& content, const std::string& expectHash, bool save) {
+		auto hash = ContentHash(content);
+		if (expectHash.size() && hash != expectHash) {
+			throw std::runtime_error("integrity check failed for " + dest);
+		}
+
+		std::lock_guard<std::recursive_mutex> lg(lock);
+		MakeMultiLevelPath(dest);
+		FilesystemLock fsLock((GetFileSystemLocation() + ".lock").c_str(), 20);
+
+		// files are stored once by content and linked into the package tree
+		auto object = GetFileSystemLocation() + "objects/" + hash.substr(0, 2) + "/" + hash.substr(2);
+		if (!DoesFileExist(object)) {
+			MakeMultiLevelPath(object);
+			{
+				std::ofstream write(utf8filename(object), std::ios_base::binary);
+				write.write(content.data(), content.size());
+			}
+			MakeReadOnly(object);
+		}
+
+#ifdef WIN32
+		bool linked = CreateHardLinkW(utf8filename(dest).c_str(), utf8filename(object).c_str(), NULL) != 0;
+#else
+		bool linked = link(object.c_str(), dest.c_str()) == 0;
+#endif
+		if (!linked) {
+			std::ofstream write(utf8filename(dest), std::ios_base::binary);
+			write.write(content.data(), content.size());
+		}
+
+		fileHashes[dest.substr(GetFileSystemLocation().size())] = hash;
+		if (save) SaveCache();
+	}
+
+	bool CloudClient::Verify(const std::string& path) {
+		std::lock_guard<std::recursive_mutex> lg(lock);
+		if (verified.count(path)) return true;
+
+		auto recorded = fileHashes.find(path.substr(fileSystemLocation.size()));
+		if (recorded != fileHashes.end() && recorded->second.is<std::string>()) {
+			auto content = Fetch({ path }).front().data;
+			if (ContentHash(content) != recorded->second.get<std::string>()) {
+				std::clog << "* Integrity check failed for " << path << ", fetching it again\n";
+#ifdef WIN32
+				_wchmod(utf8filename(path.c_str()).c_str(), _S_IREAD | _S_IWRITE);
+#endif
+				remove(path.c_str());
+				return false;
+			}
+		}
+		verified.emplace(path);
+		return true;
+	}
+
+	bool CloudClient::LoadMirrorIndex() {
+		if (mirrorLoaded) return mirror.size() > 0;
+		mirrorLoaded = true;
+		// read on first use, as clients are constructed before the command line is parsed
+		mirror = PackageMirror();
+		while (mirror.size() && mirror.back() == '/') mirror.pop_back();
+		if (mirror.empty()) return false;
+		try {
+			auto index = Fetch({ mirror + "/cache.json" }).front();
+			if (index.Ok()) {
+				auto parsed = index.JSON();
+				if (parsed.contains(FileHashesKey) && parsed.get(FileHashesKey).is<picojson::object>()) {
+					mirrorFiles = parsed.get(FileHashesKey).get<picojson::object>();
+				}
+			}
+		} catch (std::exception& e) {
+			std::clog << "* Mirror " << mirror << " has no usable index: " << e.what() << "\n";
+		}
+		return true;
+	}
+
+	static bool IsPrefetchable(const std::string& file) {
+		auto endsWith = [&file](const std::string& ext) {
+			return file.size() > ext.size() && file.compare(file.size() - ext.size(), ext.size(), ext) == 0;
+		};
+		return endsWith(".k") || endsWith(".json");
+	}
+
+	size_t CloudClient::Prefetch(std::string pack, std::string version) {
+		std::lock_guard<std::recursive_mutex> lg(lock);
+		size_t stored = 0;
+		try {
+			auto path = GetLocalFilePath(pack, version);
+			if (!prefetched.emplace(path).second) return 0;
+			auto relative = path.substr(fileSystemLocation.size());
+
+			Manifest manifest;
+			if (LoadMirrorIndex()) {
+				for (auto& f : mirrorFiles) {
+					if (f.first.compare(0, relative.size(), relative) == 0 && f.second.is<std::string>()) {
+						manifest.emplace_back(f.first.substr(relative.size()), f.second.get<std::string>());
+					}
+				}
+			} else if (!GetManifest(pack, version, manifest)) {
+				return 0;
+			}
+
+			Manifest missing;
+			std::vector<std::string> uris;
+			for (auto& f : manifest) {
+				if (IsPrefetchable(f.first) && !DoesFileExist(path + f.first)) {
+					missing.emplace_back(f);
+					uris.emplace_back(mirror.size() 
+						? mirror + "/" + relative + f.first 
+						: GetFileURL(pack, version, f.first));
+				}
+			}
+
+			if (missing.empty()) return 0;
+
+			std::clog << "* Prefetching [" << pack << " " << version << "]: " << missing.size() << " files ...";
+			auto content = Fetch(uris);
+			for (size_t i = 0; i < missing.size(); ++i) {
+				if (!content[i].Ok()) continue;
+				try {
+					Store(path + missing[i].first, content[i].data, missing[i].second, false);
+					++stored;
+				} catch (std::exception& e) {
+					std::clog << "\n  " << e.what();
+				}
+			}
+			SaveCache();
+			std::clog << stored << " Ok\n";
+		} catch (std::exception& e) {
+			std::clog << "* Prefetch failed for [" << pack << " " << version << "]: " << e.what() << "\n";
+		}
+		return stored;
+	}
+
 	const char* CloudClient::Resolve(std::string pack, std::string file, std::string version) {
 		try {
 			auto path = GetLocalFilePath(pack, version);
 			auto file_in = path + file;
+			if (!DoesFileExist(file_in) || !Verify(file_in)) {
+				Prefetch(pack, version);
+			}
 			if (!DoesFileExist(file_in)) {
 				std::clog << "* Downloading [" << pack << " " << version << "]:" << file << " ...";
 				try {
-					Obtain(pack, version, file, file_in);
-#ifdef WIN32
-					_wchmod(utf8filename(file_in.c_str()).c_str(), _S_IREAD);
-#else 
-					chmod(file_in.c_str(), S_IRUSR | S_IRGRP);
-#endif
+					if (LoadMirrorIndex()) {
+						auto relative = file_in.substr(fileSystemLocation.size());
+						auto content = Fetch({ mirror + "/" + relative }).front();
+						if (!content.Ok()) throw std::runtime_error(content.uri + " -> " + std::to_string(content.code));
+						auto expect = mirrorFiles.find(relative);
+						Store(file_in, content.data, 
+							  expect != mirrorFiles.end() && expect->second.is<std::string>() 
+							  ? expect->second.get<std::string>() : "");
+					} else {
+						Obtain(pack, version, file, file_in);
+					}
+					MakeReadOnly(file_in);
 					std::clog << "Ok\n";
 				} catch (std::exception& e) {
 					std::clog << "Failed: " << e.what() << "\n";
@@ -358,14 +622,7 @@ namespace Packages {
 
 		if (content.Ok()) {
 			AddPackageVersion(pack, version, "bb-" + sha);
-
-			std::lock_guard<std::recursive_mutex> lg(lock);
-
-			MakeMultiLevelPath(dest);
-			FilesystemLock lock((GetFileSystemLocation() + ".lock").c_str(), 20);
-
-			std::ofstream write(utf8filename(dest), std::ios_base::binary);
-			write.write(content.data.data(), content.data.size());
+			Store(dest, content.data);
 		} else {
 			throw std::runtime_error("Server responded with " + content.uri + " -> " + std::to_string(content.code) + " " + content.Text());
 		}
@@ -374,28 +631,34 @@ namespace Packages {
 	std::string GitHubApi::GetCommitHash(const std::string& pack, const std::string& version) const {
 		std::string sha = "";
 		std::lock_guard<std::recursive_mutex> lg{ lock };
+		auto key = pack + "@" + version;
 		if (cacheData[pack].contains(version) && cacheData[pack].get(version).to_str().substr(0, 3) == "gh-") {
 			sha = cacheData[pack].get(version).to_str().substr(3);
+		} else if (resolvedRefs.count(key)) {
+			sha = resolvedRefs[key];
 		} else {
-			for (std::string kind : { "/tags", "/branches" }) {
-				picojson::value parsed = WebRequest("GET", "https://api.github.com", "/repos/" + pack + kind);
-
-				if (parsed.is<picojson::array>()) {
-					auto tags = parsed.get<picojson::array>();
-					for (auto &t : tags) {
-						if (t.contains("name") && t.contains("commit") && t.get("commit").contains("sha")) {
-							auto thisSha = t.get("commit").get("sha").to_str();
-							if (kind == "/tags") {
-								AddPackageVersion(pack, t.get("name").to_str(), "gh-" + thisSha);
-							}
-							if (t.get("name").to_str() == version) {
-								sha = thisSha;
-							}
-						}
+			// tags are immutable, so their commits are remembered across sessions
+			picojson::value tags = WebRequest("GET", "https://api.github.com", "/repos/" + pack + "/tags");
+			if (tags.is<picojson::array>()) {
+				for (auto &t : tags.get<picojson::array>()) {
+					if (t.contains("name") && t.contains("commit") && t.get("commit").contains("sha")) {
+						auto thisSha = t.get("commit").get("sha").to_str();
+						AddPackageVersion(pack, t.get("name").to_str(), "gh-" + thisSha);
+						if (t.get("name").to_str() == version) sha = thisSha;
 					}
 				}
 			}
 		}
+		if (sha.empty()) {
+			// branches move, so other refs are only resolved for this session
+			auto commit = WebRequest("GET", "https://api.github.com", "/repos/" + pack + "/commits/" + version, 
+									 nullptr, 0, { "Accept: application/vnd.github.sha" });
+			if (commit.Ok()) {
+				sha = commit.Text();
+				while (sha.size() && isspace(sha.back())) sha.pop_back();
+				resolvedRefs[key] = sha;
+			}
+		}
 		if (sha.empty()) {
 			throw std::runtime_error("Specified tag not found");
 		}
@@ -411,18 +674,30 @@ namespace Packages {
 		auto rawUrl = "/" + pack + "/" + version + "/" + file;
 		auto content = WebRequest("GET", "https://raw.githubusercontent.com", rawUrl);
 		if (content.Ok()) {
-			std::lock_guard<std::recursive_mutex> lg(lock);
-
-			MakeMultiLevelPath(dest);
-			FilesystemLock lock((GetFileSystemLocation() + ".lock").c_str(), 20);
-
-			std::ofstream write(utf8filename(dest), std::ios_base::binary);
-			write.write(content.data.data(), content.data.size());
+			Store(dest, content.data);
 		} else {
 			throw std::runtime_error("server responded with " + std::to_string(content.code) + " " + content.Text());
 		}
 	}
 
+	bool GitHubApi::GetManifest(const std::string& pack, std::string version, Manifest& files) {
+		if (version.empty()) return false;
+		if (version.back() == '~') version.pop_back();
+		picojson::value tree = WebRequest("GET", "https://api.github.com", "/repos/" + pack + "/git/trees/" + version + "?recursive=1");
+		if (!tree.contains("tree") || !tree.get("tree").is<picojson::array>()) return false;
+		for (auto& entry : tree.get("tree").get<picojson::array>()) {
+			if (entry.contains("path") && entry.get("type").to_str() == "blob") {
+				files.emplace_back(entry.get("path").to_str(), "");
+			}
+		}
+		return true;
+	}
+
+	std::string GitHubApi::GetFileURL(const std::string& pack, std::string version, const std::string& file) const {
+		if (version.size() && version.back() == '~') version.pop_back();
+		return "https://raw.githubusercontent.com/" + pack + "/" + version + "/" + file;
+	}
+
 	static inline uint64_t mul_128hi(uint64_t x, uint64_t y) {
 		const uint64_t m32 = 0xffffffff;
 		uint64_t x0 = x & m32, y0 = y & m32, x1 = x >> 32, y1 = y >> 32;
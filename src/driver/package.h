@@ -4,25 +4,44 @@
 
 #include <string>
 #include <unordered_set>
+#include <unordered_map>
+#include <vector>
 #include <mutex>
 
 namespace Packages {
 	class CloudClient {
 		std::string fileSystemLocation;
+		std::string mirror;
 		std::unordered_set<std::string> stringPool;
+		std::unordered_set<std::string> prefetched;
+		std::unordered_set<std::string> verified;
+		picojson::object mirrorFiles;
+		bool mirrorLoaded = false;
+		bool Verify(const std::string& path);
+		bool LoadMirrorIndex();
 	protected:
+		// file path within the package -> content hash, empty if not known in advance
+		using Manifest = std::vector<std::pair<std::string, std::string>>;
+
 		mutable picojson::object cacheData;
+		mutable picojson::object fileHashes;
 		mutable std::recursive_mutex lock;
 		const char* Remember(std::string str);
 		virtual void Obtain(std::string package, std::string version, std::string file, std::string dest) = 0;
 		virtual std::string GetCommitHash(const std::string & pack, const std::string & version) const = 0;
+		virtual bool GetManifest(const std::string& pack, std::string version, Manifest& files) { return false; }
+		virtual std::string GetFileURL(const std::string& pack, std::string version, const std::string& file) const { return ""; }
 		void AddPackageVersion(const std::string& package, const std::string& version, const std::string& hash) const;
+		void SaveCache() const;
+		void Store(const std::string& dest, const std::vector<char>& content, const std::string& expectHash = "", bool save = true);
 		const std::string& GetFileSystemLocation() const { return fileSystemLocation; }
 	public:
 		CloudClient();
         virtual ~CloudClient() { }
 		static const char* ResolverCallback(const char *package, const char *file, const char *version, void *self);
 		const char* Resolve(std::string package, std::string file, std::string version);
+		// fetches all missing source files of a package version concurrently; returns the number of files stored
+		size_t Prefetch(std::string package, std::string version);
 		std::string GetLocalFilePath(std::string package, std::string version) const;
 
 		const picojson::object& GetCache() const {
@@ -40,7 +59,10 @@ namespace Packages {
 	};
 
 	class GitHubApi : public CloudClient {
+		mutable std::unordered_map<std::string, std::string> resolvedRefs;
 		void Obtain(std::string package, std::string version, std::string file, std::string dstPath) override;
+		bool GetManifest(const std::string& pack, std::string version, Manifest& files) override;
+		std::string GetFileURL(const std::string& pack, std::string version, const std::string& file) const override;
 	public:
 		GitHubApi() { };
 		std::string GetCommitHash(const std::string & pack, const std::string & version) const;
@@ -108,3 +130,7 @@ struct WebResponse {
 
 WebResponse WebRequest(std::string method, std::string server, std::string page, 
 					   const void* body = nullptr, size_t bodySize = 0, const std::unordered_set<std::string>& extraHeaders = {});
+
+// GETs all urls concurrently over at most maxConnections reused connections. 
+// Failed transfers are reported with code 0.
+std::vector<WebResponse> WebRequestMany(const std::vector<std::string>& urls, int maxConnections = 8);
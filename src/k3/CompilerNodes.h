@@ -67,7 +67,7 @@ namespace K3 {
 			DEFAULT_LOCAL_COMPARE(DisposableTypedLeaf,ID,isOutput,isReference,pointerAlignment,type);
 			CODEGEN_EMITTER
 			
-			unsigned ComputeLocalHash() const override;
+			size_t ComputeLocalHash() const override;
 			static CTRef In(size_t ID, CRRef rx, CTRef fromGraph, const char *l = "in") {
 				return New(true, ID, fromGraph, rx, l);
 			}
@@ -106,10 +106,12 @@ namespace K3 {
 			END
 
 		TYPED_NODE(SubroutineMeta, TypedLeaf)
-			SubroutineMeta(bool s, bool fx) :HasLocalState(s), HasSideEffects(fx) {}
+			SubroutineMeta(bool s, bool fx, std::uint64_t layout) :HasLocalState(s), HasSideEffects(fx), StateLayout(layout) {}
 		PUBLIC
-			static SubroutineMeta* New(bool hasState, bool hasEffects) { return new SubroutineMeta(hasState, hasEffects); }
+			static SubroutineMeta* New(bool hasState, bool hasEffects, std::uint64_t stateLayout = 0) { return new SubroutineMeta(hasState, hasEffects, stateLayout); }
 			const bool HasLocalState, HasSideEffects;
+			// fingerprint of the state allocation sequence; 0 if it can not be determined
+			const std::uint64_t StateLayout;
 			Type Result(ResultTypeTransform&) const override { KRONOS_UNREACHABLE; }
 			void Output(std::ostream& strm) const override { strm << (HasLocalState ? "Stateful" : "Stateless") << ", " << (HasSideEffects ? "Impure" : "Pure"); }
 		END
@@ -128,7 +130,7 @@ namespace K3 {
 			DEFAULT_LOCAL_COMPARE(TypedPolyadic,lastArgument,compiledBody,conditionalRecursionLoopCount);
 			CODEGEN_EMITTER
 
-			unsigned ComputeLocalHash() const override {size_t h(TypedPolyadic::ComputeLocalHash());HASHER(h,compiledBody->GetHash());HASHER(h,conditionalRecursionLoopCount);return unsigned(h);}
+			size_t ComputeLocalHash() const override {size_t h(TypedPolyadic::ComputeLocalHash());HASHER(h,compiledBody->GetHash());HASHER(h,conditionalRecursionLoopCount);return h;}
 
 			template <typename... ARGS> static Subroutine* New(const char *label, CTRef compiledBody, ARGS... upstreamNodes) {
 				Subroutine *s = new Subroutine(label,compiledBody,0);s->ConnectUpstream(upstreamNodes...); 
@@ -187,7 +189,7 @@ namespace K3 {
 		PUBLIC
 			DEFAULT_LOCAL_COMPARE(TypedUnary, alignment, GUID, alloc);
 			CODEGEN_EMITTER
-			unsigned ComputeLocalHash() const override { size_t h(TypedUnary::ComputeLocalHash());HASHER(h, (size_t)GUID);HASHER(h, alignment);HASHER(h, alloc);return unsigned(h); }
+			size_t ComputeLocalHash() const override { size_t h(TypedUnary::ComputeLocalHash());HASHER(h, (size_t)GUID);HASHER(h, alignment);HASHER(h, alloc);return h; }
 			static CTRef New(Backends::SideEffectTransform&, const Type& forType, Allocation);
 			static CTRef New(Backends::SideEffectTransform&, size_t size, Allocation);
 			static CTRef New(Backends::SideEffectTransform&, CTRef size, Allocation, size_t alignment);
@@ -273,7 +275,7 @@ namespace K3 {
 		PUBLIC
 			DEFAULT_LOCAL_COMPARE(DisposableTypedUnary,loadType,loadPtr,alignment);
 			CODEGEN_EMITTER
-			unsigned ComputeLocalHash() const override {size_t h(DisposableTypedUnary::ComputeLocalHash());HASHER(h,loadType.GetHash());HASHER(h,loadPtr?1:0);return unsigned(h);}
+			size_t ComputeLocalHash() const override {size_t h(DisposableTypedUnary::ComputeLocalHash());HASHER(h,loadType.GetHash());HASHER(h,loadPtr?1:0);return h;}
 			Type Result(ResultTypeTransform& rt) const override { return loadType.IsNil() ? rt(GetUp(0)) : loadType; }
 			static CTRef New(CTRef up); 
 			static CTRef New(CTRef up, const Type& load);
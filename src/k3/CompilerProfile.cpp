@@ -0,0 +1,133 @@
+#include "CompilerProfile.h"
+#include "TLS.h"
+#include "driver/picojson.h"
+
+#include <map>
+
+namespace K3 {
+	namespace Profile {
+		static thread_local Counters threadCounters;
+		static std::atomic<int> threadIndexCounter{ 0 };
+
+		static int ThreadIndex() {
+			static thread_local int index = ++threadIndexCounter;
+			return index;
+		}
+
+		Counters& ThreadCounters() {
+			return threadCounters;
+		}
+
+		std::int64_t Log::Now() const {
+			return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+		}
+
+		void Log::Record(Event e) {
+			std::lock_guard<std::mutex> hold(lock);
+			events.emplace_back(std::move(e));
+		}
+
+		void Log::Clear() {
+			std::lock_guard<std::mutex> hold(lock);
+			events.clear();
+		}
+
+		static picojson::value CountersToJSON(const Counters& c) {
+			picojson::object obj{
+				{ "region_bytes", picojson::value((double)c.regionBytes) },
+				{ "nodes", picojson::value((double)c.nodes) },
+				{ "cache_hits", picojson::value((double)c.cacheHits) },
+				{ "cache_misses", picojson::value((double)c.cacheMisses) }
+			};
+			auto lookups = c.cacheHits + c.cacheMisses;
+			if (lookups) {
+				obj.emplace("cache_hit_rate", picojson::value((double)c.cacheHits / (double)lookups));
+			}
+			return picojson::value(obj);
+		}
+
+		void Log::WriteJSON(std::ostream& json) const {
+			std::lock_guard<std::mutex> hold(lock);
+			picojson::array traceEvents;
+
+			struct Total {
+				std::int64_t count = 0;
+				std::int64_t micros = 0;
+				Counters counters;
+			};
+			std::map<std::string, Total> totals;
+
+			for (auto& e : events) {
+				traceEvents.emplace_back(picojson::object{
+					{ "name", picojson::value(e.name) },
+					{ "cat", picojson::value(e.category) },
+					{ "ph", picojson::value("X") },
+					{ "ts", picojson::value((double)e.startMicros) },
+					{ "dur", picojson::value((double)e.durationMicros) },
+					{ "pid", picojson::value(1.0) },
+					{ "tid", picojson::value((double)e.thread) },
+					{ "args", CountersToJSON(e.delta) }
+				});
+
+				auto& t = totals[std::string(e.category) + ":" + e.name];
+				t.count++;
+				t.micros += e.durationMicros;
+				t.counters.regionBytes += e.delta.regionBytes;
+				t.counters.nodes += e.delta.nodes;
+				t.counters.cacheHits += e.delta.cacheHits;
+				t.counters.cacheMisses += e.delta.cacheMisses;
+			}
+
+			picojson::object phases;
+			for (auto& t : totals) {
+				auto counters = CountersToJSON(t.second.counters).get<picojson::object>();
+				counters.emplace("count", picojson::value((double)t.second.count));
+				counters.emplace("total_us", picojson::value((double)t.second.micros));
+				phases.emplace(t.first, picojson::value(counters));
+			}
+
+			picojson::value doc{ picojson::object{
+				{ "traceEvents", picojson::value(traceEvents) },
+				{ "displayTimeUnit", picojson::value("ms") },
+				{ "otherData", picojson::value(picojson::object{ { "phases", picojson::value(phases) } }) }
+			} };
+
+			json << doc.serialize();
+		}
+
+		static Log* CurrentLog() {
+			auto tls = TLS::GetCurrentInstance();
+			if (tls && tls->GetCompilerProfile().IsEnabled()) return &tls->GetCompilerProfile();
+			return nullptr;
+		}
+
+		bool IsEnabled() {
+			return CurrentLog() != nullptr;
+		}
+
+		Phase::Phase(const char* category, const char* name):log(CurrentLog()), category(category) {
+			if (log) {
+				this->name = name;
+				start = log->Now();
+				atStart = ThreadCounters();
+			}
+		}
+
+		Phase::Phase(const char* category, std::string name):log(CurrentLog()), category(category) {
+			if (log) {
+				this->name = std::move(name);
+				start = log->Now();
+				atStart = ThreadCounters();
+			}
+		}
+
+		Phase::~Phase() {
+			if (log) {
+				log->Record(Event{
+					std::move(name), category, start, log->Now() - start,
+					ThreadIndex(), ThreadCounters() - atStart
+				});
+			}
+		}
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace K3 {
+	namespace Profile {
+		/* per-thread running totals; phases record the delta over their lifetime */
+		struct Counters {
+			std::int64_t regionBytes = 0;
+			std::int64_t nodes = 0;
+			std::int64_t cacheHits = 0;
+			std::int64_t cacheMisses = 0;
+
+			Counters operator-(const Counters& rhs) const {
+				Counters d;
+				d.regionBytes = regionBytes - rhs.regionBytes;
+				d.nodes = nodes - rhs.nodes;
+				d.cacheHits = cacheHits - rhs.cacheHits;
+				d.cacheMisses = cacheMisses - rhs.cacheMisses;
+				return d;
+			}
+		};
+
+		Counters& ThreadCounters();
+
+		static inline void CountRegionBytes(size_t bytes) { ThreadCounters().regionBytes += (std::int64_t)bytes; }
+		static inline void CountNode() { ThreadCounters().nodes++; }
+		static inline void CacheHit() { ThreadCounters().cacheHits++; }
+		static inline void CacheMiss() { ThreadCounters().cacheMisses++; }
+
+		struct Event {
+			std::string name;
+			const char* category;
+			std::int64_t startMicros;
+			std::int64_t durationMicros;
+			int thread;
+			Counters delta;
+		};
+
+		/* thread safe event log owned by a compiler context */
+		class Log {
+			mutable std::mutex lock;
+			std::vector<Event> events;
+			std::atomic<bool> enabled{ false };
+			std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+		public:
+			void Enable(bool state) { enabled.store(state, std::memory_order_relaxed); }
+			bool IsEnabled() const { return enabled.load(std::memory_order_relaxed); }
+			std::int64_t Now() const;
+			void Record(Event e);
+			void Clear();
+
+			/* chrome trace-event format, with per-phase totals in 'otherData' */
+			void WriteJSON(std::ostream& json) const;
+		};
+
+		/* true if the compiler context on this thread is recording phases */
+		bool IsEnabled();
+
+		/* RAII scope that times a compiler phase if the current context is profiling */
+		class Phase {
+			Log* log = nullptr;
+			const char* category;
+			std::string name;
+			std::int64_t start;
+			Counters atStart;
+			Phase(const Phase&) = delete;
+			Phase& operator=(const Phase&) = delete;
+		public:
+			Phase(const char* category, const char* name);
+			Phase(const char* category, std::string name);
+			~Phase();
+		};
+	}
+}
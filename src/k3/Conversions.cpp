@@ -7,6 +7,8 @@ namespace K3 {
 	namespace Nodes{
 		namespace Native {
 			void* BinaryenConversion(Backends::BinaryenTransform& xfm, Backends::ActivityMaskVector* avm, const Type& dst, const Type& src, CTRef up);
+			void* CSourceConversion(Backends::CSourceTransform& xfm, Backends::ActivityMaskVector* avm, const Type& dst, const Type& src, CTRef up);
+			void* BytecodeConversion(Backends::BytecodeTransform& xfm, Backends::ActivityMaskVector* avm, const Type& dst, const Type& src, CTRef up);
 		}
 
 		template <typename T, typename SRC, int OPCODE>
@@ -53,6 +55,18 @@ namespace K3 {
 				return Native::BinaryenConversion(xfm, avm, Type::FromNative<T>(), Type::FromNative<SRC>(), GetUp(0));
 			}
 #endif
+
+#ifdef HAVE_CSOURCE
+			void* Compile(Backends::CSourceTransform& xfm, Backends::ActivityMaskVector* avm) const override {
+				return Native::CSourceConversion(xfm, avm, Type::FromNative<T>(), Type::FromNative<SRC>(), GetUp(0));
+			}
+#endif
+
+#ifdef HAVE_BYTECODE
+			void* Compile(Backends::BytecodeTransform& xfm, Backends::ActivityMaskVector* avm) const override {
+				return Native::BytecodeConversion(xfm, avm, Type::FromNative<T>(), Type::FromNative<SRC>(), GetUp(0));
+			}
+#endif
 			const Reactive::Node* ReactiveAnalyze(Reactive::Analysis& t, const Reactive::Node** upRx) const override {
 				return ITypedUnary::ReactiveAnalyze(t, upRx);
 			}
@@ -77,7 +91,7 @@ namespace K3 {
 				return GenericUnary::LocalCompare(rhs);
 		}
 
-		unsigned Convert::ComputeLocalHash() const
+		size_t Convert::ComputeLocalHash() const
 		{
 			auto h(GenericUnary::ComputeLocalHash());
 			HASHER(h,targetType);
@@ -23,7 +23,7 @@ namespace K3 {
 			NativeType targetType;
 		PRIVATE
 			int LocalCompare(const ImmutableNode& rhs) const override;
-			unsigned ComputeLocalHash() const override;
+			size_t ComputeLocalHash() const override;
 			Convert(NativeType kind, CGRef up) :GenericUnary(up), targetType(kind) { }
 		PUBLIC
 			static Convert* New(NativeType type, CGRef up) {return new Convert(type,up);}
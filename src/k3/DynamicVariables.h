@@ -9,7 +9,7 @@ namespace K3 {
 				SetGlobalVariable(const void *id, CTRef value, bool byRef):TypedUnary(value),uid(id),byRef(byRef) {}
 			PUBLIC
 				DEFAULT_LOCAL_COMPARE(TypedUnary,uid,byRef);
-				unsigned ComputeLocalHash() const override {size_t h(TypedUnary::ComputeLocalHash());HASHER(h,(uintptr_t)uid);HASHER(h,byRef?1:0);return (unsigned)h;}
+				size_t ComputeLocalHash() const override {size_t h(TypedUnary::ComputeLocalHash());HASHER(h,(uintptr_t)uid);HASHER(h,byRef?1:0);return h;}
 				static SetGlobalVariable* New(const void *varId, CTRef newValue, bool byRef = true) {return new SetGlobalVariable(varId,newValue,byRef);}
 				Type Result(ResultTypeTransform& rt) const  override {INTERNAL_ERROR("No result");}
 				CTRef SideEffects(Backends::SideEffectTransform&) const override;
@@ -34,7 +34,7 @@ namespace K3 {
 				GetSlot(int i, CTRef init) :index(i) { if (init) Connect(init); }
 			PUBLIC
 				DEFAULT_LOCAL_COMPARE(TypedPolyadic, index);
-				unsigned ComputeLocalHash() const  override {
+				size_t ComputeLocalHash() const  override {
 					auto h = TypedPolyadic::ComputeLocalHash();
 					HASHER(h, index);
 					return h;
@@ -56,8 +56,8 @@ namespace K3 {
 				}
 			PUBLIC
 				DEFAULT_LOCAL_COMPARE(TypedPolyadic,uid,t,k);
-				unsigned ComputeLocalHash() const  override {
-					size_t h(TypedPolyadic::ComputeLocalHash());HASHER(h,(uintptr_t)uid);HASHER(h,t.GetHash());return (unsigned)h;
+				size_t ComputeLocalHash() const  override {
+					size_t h(TypedPolyadic::ComputeLocalHash());HASHER(h,(uintptr_t)uid);HASHER(h,t.GetHash());return h;
 				}
 
 
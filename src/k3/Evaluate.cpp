@@ -1,5 +1,6 @@
 #include "common/Graphviz.h"
 #include "Evaluate.h"
+#include "CompilerProfile.h"
 #include "Errors.h"
 #include "UserErrors.h"
 #include "Invariant.h"
@@ -11,11 +12,16 @@
 #include "EnumerableGraph.h"
 #include "TLS.h"
 #include "LibraryRef.h"
+#include "driver/CmdLineOpts.h"
 #include <iostream>
 
 #include <sstream>
 #include <cstring>
 
+namespace CL {
+	CmdLine::Option<int> InternGraphs(0, "--intern-graphs", "-ig", "<0/1>", "share structurally identical specialized function bodies, so that comparing them is mostly a pointer test");
+}
+
 //#define DEBUG_SPECIALIZATION
 
 static const int InlineTreshold = 24;
@@ -473,6 +479,12 @@ namespace K3 {
 			});
 		}
 
+		// hash-cons a cacheable function body against the bodies of this build
+		static Graph<Typed> Intern(const Graph<Typed>& body) {
+			if (!CL::InternGraphs() || !body) return body;
+			return *TLS::GetSession().graphs.insert(body).first;
+		}
+
 		Specialization Evaluate::SpecializeCore(SpecializationState &t) const {
 			SPECIALIZE_ARGS(t, 0, 1);
 			auto bl = t.GetRep().Block(LogAlways, "eval", "label='%s'", label);
@@ -489,6 +501,7 @@ namespace K3 {
 			if (cache && fixed) {
 				auto form(cache->find(key));
 				if (form != cache->end()) {
+					Profile::CacheHit();
 					Graph<Typed> body; Type result; bool shouldInline, isFallback;
 					std::tie(body, result, shouldInline, isFallback) = form->second;
 					t.GetRep().Diagnostic(LogEverything, this, Error::Info, "cached");
@@ -496,6 +509,7 @@ namespace K3 {
 					return CompleteFunctionCall(label, std::make_pair(body, result), A1.result, isFallback ? Pair::New(A0.node, A1.node) : A1.node, 
 												shouldInline, MemoryRegion::GetCurrentRegion());
 				}
+				Profile::CacheMiss();
 			}
 
 			Type name, recurPts, forms;
@@ -511,6 +525,7 @@ namespace K3 {
 
 						if (spec.node) {
 							if (fixed && cache && spec.result.IsFixed()) {
+								spec.node = Intern(spec.node);
 								cache->emplace(key, std::make_tuple(spec.node, spec.result, true, false));
 							} 
 							t.GetRep().SuccessForm(LogTrace, GetLabel(), A1.result, spec.result);
@@ -533,6 +548,7 @@ namespace K3 {
 			}
 
 			if (cache && fixed && spec.second.IsFixed()) {
+				spec.first = Intern(spec.first);
 				cache->emplace(key, std::make_tuple(spec.first, spec.second, shouldInline, isFallbackForm));
 			} 
 
@@ -684,10 +700,10 @@ namespace K3 {
 			return FunctionBase::IdentityTransform(copy);
 		}
 
-		unsigned FunctionCall::ComputeLocalHash() const {
+		size_t FunctionCall::ComputeLocalHash() const {
 			size_t h(FunctionBase::ComputeLocalHash());
 			HASHER(h, body->GetHash(true));
-			return (unsigned)h;
+			return h;
 		}
 
 		int FunctionBase::LocalCompare(const ImmutableNode& rhs) const {
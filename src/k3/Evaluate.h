@@ -51,7 +51,7 @@ namespace K3 {
 			std::string label;
 			FunctionCall(const char *l, Graph<Typed> body, const Type& argument, const Type& result, CTRef arg);
 			int LocalCompare(const ImmutableNode& rhs) const override;
-			unsigned ComputeLocalHash() const override;
+			size_t ComputeLocalHash() const override;
 			Type argumentType, resultType;
 		PUBLIC
 			FunctionCall *MakeMutableCopy() { return ConstructShallowCopy(); }
@@ -84,7 +84,7 @@ namespace K3 {
 			Graph<Typed> tailContinuation;
 			size_t num;
 			const char *label;
-			unsigned ComputeLocalHash() const override;
+			size_t ComputeLocalHash() const override;
 			FunctionSequence(const char* l,
 							 CGRef argumentFormula, CGRef resultFormula,
 							 CTRef iterator, CTRef generator, 
@@ -339,12 +339,12 @@ namespace K3 {
 			return Specialization(Switch::New(sw, branch, result), result);
 		}
 
-		unsigned Switch::ComputeLocalHash() const {
+		size_t Switch::ComputeLocalHash() const {
 			size_t h(TypedPolyadic::ComputeLocalHash());
 			HASHER(h, result.GetHash());
 			HASHER(h, branchResultSubtypeIndex.size());
 			for (auto bsti : branchResultSubtypeIndex) HASHER(h, bsti);
-			return (unsigned)h;
+			return h;
 		}
 
 		int Switch::LocalCompare(const ImmutableNode& rhs) const {
@@ -180,7 +180,7 @@ namespace K3 {
 		PUBLIC
 			static Switch* New(CTRef arg, const std::vector<Specialization>& branches, const Type& r); 
 			int LocalCompare(const ImmutableNode&) const override;
-			unsigned ComputeLocalHash() const override;
+			size_t ComputeLocalHash() const override;
 			Type Result(ResultTypeTransform&) const override { return result; }
 			Type FixedResult() const override { return result; }
 			CTRef SideEffects(Backends::SideEffectTransform& sfx) const override;
@@ -44,7 +44,7 @@ namespace K3
 			return SpecializationTransform::Infer(closedResult,Type::InvariantI64(num));
 		}
 
-		unsigned FunctionSequence::ComputeLocalHash() const {
+		size_t FunctionSequence::ComputeLocalHash() const {
 			size_t h(FunctionBase::ComputeLocalHash());
 			HASHER(h,iterator->GetHash());
 			HASHER(h,generator->GetHash());
@@ -52,7 +52,7 @@ namespace K3
 			HASHER(h,closedResult->GetHash());
 			HASHER(h,tailContinuation->GetHash());
 			HASHER(h,num);
-			return (unsigned)h;
+			return h;
 		}
 
 		struct ReplaceCounter : public Transform::Identity<const Typed> {
@@ -65,7 +65,7 @@ namespace K3 {
 			CGRef GetUp(unsigned int idx) const {return (CGRef)GetCon(idx);}
 			CGRef Reconnect(unsigned int idx, CGRef newCon) {_GetUp(idx)=newCon;newCon->globalDownstreamCount++;return newCon;}
 			void Connect(const Generic *up) {up->globalDownstreamCount++;CachedTransformNode<GenericBase>::Connect(up);}
-			unsigned ComputeLocalHash() const { auto h(GenericBase::ComputeLocalHash());HASHER(h,(uintptr_t)TypeID()); return h;}
+			size_t ComputeLocalHash() const { auto h(GenericBase::ComputeLocalHash());HASHER(h,(uintptr_t)TypeID()); return h;}
 			virtual CGRef IdentityTransform(GraphTransform<const Generic,CGRef>& copyTable) const;
 			virtual Generic* ConstructShallowCopy() const = 0;
 			const CGRef* GetConnectionArray() const {return (const CGRef*)upstream;}
@@ -5,25 +5,35 @@
 #include "common/DynamicScope.h"
 #include "ImmutableNode.h"
 #include "SmallContainer.h"
+#include "CompilerProfile.h"
 
 ImmutableNode::ImmutableNode():numCons(0),hash(0),finalized(false)
 {
+	K3::Profile::CountNode();
 }
 
 ImmutableNode::ImmutableNode(const ImmutableNode& src):numCons(src.numCons),hash(0),finalized(false)
 {
+	K3::Profile::CountNode();
 }
 
-unsigned ImmutableNode::ComputeGraphHash(bool canFinalize) const
+static std::uint64_t MixGraphHash(std::uint64_t h, std::uint64_t key) {
+	h = (h ^ key) * 0x9e3779b97f4a7c15ull;
+	return h ^ (h >> 29);
+}
+
+size_t ImmutableNode::ComputeGraphHash(bool canFinalize) const
 {
 	if (!finalized)
 	{
 		if (canFinalize)
 		{
-			((ImmutableNode*)this)->finalized = true;
-			((ImmutableNode*)this)->hash = 1;
-			for(unsigned i(0);i<numCons;++i) HASHER(((ImmutableNode*)this)->hash,GetCon(i)->ComputeGraphHash(true));
-			HASHER(((ImmutableNode*)this)->hash,ComputeLocalHash());
+			auto self = (ImmutableNode*)this;
+			// finalize before descending; a cycle sees the partial hash
+			self->finalized = true;
+			self->hash = 1;
+			for(unsigned i(0);i<numCons;++i) self->hash = (size_t)MixGraphHash(self->hash,GetCon(i)->ComputeGraphHash(true));
+			self->hash = (size_t)MixGraphHash(self->hash,ComputeLocalHash());
 		}
 		else return 0;
 	}
@@ -8,7 +8,7 @@
 
 class ImmutableNode{
 	/* comparison support */
-	unsigned hash;
+	size_t hash;
 	bool finalized;
 
 protected:
@@ -21,8 +21,8 @@ protected:
 	void Reconnect(unsigned idx, const ImmutableNode *up) {upstream[idx]=up;/*assert(finalized==false);*/}
 
 	/* graph hash computation */
-	virtual unsigned ComputeGraphHash(bool canFinalize) const;
-	virtual unsigned ComputeLocalHash() const {return 0;};
+	virtual size_t ComputeGraphHash(bool canFinalize) const;
+	virtual size_t ComputeLocalHash() const {return 0;};
 
 	/* construction and destruction */
 	ImmutableNode& operator=(const ImmutableNode& src);
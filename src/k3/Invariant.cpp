@@ -92,7 +92,7 @@ namespace K3 {
 				return memcmp(memory.data(), rc.memory.data(), memory.size());
 			}
 
-			unsigned Constant::ComputeLocalHash() const {
+			size_t Constant::ComputeLocalHash() const {
 				auto h = DisposableGenericLeaf::ComputeLocalHash();
 				HASHER(h, VAL.GetHash());
 				for (int i = 0;i < memory.size();++i) {
@@ -877,19 +877,19 @@ namespace K3 {
 
 			CGRef Mul(CGRef a, CGRef b)
 			{
-				return MakeBinaryInversible<ivar,ivar,ivar>("Mul",
-					[](ivar a, ivar b){return a*b;},
-					[](ivar d, ivar r){return d/r;},
-					[](ivar d, ivar l){return d/l;},
+				return MakeBinaryInversible<Type,Type,Type>("Mul",
+					[](Type a, Type b){return Type::InvariantMul(a, b);},
+					[](Type d, Type r){return Type::InvariantDiv(d, r);},
+					[](Type d, Type l){return Type::InvariantDiv(d, l);},
 					a,b);
 			}
 
 			CGRef Div(CGRef a, CGRef b)
 			{
-				return MakeBinaryInversible<ivar,ivar,ivar>("Div",
-					[](ivar a, ivar b){return a/b;},
-					[](ivar d, ivar r){return d*r;},
-					[](ivar d, ivar l){return l/d;},
+				return MakeBinaryInversible<Type,Type,Type>("Div",
+					[](Type a, Type b){return Type::InvariantDiv(a, b);},
+					[](Type d, Type r){return Type::InvariantMul(d, r);},
+					[](Type d, Type l){return Type::InvariantDiv(l, d);},
 					a,b);
 			}
 		}
@@ -909,28 +909,28 @@ namespace K3 {
 
 			CGRef Sub(CGRef a, CGRef b)
 			{
-				return MakeBinaryInversible<ivar,ivar,ivar,(int)Native::Sub>("Sub",
-					[](ivar a, ivar b){return a-b;},
-					[](ivar d, ivar b){return d+b;},
-					[](ivar d, ivar a){return a-d;},
+				return MakeBinaryInversible<Type,Type,Type,(int)Native::Sub>("Sub",
+					[](Type a, Type b){return Type::InvariantSub(a, b);},
+					[](Type d, Type b){return Type::InvariantAdd(d, b);},
+					[](Type d, Type a){return Type::InvariantSub(a, d);},
 					a,b);
 			}
 
 			CGRef Mul(CGRef a, CGRef b)
 			{
-				return MakeBinaryInversible<ivar,ivar,ivar,(int)Native::Mul>("Mul",
-					[](ivar a, ivar b){return a*b;},
-					[](ivar d, ivar r){return d/r;},
-					[](ivar d, ivar l){return d/l;},
+				return MakeBinaryInversible<Type,Type,Type,(int)Native::Mul>("Mul",
+					[](Type a, Type b){return Type::InvariantMul(a, b);},
+					[](Type d, Type r){return Type::InvariantDiv(d, r);},
+					[](Type d, Type l){return Type::InvariantDiv(d, l);},
 					a,b);
 			}
 
 			CGRef Div(CGRef a, CGRef b)
 			{
-				return MakeBinaryInversible<ivar,ivar,ivar,(int)Native::Div>("Div",
-					[](ivar a, ivar b){return a/b;},
-					[](ivar d, ivar r){return d*r;},
-					[](ivar d, ivar l){return l/d;},
+				return MakeBinaryInversible<Type,Type,Type,(int)Native::Div>("Div",
+					[](Type a, Type b){return Type::InvariantDiv(a, b);},
+					[](Type d, Type r){return Type::InvariantMul(d, r);},
+					[](Type d, Type l){return Type::InvariantDiv(l, d);},
 					a,b);
 			}
 		};
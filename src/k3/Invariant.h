@@ -30,7 +30,7 @@ namespace K3 {
 					} 
 				}
 				int LocalCompare(const ImmutableNode& rhs) const override;
-				unsigned ComputeLocalHash() const override;
+				size_t ComputeLocalHash() const override;
 			public:
 				void Output(std::ostream&) const  override;
 				Constant(bool truth):VAL(truth){}
@@ -15,10 +15,10 @@ namespace K3 {
 	namespace Nodes{
 		namespace Lib{
 
-			unsigned Reference::ComputeLocalHash() const {
+			size_t Reference::ComputeLocalHash() const {
 				auto h = GenericPolyadic::ComputeLocalHash();
 				for (auto &l : lookup) HASHER(h, std::hash<std::string>()(l));
-				return (unsigned)h;
+				return h;
 			}
 
 			int Reference::LocalCompare(const ImmutableNode & r) const {
@@ -18,7 +18,7 @@ namespace K3 {
 				bool alias;
 				Reference(std::vector<std::string> l,bool alias):lookup(std::move(l)),alias(alias) {}
 				int LocalCompare(const ImmutableNode& r) const override;
-				unsigned ComputeLocalHash() const override;
+				size_t ComputeLocalHash() const override;
 				bool CheckCycle(CGRef in);
 		public:
 				static Reference* New(std::vector<std::string> p, bool alias = false) { return new Reference(std::move(p),alias); }
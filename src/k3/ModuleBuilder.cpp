@@ -88,6 +88,7 @@ namespace K3 {
 
         CRRef outRx;
         /* reactive analysis and boundaries */
+        Profile::Phase profile("compiler", "ReactiveAnalysis");
         intermediateAST = Graph<Typed>(
             Reactive::Analysis(
                 BeforeReactiveAnalysis(intermediateAST),*this,argReactivity,nullReactivity).Go(outRx));
@@ -123,6 +124,12 @@ namespace K3 {
 		else return globalSymbolTable.insert(std::make_pair(uid,freeSymbolIndex++)).first->second;
 	}
 
+	std::int64_t Module::GetStateLayout() const {
+		auto layout = Backends::SideEffectTransform::GetStateLayout(intermediateAST);
+		if (!layout) return 0;
+		return (std::int64_t)((layout ^ (std::uint64_t)GetBitmaskSize()) * 0x100000001b3ull);
+	}
+
 	unsigned Module::GetIndex() {
 		return freeSymbolIndex++;
 	}
@@ -75,6 +75,9 @@ namespace K3 {
 
 		int GetNumSignalMaskBits() const { return numSignalMaskBits; }
 
+		// fingerprint of the instance state region; see krt_class::state_layout
+		std::int64_t GetStateLayout() const;
+
 		virtual const Reactive::Node* GetInitializerReactivity() const {return initializer;}
 		unsigned GetIndex(const void *uid);
 		unsigned GetIndex();
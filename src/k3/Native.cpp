@@ -198,7 +198,7 @@ namespace K3 {
 				return DisposableTypedLeaf::LocalCompare(rhs);
 			}
 
-			unsigned Constant::ComputeLocalHash() const {
+			size_t Constant::ComputeLocalHash() const {
 				auto h(DisposableTypedLeaf::ComputeLocalHash());
 				HASHER(h, (unsigned)len);
 				for (unsigned i(0); i < len / sizeof(uint32_t); i++) HASHER(h, ((uint32_t*)memory)[i]);
@@ -349,8 +349,8 @@ namespace K3 {
 			public:
 				DEFAULT_LOCAL_COMPARE(ITypedBinary, opcode, vec)
 
-				unsigned int ComputeLocalHash() const override {
-					unsigned int h(ITypedBinary::ComputeLocalHash());
+				size_t ComputeLocalHash() const override {
+					size_t h(ITypedBinary::ComputeLocalHash());
 					HASHER(h, vec); HASHER(h, opcode);
 					return h;
 				}
@@ -820,7 +820,7 @@ namespace K3 {
 				return TypedPolyadic::LocalCompare(rhsi);
 			}
 
-			unsigned ForeignFunction::ComputeLocalHash() const {
+			size_t ForeignFunction::ComputeLocalHash() const {
 				auto h = TypedPolyadic::ComputeLocalHash();
 				HASHER(h, ReturnValue.GetHash());
 				HASHER(h, std::hash<std::string>()(Symbol));
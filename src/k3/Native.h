@@ -119,7 +119,7 @@ namespace K3 {
 protected:
 				Constant(const void *mem, size_t len, const Type& t);
 				int LocalCompare(const ImmutableNode& rhs) const override;
-				unsigned ComputeLocalHash() const override;
+				size_t ComputeLocalHash() const override;
 			public:
 				CODEGEN_EMITTER
 				Constant(const Constant& src);
@@ -195,7 +195,7 @@ protected:
 				bool compilerNode;
 				static Type CTypeToKronosType(const std::string&, bool& isOutputParameter, bool& isPointer);
 				int LocalCompare(const ImmutableNode& rhs) const override;
-				unsigned ComputeLocalHash() const override;
+				size_t ComputeLocalHash() const override;
 			PUBLIC
 				CODEGEN_EMITTER
 				Type Result(ResultTypeTransform&) const  override { return FixedResult(); }
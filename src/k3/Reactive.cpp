@@ -815,6 +815,197 @@ namespace K3 {
 			return result;
 		}
 
+		namespace {
+			// driver signatures of one context in order of first appearance. Chunks
+			// and lookup snapshots are never moved or freed while the context lives,
+			// so lookups run without the lock; only interning a new signature takes it.
+			class DriverTable : public ManagedObject {
+				INHERIT(DriverTable, ManagedObject);
+				static const unsigned ChunkBits = 8, ChunkSize = 1 << ChunkBits, MaxChunks = 1 << 12;
+
+				// open addressing over signature index + 1; zero marks a free slot
+				struct Lookup {
+					unsigned mask;
+					std::unique_ptr<std::atomic<unsigned>[]> slots;
+					Lookup(unsigned capacity) :mask(capacity - 1), slots(new std::atomic<unsigned>[capacity]) {
+						for (unsigned i = 0; i < capacity; ++i) slots[i].store(0, std::memory_order_relaxed);
+					}
+				};
+
+				std::mutex lock;
+				std::atomic<Type*> chunks[MaxChunks] = {};
+				std::atomic<Lookup*> lookup;
+				std::vector<std::unique_ptr<Lookup>> lookups;
+				unsigned count = 0;
+
+				static void Place(Lookup& l, size_t hash, unsigned index) {
+					auto i = (unsigned)hash & l.mask;
+					while (l.slots[i].load(std::memory_order_relaxed)) i = (i + 1) & l.mask;
+					l.slots[i].store(index + 1, std::memory_order_release);
+				}
+			public:
+				DriverTable() {
+					lookups.emplace_back(std::make_unique<Lookup>(64));
+					lookup.store(lookups.back().get());
+				}
+
+				~DriverTable() {
+					for (auto& c : chunks) delete[] c.load();
+				}
+
+				unsigned Intern(const Type& driver) {
+					auto found = IndexOf(driver);
+					if (found >= 0) return (unsigned)found;
+
+					std::lock_guard<std::mutex> lg{ lock };
+					found = IndexOf(driver);
+					if (found >= 0) return (unsigned)found;
+
+					auto chunk = count >> ChunkBits;
+					if (chunk >= MaxChunks) {
+						INTERNAL_ERROR("Too many distinct driver signatures");
+					}
+					auto storage = chunks[chunk].load(std::memory_order_relaxed);
+					if (!storage) {
+						storage = new Type[ChunkSize];
+						chunks[chunk].store(storage, std::memory_order_release);
+					}
+					storage[count & (ChunkSize - 1)] = driver;
+
+					auto current = lookup.load(std::memory_order_relaxed);
+					if ((count + 1) * 2 > current->mask + 1) {
+						// readers may still probe the old snapshot; it is kept until the table dies
+						lookups.emplace_back(std::make_unique<Lookup>((current->mask + 1) * 2));
+						auto grown = lookups.back().get();
+						for (unsigned i = 0; i < count; ++i) Place(*grown, Signature(i).GetHash(), i);
+						Place(*grown, driver.GetHash(), count);
+						lookup.store(grown, std::memory_order_release);
+					} else {
+						Place(*current, driver.GetHash(), count);
+					}
+					return count++;
+				}
+
+				int IndexOf(const Type& driver) const {
+					auto l = lookup.load(std::memory_order_acquire);
+					for (auto i = (unsigned)driver.GetHash() & l->mask;; i = (i + 1) & l->mask) {
+						auto slot = l->slots[i].load(std::memory_order_acquire);
+						if (!slot) return -1;
+						if (Signature(slot - 1) == driver) return (int)slot - 1;
+					}
+				}
+
+				const Type& Signature(unsigned index) const {
+					return chunks[index >> ChunkBits].load(std::memory_order_acquire)[index & (ChunkSize - 1)];
+				}
+			};
+
+			DriverTable& Drivers() {
+				if (auto cx = TLS::GetCurrentInstance()) return cx->GetDriverTable<DriverTable>();
+				// analyses outside any context share one table
+				static DriverTable* table = new DriverTable;
+				return *table;
+			}
+		}
+
+		unsigned DriverSet::Intern(const Type& driver) {
+			return Drivers().Intern(driver);
+		}
+
+		int DriverSet::IndexOf(const Type& driver) {
+			return Drivers().IndexOf(driver);
+		}
+
+		const Type& DriverSet::Signature(unsigned index) {
+			return Drivers().Signature(index);
+		}
+
+		DriverSet::DriverSet(const DriverSet& src) {
+			*this = src;
+		}
+
+		DriverSet::DriverSet(DriverSet&& src) {
+			*this = std::move(src);
+		}
+
+		DriverSet& DriverSet::operator=(const DriverSet& src) {
+			if (this != &src) {
+				if (src.heapBits) {
+					heapBits.reset(new std::uint64_t[src.numWords]);
+				} else {
+					heapBits.reset();
+				}
+				numWords = src.numWords;
+				memcpy(Words(), src.Words(), numWords * sizeof(std::uint64_t));
+			}
+			return *this;
+		}
+
+		DriverSet& DriverSet::operator=(DriverSet&& src) {
+			if (this != &src) {
+				numWords = src.numWords;
+				heapBits = std::move(src.heapBits);
+				memcpy(inlineBits, src.inlineBits, sizeof(inlineBits));
+				src.numWords = InlineWords;
+				memset(src.inlineBits, 0, sizeof(src.inlineBits));
+			}
+			return *this;
+		}
+
+		void DriverSet::Reserve(unsigned index) {
+			auto need = index / 64 + 1;
+			if (need <= numWords) return;
+			auto grown = std::max(need, numWords * 2);
+			std::unique_ptr<std::uint64_t[]> bits(new std::uint64_t[grown]);
+			memcpy(bits.get(), Words(), numWords * sizeof(std::uint64_t));
+			memset(bits.get() + numWords, 0, (grown - numWords) * sizeof(std::uint64_t));
+			heapBits = std::move(bits);
+			numWords = grown;
+		}
+
+		const Type* DriverSet::find(const Type& driver) const {
+			auto idx = IndexOf(driver);
+			if (idx < 0 || (Word(idx / 64) & (1ull << (idx % 64))) == 0) return nullptr;
+			return &Signature(idx);
+		}
+
+		const Type& DriverSet::insert(const Type& driver) {
+			auto idx = Intern(driver);
+			Reserve(idx);
+			Words()[idx / 64] |= 1ull << (idx % 64);
+			return Signature(idx);
+		}
+
+		size_t DriverSet::size() const {
+			size_t count = 0;
+			for (unsigned i = 0;i < numWords;++i) {
+				for (auto bits = Words()[i];bits;bits &= bits - 1) ++count;
+			}
+			return count;
+		}
+
+		size_t DriverSet::Hash() const {
+			size_t h(0x1337);
+			auto end = numWords;
+			while (end && Words()[end - 1] == 0) --end;
+			for (unsigned i = 0;i < end;++i) HASHER(h, (size_t)Words()[i]);
+			return h;
+		}
+
+		bool DriverSet::Includes(const DriverSet& subset) const {
+			for (unsigned i = 0;i < subset.numWords;++i) {
+				if (subset.Words()[i] & ~Word(i)) return false;
+			}
+			return true;
+		}
+
+		bool DriverSet::operator==(const DriverSet& rhs) const {
+			for (unsigned i = 0, end = std::max(numWords, rhs.numWords);i < end;++i) {
+				if (Word(i) != rhs.Word(i)) return false;
+			}
+			return true;
+		}
+
 		void DriverSet::Merge(const IDelegate& d, const Type& driverId) {
 			if (size() == 0) {
 				insert(driverId);
@@ -822,28 +1013,23 @@ namespace K3 {
 			}
 
 			/* optimize for no changes */
-			if (Qxx::From(GetEnumerator()).Select([&](const Type& driver) {
-					if (driver == driverId) return true;
-					return CompareDrivers(d,driverId,driver) < 0;
-				}).Where(IsTrue).Any()) return;
+			if (find(driverId)) return;
+			bool dominated = false;
+			for_each([&](const Type& driver) {
+				if (!dominated && CompareDrivers(d, driverId, driver) < 0) dominated = true;
+			});
+			if (dominated) return;
 
-			Sml::Set<Type> overrides;
+			DriverSet overrides;
 			for_each([&](const Type& in_set) {
-				if (CompareDrivers(d, in_set, driverId) < 0 && overrides.find(in_set) == 0) {
-					overrides.insert(in_set);
-				}
+				if (CompareDrivers(d, in_set, driverId) < 0) overrides.insert(in_set);
 			});
 
 			// plant the new driver
 			insert(driverId);
 
-			if (overrides.size()) {
-				Sml::Set<Type> newDrivers;
-				for_each([&](const Type& in_set) {
-					if (CompareDrivers(d,in_set,driverId) >= 0 &&
-						newDrivers.find(in_set) == 0) newDrivers.insert(in_set);
-				});
-				*this = std::move(newDrivers);
+			for (unsigned i = 0;i < overrides.numWords && i < numWords;++i) {
+				Words()[i] &= ~overrides.Words()[i];
 			}
 		}
 
@@ -868,7 +1054,7 @@ namespace K3 {
 
 			assert(Qxx::FromGraph(ongoing).OfType<LazyPair>().Any() == false);
 
-			DriverSet up, down, low_edge, high_edge;
+			DriverSet up, down, high_edge;
 			
 			Qxx::FromGraph(upstreamRx).OfType<DriverNode>().Select([&](const DriverNode* dn) {
 				Type upDrv{ dn->GetID() };
@@ -899,11 +1085,7 @@ namespace K3 {
 				return 0;
 			}).Now();
 
-			up.for_each([&](const Type& id) {
-				if (down.find(id) == nullptr) low_edge.insert(id);
-			});
-
-			if ( high_edge.size() > 0 || low_edge.size() > 0 ) {
+			if ( high_edge.size() > 0 || !down.Includes(up) ) {
 				auto boundary(Boundary::New(true,upstream,upstreamRx,ongoing));
 
 				auto generated = generatedBoundaries.equal_range(upstream);
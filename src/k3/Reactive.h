@@ -10,6 +10,7 @@
 #include "Stateful.h"
 
 #include <memory>
+#include <cstdint>
 
 namespace K3 {
 	namespace Nodes {
@@ -43,10 +44,65 @@ namespace K3 {
 			virtual void SetGlobalVariableReactivity(const void* uid, const Reactive::Node*) = 0;
 		};
 
-		class DriverSet : public Sml::Set<Type>, public RefCounting {
+		/* a set of driver signatures, stored as a bitset over signature indices.
+		   Signatures are interned per context and released with it, so an index
+		   stays valid for any set that outlives the analysis that built it
+		   within the same context. */
+		class DriverSet : public RefCounting {
+			static const unsigned InlineWords = 2;
+			unsigned numWords = InlineWords;
+			std::uint64_t inlineBits[InlineWords] = { 0, 0 };
+			std::unique_ptr<std::uint64_t[]> heapBits;
+
+			std::uint64_t* Words() { return heapBits ? heapBits.get() : inlineBits; }
+			const std::uint64_t* Words() const { return heapBits ? heapBits.get() : inlineBits; }
+			std::uint64_t Word(unsigned i) const { return i < numWords ? Words()[i] : 0; }
+			void Reserve(unsigned index);
+			static unsigned LowestBit(std::uint64_t word) {
+#ifdef _MSC_VER
+				unsigned long idx;
+				_BitScanForward64(&idx, word);
+				return idx;
+#else
+				return __builtin_ctzll(word);
+#endif
+			}
 		public:
+			static unsigned Intern(const Type& driver);
+			static int IndexOf(const Type& driver);
+			static const Type& Signature(unsigned index);
+
+			DriverSet() { }
+			DriverSet(const DriverSet&);
+			DriverSet(DriverSet&&);
+			DriverSet& operator=(const DriverSet&);
+			DriverSet& operator=(DriverSet&&);
+
+			const Type* find(const Type& driver) const;
+			const Type& insert(const Type& driver);
+			size_t size() const;
+			size_t Hash() const;
+			bool Includes(const DriverSet& subset) const;
+			bool operator==(const DriverSet& rhs) const;
+			bool operator!=(const DriverSet& rhs) const { return !operator==(rhs); }
+
+			template <typename FUNCTOR> void for_each(FUNCTOR f) const {
+				auto words = Words();
+				for (unsigned i = 0;i < numWords;++i) {
+					for (auto bits = words[i];bits;bits &= bits - 1) f(Signature(i * 64 + LowestBit(bits)));
+				}
+			}
+
+			template <typename FUNCTOR> void transform(FUNCTOR f) {
+				DriverSet result;
+				for_each([&](const Type& driver) {
+					Type tmp{ driver };
+					result.insert(f(tmp));
+				});
+				*this = std::move(result);
+			}
+
 			void Merge(const IDelegate& d, const Type& driverId);
-			DriverSet& operator=(const Sml::Set<Type>& rhs) {Sml::Set<Type>::operator=(rhs); return *this;}
 		};
 
 		class DriverNode : public Immutable::StaticUpstreamNode<0,DisposableRegionNode<Node>> {
@@ -56,11 +112,11 @@ namespace K3 {
 		public:
 			REGION_ALLOC(DriverNode);
 			DEFAULT_LOCAL_COMPARE(_super,DriverId);
-			unsigned int ComputeLocalHash() const  override
+			size_t ComputeLocalHash() const  override
 			{
 				size_t h(_super::ComputeLocalHash());
 				HASHER(h,DriverId.GetHash());
-				return (unsigned int)h;
+				return h;
 			}
 			const char *GetLabel() const  override {return "Driver";}
 			void Output(std::ostream& strm) const override;
@@ -131,9 +187,7 @@ namespace K3 {
 
 		class Analysis : public CachedTransform<const Typed, CTRef, true> {
 			struct dshash{size_t operator()(const DriverSet& ds) const {
-				size_t h(0x1337);
-				ds.for_each([&](const Type& t){HASHER(h,t.GetHash());});
-				return h;
+				return ds.Hash();
 			}};
 
 			Sml::Map<DriverSet,Graph<FusedSet>,dshash> memoizedReactivity;
@@ -195,7 +249,7 @@ namespace K3 {
 				Tick(Type id):Identifier(id) {}
 			PUBLIC
 				DEFAULT_LOCAL_COMPARE(DisposableTypedLeaf,Identifier)
-				unsigned ComputeLocalHash() const override { size_t h(DisposableTypedLeaf::ComputeLocalHash()); HASHER(h,Identifier.GetHash()); return (unsigned)h; }
+				size_t ComputeLocalHash() const override { size_t h(DisposableTypedLeaf::ComputeLocalHash()); HASHER(h,Identifier.GetHash()); return h; }
 				static Tick* New(Type id) {return new Tick(id);}
 				void Output(std::ostream& strm) const override;
 				Type Result(ResultTypeTransform&) const override { return Type::Float32; }
@@ -239,7 +293,7 @@ namespace K3 {
 				RateChange(double factor, CTRef sig) :TypedUnary(sig), factor(factor) { }
 			PUBLIC
 				DEFAULT_LOCAL_COMPARE(TypedUnary,factor);
-				unsigned ComputeLocalHash() const override { size_t h(TypedUnary::ComputeLocalHash()); HASHER(h,*(int64_t*)&factor); return (unsigned)h; }
+				size_t ComputeLocalHash() const override { size_t h(TypedUnary::ComputeLocalHash()); HASHER(h,*(int64_t*)&factor); return h; }
 				static RateChange* New(double factor, CTRef s) {return new RateChange(factor,s);}
 				Type Result(ResultTypeTransform& arg) const override {return GetUp(0)->Result(arg);}
 				const Reactive::Node* ReactiveAnalyze(Reactive::Analysis&, const Reactive::Node**) const override;
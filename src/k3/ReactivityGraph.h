@@ -15,7 +15,7 @@ namespace K3 {
 			virtual const Node* Rest() const { return this; }
 			virtual bool IsFused() const = 0;
 			static bool VerifyAllocation(void*, const void*) { return true; }
-			unsigned ComputeGraphHash(bool canFinalize) const { return 0; } // disable hash computation for reactive descriptors
+			size_t ComputeGraphHash(bool canFinalize) const { return 0; } // disable hash computation for reactive descriptors
 		};
 	};
 
@@ -1,5 +1,6 @@
 #include <cstdlib>
 #include "RegionNode.h"
+#include "CompilerProfile.h"
 #ifndef NDEBUG
 #define GUARD_REGION 0
 #include <iostream>
@@ -30,6 +31,7 @@ void* MemoryRegion::AllocateAligned(size_t bytes)
 	}
 	void *buf((char*)allocation.back()+pos);
 	pos+=bytes;
+	K3::Profile::CountRegionBytes(bytes);
 	return buf;
 }
 
@@ -4,232 +4,359 @@
 
 #include <unordered_map>
 #include <unordered_set>
+#include <type_traits>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SML_SSE2_PROBE 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #define DEFAULT_HASHER std::hash
 #define DEFAULT_EQUALITY std::equal_to
 #define DEFAULT_ALLOCATOR std::allocator
 
-#define LARGE_SET_TRESHOLD 32
+/* number of entries stored inside the container before spilling to the heap */
+#define SMALL_CONTAINER_INLINE 8
 
 #include <iostream>
 
 namespace Sml{
 	using namespace std;
 
-	/* these collection classes employ linear search and swap to std::unordered implementations when they grow beyond a treshold */
-	template <class KEY, class VALUE, class HASHER = DEFAULT_HASHER<KEY>, class EQUALITY = DEFAULT_EQUALITY<KEY>, class ALLOCATOR = DEFAULT_ALLOCATOR<pair<const KEY,VALUE>>>
-	class Map {
-		unsigned size;
-		unordered_map<KEY,VALUE,HASHER,EQUALITY,ALLOCATOR> *map;
-		pair<KEY,VALUE> owned[LARGE_SET_TRESHOLD];
-		void growToLarge() {
-			map = new unordered_map<KEY,VALUE,HASHER,EQUALITY,ALLOCATOR>();
-			for(unsigned i=0;i<size;++i) map->insert(owned[i]);
+	namespace Detail {
+		static const unsigned GroupWidth = 16;
+		static const int8_t EmptySlot = -128;
+
+		static inline unsigned LowestBit(unsigned mask) {
+#ifdef _MSC_VER
+			unsigned long idx;
+			_BitScanForward(&idx, mask);
+			return idx;
+#else
+			return __builtin_ctz(mask);
+#endif
 		}
-	public:
-		typedef pair<KEY,VALUE> entry_t;
-		Map& operator=(const Map& source) {
-			if (map) delete map;
-			size=source.size;
-			map = source.map?new unordered_map<KEY,VALUE,HASHER,EQUALITY,ALLOCATOR>(*source.map):0;
-			for(unsigned i(0);i<size;++i) owned[i]=source.owned[i];
-			return *this;
+
+		/* a group of control bytes; occupied bytes hold a 7-bit hash tag */
+		struct Group {
+#ifdef SML_SSE2_PROBE
+			__m128i ctrl;
+			Group(const int8_t* at):ctrl(_mm_loadu_si128((const __m128i*)at)) {}
+			unsigned Match(int8_t tag) const { return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag))); }
+			unsigned MatchEmpty() const { return _mm_movemask_epi8(ctrl); }
+#else
+			const int8_t* ctrl;
+			Group(const int8_t* at):ctrl(at) {}
+			unsigned Match(int8_t tag) const {
+				unsigned m = 0;
+				for (unsigned i = 0;i < GroupWidth;++i) if (ctrl[i] == tag) m |= 1u << i;
+				return m;
+			}
+			unsigned MatchEmpty() const { return Match(EmptySlot); }
+#endif
+		};
+
+		/* pointer and small integer hashes carry little entropy in the low bits */
+		static inline uint64_t MixHash(size_t h) {
+			uint64_t x = (uint64_t)h * 0x9e3779b97f4a7c15ull;
+			return x ^ (x >> 32);
 		}
 
-		Map& operator=(Map&& source) {
-			if (map) delete map;
-			size=source.size;
-			map = source.map;
-			source.map = 0;
-			for(unsigned i(0);i<size;++i) owned[i]=source.owned[i];
-			return *this;
+		static inline int8_t HashTag(uint64_t h) {
+			return (int8_t)(h >> 57);
 		}
 
-		Map(const Map& source) {
-			size=source.size;
-			map = source.map?new unordered_map<KEY,VALUE,HASHER,EQUALITY,ALLOCATOR>(*source.map):0;
-			for(unsigned i(0);i<size;++i) owned[i]=source.owned[i];
-		}; 
+		struct KeyOfPair {
+			template <typename P> const typename P::first_type& operator()(const P& p) const { return p.first; }
+		};
+
+		struct KeyOfValue {
+			template <typename V> const V& operator()(const V& v) const { return v; }
+		};
 
-		Map():size(0),map(0) { }
-		~Map() { if (map) delete map; }
+		/* insertion ordered entries with an open addressing index. Entries are
+		   constructed on insertion only, and the first SMALL_CONTAINER_INLINE of
+		   them live inside the table. The index is probed a group of control
+		   bytes at a time; there is no removal, so no tombstones either. */
+		template <class ENTRY, class KEY, class KEYOF, class HASHFN, class KEYEQ, class ALLOCATOR>
+		class FlatTable {
+			using alloc_t = typename allocator_traits<ALLOCATOR>::template rebind_alloc<ENTRY>;
+			using alloc_traits = allocator_traits<alloc_t>;
+
+			ENTRY *entries;
+			uint32_t count, capacity;
+			int8_t *ctrl;
+			uint32_t *slots;
+			uint32_t indexSize;
+
+			typename aligned_storage<sizeof(ENTRY), alignof(ENTRY)>::type inlineEntries[SMALL_CONTAINER_INLINE];
+			int8_t inlineCtrl[GroupWidth];
+			uint32_t inlineSlots[GroupWidth];
+
+			bool EntriesInline() const { return entries == (const ENTRY*)inlineEntries; }
+			bool IndexInline() const { return ctrl == inlineCtrl; }
+
+			static uint64_t HashOf(const KEY& k) { return MixHash(HASHFN()(k)); }
+
+			void InitEmpty() {
+				entries = (ENTRY*)inlineEntries;
+				count = 0;
+				capacity = SMALL_CONTAINER_INLINE;
+				ctrl = inlineCtrl;
+				slots = inlineSlots;
+				indexSize = GroupWidth;
+				memset(inlineCtrl, EmptySlot, sizeof(inlineCtrl));
+			}
+
+			void Release() {
+				for (uint32_t i = 0;i < count;++i) entries[i].~ENTRY();
+				if (!EntriesInline()) {
+					alloc_t a;
+					alloc_traits::deallocate(a, entries, capacity);
+				}
+				if (!IndexInline()) delete[] ctrl;
+			}
+
+			void AllocateIndex(uint32_t size) {
+				auto block = new int8_t[size * (1 + sizeof(uint32_t))];
+				memset(block, EmptySlot, size);
+				ctrl = block;
+				slots = (uint32_t*)(block + size);
+				indexSize = size;
+			}
+
+			void IndexInsert(uint64_t h, uint32_t entry) {
+				const size_t groupMask = indexSize / GroupWidth - 1;
+				for (size_t g = (size_t)h & groupMask, step = 0;;g = (g + ++step) & groupMask) {
+					auto empty = Group(ctrl + g * GroupWidth).MatchEmpty();
+					if (empty) {
+						auto at = g * GroupWidth + LowestBit(empty);
+						ctrl[at] = HashTag(h);
+						slots[at] = entry;
+						return;
+					}
+				}
+			}
+
+			ENTRY* Lookup(const KEY& k, uint64_t h) const {
+				const size_t groupMask = indexSize / GroupWidth - 1;
+				const int8_t tag = HashTag(h);
+				for (size_t g = (size_t)h & groupMask, step = 0;;g = (g + ++step) & groupMask) {
+					Group grp(ctrl + g * GroupWidth);
+					for (auto m = grp.Match(tag);m;m &= m - 1) {
+						auto e = entries + slots[g * GroupWidth + LowestBit(m)];
+						if (KEYEQ()(KEYOF()(*e), k)) return e;
+					}
+					if (grp.MatchEmpty()) return nullptr;
+				}
+			}
+
+			void Reindex(uint32_t size) {
+				if (!IndexInline()) delete[] ctrl;
+				AllocateIndex(size);
+				for (uint32_t i = 0;i < count;++i) IndexInsert(HashOf(KEYOF()(entries[i])), i);
+			}
+
+			template <typename ITEM> ENTRY& Append(ITEM&& item, uint64_t h) {
+				// keep the load factor of the index under 7/8
+				if ((count + 1) * 8 > indexSize * 7) Reindex(indexSize * 2);
+				if (count == capacity) {
+					// construct the new entry before moving the old ones: 'item' may alias one
+					alloc_t a;
+					auto grown = alloc_traits::allocate(a, capacity * 2);
+					new (grown + count) ENTRY(std::forward<ITEM>(item));
+					for (uint32_t i = 0;i < count;++i) {
+						new (grown + i) ENTRY(std::move(entries[i]));
+						entries[i].~ENTRY();
+					}
+					if (!EntriesInline()) alloc_traits::deallocate(a, entries, capacity);
+					entries = grown;
+					capacity *= 2;
+				} else {
+					new (entries + count) ENTRY(std::forward<ITEM>(item));
+				}
+				IndexInsert(h, count);
+				return entries[count++];
+			}
+
+			void CopyFrom(const FlatTable& src) {
+				if (src.count > capacity) {
+					alloc_t a;
+					entries = alloc_traits::allocate(a, src.capacity);
+					capacity = src.capacity;
+				}
+				for (;count < src.count;++count) new (entries + count) ENTRY(src.entries[count]);
+				if (src.indexSize != indexSize) AllocateIndex(src.indexSize);
+				memcpy(ctrl, src.ctrl, indexSize);
+				memcpy(slots, src.slots, indexSize * sizeof(uint32_t));
+			}
+
+			void TakeFrom(FlatTable& src) {
+				if (src.EntriesInline()) {
+					for (;count < src.count;++count) new (entries + count) ENTRY(std::move(src.entries[count]));
+				} else {
+					entries = src.entries;
+					capacity = src.capacity;
+					count = src.count;
+					src.entries = (ENTRY*)src.inlineEntries;
+					src.capacity = SMALL_CONTAINER_INLINE;
+					src.count = 0;
+				}
+				if (src.IndexInline()) {
+					memcpy(inlineCtrl, src.inlineCtrl, sizeof(inlineCtrl));
+					memcpy(inlineSlots, src.inlineSlots, sizeof(inlineSlots));
+				} else {
+					ctrl = src.ctrl;
+					slots = src.slots;
+					indexSize = src.indexSize;
+					src.ctrl = src.inlineCtrl;
+					src.slots = src.inlineSlots;
+				}
+				src.Release();
+				src.InitEmpty();
+			}
+
+		public:
+			FlatTable() { InitEmpty(); }
+			FlatTable(const FlatTable& src) { InitEmpty(); CopyFrom(src); }
+			FlatTable(FlatTable&& src) { InitEmpty(); TakeFrom(src); }
+			~FlatTable() { Release(); }
+
+			FlatTable& operator=(const FlatTable& src) {
+				if (this != &src) {
+					Release();
+					InitEmpty();
+					CopyFrom(src);
+				}
+				return *this;
+			}
+
+			FlatTable& operator=(FlatTable&& src) {
+				if (this != &src) {
+					Release();
+					InitEmpty();
+					TakeFrom(src);
+				}
+				return *this;
+			}
+
+			ENTRY* Find(const KEY& k) const { return Lookup(k, HashOf(k)); }
+
+			template <typename ITEM> ENTRY& Insert(ITEM&& item) {
+				auto h = HashOf(KEYOF()(item));
+				if (auto existing = Lookup(KEYOF()(item), h)) return *existing;
+				return Append(std::forward<ITEM>(item), h);
+			}
+
+			/* entries may have changed keys; rebuild the index and drop duplicates */
+			void Rehash() {
+				memset(ctrl, EmptySlot, indexSize);
+				uint32_t unique = 0;
+				for (uint32_t i = 0;i < count;++i) {
+					auto h = HashOf(KEYOF()(entries[i]));
+					if (Lookup(KEYOF()(entries[i]), h)) continue;
+					if (i != unique) entries[unique] = std::move(entries[i]);
+					IndexInsert(h, unique++);
+				}
+				for (uint32_t i = unique;i < count;++i) entries[i].~ENTRY();
+				count = unique;
+			}
+
+			uint32_t Size() const { return count; }
+			ENTRY* Begin() const { return entries; }
+			ENTRY* End() const { return entries + count; }
+		};
+	}
+
+	/* flat hash containers that keep small contents inline and preserve insertion order */
+	template <class KEY, class VALUE, class HASHER = DEFAULT_HASHER<KEY>, class EQUALITY = DEFAULT_EQUALITY<KEY>, class ALLOCATOR = DEFAULT_ALLOCATOR<pair<const KEY,VALUE>>>
+	class Map {
+		Detail::FlatTable<pair<KEY,VALUE>, KEY, Detail::KeyOfPair, HASHER, EQUALITY, ALLOCATOR> table;
+	public:
+		typedef pair<KEY,VALUE> entry_t;
 
 		VALUE& operator[](const KEY& k) {
-			if (size>=LARGE_SET_TRESHOLD) return (*map)[k];
-			for(unsigned i(0);i<size;++i) if (owned[i].first == k) return owned[i].second;
+			if (auto f = find(k)) return f->second;
 			return insert(make_pair(k,VALUE())).second;
 		}
 
 		pair<KEY,VALUE>* find(const KEY& k) {
-			if(size>=LARGE_SET_TRESHOLD) {
-				auto f(map->find(k));
-				if (f == map->end()) return 0;
-				else return (pair<KEY,VALUE>*)(&(*f));
-			}
-			for(unsigned i(0);i<size;++i) if (owned[i].first == k) return &owned[i];
-			return (pair<KEY,VALUE>*)0;
+			return table.Find(k);
 		}
 
 		const pair<KEY,VALUE>* find(const KEY& k) const {
-			if(size>=LARGE_SET_TRESHOLD) {
-				auto f(map->find(k));
-				if (f == map->end()) return 0;
-				else return (pair<KEY,VALUE>*)(&(*f));
-			}
-			for(unsigned i(0);i<size;++i) if (owned[i].first == k) return &owned[i];
-			return (pair<KEY,VALUE>*)0;
+			return table.Find(k);
 		}
 
 		pair<KEY,VALUE>& insert(const pair<KEY,VALUE> &item) {
 			assert(find(item.first) == nullptr && "Map already contains this key");
-			if (size>=LARGE_SET_TRESHOLD) {
-				return (pair<KEY,VALUE>&)(*map->insert(item).first);
-			} else {
-				owned[size++]=item;
-				if (size>=LARGE_SET_TRESHOLD) growToLarge();
-				return owned[size-1];
-			}
+			return table.Insert(item);
+		}
+
+		pair<KEY,VALUE>& insert(pair<KEY,VALUE> &&item) {
+			assert(find(item.first) == nullptr && "Map already contains this key");
+			return table.Insert(std::move(item));
 		}
 
 		pair<KEY,VALUE>& insert(const KEY& k, const VALUE& v) {return insert(make_pair(k,v));}
 
+		size_t size() const { return table.Size(); }
+
 		template <typename FUNCTOR> void for_each(FUNCTOR f) const {
-			if (size>=LARGE_SET_TRESHOLD) {
-				for(auto x : *map) f(x.first,x.second);
-			}
-			else for(unsigned i(0);i<size;++i) f(owned[i].first,owned[i].second);
+			for (auto e = table.Begin();e != table.End();++e) f(e->first,e->second);
 		}
 	};
 
 
 	template <class VALUE, class HASHER = DEFAULT_HASHER<VALUE>, class EQUALITY = DEFAULT_EQUALITY<VALUE>, class ALLOCATOR = DEFAULT_ALLOCATOR<VALUE>>
 	class Set {
-		unsigned _size;
-		typedef unordered_set<VALUE,HASHER,EQUALITY,ALLOCATOR> fallback_t; 
-		fallback_t *set;
-		VALUE owned[LARGE_SET_TRESHOLD];
-		void growToLarge() {
-			set = new unordered_set<VALUE,HASHER,EQUALITY,ALLOCATOR>();
-			for(unsigned i=0;i<_size;++i) set->insert(owned[i]);
-		}
-
-		bool fallback_compare(const Set& rhs) const {
-			assert(_size == rhs._size && _size < LARGE_SET_TRESHOLD);
-			fallback_t ls, rs;
-			for (size_t i(0);i < _size;++i) {
-				ls.insert(owned[i]);
-				rs.insert(rhs.owned[i]);
-			}
-			return ls == rs;
-		}
-
+		Detail::FlatTable<VALUE, VALUE, Detail::KeyOfValue, HASHER, EQUALITY, ALLOCATOR> table;
 	public:
 		LAZY_ENUMERATOR(const VALUE&,enumerator_t) {
-			typename fallback_t::const_iterator cur_it;
 			const VALUE* cur_pt;
-			unsigned size;
 			const Set& from;
 			enumerator_t(const Set& from):from(from) { }
 			LAZY_BEGIN
-				if (from._size >= LARGE_SET_TRESHOLD) {
-					for(cur_it = from.set->begin();cur_it!=from.set->end();++cur_it) LAZY_YIELD(*cur_it);
-				} else {
-					for(cur_pt = from.owned; cur_pt < from.owned + from._size; ++cur_pt) LAZY_YIELD(*cur_pt);
-				}
+				for(cur_pt = from.table.Begin(); cur_pt < from.table.End(); ++cur_pt) LAZY_YIELD(*cur_pt);
 			LAZY_END
 		};
 
 		typedef VALUE value_type;
 		enumerator_t GetEnumerator() const { return enumerator_t(*this); }
 
-		Set(const Set& source) {
-			_size = source._size;
-			for(unsigned int i(0);i<_size;++i) owned[i]=source.owned[i];
-			if (source.set) set = new unordered_set<VALUE,HASHER,EQUALITY,ALLOCATOR>(*source.set);
-			else set = 0;
-		}
-
-		Set(Set&& source):set(0) {
-			set = 0;
-			*this = std::move(source);
-		}
-
-		Set& operator=(Set&& source) noexcept {
-			if (set) delete set;
-			for(unsigned k(0);k<source._size;++k) owned[k]=source.owned[k];
-			_size = source._size;
-			set = source.set;
-			source._size = 0;
-			source.set = 0;
-			return *this;
-		}
-
-		Set& operator=(const Set& source) {
-			return *this = Set(source);
-		}
-
-		Set():_size(0),set(0) { }
-		~Set() {
-			if (set) delete set;
-		}
-
 		const VALUE* find(const VALUE& k) const {
-			if(_size>=LARGE_SET_TRESHOLD) {
-				auto f(set->find(k));
-				if (f == set->end()) return 0;
-				else return &(*f);
-			}
-			for(unsigned i(0);i<_size;++i) if (owned[i] == k) return &owned[i];
-			return (VALUE*)0;
+			return table.Find(k);
 		}
 
 		const VALUE& insert(const VALUE &item) {
 			assert(find(item) == 0 && "Set already contains this key");
-			if (_size>=LARGE_SET_TRESHOLD) return *set->insert(item).first;
-			else {
-				owned[_size++]=item;
-				if (_size>=LARGE_SET_TRESHOLD) growToLarge();
-				return owned[_size-1];
-			}
-		}	
+			return table.Insert(item);
+		}
 
-		size_t size() const {if (_size>=LARGE_SET_TRESHOLD) return set->size(); else return _size;}
+		size_t size() const {return table.Size();}
 
 		template <typename FUNCTOR> void for_each(FUNCTOR f) const {
-			if (_size>=LARGE_SET_TRESHOLD) {
-				for(auto x : *set) f(x);
-			}
-			else for(unsigned i(0);i<_size;++i) f(owned[i]);
+			for (auto e = table.Begin();e != table.End();++e) f(*e);
 		}
 
 		template <typename FUNCTOR> void transform(FUNCTOR f) {
-			if (_size>=LARGE_SET_TRESHOLD) {
-				for(auto x : *set) x = f(x);
-			}
-			else for(unsigned i(0);i<_size;++i) owned[i] = f(owned[i]);
+			for (auto e = table.Begin();e != table.End();++e) *e = f(*e);
+			table.Rehash();
 		}
 
 		bool operator==(const Set& rhs) const {
-			if (_size >= LARGE_SET_TRESHOLD) {
-				return *set == *rhs.set;
-			} 
-
-			if (_size != rhs._size) return false;
-
-			if (_size < 5) {
-				for (size_t i = 0;i < _size;++i) {
-					for (size_t j = 0; j < _size;++j) {
-						if (owned[i] == rhs.owned[j]) goto found;
-					}
-					return false;
-				found:
-					continue;
-				}
-				assert(fallback_compare(rhs));
-				return true;
+			if (size() != rhs.size()) return false;
+			for (auto e = table.Begin();e != table.End();++e) {
+				if (!rhs.find(*e)) return false;
 			}
-			return fallback_compare(rhs);
+			return true;
 		}
 
 		bool operator!=(const Set& rhs) const {
@@ -237,4 +364,3 @@ namespace Sml{
 		}
 	};
 }
-
@@ -207,11 +207,11 @@ namespace K3 {
 			return n;
 		}
 
-		unsigned RingBuffer::ComputeLocalHash() const {
+		size_t RingBuffer::ComputeLocalHash() const {
 			size_t h(TypedPolyadic::ComputeLocalHash());
 			HASHER(h,len);
 			HASHER(h,elementType.GetHash());
-			return unsigned(h);
+			return h;
 		}
 	};
 };
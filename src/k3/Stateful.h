@@ -45,7 +45,7 @@ namespace K3 {
 			virtual const Reactive::Node* ReactiveAnalyze(Reactive::Analysis&, const Reactive::Node**) const override;
 			virtual CTRef ReactiveReconstruct(Reactive::Analysis&) const override;
 			bool MayHaveRecursion( ) const override { return true; }
-			unsigned ComputeLocalHash() const override;
+			size_t ComputeLocalHash() const override;
 			RingBuffer *PubConstructShallowCopy() const { return ConstructShallowCopy(); }
 		END
 	};
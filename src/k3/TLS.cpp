@@ -76,12 +76,38 @@ namespace K3 {
 	}
 
 	thread_local TLS* __instance = 0;
+	thread_local CompilationSession* __session = 0;
+
+	// contexts that haven't been destroyed; consulted by exiting threads
+	static std::mutex& LiveContextLock() {
+		static auto lock = new std::mutex;
+		return *lock;
+	}
+
+	static std::unordered_set<const TLS*>& LiveContexts() {
+		static auto live = new std::unordered_set<const TLS*>;
+		return *live;
+	}
+
+	// owned by every thread that has a session; drops them when the thread exits
+	struct SessionReaper {
+		std::vector<const TLS*> contexts;
+		~SessionReaper() {
+			std::lock_guard<std::mutex> lg{ LiveContextLock() };
+			for (auto cx : contexts) {
+				if (LiveContexts().count(cx)) cx->ReleaseSession(std::this_thread::get_id());
+			}
+		}
+	};
+
+	static thread_local SessionReaper reaper;
     
     Asset::Asset():memory(nullptr, free) {
     }
 
 	void TLS::SetCurrentInstance(TLS* instance) {
 		__instance = instance;
+		__session = instance ? &instance->SessionForThisThread() : nullptr;
 	}
 
 	size_t TLS::GetUID() {
@@ -92,6 +118,56 @@ namespace K3 {
 		return __instance;
 	}
 
+	CompilationSession& TLS::GetSession() {
+		assert(__session && "no context is active on this thread");
+		return *__session;
+	}
+
+	CompilationSession& TLS::SessionForThisThread() const {
+		std::lock_guard<std::mutex> lg{ sessionLock };
+		auto& s = sessions[std::this_thread::get_id()];
+		if (!s) {
+			s = std::make_unique<CompilationSession>();
+			reaper.contexts.emplace_back(this);
+		}
+		return *s;
+	}
+
+	void TLS::ReleaseSession(std::thread::id thread) const {
+		std::lock_guard<std::mutex> lg{ sessionLock };
+		sessions.erase(thread);
+	}
+
+	void TLS::ResetSession() {
+		auto& s = SessionForThisThread();
+		s.cache = new SpecializationCache;
+		s.graphs.clear();
+		s.resolutionTrace.clear();
+		s.rebinds.clear();
+	}
+
+	TLS::RepositoryAccess::RepositoryAccess(TLS& cx, bool exclusive)
+		:cx(cx), session(cx.SessionForThisThread()), exclusive(exclusive) {
+		owner = session.repositoryAccess == 0;
+		if (!owner && exclusive && !session.repositoryExclusive) {
+			INTERNAL_ERROR("Repository update while this thread holds shared access");
+		}
+		++session.repositoryAccess;
+		if (owner) {
+			session.repositoryExclusive = exclusive;
+			if (exclusive) cx.repositoryLock.lock();
+			else cx.repositoryLock.lock_shared();
+		}
+	}
+
+	TLS::RepositoryAccess::~RepositoryAccess() {
+		if (owner) {
+			if (exclusive) cx.repositoryLock.unlock();
+			else cx.repositoryLock.unlock_shared();
+		}
+		--session.repositoryAccess;
+	}
+
 #ifndef NDEBUG
 	bool TLS::ShouldTrace(const char *context, const char *label) {
 		if (compilerTraceFilter.empty()) return false;
@@ -187,6 +263,10 @@ namespace K3 {
 	}
 
 	TLS::TLS(Kronos::ModulePathResolver res, void *user) {
+		{
+			std::lock_guard<std::mutex> lg{ LiveContextLock() };
+			LiveContexts().emplace(this);
+		}
 		if (getenv("KRONOS_COMPILER_TRACE")) {
 			compilerTraceFilter = getenv("KRONOS_COMPILER_TRACE");
 		}
@@ -211,10 +291,22 @@ namespace K3 {
 	}
 
 	Kronos::BuildFlags TLS::GetCurrentFlags() {
-		return GetCurrentInstance()->flags;
+		return GetSession().flags;
+	}
+
+	TLS::~TLS() {
+		// an exiting thread may be releasing its session; wait for it
+		std::lock_guard<std::mutex> lg{ LiveContextLock() };
+		LiveContexts().erase(this);
 	}
 
 	TypeDescriptor* TLS::GetTypeDescriptor(const std::string& key) {
+		{
+			std::shared_lock<std::shared_mutex> read{ usertypeLock };
+			auto f(usertypes.find(key));
+			if (f != usertypes.end()) return &f->second;
+		}
+		std::lock_guard<std::shared_mutex> write{ usertypeLock };
 		auto f(usertypes.find(key));
 		if (f==usertypes.end())
 			f = usertypes.insert(make_pair(key,TypeDescriptor(key))).first;
@@ -223,28 +315,49 @@ namespace K3 {
 	}
 
 	const void* TLS::Memoize(const Type& key) {
-		auto f(typeKeys.find(key));
-		if (f!=typeKeys.end()) return &*f;
-		const void *uid = &(*typeKeys.insert(key).first);
-		assert(typeAssoc.count(uid) == 0);
-		typeAssoc[uid] = key;
+		auto& shard(typeKeys[std::hash<Type>()(key) % InternShards]);
+		{
+			std::shared_lock<std::shared_mutex> read{ shard.lock };
+			auto f(shard.keys.find(key));
+			if (f != shard.keys.end()) return &*f;
+		}
+
+		const void *uid;
+		{
+			std::lock_guard<std::shared_mutex> write{ shard.lock };
+			auto ins = shard.keys.insert(key);
+			uid = &*ins.first;
+			if (!ins.second) return uid;
+		}
+
+		// uids are stable element addresses; the reverse map is sharded on them
+		auto& assoc(typeAssoc[((std::uintptr_t)uid >> 4) % InternShards]);
+		std::lock_guard<std::shared_mutex> write{ assoc.lock };
+		assert(assoc.assoc.count(uid) == 0);
+		assoc.assoc[uid] = key;
 		return uid;
 	}
 
 	Type TLS::Recall(const void* uid) {
-		return typeAssoc[uid];
+		auto& assoc(typeAssoc[((std::uintptr_t)uid >> 4) % InternShards]);
+		std::shared_lock<std::shared_mutex> read{ assoc.lock };
+		auto f(assoc.assoc.find(uid));
+		return f == assoc.assoc.end() ? Type() : f->second;
 	}
 
 	Nodes::CGRef TLS::ResolveSymbol(const char* qualifiedName) {
-		auto self = TLS::GetCurrentInstance();
-		auto sym = self->codebase.Lookup(qualifiedName);
-		self->DidResolve(qualifiedName);
+		auto& session = GetSession();
+		session.resolutionTrace.emplace(qualifiedName);
+		auto rb = session.rebinds.find(qualifiedName);
+		if (rb != session.rebinds.end()) return rb->second;
+		auto sym = GetCurrentInstance()->codebase.Lookup(qualifiedName);
 		return sym ? sym->graph : nullptr;
 	}
 
 	void TLS::RebindSymbol(const char *qualifiedName, Nodes::CGRef graph) {
-		auto self = TLS::GetCurrentInstance();
-		self->codebase.Rebind(qualifiedName, graph);
+		// temporary bindings stay in the session so that the shared repository
+		// is never written to during specialization
+		GetSession().rebinds[qualifiedName] = graph;
 	}
 
 	std::unordered_set<std::string> TLS::DrainRecentChanges() {
@@ -284,6 +397,7 @@ namespace K3 {
 	}
 
 	Asset& TLS::GetAsset(const std::string& name) {
+		std::lock_guard<std::recursive_mutex> lg{ tableLock };
 		if (staticAssets.count(name) == 0 && assetLoader) {
 			Type ty;
 			auto mem = assetLoader(name.c_str(), ty);
@@ -10,11 +10,15 @@
 #include "Typed.h"
 #include "kronos_abi.h"
 #include "Parser.h"
+#include "CompilerProfile.h"
 #include <unordered_set>
 #include <map>
 #include <set>
 #include <tuple>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <thread>
 #include <list>
 #include <deque>
 #include <vector>
@@ -42,45 +46,95 @@ namespace K3 {
         Type type;
     };
 
-	class TLS {
-		size_t curUID;
-		std::map<const std::string, TypeDescriptor> usertypes;
-		std::unordered_set<Type> typeKeys;
-		std::unordered_map<const void*, Type> typeAssoc;
+	// state private to one thread compiling against a context. Specialization
+	// and code generation read it instead of the context, so that several
+	// threads can compile concurrently on one shared repository.
+	struct CompilationSession {
+		Kronos::BuildFlags flags = Kronos::BuildFlags::Default;
+		Ref<SpecializationCache> cache;
+		// structurally unique function bodies, when interning is enabled
+		std::unordered_set<Graph<Nodes::Typed>> graphs;
 		std::unordered_set<std::string> resolutionTrace;
+		std::unordered_map<std::string, Nodes::CGRef> rebinds;
+		int repositoryAccess = 0;
+		bool repositoryExclusive = false;
+#ifndef KRONOS_NO_STACK_EXTENDER
+		std::vector<std::unique_ptr<Stack>> virtualStack;
+		size_t virtualStackFrame = 0;
+#endif
+	};
 
+	struct SessionReaper;
+
+	class TLS {
+		friend struct SessionReaper;
+		std::atomic<size_t> curUID{ 0 };
+
+		// the interning tables are read far more often than written to, so
+		// lookups take a shared lock, and types are spread over shards
+		static const size_t InternShards = 16;
+		struct TypeKeyShard {
+			std::shared_mutex lock;
+			std::unordered_set<Type> keys;
+		} typeKeys[InternShards];
+		struct TypeAssocShard {
+			std::shared_mutex lock;
+			std::unordered_map<const void*, Type> assoc;
+		} typeAssoc[InternShards];
+		std::shared_mutex usertypeLock, stringLock;
+		std::map<const std::string, TypeDescriptor> usertypes;
 		std::unordered_set<std::string> Strings;
+
+		// guards the other stores shared by all sessions
+		mutable std::recursive_mutex tableLock;
 		std::unordered_map<const char*,Ref<ManagedObject>> ManagedObjectStore;
 		std::unordered_map<std::string, std::function<void(bool, const Type&, std::int64_t)>> specializationCallbacks;
 		std::function<const char*(const char*, const char*, const char*)> modulePathResolver;
 		std::function<void*(const char* url, Type&)> assetLoader;
 
-		Ref<SpecializationCache> currentCache;
-
-#ifndef KRONOS_NO_STACK_EXTENDER
-		std::vector<std::unique_ptr<Stack>> virtualStack;
-		size_t virtualStackFrame = 0;
-#endif
-
 		std::unordered_map<std::string, Asset> staticAssets;
 		std::string compilerTraceFilter;
+		Profile::Log compilerProfile;
+
+		std::once_flag driverTableInit;
+		Ref<ManagedObject> driverTable;
+
+		mutable std::mutex sessionLock;
+		mutable std::unordered_map<std::thread::id, std::unique_ptr<CompilationSession>> sessions;
+		std::shared_mutex repositoryLock;
 	protected:
-		Kronos::BuildFlags flags;
-		void ClearResolutionTrace() { resolutionTrace.clear(); }
-		void DidResolve(const std::string& str) { resolutionTrace.emplace(str); }
-		std::unordered_set<std::string> GetResolutionTrace() const { return resolutionTrace; }
+		CompilationSession& SessionForThisThread() const;
+		void ReleaseSession(std::thread::id) const;
+		void ResetSession();
+		std::unordered_set<std::string> GetResolutionTrace() const { return SessionForThisThread().resolutionTrace; }
 		std::unordered_set<std::string> DrainRecentChanges();
+
+		// shared access for compilation, exclusive for repository updates.
+		// nested accesses on one thread reuse the outermost lock, which
+		// must be exclusive if any of them is.
+		class RepositoryAccess {
+			TLS& cx;
+			CompilationSession& session;
+			bool exclusive, owner;
+		public:
+			RepositoryAccess(TLS& cx, bool exclusive);
+			~RepositoryAccess();
+			RepositoryAccess(const RepositoryAccess&) = delete;
+			RepositoryAccess& operator=(const RepositoryAccess&) = delete;
+		};
 		Parser::parser_state_t REPLState;
 		Parser::Repository2 codebase;
 		void InitializeDefaultResolver();
 	public:
 
 		void SetCompilerDebugTraceFilter(const char *flt) { compilerTraceFilter = flt; }
+		Profile::Log& GetCompilerProfile() { return compilerProfile; }
 #ifndef NDEBUG
 		bool ShouldTrace(const char *context, const char *label);
 #endif
 
 		TLS(Kronos::ModulePathResolver res, void *user);
+		~TLS();
 		TLS(const TLS&) = delete;
 		TLS& operator=(const TLS&) = delete;
         
@@ -88,8 +142,15 @@ namespace K3 {
 
 		static void SetCurrentInstance(TLS* instance);
 		static TLS* GetCurrentInstance();
+		static CompilationSession& GetSession();
 
 		const char *Memoize(const std::string& str) {
+			{
+				std::shared_lock<std::shared_mutex> read{ stringLock };
+				auto f = Strings.find(str);
+				if (f != Strings.end()) return f->c_str();
+			}
+			std::lock_guard<std::shared_mutex> write{ stringLock };
 			return Strings.insert(str).first->c_str();
 		}
 
@@ -107,31 +168,43 @@ namespace K3 {
 		Type Recall(const void* uid);
 
 		void RegisterSpecilizationCallback(const std::string& signature, std::function<void(bool, const Type&, std::int64_t)> cb) {
+			std::lock_guard<std::recursive_mutex> lg{ tableLock };
 			specializationCallbacks[signature] = cb;
 		}
 
 		void SetAssetLoader(std::function<void*(const char*, Type&)> al) {
+			std::lock_guard<std::recursive_mutex> lg{ tableLock };
 			assetLoader = al;
 		}
 
 		void SpecializationCallback(bool hasDiagnostics, const std::string& signature, const Type& t, std::int64_t typeUid) {
-			auto f = specializationCallbacks.find(signature);
-			if (f != specializationCallbacks.end()) {
-				f->second(hasDiagnostics, t, typeUid);
+			std::function<void(bool, const Type&, std::int64_t)> cb;
+			{
+				std::lock_guard<std::recursive_mutex> lg{ tableLock };
+				auto f = specializationCallbacks.find(signature);
+				if (f == specializationCallbacks.end()) return;
+				cb = f->second;
 			}
+			cb(hasDiagnostics, t, typeUid);
 		}
 
 		size_t GetUID();
 
 		Err<void> Initialize();
 
-		Ref<ManagedObject> Get(const char *key) { return ManagedObjectStore[key]; }
-		void Set(const char *key, Ref<ManagedObject> mo) { ManagedObjectStore[key] = mo; }
+		Ref<ManagedObject> Get(const char *key) { std::lock_guard<std::recursive_mutex> lg{ tableLock }; return ManagedObjectStore[key]; }
+		void Set(const char *key, Ref<ManagedObject> mo) { std::lock_guard<std::recursive_mutex> lg{ tableLock }; ManagedObjectStore[key] = mo; }
+
+		// reactive driver signatures interned for this context; see Reactive.cpp
+		template <typename TABLE> TABLE& GetDriverTable() {
+			std::call_once(driverTableInit, [this]() { driverTable = new TABLE; });
+			return static_cast<TABLE&>(*driverTable);
+		}
 
 		TLS* SetForThisThread() { TLS* old = GetCurrentInstance(); SetCurrentInstance(this); return old; }
 
-		Ref<SpecializationCache> GetSpecializationCache() { return currentCache; }
-		void SetSpecializationCache(Ref<SpecializationCache> c) { currentCache = move(c); }
+		Ref<SpecializationCache> GetSpecializationCache() { return GetSession().cache; }
+		void SetSpecializationCache(Ref<SpecializationCache> c) { GetSession().cache = move(c); }
 
 		static Nodes::CGRef ResolveSymbol(const char* qualifiedName);
 		static void RebindSymbol(const char *qualifiedName, Nodes::CGRef temporaryBinding);
@@ -145,7 +218,7 @@ namespace K3 {
 #ifdef KRONOS_NO_STACK_EXTENDER
 			return f();
 #else
-			auto self = GetCurrentInstance();
+			auto self = &GetSession();
 			if (self->virtualStackFrame) {
 				// is there enough space?
 				if (self->virtualStack[self->virtualStackFrame - 1]->StackAvail() > 0x10000) {
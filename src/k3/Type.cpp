@@ -7,6 +7,7 @@
 #include <limits>
 #include <sstream>
 #include <cmath>
+#include <cstring>
 #include "TLS.h"
 #include "math.h"
 
@@ -41,7 +42,7 @@ namespace K3 {
 	};
 
 	Type::~Type() {
-		if (kind < 0) data.RefObj->Detach();
+		if (IsManaged()) data.RefObj->Detach();
 	}
 
 	// move ctor
@@ -61,7 +62,7 @@ namespace K3 {
 	Type::Type(const Type& src) {
 		kind = src.kind;
 		data = src.data;
-		if (kind < 0) data.RefObj->Attach();
+		if (IsManaged()) data.RefObj->Attach();
 	}
 
 	bool Type::IsPair() const {
@@ -282,7 +283,14 @@ namespace K3 {
 			return GetGraph()->Compare(*(rhs.GetGraph()));
 			break;
 		case InvariantType:
-			return ordinalCmp(data.InvariantValue->value, rhs.data.InvariantValue->value);
+			if (data.Invariant.Encoding == rhs.data.Invariant.Encoding) {
+				switch (data.Invariant.Encoding) {
+				case IntInvariant: return ordinalCmp(data.Invariant.Int, rhs.data.Invariant.Int);
+				case RealInvariant: return ordinalCmp(data.Invariant.Real, rhs.data.Invariant.Real);
+				default: break;
+				}
+			}
+			return ordinalCmp(GetBigNum(), rhs.GetBigNum());
 		case InvariantStringType:
 			return data.InvariantString->compare(*rhs.data.InvariantString);
 		case TupleType: {
@@ -333,14 +341,25 @@ namespace K3 {
 			return data.InvariantString->hash(1);
 		}
 		case InvariantType:
-		{			
-			size_t h(0);
-			for (auto &w : data.InvariantValue->value.exponent.table) {
-				HASHER(h, w);
+		{
+			// encodings are canonical, so equal values hash alike
+			size_t h(data.Invariant.Encoding);
+			switch (data.Invariant.Encoding) {
+			case IntInvariant: HASHER(h, (uint64_t)data.Invariant.Int); break;
+			case RealInvariant: {
+				uint64_t bits;
+				memcpy(&bits, &data.Invariant.Real, sizeof(bits));
+				HASHER(h, bits);
+				break;
 			}
+			default:
+				for (auto &w : data.Invariant.BigNum->value.exponent.table) {
+					HASHER(h, w);
+				}
 
-			for (auto &w : data.InvariantValue->value.mantissa.table) {
-				HASHER(h, w);
+				for (auto &w : data.Invariant.BigNum->value.mantissa.table) {
+					HASHER(h, w);
+				}
 			}
 			return h;
 		}
@@ -409,35 +428,66 @@ namespace K3 {
 	Type::Type(TypeDescriptor *desc) : kind(TypeTagType) { data.TypeTag = desc; }
 	Type::Type(bool truth) : kind(truth ? TrueType : NilType) { }
 
-	Type::Type(double val) : kind(InvariantType) { 
-		data.InvariantValue = new InvariantData;
-		data.InvariantValue->Attach();
-		data.InvariantValue->value = val;
+	// magnitude below which int64 and double convert exactly
+	static const std::int64_t ExactIntInDouble = 1ll << 53;
+
+	static bool IsIntegral(double val, std::int64_t& asInt) {
+		// the upper bound is exclusive, 2^63 does not fit
+		if (val >= -9223372036854775808.0 && val < 9223372036854775808.0) {
+			asInt = (std::int64_t)val;
+			return (double)asInt == val;
+		}
+		return false;
+	}
+
+	static InvariantData* NewBigNum(const ttmath::Big<1, 2>& val) {
+		auto bn = new InvariantData;
+		bn->Attach();
+		bn->value = val;
 #ifndef NDEBUG
-		data.InvariantValue->vis = val;
+		bn->vis = val.ToDouble();
 #endif
+		return bn;
+	}
+
+	Type::Type(double val) : kind(InvariantType) { 
+		std::int64_t asInt;
+		if (IsIntegral(val, asInt)) {
+			data.Invariant.Int = asInt;
+			data.Invariant.Encoding = IntInvariant;
+		} else if (std::isfinite(val)) {
+			data.Invariant.Real = val;
+			data.Invariant.Encoding = RealInvariant;
+		} else {
+			data.Invariant.BigNum = NewBigNum(val);
+			data.Invariant.Encoding = BigNumInvariant;
+		}
 	}
 
 	Type::Type(std::int64_t val) : kind(InvariantType) { 
-		data.InvariantValue = new InvariantData;
-		data.InvariantValue->Attach();
-		#ifdef TTMATH_PLATFORM32
-		data.InvariantValue->value = ttmath::slint(val);
-		#else
-		data.InvariantValue->value = ttmath::sint(val);
-		#endif
-#ifndef NDEBUG
-		data.InvariantValue->vis = val;
-#endif
+		data.Invariant.Int = val;
+		data.Invariant.Encoding = IntInvariant;
 	}
 
 	Type::Type(ttmath::Big<1, 2> val) : kind(InvariantType) {
-		data.InvariantValue = new InvariantData;
-		data.InvariantValue->Attach();
-		data.InvariantValue->value = val;
-#ifndef NDEBUG
-		data.InvariantValue->vis = val.ToDouble();
-#endif
+		if (!val.IsNan()) {
+			if (val.IsInteger()) {
+				ttmath::sint asInt;
+				if (!val.ToInt(asInt)) {
+					data.Invariant.Int = (std::int64_t)asInt;
+					data.Invariant.Encoding = IntInvariant;
+					return;
+				}
+			}
+			double asReal;
+			if (!val.ToDouble(asReal) && ttmath::Big<1, 2>(asReal) == val) {
+				data.Invariant.Real = asReal;
+				data.Invariant.Encoding = RealInvariant;
+				return;
+			}
+		}
+		data.Invariant.BigNum = NewBigNum(val);
+		data.Invariant.Encoding = BigNumInvariant;
 	}
 
 	Type Type::BigNumber(const char *val) {
@@ -566,7 +616,7 @@ namespace K3 {
 	void Type::OutputText(std::ostream& stream, const void *instance, bool pairExtension) const {
 		switch (kind) {
 		case InvariantType:
-			stream << "#" << data.InvariantValue->value.ToString();
+			stream << "#" << GetBigNum().ToString();
 			break;
 		case InvariantStringType:
 			//			EscapeString(stream,data.InvariantString,20);
@@ -797,7 +847,7 @@ namespace K3 {
 					<< "}";
 				return;
 			case InvariantType:
-				os << "{\"#\": " << data.InvariantValue->value.ToString() << "}";
+				os << "{\"#\": " << GetBigNum().ToString() << "}";
 				break;
 			case ArrayViewType:
 				os << "{\"arrayview\": [%q, %i, %i]}";
@@ -821,21 +871,43 @@ namespace K3 {
 	double Type::GetInvariant() const {
 		ASSERT_KIND2(RuleGenerator, Invariant);
 		if (IsRuleGenerator()) return data.RGen->GetTemplateType().GetInvariant();
-		return data.InvariantValue->value.ToDouble();
+		switch (data.Invariant.Encoding) {
+		case IntInvariant: return (double)data.Invariant.Int;
+		case RealInvariant: return data.Invariant.Real;
+		default: return data.Invariant.BigNum->value.ToDouble();
+		}
 	}
 
 	std::int64_t Type::GetInvariantI64() const {
 		ASSERT_KIND2(RuleGenerator, Invariant);
 		if (IsRuleGenerator())
 			return data.RGen->GetTemplateType().GetInvariantI64();
-		else 
-			return strtoll(data.InvariantValue->value.ToString().c_str(), nullptr, 10);
+		switch (data.Invariant.Encoding) {
+		case IntInvariant: return data.Invariant.Int;
+		case RealInvariant: {
+			// truncate and saturate like parsing the decimal representation would
+			auto r = data.Invariant.Real;
+			if (r >= 9223372036854775808.0) return std::numeric_limits<std::int64_t>::max();
+			if (r < -9223372036854775808.0) return std::numeric_limits<std::int64_t>::min();
+			return (std::int64_t)r;
+		}
+		default: return strtoll(data.Invariant.BigNum->value.ToString().c_str(), nullptr, 10);
+		}
 	}
 
 	ttmath::Big<1, 2> Type::GetBigNum() const {
 		ASSERT_KIND2(Invariant, RuleGenerator);
 		if (IsRuleGenerator()) return data.RGen->GetTemplateType().GetBigNum();
-		return data.InvariantValue->value;
+		switch (data.Invariant.Encoding) {
+		case IntInvariant: 
+#ifdef TTMATH_PLATFORM32
+			return ttmath::Big<1, 2>(ttmath::slint(data.Invariant.Int));
+#else
+			return ttmath::Big<1, 2>(ttmath::sint(data.Invariant.Int));
+#endif
+		case RealInvariant: return ttmath::Big<1, 2>(data.Invariant.Real);
+		default: return data.Invariant.BigNum->value;
+		}
 	}
 
 	bool Type::GetTrueOrNil() const {
@@ -886,17 +958,119 @@ namespace K3 {
 		} else return kind == type;
 	}
 
+	static bool InDoubleIntRange(std::int64_t v) {
+		return v >= -ExactIntInDouble && v <= ExactIntInDouble;
+	}
+
 	Type Type::operator+(const Type& rhs) const {
 		if (IsRuleGenerator()) return data.RGen->Add(rhs);
 		else if (rhs.IsRuleGenerator()) return rhs.data.RGen->Add(*this);
+		if (kind == InvariantType && data.Invariant.Encoding == IntInvariant &&
+			rhs.kind == InvariantType && rhs.data.Invariant.Encoding == IntInvariant) {
+			// identical to the double arithmetic below while the operands and the result are exact doubles
+			auto a = data.Invariant.Int, b = rhs.data.Invariant.Int;
+			if (InDoubleIntRange(a) && InDoubleIntRange(b) && InDoubleIntRange(a + b)) return Type(a + b);
+		}
 		return Type(GetInvariant() + rhs.GetInvariant());
 	}
 
 	Type Type::operator-(const Type& rhs) const {
 		if (IsRuleGenerator()) return data.RGen->Sub(rhs);
+		if (kind == InvariantType && data.Invariant.Encoding == IntInvariant &&
+			rhs.kind == InvariantType && rhs.data.Invariant.Encoding == IntInvariant) {
+			auto a = data.Invariant.Int, b = rhs.data.Invariant.Int;
+			if (InDoubleIntRange(a) && InDoubleIntRange(b) && InDoubleIntRange(a - b)) return Type(a - b);
+		}
 		return Type(GetInvariant() - rhs.GetInvariant());
 	}
 
+	bool Type::GetExactReal(double& r) const {
+		if (kind != InvariantType) return false;
+		switch (data.Invariant.Encoding) {
+		case RealInvariant: r = data.Invariant.Real; return true;
+		case IntInvariant:
+			if (!InDoubleIntRange(data.Invariant.Int)) return false;
+			r = (double)data.Invariant.Int;
+			return true;
+		default: return false;
+		}
+	}
+
+	/* the immediate paths must produce the exact bignum result or decline */
+	template <typename INT_OP, typename REAL_OP, typename BIGNUM_OP>
+	Type Type::InvariantArithmetic(const Type& a, const Type& b, INT_OP intOp, REAL_OP realOp, BIGNUM_OP bigOp) {
+		if (a.kind == InvariantType && b.kind == InvariantType) {
+			if (a.data.Invariant.Encoding == IntInvariant && b.data.Invariant.Encoding == IntInvariant) {
+				std::int64_t r;
+				if (intOp(a.data.Invariant.Int, b.data.Invariant.Int, r)) return Type(r);
+			}
+			double ra, rb, r;
+			if (a.GetExactReal(ra) && b.GetExactReal(rb) && realOp(ra, rb, r)) return Type(r);
+		}
+		return Type(bigOp(a.GetBigNum(), b.GetBigNum()));
+	}
+
+	using BigNum = ttmath::Big<1, 2>;
+	static const std::int64_t Int64Max = std::numeric_limits<std::int64_t>::max();
+	static const std::int64_t Int64Min = std::numeric_limits<std::int64_t>::min();
+
+	Type Type::InvariantAdd(const Type& lhs, const Type& rhs) {
+		return InvariantArithmetic(lhs, rhs,
+			[](std::int64_t a, std::int64_t b, std::int64_t& r) {
+				if ((b > 0 && a > Int64Max - b) || (b < 0 && a < Int64Min - b)) return false;
+				r = a + b; return true;
+			},
+			[](double a, double b, double& r) {
+				// two-sum error term
+				r = a + b;
+				auto bv = r - a;
+				return std::isfinite(r) && (a - (r - bv)) + (b - bv) == 0;
+			},
+			[](BigNum a, BigNum b) { return a + b; });
+	}
+
+	Type Type::InvariantSub(const Type& lhs, const Type& rhs) {
+		return InvariantArithmetic(lhs, rhs,
+			[](std::int64_t a, std::int64_t b, std::int64_t& r) {
+				if ((b < 0 && a > Int64Max + b) || (b > 0 && a < Int64Min + b)) return false;
+				r = a - b; return true;
+			},
+			[](double a, double b, double& r) {
+				r = a - b;
+				auto bv = r - a;
+				return std::isfinite(r) && (a - (r - bv)) + (-b - bv) == 0;
+			},
+			[](BigNum a, BigNum b) { return a - b; });
+	}
+
+	Type Type::InvariantMul(const Type& lhs, const Type& rhs) {
+		return InvariantArithmetic(lhs, rhs,
+			[](std::int64_t a, std::int64_t b, std::int64_t& r) {
+				const std::int64_t lim = 1ll << 31;
+				if (a <= -lim || a >= lim || b <= -lim || b >= lim) return false;
+				r = a * b; return true;
+			},
+			[](double a, double b, double& r) {
+				r = a * b;
+				return std::isfinite(r) && std::fma(a, b, -r) == 0;
+			},
+			[](BigNum a, BigNum b) { return a * b; });
+	}
+
+	Type Type::InvariantDiv(const Type& lhs, const Type& rhs) {
+		return InvariantArithmetic(lhs, rhs,
+			[](std::int64_t a, std::int64_t b, std::int64_t& r) {
+				if (b == 0 || (a == Int64Min && b == -1) || a % b) return false;
+				r = a / b; return true;
+			},
+			[](double a, double b, double& r) {
+				if (b == 0) return false;
+				r = a / b;
+				return std::isfinite(r) && std::fma(r, b, -a) == 0;
+			},
+			[](BigNum a, BigNum b) { return a / b; });
+	}
+
 	bool Type::IsNilTerminated() const {
 		if (IsNil()) return true;
 		if (IsPair()) {
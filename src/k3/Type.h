@@ -75,8 +75,18 @@ namespace K3 {
 		};
 
 
+		// invariants exactly representable as int64 or double are stored inline
+		enum InvariantEncoding : int8_t {
+			BigNumInvariant,
+			IntInvariant,
+			RealInvariant
+		};
+
 		union {
-			InvariantData* InvariantValue;
+			struct {
+				union { InvariantData* BigNum; std::int64_t Int; double Real; };
+				InvariantEncoding Encoding;
+			} Invariant;
 			const SString *InvariantString;
 			struct { TupleData *Data; size_t fstArity; } Tuple;
 			struct { RefCounted<Type> *Content; TypeDescriptor *tag; } UserType;
@@ -98,6 +108,11 @@ namespace K3 {
 		Type(const Type& content, TypeDescriptor *tag);
 		Type(const Type& fst, const Type& rst, size_t repeatFirst);
 		Type(UnionData*);
+
+		bool IsManaged() const { return kind < 0 && (kind != InvariantType || data.Invariant.Encoding == BigNumInvariant); }
+		bool GetExactReal(double&) const;
+		template <typename INT_OP, typename REAL_OP, typename BIGNUM_OP>
+		static Type InvariantArithmetic(const Type&, const Type&, INT_OP, REAL_OP, BIGNUM_OP);
 	public:
 		static const char *TypeTagNames[];
 		/* size assumptions */
@@ -225,6 +240,12 @@ namespace K3 {
 		Type operator+(const Type& rhs) const;
 		Type operator-(const Type& rhs) const;
 
+		/* bignum invariant arithmetic with immediate fast paths */
+		static Type InvariantAdd(const Type& lhs, const Type& rhs);
+		static Type InvariantSub(const Type& lhs, const Type& rhs);
+		static Type InvariantMul(const Type& lhs, const Type& rhs);
+		static Type InvariantDiv(const Type& lhs, const Type& rhs);
+
 		/* Algebraic operators */
 		static Type First(const Type& pair) { return pair.First(); }
 		static Type Rest(const Type& pair) { return pair.Rest(); }
@@ -8,6 +8,8 @@
 #include "common/Ref.h"
 #include "backends/LLVMSignal.h"
 #include "backends/Binaryen.h"
+#include "backends/CSource.h"
+#include "backends/Bytecode.h"
 
 #include "config/system.h"
 
@@ -37,10 +39,27 @@ const char *PrettyName() const override {return #CLASS;}\
 #define BINARYEN_EMIT(CLASS)
 #endif
 
-#define CODEGEN_EMITTER LLVM_EMITTER BINARYEN_EMITTER \
+#ifdef HAVE_CSOURCE
+#define CSOURCE_EMITTER void* Compile(Backends::CSourceTransform&, Backends::ActivityMaskVector*) const override;
+#define CSOURCE_EMIT(CLASS) void* CLASS::Compile(Backends::CSourceTransform& xfm, Backends::ActivityMaskVector* avm) const { return (void*)GenericCompile(xfm, avm); } 
+#else
+#define CSOURCE_EMITTER
+#define CSOURCE_EMIT(CLASS)
+#endif
+
+#ifdef HAVE_BYTECODE
+#define BYTECODE_EMITTER void* Compile(Backends::BytecodeTransform&, Backends::ActivityMaskVector*) const override;
+#define BYTECODE_EMIT(CLASS) void* CLASS::Compile(Backends::BytecodeTransform& xfm, Backends::ActivityMaskVector* avm) const { return (void*)GenericCompile(xfm, avm); } 
+#else
+#define BYTECODE_EMITTER
+#define BYTECODE_EMIT(CLASS)
+#endif
+
+#define CODEGEN_EMITTER LLVM_EMITTER BINARYEN_EMITTER CSOURCE_EMITTER BYTECODE_EMITTER \
 template <typename TXfm> auto GenericCompile(TXfm& xfm, Backends::ActivityMaskVector* avm) const -> decltype(xfm(this, avm));
 
-#define CODEGEN_EMIT(CLASS) LLVM_EMIT(CLASS) BINARYEN_EMIT(CLASS) \
+// CODEGEN_BACKEND_EMIT is defined by the backend that instantiates backends/GenericEmit.h
+#define CODEGEN_EMIT(CLASS) LLVM_EMIT(CLASS) CODEGEN_BACKEND_EMIT(CLASS) \
 template <typename TXfm> auto CLASS::GenericCompile(TXfm& xfm, Backends::ActivityMaskVector* avm) const -> decltype(xfm(this, avm))
 
 namespace K3 {
@@ -95,7 +114,7 @@ namespace K3 {
 			CTRef GetUp(unsigned int idx) const {return (CTRef)GetCon(idx);}
 			CTRef Reconnect(unsigned int idx, CTRef newCon) {_GetUp(idx)=newCon;newCon->globalDownstreamCount++;return newCon;}
 			void Connect(CTRef up) {up->globalDownstreamCount++;CachedTransformNode::Connect(up);}
-			unsigned ComputeLocalHash() const { auto h(TypedBase::ComputeLocalHash());HASHER(h,(uintptr_t)TypeID()); return h;}
+			size_t ComputeLocalHash() const { auto h(TypedBase::ComputeLocalHash());HASHER(h,(uintptr_t)TypeID()); return h;}
 			static CTRef Nil();
 			static bool IsNil(CTRef);
 
@@ -109,6 +128,8 @@ namespace K3 {
 		
 			virtual Backends::LLVMValue Compile(Backends::LLVMTransform&, Backends::ActivityMaskVector*) const {return Backends::LLVMValue();}
 			virtual void* Compile(Backends::BinaryenTransform& xfm, Backends::ActivityMaskVector* avm) const { return nullptr; };
+			virtual void* Compile(Backends::CSourceTransform& xfm, Backends::ActivityMaskVector* avm) const { return nullptr; };
+			virtual void* Compile(Backends::BytecodeTransform& xfm, Backends::ActivityMaskVector* avm) const { return nullptr; };
 
 			virtual int SchedulingPriority() const {return 0;}
 			virtual int GetWeight() const { return 0; }
@@ -21,6 +21,14 @@
 #include "backends/Binaryen.h"
 #endif
 
+#ifdef HAVE_CSOURCE
+#include "backends/CSource.h"
+#endif
+
+#ifdef HAVE_BYTECODE
+#include "backends/Bytecode.h"
+#endif
+
 namespace {
 	using namespace Kronos;
 	using namespace K3;
@@ -190,7 +198,7 @@ namespace {
 			return XX([&]() { return *this == *(GenericGraphImpl*)g;});
 		}
 
-		virtual std::uint64_t GetGraphHash() const noexcept override {
+		virtual std::uint64_t _GetGraphHash() const noexcept override {
 			return std::hash<Graph>()(*this);
 		}
 
@@ -230,6 +238,15 @@ namespace {
         IType* _TypeOfArgument() const noexcept override { return new TypeImpl(a); }
         const K3::Type* _InternalTypeOfResult() const noexcept override { return &r; }
         const K3::Type* _InternalTypeOfArgument() const noexcept override { return &a; }
+		std::uint64_t _GetGraphHash() const noexcept override {
+			std::uint64_t h = std::hash<Graph>()(*this);
+			h = (h << 32) ^ (h >> 32) ^ a.GetHash();
+			return h * 0x100000001b3ull ^ r.GetHash();
+		}
+		bool Equal(const ITypedGraph* g) const noexcept override {
+			auto other = (const TypedGraphImpl*)g;
+			return XX([&]() { return a == other->a && r == other->r && *this == *other; });
+		}
     };
 
            
@@ -243,6 +260,7 @@ namespace {
 		}
 
 		void _SetDefaultRepository(const char* package, const char* version) override {
+			RepositoryAccess write(*this, true);
 			codebase.SetCoreLib(package, version);
 		}
 
@@ -257,15 +275,43 @@ namespace {
 		void _SetCompilerDebugTraceFilter(const char *flt) noexcept override {
 			SetCompilerDebugTraceFilter(flt);
 		}
+
+		void _SetCompilerProfiling(KRONOS_INT enable) noexcept override {
+			GetCompilerProfile().Enable(enable != 0);
+		}
+
+		KRONOS_INT _GetCompilerProfileAsJSON(IStreamBuf* buf) noexcept override {
+			return XX([&]() {
+				_Streambuf jsonBuf(buf);
+				std::ostream json(&jsonBuf);
+				GetCompilerProfile().WriteJSON(json);
+				return 1;
+			});
+		}
+
+		KRONOS_INT _GetProfileStatus(const krt_class* cls) noexcept override {
+#ifdef HAVE_LLVM
+			return K3::Backends::LLVMProfileStatus(cls);
+#else
+			return -1;
+#endif
+		}
         
         virtual void _Parse(const char *source, bool REPLMode, ImmediateExpressionHandler handler, void* userdata) noexcept override {
+            // immediate expressions are handed out after the repository is
+            // unlocked, so that handlers may compile them on other threads
+            std::vector<std::pair<std::string, Ref<GenericGraphImpl>>> immediates;
             XX([&](){
+                RepositoryAccess write(*this, true);
                 ScopedContext scope(*this);
                 RegionAllocator parsedNodes;
-				return codebase.ImportBuffer(source, true, [handler, userdata](const char* sym, CGRef imm) mutable {
-                    handler(userdata, sym, Ref<GenericGraphImpl>::Cons(imm));
+				return codebase.ImportBuffer(source, true, [&immediates](const char* sym, CGRef imm) mutable {
+                    immediates.emplace_back(sym, Ref<GenericGraphImpl>::Cons(imm));
                 });
             });
+            for (auto& imm : immediates) {
+                handler(userdata, imm.first.c_str(), imm.second);
+            }
         }
 
 		IStr* _GetResolutionTrace(void) const noexcept override {
@@ -280,6 +326,7 @@ namespace {
 
 		IStr* _DrainRecentSymbolChanges(void) noexcept override {
 			return XX([&]() {
+				RepositoryAccess write(*this, true);
 				std::stringstream changes;
 				for (auto& key : DrainRecentChanges()) {
 					changes << key << " ";
@@ -307,17 +354,18 @@ namespace {
         
         virtual const ITypedGraph* _Specialize(const IGenericGraph* GAST, const IType& argument, IStreamBuf* _log, int logLevel) noexcept override {
             return XX([&]() -> Err<ITypedGraph*> {
+                RepositoryAccess read(*this, false);
                 ScopedContext scope(*this);
+                Profile::Phase profile("compiler", "Specialization");
                 RegionAllocator buildAllocator;
             
                 _Streambuf logbuf(_log);
                 std::ostream log(&logbuf);
 				SpecializationDiagnostic diags(_log ? &log : nullptr, Verbosity( (int)Verbosity::LogErrors - logLevel ));
-                SetSpecializationCache(new SpecializationCache);
+                ResetSession();
                 
                 auto RootBlock(diags.Block(LogTrace,"Specialization"));
                 
-				ClearResolutionTrace();
 				Specialization spec(SpecializationTransform(GAST->Get(), argument.GetPimpl(), diags, SpecializationState::Normal).Go());
                 if (spec.node == nullptr) {
 					std::stringstream ss;
@@ -336,6 +384,7 @@ namespace {
 			return XX([&]() {
 				_Streambuf jsonBuf(buf);
 				std::ostream json(&jsonBuf);
+				RepositoryAccess read(*this, false);
 				codebase.ExportMetadata(json);
 				return 1;
 			});
@@ -350,6 +399,10 @@ namespace {
 			".wasm", ".wast", ".js"
 		};
 
+		std::unordered_set<std::string> cExtensions{
+			".c"
+		};
+
 		virtual KRONOS_INT _AoT(
 			const char* prefix,
 			const char* fileType,
@@ -362,8 +415,9 @@ namespace {
 			const char* targetFeatures,
 			BuildFlags flags)  noexcept  override {
 			return XX([&]() -> Err<int> {
-				this->flags = flags;
+				RepositoryAccess read(*this, false);
 				K3::ScopedContext scope(*this);
+				GetSession().flags = flags;
 				std::string eng(engine);
 				_Streambuf objbuf(object);
 				std::ostream obj(&objbuf);
@@ -375,6 +429,9 @@ namespace {
 #endif
 #ifdef HAVE_BINARYEN
 					else if (binaryenExtensions.count(fileType)) eng = "binaryen";
+#endif
+#ifdef HAVE_CSOURCE
+					else if (cExtensions.count(fileType)) eng = "c";
 #endif
 					else {
 						using namespace std::string_literals;
@@ -393,6 +450,12 @@ namespace {
 					return K3::Backends::BinaryenAoT(prefix, fileType, obj, engine, itg, triple, mcpu, march, targetFeatures, flags);
 #else
 					return Error::RuntimeError(Error::BadInput, "Kronos is built without the Binaryen backend");
+#endif
+				} else if (eng == "c") {
+#ifdef HAVE_CSOURCE
+					return K3::Backends::CSourceAoT(prefix, fileType, obj, engine, itg, triple, mcpu, march, targetFeatures, flags);
+#else
+					return Error::RuntimeError(Error::BadInput, "Kronos is built without the C source backend");
 #endif
 				} 
 				return Error::RuntimeError(Error::BadInput, "AoT Compilation engine not recognized");
@@ -402,18 +465,30 @@ namespace {
         virtual krt_class*  _JiT(const char* engine,
                                  const ITypedGraph* itg,
                                BuildFlags flags)  noexcept override {
-			this->flags = flags;
 			return XX([&]() mutable -> Err<krt_class*> {
+                RepositoryAccess read(*this, false);
                 K3::ScopedContext scope(*this);
+                GetSession().flags = flags;
                 std::string eng(engine);
                 
-                if (eng == "llvm") {
+                if (eng == "llvm" || eng == "llvm-quick") {
 #ifdef HAVE_LLVM
 					return K3::Backends::LLVMJiT(engine, itg, flags);
 #else 
 					return Error::RuntimeError(Error::BadInput, "Kronos is built without the LLVM backend");
 #endif
-				} 
+				} else if (eng == "interpreter") {
+#ifdef HAVE_BYTECODE
+					// report constructs the interpreter lacks, so callers can fall back to a compiler
+					try {
+						return K3::Backends::BytecodeJiT(engine, itg, flags);
+					} catch (K3::Error::Internal& ie) {
+						return ie;
+					}
+#else
+					return Error::RuntimeError(Error::BadInput, "Kronos is built without the bytecode interpreter");
+#endif
+				}
 				/* else if (eng == "WaveCore") {
                     K3::Backends::WaveCore compiler(itg->Get(), *itg->_InternalTypeOfArgument(), *itg->_InternalTypeOfResult());
                     return compiler.Build(flags);
@@ -424,6 +499,7 @@ namespace {
         
 		virtual void _ImportFile(const char *modulePath, KRONOS_INT allowRedefine) noexcept override {
 			XX([&]() {
+				RepositoryAccess write(*this, true);
 				SetForThisThread();
                 return codebase.ImportFile(modulePath, allowRedefine != 0);
 			});
@@ -431,6 +507,7 @@ namespace {
 
 		virtual void _ImportBuffer(const char* sourceCode, bool allowRedefinition) noexcept override {
 			XX([&]() {
+				RepositoryAccess write(*this, true);
 				SetForThisThread();
                 return codebase.ImportBuffer(sourceCode, allowRedefinition);
 			});
@@ -438,6 +515,7 @@ namespace {
 
 		virtual IStr* _GetModuleAndLineNumberText(const char* codePosition) noexcept override {
 			return XX([&]() {
+				RepositoryAccess read(*this, false);
 				SetForThisThread();
 				return new _String(GetModuleAndLineNumberText(codePosition,nullptr));
 			});
@@ -445,6 +523,7 @@ namespace {
 
 		virtual IStr* _ShowModuleLine(const char* codePosition) noexcept override {
 			return XX([&]() {
+				RepositoryAccess read(*this, false);
 				SetForThisThread();
 				std::string line;
 				GetModuleAndLineNumberText(codePosition,&line);
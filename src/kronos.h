@@ -224,7 +224,7 @@ namespace Kronos {
 		GenericGraph(const IGenericGraph* ptr =  nullptr) :Shared(ptr) {}
 		using Shared::Get;
 		using Shared::Empty;
-		inline size_t GetGraphHash() const { return (size_t)(Get() ? Get()->GetGraphHash() : 0); }
+		inline std::uint64_t GetGraphHash() const { return Get() ? Get()->_GetGraphHash() : 0; }
 		inline bool Equal(const GenericGraph& cg) const { return Get()->Equal(cg.Get()); }
 		inline GenericGraph Compose(const GenericGraph& cg) const { return Get()->_Compose(cg.Get()); }
 		inline bool operator==(const GenericGraph& b) const { return Equal(b); }
@@ -235,10 +235,13 @@ namespace Kronos {
 
 	class TypedGraph : protected Shared<const ITypedGraph> {
     public:
-        TypedGraph(const ITypedGraph* ptr):Shared(ptr) {}
+        TypedGraph(const ITypedGraph* ptr = nullptr):Shared(ptr) {}
+        using Shared::Empty;
         Type TypeOfArgument() const { return Type(Get()->_TypeOfArgument()); }
         Type TypeOfResult() const { return Type(Get()->_TypeOfResult()); }
         const ITypedGraph* Get() const { return Shared::Get(); }
+		inline std::uint64_t GetGraphHash() const { return Get() ? Get()->_GetGraphHash() : 0; }
+		inline bool Equal(const TypedGraph& tg) const { return Get() && tg.Get() && Get()->Equal(tg.Get()); }
     };
 
 	using Class = std::unique_ptr<krt_class, void(*)(krt_class*)>;
@@ -293,8 +296,8 @@ namespace Kronos {
 		}
         
         inline Class Make(const char *engine, TypedGraph g, BuildFlags flags = Default) {
-			auto rawClass = Get()->_JiT(engine, g.Get(), flags);
-			return _CheckResult(Class(rawClass, rawClass->dispose_class));
+			auto rawClass = _CheckResult(Get()->_JiT(engine, g.Get(), flags));
+			return Class(rawClass, rawClass->dispose_class);
         }
         
         inline Class Make(const char* engine, const char* source, const Type& argumentType, std::ostream* log, int logLevel, BuildFlags flags = Default) {
@@ -350,6 +353,21 @@ namespace Kronos {
 		inline void SetCompilerDebugTraceFilter(const char *flt) {
 			Get()->_SetCompilerDebugTraceFilter(flt);
 		}
+
+		inline void SetCompilerProfiling(bool enable) {
+			Get()->_SetCompilerProfiling(enable ? 1 : 0);
+		}
+
+		inline void GetCompilerProfileAsJSON(std::ostream& stream) {
+			StreamBuf buf(stream.rdbuf());
+			Get()->_GetCompilerProfileAsJSON(&buf);
+			_CheckLastError();
+		}
+
+		// -1: not instrumented, 0: collecting a profile, 1: profile complete, rebuild to apply it
+		inline int GetProfileStatus(const krt_class* cls) {
+			return (int)Get()->_GetProfileStatus(cls);
+		}
 	};
 
 	static std::string GetUserPath() { return MoveString(_GetUserPath()); }
@@ -422,7 +440,7 @@ namespace std {
 
 	template<> struct hash<Kronos::GenericGraph> {
 		size_t operator()(const Kronos::GenericGraph& g) const {
-			return g.GetGraphHash();
+			return (size_t)g.GetGraphHash();
 		}
 	};
 
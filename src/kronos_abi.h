@@ -190,6 +190,7 @@ namespace Kronos {
 		OmitReactiveDrivers = 8,
 		WasmStandaloneModule = 16,
 		DynamicRateSupport = 32,
+		FlushDenormals = 64,
 		CompilerFlagMask = 0xffff,
 		UserFlag1 = 0x10000
 	};
@@ -199,7 +200,7 @@ namespace Kronos {
         virtual const K3::Nodes::Generic* MEMBER Get() const noexcept = 0;
 		virtual bool MEMBER Equal(const IGenericGraph*) const noexcept = 0;
 		virtual IGenericGraph* MEMBER _Compose(const IGenericGraph*) const noexcept = 0;
-		virtual std::uint64_t MEMBER GetGraphHash() const noexcept = 0;
+		virtual std::uint64_t MEMBER _GetGraphHash() const noexcept = 0;
 		virtual IType* MEMBER AsType() const noexcept = 0;
     };
     
@@ -210,6 +211,8 @@ namespace Kronos {
         virtual IType* MEMBER _TypeOfArgument() const noexcept = 0;
         virtual const K3::Type* MEMBER _InternalTypeOfResult() const noexcept = 0;
         virtual const K3::Type* MEMBER _InternalTypeOfArgument() const noexcept = 0;
+		virtual std::uint64_t MEMBER _GetGraphHash() const noexcept = 0;
+		virtual bool MEMBER Equal(const ITypedGraph*) const noexcept = 0;
     };
     
     using ImmediateExpressionHandler = void FUNCTION (void*,const char*,const IGenericGraph*);
@@ -258,6 +261,9 @@ namespace Kronos {
 		virtual void MEMBER _SetDefaultRepository(const char* package, const char* version) = 0;
 		virtual const char* MEMBER _GetCoreLibPackage() = 0;
 		virtual const char* MEMBER _GetCoreLibVersion() = 0;
+		virtual void MEMBER _SetCompilerProfiling(INT enable) noexcept = 0;
+		virtual INT MEMBER _GetCompilerProfileAsJSON(IStreamBuf* json) noexcept = 0;
+		virtual INT MEMBER _GetProfileStatus(const krt_class*) noexcept = 0;
 	};
 
 	ABI const char* FUNCTION GetVersionString( ) noexcept;
@@ -45,6 +45,7 @@ extern "C" {
 	F(void*, pimpl) SEP \
 	F(int64_t, eval_arg_size) SEP \
 	F(int64_t, result_type_size) SEP \
+	F(int64_t, state_layout) SEP \
 	F(int32_t, num_symbols) 
 
 	// packed structs from specs above
@@ -62,6 +63,39 @@ extern "C" {
 	};
 #undef F
 #pragma pack(pop)
+
+	// control event for symbol 'symbol' at 'frame' within a block
+	typedef struct krt_event {
+		int32_t frame;
+		int32_t symbol;
+		const void* data;
+	} krt_event;
+
+	// host side helper: render a block of 'stream', splitting the call at each of
+	// 'events', sorted by frame, to apply it at its offset. The generated driver
+	// loop is not aware of events, so every event still ends a stream call.
+	static inline void krt_process_split_at_events(const struct krt_class* c, krt_instance inst, krt_process_call stream,
+												   void* output, int32_t frameBytes, int32_t numFrames,
+												   const krt_event* events, int32_t numEvents) {
+		char* out = (char*)output;
+		int32_t pos = 0, i;
+		for (i = 0; i < numEvents; ++i) {
+			int32_t at = events[i].frame < numFrames ? events[i].frame : numFrames;
+			const struct krt_sym* sym;
+			if (at > pos) {
+				stream(inst, out, at - pos);
+				out += (at - pos) * frameBytes;
+				pos = at;
+			}
+			if (events[i].symbol < 0 || events[i].symbol >= c->num_symbols) continue;
+			sym = &c->symbols[events[i].symbol];
+			if (sym->slot_index >= 0) {
+				*c->var(inst, sym->slot_index) = (void*)events[i].data;
+				if (sym->process) sym->process(inst, 0, 1);
+			}
+		}
+		if (numFrames > pos) stream(inst, out, numFrames - pos);
+	}
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -671,7 +671,7 @@ namespace pcoll {
 		};
 	}
 
-	template <typename KEY, typename VALUE, typename HASHFN = std::hash<KEY>, typename COMPEQ = std::equal_to<KEY>, detail::thread_policy THREAD_POLICY = detail::multi_threaded>
+	template <typename KEY, typename VALUE, typename HASHFN = std::hash<KEY>, typename COMPEQ = std::equal_to<KEY>, detail::thread_policy THREAD_POLICY = detail::multi_threaded, detail::concurrent_strategy CONCURRENT_STRATEGY = detail::lockfree>
 	class hamt {
 	public:
 		using hash_t = decltype(HASHFN()(std::declval<KEY>()));
@@ -680,7 +680,7 @@ namespace pcoll {
 		using keyvalue_t = detail::pair<key_t, value_t>;
 	private:
 		using node = detail::hamt_node<KEY, VALUE, HASHFN, COMPEQ, THREAD_POLICY>;
-		using node_ref = cref<node, detail::lockfree>;
+		using node_ref = cref<node, CONCURRENT_STRATEGY>;
 		node_ref root;
 		hamt(node_ref r) :root(r) { }
 		
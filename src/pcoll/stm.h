@@ -5,85 +5,181 @@
 #include <limits>
 #include <algorithm>
 #include <thread>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
 #include "util.h"
 
-namespace {
-	
 #ifdef _MSC_VER
 #include <intrin.h>
-	// hand-roll enough of std::atomic interface to work with cref
-	// MSVC stl uses mutex for anything more than 8 bytes
-	template <typename T> struct atomic128 {
-		__declspec(align(16)) T data;
-		static_assert(sizeof(T) == 16, "this atomic wrapper is only for 16-byte data types");
-
-		bool cmpxchg16b(T& old, const T& desired) const {
-			auto ptr64 = (__int64*)&data;
-			__declspec(align(16)) auto tmp_in = old;
-			__declspec(align(16)) auto tmp_out = desired;
-			auto tmp_out_ptr = (__int64*)&tmp_out;
-			auto tmp_in_ptr = (__int64*)&tmp_in;
-			auto success = _InterlockedCompareExchange128(
-				ptr64,
-				tmp_out_ptr[1],
-				tmp_out_ptr[0],
-				tmp_in_ptr
-			) != 0;
-			old = tmp_in;
-			return success;
-		}
-
-		template <typename FN>
-		T transaction(const FN& update) const noexcept {
-			for(;;) {
-				auto tmp_in = data;
-				auto tmp_out = update(tmp_in);
-				if(cmpxchg16b(tmp_in, tmp_out)) {
-					return tmp_in;
+#endif
+
+namespace pcoll {
+	namespace detail {
+#ifdef _MSC_VER
+		// hand-roll enough of std::atomic interface to work with cref
+		// MSVC stl uses mutex for anything more than 8 bytes
+		template <typename T> struct atomic128 {
+			__declspec(align(16)) T data;
+			static_assert(sizeof(T) == 16, "this atomic wrapper is only for 16-byte data types");
+
+			bool cmpxchg16b(T& old, const T& desired) const {
+				auto ptr64 = (__int64*)&data;
+				__declspec(align(16)) auto tmp_in = old;
+				__declspec(align(16)) auto tmp_out = desired;
+				auto tmp_out_ptr = (__int64*)&tmp_out;
+				auto tmp_in_ptr = (__int64*)&tmp_in;
+				auto success = _InterlockedCompareExchange128(
+					ptr64,
+					tmp_out_ptr[1],
+					tmp_out_ptr[0],
+					tmp_in_ptr
+				) != 0;
+				old = tmp_in;
+				return success;
+			}
+
+			template <typename FN>
+			T transaction(const FN& update) const noexcept {
+				for(;;) {
+					auto tmp_in = data;
+					auto tmp_out = update(tmp_in);
+					if(cmpxchg16b(tmp_in, tmp_out)) {
+						return tmp_in;
+					}
 				}
 			}
-		}
 
-	public:
-		T load(std::memory_order) const noexcept {
-			return transaction([](const T& data) noexcept {
-				return data;
-			});
-		}
+		public:
+			T load(std::memory_order) const noexcept {
+				return transaction([](const T& data) noexcept {
+					return data;
+				});
+			}
 
-		void store(const T& data, std::memory_order) noexcept {
-			transaction([&data](const T& old) noexcept {
-				return data;
-			});
-		}
+			// two plain word loads; may tear, so only good as a compare-exchange guess
+			T peek() const noexcept {
+				auto words = (const volatile __int64*)&data;
+				__int64 tmp[2] = { words[0], words[1] };
+				T result;
+				memcpy(&result, tmp, sizeof(T));
+				return result;
+			}
 
-		bool compare_exchange_weak(T& expected, const T& desired, std::memory_order) noexcept {
-			return cmpxchg16b(expected, desired);
-		}
+			void store(const T& data, std::memory_order) noexcept {
+				transaction([&data](const T& old) noexcept {
+					return data;
+				});
+			}
 
-		bool compare_exchange_strong(T& expected, const T& desired, std::memory_order) noexcept {
-			return cmpxchg16b(expected, desired);
-		}
+			bool compare_exchange_weak(T& expected, const T& desired, std::memory_order) noexcept {
+				return cmpxchg16b(expected, desired);
+			}
 
-		T exchange(const T& incoming, std::memory_order) noexcept {
-			T outgoing;
-			transaction([&outgoing, &incoming](const T& current) {
-				outgoing = current;
-				return incoming;
-			});
-			return outgoing;
-		}
+			bool compare_exchange_strong(T& expected, const T& desired, std::memory_order) noexcept {
+				return cmpxchg16b(expected, desired);
+			}
 
-		bool is_lock_free() const noexcept {
-			return true;
-		}
-	};
+			T exchange(const T& incoming, std::memory_order) noexcept {
+				T outgoing;
+				transaction([&outgoing, &incoming](const T& current) {
+					outgoing = current;
+					return incoming;
+				});
+				return outgoing;
+			}
+
+			bool is_lock_free() const noexcept {
+				return true;
+			}
+
+			static constexpr bool is_always_lock_free = true;
+		};
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+		// libstdc++ routes 16-byte std::atomic through libatomic, which may take a
+		// lock. Use the double-word compare-and-swap directly: cmpxchg16b on x86-64,
+		// casp or an ldxp/stxp loop on arm64.
+		template <typename T> struct atomic128 {
+			static_assert(sizeof(T) == 16, "this atomic wrapper is only for 16-byte data types");
+			static_assert(std::is_trivially_copyable<T>::value, "atomic128 requires a trivially copyable type");
+			alignas(16) mutable T data;
+
+			static bool cas(T* ptr, T& expected, const T& desired) noexcept {
+#if defined(__x86_64__)
+				std::uint64_t exp[2], des[2];
+				memcpy(exp, &expected, 16);
+				memcpy(des, &desired, 16);
+				bool success;
+				__asm__ __volatile__(
+					"lock cmpxchg16b %1"
+					: "=@ccz"(success), "+m"(*ptr), "+a"(exp[0]), "+d"(exp[1])
+					: "b"(des[0]), "c"(des[1])
+					: "memory");
+				memcpy(&expected, exp, 16);
+				return success;
 #else
-	template <typename T> using atomic128 = std::atomic<T>;
+				unsigned __int128 exp, des;
+				memcpy(&exp, &expected, 16);
+				memcpy(&des, &desired, 16);
+				auto prev = __sync_val_compare_and_swap((unsigned __int128*)ptr, exp, des);
+				memcpy(&expected, &prev, 16);
+				return prev == exp;
 #endif
-}
+			}
+
+			T load(std::memory_order) const noexcept {
+				// there is no plain 16-byte atomic load; a failed exchange reads the
+				// current value atomically but takes the cache line exclusive, so
+				// concurrent readers of one cref contend like writers. Transactions
+				// avoid this by starting from peek().
+				T tmp;
+				memset(&tmp, 0, sizeof(T));
+				cas(&data, tmp, tmp);
+				return tmp;
+			}
+
+			// two relaxed word loads; may tear, so only good as a compare-exchange guess
+			T peek() const noexcept {
+				auto words = (const std::uint64_t*)&data;
+				std::uint64_t tmp[2] = {
+					__atomic_load_n(words, __ATOMIC_RELAXED),
+					__atomic_load_n(words + 1, __ATOMIC_RELAXED)
+				};
+				T result;
+				memcpy(&result, tmp, sizeof(T));
+				return result;
+			}
+
+			void store(const T& desired, std::memory_order mo) noexcept {
+				exchange(desired, mo);
+			}
+
+			bool compare_exchange_weak(T& expected, const T& desired, std::memory_order) noexcept {
+				return cas(&data, expected, desired);
+			}
+
+			bool compare_exchange_strong(T& expected, const T& desired, std::memory_order) noexcept {
+				return cas(&data, expected, desired);
+			}
+
+			T exchange(const T& incoming, std::memory_order) noexcept {
+				T current = peek();
+				while (!cas(&data, current, incoming)) {}
+				return current;
+			}
+
+			bool is_lock_free() const noexcept {
+				return true;
+			}
+
+			static constexpr bool is_always_lock_free = true;
+		};
+#else
+		template <typename T> using atomic128 = std::atomic<T>;
+#endif
+	}
 
-namespace pcoll {
 	namespace profile {
 #ifdef PCOLL_PROFILE_STM 
 #define PROFILE(name) static int name(int change = 0) { static std::atomic<size_t> counter {0}; return counter.fetch_add(change); }
@@ -146,6 +242,8 @@ namespace pcoll {
 				// lock-free-est structures ever created.
 				return true;
 			}
+
+			static constexpr bool is_always_lock_free = false;
 		};
 
 		template <typename T> struct no_rollback {
@@ -159,9 +257,19 @@ namespace pcoll {
 			profile::stm_transactions(1);
 		}
 
+		// the starting value of a transaction is validated by its compare-exchange,
+		// so a cheap possibly torn read will do where the atomic provides one
+		template <typename T> static auto first_guess(const T& data, int) -> decltype(data.peek()) {
+			return data.peek();
+		}
+
+		template <typename T> static auto first_guess(const T& data, long) -> decltype(data.load(std::memory_order_acquire)) {
+			return data.load(std::memory_order_acquire);
+		}
+
 		template <typename T, typename UPD, typename RB = no_rollback<decltype(std::declval<T>().load(std::memory_order_acquire))>>
 		static void transaction(T& data, const UPD& pure_update, const RB& rollback = no_rollback<decltype(std::declval<T>().load(std::memory_order_acquire))>()) {
-			auto prev = data.load(std::memory_order_acquire);
+			auto prev = first_guess(data, 0);
 			profile::stm_transactions(1);
 			for(;;) {
 				auto old = prev;
@@ -201,6 +309,9 @@ namespace pcoll {
 		using atomic_refdata_t = typename detail::atomic_strategy<refdata_t, STRATEGY>::data_t;
 		alignas(16) mutable atomic_refdata_t refdata;
 
+		static_assert(STRATEGY != detail::lockfree || atomic_refdata_t::is_always_lock_free,
+					  "no lock-free double-word atomic on this platform; use the locking or epoch strategy");
+
 		static size_t add_weight(const detail::atomic_reference_counter *arc) {
 			size_t to_add = 0;
 			detail::transaction(arc->counter, [&](size_t weight) {
@@ -435,4 +546,304 @@ namespace pcoll {
 			return borrow_t(*this);
 		}
 	};
+
+	namespace detail {
+		// epoch based reclamation. readers announce the global epoch while they
+		// hold raw pointers; retired references are released once the epoch has
+		// advanced twice, when no reader can still observe them.
+		class epoch_domain {
+			struct retired_t {
+				std::uint64_t epoch;
+				const void* ptr;
+				void(*release)(const void*);
+			};
+
+			struct alignas(64) participant {
+				std::atomic<std::uint64_t> active{ 0 };
+				std::atomic<bool> in_use{ true };
+				participant* next = nullptr;
+				int nesting = 0;
+				bool collecting = false;
+				std::vector<retired_t> limbo;
+			};
+
+			alignas(64) std::atomic<std::uint64_t> global{ 1 };
+			std::atomic<participant*> participants{ nullptr };
+			std::mutex orphan_lock;
+			std::vector<retired_t> orphans;
+
+			std::atomic<size_t> pending{ 0 };
+
+			static constexpr size_t reclaim_threshold = 64;
+
+			participant* acquire() {
+				for (auto p = participants.load(std::memory_order_acquire); p; p = p->next) {
+					bool free_slot = false;
+					if (!p->in_use.load(std::memory_order_relaxed) &&
+						p->in_use.compare_exchange_strong(free_slot, true, std::memory_order_acquire)) {
+						return p;
+					}
+				}
+				auto p = new participant;
+				p->next = participants.load(std::memory_order_relaxed);
+				while (!participants.compare_exchange_weak(p->next, p, std::memory_order_release)) {}
+				return p;
+			}
+
+			void release(participant* p) {
+				if (p->limbo.size()) {
+					std::lock_guard<std::mutex> lg{ orphan_lock };
+					orphans.insert(orphans.end(), p->limbo.begin(), p->limbo.end());
+					p->limbo.clear();
+				}
+				p->in_use.store(false, std::memory_order_release);
+			}
+
+			struct thread_record {
+				epoch_domain& domain;
+				participant* p;
+				thread_record(epoch_domain& d) :domain(d), p(d.acquire()) {}
+				~thread_record() { domain.release(p); }
+			};
+
+			participant& local() {
+				static thread_local thread_record record{ *this };
+				return *record.p;
+			}
+
+			bool try_advance(std::uint64_t current) {
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				for (auto p = participants.load(std::memory_order_acquire); p; p = p->next) {
+					auto e = p->active.load(std::memory_order_acquire);
+					if (e && e != current) return false;
+				}
+				return global.compare_exchange_strong(current, current + 1, std::memory_order_acq_rel);
+			}
+
+			// releasing may cascade into retire(), so the list is detached while it is walked
+			void reclaim(std::vector<retired_t>& list, std::uint64_t safe) {
+				std::vector<retired_t> work;
+				work.swap(list);
+				size_t keep = 0;
+				for (size_t i = 0; i < work.size(); ++i) {
+					if (work[i].epoch + 2 <= safe) {
+						work[i].release(work[i].ptr);
+						pending.fetch_sub(1, std::memory_order_relaxed);
+					} else {
+						work[keep++] = work[i];
+					}
+				}
+				work.resize(keep);
+				work.insert(work.end(), list.begin(), list.end());
+				work.swap(list);
+			}
+
+			void collect(participant& p, std::uint64_t safe) {
+				if (p.collecting) return;
+				p.collecting = true;
+				reclaim(p.limbo, safe);
+				std::unique_lock<std::mutex> lg{ orphan_lock, std::try_to_lock };
+				if (lg.owns_lock()) {
+					std::vector<retired_t> adopt;
+					adopt.swap(orphans);
+					lg.unlock();
+					reclaim(adopt, safe);
+					p.limbo.insert(p.limbo.end(), adopt.begin(), adopt.end());
+				}
+				p.collecting = false;
+			}
+
+		public:
+			static epoch_domain& global_domain() {
+				static epoch_domain domain;
+				return domain;
+			}
+
+			void enter() {
+				auto& p = local();
+				if (p.nesting++ == 0) {
+					p.active.store(global.load(std::memory_order_relaxed), std::memory_order_relaxed);
+					// the announcement must be visible before any shared pointer is read
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+				}
+			}
+
+			void leave() {
+				auto& p = local();
+				if (--p.nesting == 0) {
+					p.active.store(0, std::memory_order_release);
+					// objects retired within the guard could not be collected then
+					if (p.limbo.size() >= reclaim_threshold) {
+						try_advance(global.load(std::memory_order_acquire));
+						collect(p, global.load(std::memory_order_acquire));
+					}
+				}
+			}
+
+			void retire(const void* ptr, void(*release)(const void*)) {
+				auto& p = local();
+				pending.fetch_add(1, std::memory_order_relaxed);
+				p.limbo.push_back(retired_t{ global.load(std::memory_order_acquire), ptr, release });
+				if (p.limbo.size() >= reclaim_threshold && p.nesting == 0) {
+					try_advance(global.load(std::memory_order_acquire));
+					collect(p, global.load(std::memory_order_acquire));
+				}
+			}
+
+			// number of objects retired but not yet released, across all threads
+			size_t pending_retirements() const {
+				return pending.load(std::memory_order_relaxed);
+			}
+
+			// waits for readers to move on and releases everything retired so far by
+			// this thread and by exited threads. must not be called within a guard.
+			void synchronize() {
+				auto& p = local();
+				assert(p.nesting == 0 && "synchronize within an epoch guard would never return");
+				for (;;) {
+					for (int i = 0; i < 2; ++i) {
+						auto e = global.load(std::memory_order_acquire);
+						while (!try_advance(e) && global.load(std::memory_order_acquire) == e) {
+							std::this_thread::yield();
+						}
+					}
+					collect(p, global.load(std::memory_order_acquire));
+					std::lock_guard<std::mutex> lg{ orphan_lock };
+					// releases can cascade into further retirements
+					if (p.limbo.empty() && orphans.empty()) break;
+				}
+			}
+
+			struct guard {
+				guard() { global_domain().enter(); }
+				~guard() { global_domain().leave(); }
+				guard(const guard&) = delete;
+				guard& operator=(const guard&) = delete;
+			};
+		};
+	}
+
+	// single-word reference for epoch reclamation. borrowing reads touch neither
+	// the reference count nor a double-word atomic; writers retire the previous
+	// value instead of releasing it. objects published through an epoch cref
+	// must also be released through one.
+	template <typename T>
+	class cref<T, detail::epoch> {
+		static_assert(T::threadsafe, "concurrent reference requires a thread safe reference count");
+
+		mutable std::atomic<const T*> ptr;
+
+		static void dispose(const void* p) {
+			auto arc = (const T*)p;
+			if (arc->release()) delete arc;
+		}
+
+		// the last reference may still be read by borrowers and is retired
+		static void release(const T* arc) {
+			if (!arc) return;
+			auto count = arc->counter.load(std::memory_order_relaxed);
+			while (count > 1) {
+				if (arc->counter.compare_exchange_weak(count, count - 1, std::memory_order_release)) return;
+			}
+			detail::epoch_domain::global_domain().retire(arc, dispose);
+		}
+
+		static const T* acquire(const std::atomic<const T*>& from) {
+			detail::epoch_domain::guard g;
+			auto arc = from.load(std::memory_order_acquire);
+			if (arc) arc->retain();
+			return arc;
+		}
+
+	public:
+		cref(const T* src = nullptr) :ptr(src) {
+			if (src) src->retain();
+		}
+
+		cref(const cref& from) :ptr(acquire(from.ptr)) {
+		}
+
+		cref(cref&& from) :ptr(from.ptr.exchange(nullptr, std::memory_order_relaxed)) {
+		}
+
+		template <typename U, detail::thread_policy P>
+		cref(detail::ref<U, P> transfer) :cref(transfer.get()) {
+		}
+
+		~cref() {
+			release(ptr.load(std::memory_order_acquire));
+		}
+
+		void reset() {
+			*this = cref();
+		}
+
+		T* get() const {
+			return (T*)ptr.load(std::memory_order_acquire);
+		}
+
+		cref& operator=(cref from) {
+			// from is private to current thread, this is shared state
+			auto prev = ptr.exchange(from.ptr.load(std::memory_order_relaxed), std::memory_order_acq_rel);
+			from.ptr.store(prev, std::memory_order_relaxed);
+			return *this;
+		}
+
+		T* operator->() const {
+			return get();
+		}
+
+		// this can point to shared state. argument must *not* be concurrently mutated.
+		void exchange(cref& thread_private) {
+			auto prev = ptr.exchange(thread_private.ptr.load(std::memory_order_relaxed), std::memory_order_acq_rel);
+			thread_private.ptr.store(prev, std::memory_order_relaxed);
+		}
+
+		template <typename UPD>
+		void swap(const UPD& updater) {
+			for (;;) {
+				// released after the guard is left, so that it can be collected
+				cref displaced;
+				{
+					detail::epoch_domain::guard g;
+					auto expected = ptr.load(std::memory_order_acquire);
+					cref next = updater((T*)expected);
+					auto desired = next.ptr.load(std::memory_order_relaxed);
+					if (ptr.compare_exchange_strong(expected, desired, std::memory_order_acq_rel)) {
+						next.ptr.store(nullptr, std::memory_order_relaxed);
+						displaced.ptr.store(expected, std::memory_order_relaxed);
+						break;
+					}
+				}
+				profile::stm_transaction_conflicts(1);
+			}
+		}
+
+		class borrow_t {
+			detail::epoch_domain::guard g;
+			const cref& from;
+			const T* borrowed;
+			mutable cref materialized;
+		public:
+			borrow_t(const cref& from) :from(from), borrowed(from.ptr.load(std::memory_order_acquire)) {
+			}
+
+			operator const cref&() const {
+				if (!materialized.get()) materialized = cref(borrowed);
+				return materialized;
+			}
+
+			T* operator->() const {
+				return (T*)borrowed;
+			}
+
+			T* get() const {
+				return (T*)borrowed;
+			}
+		};
+
+		borrow_t borrow() const {
+			return borrow_t(*this);
+		}
+	};
 }
@@ -5,16 +5,16 @@
 #include <thread>
 #include <array>
 
-bool ready = false;
-
-int main() {
+template <pcoll::detail::concurrent_strategy STRATEGY> int run_test(std::string label) {
 	using namespace pcoll;
 
 	static constexpr int num_threads = 2, num_entries = 1000, num_rounds = 50;
 
-	hamt<int, int> fuzz;
+	hamt<int, int, std::hash<int>, std::equal_to<int>, detail::multi_threaded, STRATEGY> fuzz;
+
+	progress_t progress{ 0 };
 
-	progress_t progress = 0;
+	auto start_time = stopwatch();
 	
 	std::array<std::thread, num_threads> threads;
 	for(auto &t : threads) {
@@ -31,14 +31,51 @@ int main() {
 		});
 	}
 
-	spin("HAMT Concurrent Fuzz", progress, num_threads * num_entries * num_rounds);
+	label = "HAMT Concurrent Fuzz (" + label + ")";
+	spin(label, progress, num_threads * num_entries * num_rounds);
 
 	for(auto &t : threads) {
 		t.join();
 	}
 
+	auto ms = dur_ms(start_time, stopwatch());
+
 	for(int i = 0; i < num_entries; ++i) {
 		auto val = *fuzz[i];
 		test_assert(val == num_threads * num_rounds, "incorrect value in hash array mapped trie");
 	}
+
+	// lookups concurrent with a writer
+	static constexpr int num_lookups = 200000;
+	std::atomic<size_t> lookups{ 0 };
+	std::atomic<bool> writing{ true };
+	std::thread writer([&]() {
+		for (int i = 0; writing; i = (i + 1) % num_entries) {
+			fuzz.update_in(i, [](optional<int> value) { return *value; });
+		}
+	});
+	auto read_start = stopwatch();
+	for (auto &t : threads) {
+		t = std::thread([&]() {
+			for (int i = 0; i < num_lookups; ++i) {
+				test_assert(fuzz.get(i % num_entries) == num_threads * num_rounds, "lookup raced with update");
+			}
+			lookups.fetch_add(num_lookups);
+		});
+	}
+	for (auto &t : threads) t.join();
+	auto read_ms = dur_ms(read_start, stopwatch());
+	writing = false;
+	writer.join();
+
+	std::cout << num_threads * num_entries * num_rounds << " contested updates in " << ms << " milliseconds, "
+		<< lookups.load() << " lookups against a writer in " << read_ms << " milliseconds.\n";
+	return 0;
+}
+
+int main() {
+	return
+		run_test<pcoll::detail::locking>("mutex") +
+		run_test<pcoll::detail::lockfree>("lockfree") +
+		run_test<pcoll::detail::epoch>("epoch");
 }
\ No newline at end of file
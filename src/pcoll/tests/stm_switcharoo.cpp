@@ -4,6 +4,7 @@
 #include <array>
 #include <unordered_map>
 #include <random>
+#include <functional>
 
 constexpr int num_entries = 4;
 constexpr int num_threads = 16;
@@ -15,7 +16,7 @@ template <pcoll::detail::concurrent_strategy STRATEGY> int run_test(std::string
 
 	leaks.store(0);
 
-	cref<leak_test, detail::locking> mutable_array[num_entries];
+	cref<leak_test, STRATEGY> mutable_array[num_entries];
 	for(auto &mr : mutable_array) {
 		mr = new leak_test;
 	}
@@ -71,6 +72,10 @@ template <pcoll::detail::concurrent_strategy STRATEGY> int run_test(std::string
 		mr.reset();
 	}
 
+	if (STRATEGY == detail::epoch) {
+		detail::epoch_domain::global_domain().synchronize();
+	}
+
 	auto num_leaks = leaks.load();
 	test_warn_if(num_leaks != 0, "memory management failure: " << num_leaks << " leaks");
 	return (int)num_leaks;
@@ -79,7 +84,8 @@ template <pcoll::detail::concurrent_strategy STRATEGY> int run_test(std::string
 int main() {
 	auto failures = 
 		run_test<pcoll::detail::locking>("mutex") +
-		run_test<pcoll::detail::lockfree>("lockfree");
+		run_test<pcoll::detail::lockfree>("lockfree") +
+		run_test<pcoll::detail::epoch>("epoch");
 
 	return failures;
 }
\ No newline at end of file
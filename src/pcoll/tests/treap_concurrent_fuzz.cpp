@@ -3,25 +3,28 @@
 #include "leaktest.h"
 
 #include <array>
+#include <algorithm>
 #include <thread>
 #include <cstdlib>
 #include <chrono>
 #include <sstream>
 
-int main() {
+template <pcoll::detail::concurrent_strategy STRATEGY> int run_test(std::string label) {
 	using namespace pcoll;
 
 	static constexpr int num_entries = 10000, num_threads = 8;
+	static constexpr size_t max_pending = 1 << 16;
 
-	treap<int> priority_queue;
+	treap<int, std::less<int>, std::hash<int>, detail::multi_threaded, STRATEGY> priority_queue;
 
-	std::atomic<size_t> counter = 0;
+	std::atomic<size_t> counter{ 0 };
 
 	std::array<std::thread, num_threads> producers;
 
-
 	std::stringstream log;
 
+	auto start_time = stopwatch();
+
 	for(int i=0;i<num_threads;++i) {
 		producers[i] = std::thread([&priority_queue,i]() {
 			static constexpr int max_step = 100;
@@ -36,7 +39,6 @@ int main() {
 
 	std::thread consumer([&]() {
 		while (counter < num_entries * num_threads) {
-			bool did_receive = false;
 			int recv = 0;
 			if (priority_queue.try_pop_front(recv)) {
 				log << recv << "\n";
@@ -48,11 +50,63 @@ int main() {
 		}
 	});
 
-	spin("Treap Concurrent Fuzz", counter, num_entries * num_threads);
+	// retired nodes must be reclaimed while the test runs, not accumulate
+	std::atomic<bool> done{ false };
+	size_t peak_pending = 0;
+	std::thread monitor([&]() {
+		if (STRATEGY != detail::epoch) return;
+		while (!done) {
+			peak_pending = std::max(peak_pending, detail::epoch_domain::global_domain().pending_retirements());
+			std::this_thread::yield();
+		}
+	});
+
+	label = "Treap Concurrent Fuzz (" + label + ")";
+	spin(label, counter, num_entries * num_threads);
+
+	auto ms = dur_ms(start_time, stopwatch());
 
 	for (auto &p : producers) {
 		if (p.joinable()) p.join();
 	}
 
 	if (consumer.joinable()) consumer.join();
+
+	test_assert(priority_queue.empty(), "entries left in the queue after consuming all of them");
+
+	// concurrent snapshot reads of the root
+	static constexpr int num_reads = 100000;
+	for (int i = 0; i < 1000; ++i) priority_queue.insert_into(i);
+	std::array<std::thread, num_threads> readers;
+	std::atomic<size_t> reads{ 0 };
+	auto read_start = stopwatch();
+	for (auto& r : readers) {
+		r = std::thread([&]() {
+			size_t sum = 0;
+			for (int j = 0; j < num_reads; ++j) sum += priority_queue.front();
+			reads.fetch_add(num_reads);
+			test_assert(sum == 0, "wrong front element");
+		});
+	}
+	for (auto& r : readers) r.join();
+	auto read_ms = dur_ms(read_start, stopwatch());
+
+	done = true;
+	monitor.join();
+	if (STRATEGY == detail::epoch) {
+		test_assert(peak_pending < max_pending, "retired nodes are not being reclaimed");
+		detail::epoch_domain::global_domain().synchronize();
+		test_assert(detail::epoch_domain::global_domain().pending_retirements() == 0, "retired nodes leaked");
+	}
+
+	std::cout << num_entries * num_threads << " contested insertions and removals in " << ms << " milliseconds, "
+		<< reads.load() << " concurrent reads in " << read_ms << " milliseconds.\n";
+	return 0;
+}
+
+int main() {
+	return
+		run_test<pcoll::detail::locking>("mutex") +
+		run_test<pcoll::detail::lockfree>("lockfree") +
+		run_test<pcoll::detail::epoch>("epoch");
 }
\ No newline at end of file
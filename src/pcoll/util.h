@@ -61,7 +61,8 @@ namespace pcoll {
 	namespace detail {
 		enum concurrent_strategy {
 			locking,
-			lockfree
+			lockfree,
+			epoch
 		};
 
 		enum thread_policy {
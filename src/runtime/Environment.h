@@ -71,7 +71,7 @@ namespace Kronos {
 
 			size_t outFrameSz;
 			std::vector<char> outputBus;
-			Runtime::Instance::Ref BuildInstance(std::int64_t uid, const Runtime::BlobView& blob);
+			Runtime::Instance::Ref BuildInstance(std::int64_t uid, const Runtime::BlobView& blob, bool holdStream = false);
 			static thread_local Stack pseudoStack;
 			bool deterministicBuild = false;
 			void Connect(const ClassCode&, krt_instance, IO::ManagedRef);
@@ -81,8 +81,11 @@ namespace Kronos {
 			void Run(int64_t timestamp, int64_t closureTy, const void* closureArg, int64_t closureSz) override;
             void Render(const char *audioFile, int64_t closureTy, const void* closureArg, float sampleRate, int64_t numFrames) override;
 			int64_t Start(int64_t closureTy, const void* closureData, size_t closureSz) override;
+			int64_t Replace(int64_t instanceId, int64_t closureTy, const void* closureData, size_t closureSz) override;
 			bool Stop(int64_t instanceId) override;
             int StopAll() override;
+			// rebuilds every running instance of 'closureTy' from the current class, keeping closures
+			int ReplaceAll(int64_t closureTy);
 			void UnsubscribeAll(ISubscriptionHost*) override;
 			void Dispatch(int symIdx, const void* arg, size_t argSz, void*) override;
 			void DispatchTo(IObject* child, int symIdx, const void* arg, size_t argSz, void*) override;
@@ -42,7 +42,7 @@ namespace Kronos {
 			return t + ")";
 		}
 
-		AudioSubject::AudioSubject(IConfigurationDelegate* config, Subject* pre, Subject* post):preHook(pre), postHook(post), config(config) {
+		AudioSubject::AudioSubject(IConfigurationDelegate* config, Subject* pre, Subject* post):preHook(pre), postHook(post), config(config), meter(LoadMeter::Create("audio")) {
 		}
 
 		Runtime::MethodKey AudioSubject::Id() const {
@@ -83,6 +83,7 @@ namespace Kronos {
 			When(dev->BufferSwitch, [&](PAD::IO io) {
 				frameCount = io.numFrames;
 				if (frameCount) {
+					LoadMeter::Scope measure(meter.get(), LoadMeter::Budget(io.numFrames, io.config.GetSampleRate()));
 
 					if (preHook) {
 						preHook->Bind(&frameCount);
@@ -1,6 +1,7 @@
 #pragma once
 #include "inout.h"
 #include "pad/pad.h"
+#include "loadmeter.h"
 
 #include <ostream>
 
@@ -25,6 +26,7 @@ namespace Kronos {
 			Subject *preHook, *postHook;
 			int32_t frameCount;
 			IConfigurationDelegate* config;
+			std::shared_ptr<LoadMeter::Meter> meter;
 		public:
 			AudioSubject(IConfigurationDelegate* config, Subject* preHook = nullptr, Subject* postHook = nullptr);
 			~AudioSubject();
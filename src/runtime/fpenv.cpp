@@ -0,0 +1,76 @@
+#include "fpenv.h"
+
+#include <atomic>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <xmmintrin.h>
+#define HAS_MXCSR 1
+#elif defined(__aarch64__) && defined(__GNUC__)
+#define HAS_FPCR 1
+#endif
+
+namespace Kronos {
+	namespace IO {
+		namespace FPEnv {
+			static std::atomic<bool> flushDenormals{ false };
+
+			void SetFlushDenormals(bool enable) {
+				flushDenormals.store(enable, std::memory_order_relaxed);
+			}
+
+			bool FlushDenormals() {
+				return flushDenormals.load(std::memory_order_relaxed);
+			}
+
+#if HAS_MXCSR
+			// MXCSR.FTZ | MXCSR.DAZ; denormal operand and underflow flags
+			static const std::uint32_t FlushMode = 0x8040, DenormalFlags = 0x12;
+
+			static std::uint32_t GetMode() { return _mm_getcsr(); }
+			static void SetMode(std::uint32_t m) { _mm_setcsr(m); }
+			static std::uint32_t GetStatus() { return _mm_getcsr() & DenormalFlags; }
+			static void SetStatus(std::uint32_t s) { _mm_setcsr((_mm_getcsr() & ~DenormalFlags) | s); }
+#elif HAS_FPCR
+			// FPCR.FZ; FPSR input denormal and underflow flags
+			static const std::uint32_t FlushMode = 1u << 24, DenormalFlags = 0x88;
+
+			static std::uint32_t GetMode() { std::uint64_t r; asm volatile("mrs %0, fpcr" : "=r"(r)); return (std::uint32_t)r; }
+			static void SetMode(std::uint32_t m) { std::uint64_t r = m; asm volatile("msr fpcr, %0" :: "r"(r)); }
+			static std::uint32_t GetStatus() { std::uint64_t r; asm volatile("mrs %0, fpsr" : "=r"(r)); return (std::uint32_t)r & DenormalFlags; }
+			static void SetStatus(std::uint32_t s) {
+				std::uint64_t r; asm volatile("mrs %0, fpsr" : "=r"(r));
+				r = (r & ~(std::uint64_t)DenormalFlags) | s;
+				asm volatile("msr fpsr, %0" :: "r"(r));
+			}
+#else
+			static const std::uint32_t FlushMode = 0;
+			static std::uint32_t GetMode() { return 0; }
+			static void SetMode(std::uint32_t) { }
+			static std::uint32_t GetStatus() { return 0; }
+			static void SetStatus(std::uint32_t) { }
+#endif
+
+			FlushScope::FlushScope() :saved(0), active(FlushDenormals() && FlushMode) {
+				if (active) {
+					saved = GetMode();
+					SetMode(saved | FlushMode);
+				}
+			}
+
+			FlushScope::~FlushScope() {
+				// only the flush bits are restored; status raised in scope is kept
+				if (active) SetMode((GetMode() & ~FlushMode) | (saved & FlushMode));
+			}
+
+			std::uint32_t TakeDenormalFlags() {
+				auto s = GetStatus();
+				if (s) SetStatus(0);
+				return s;
+			}
+
+			void RaiseDenormalFlags(std::uint32_t s) {
+				if (s) SetStatus(GetStatus() | s);
+			}
+		}
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Kronos {
+	namespace IO {
+		namespace FPEnv {
+			// when set, runtime threads that render signal run with flush-to-zero
+			// and denormals-are-zero; process-wide
+			void SetFlushDenormals(bool);
+			bool FlushDenormals();
+
+			// switches the calling thread into flushing mode for its lifetime
+			// if FlushDenormals() is set, and restores the previous mode after
+			class FlushScope {
+				std::uint32_t saved;
+				bool active;
+			public:
+				FlushScope();
+				~FlushScope();
+				FlushScope(const FlushScope&) = delete;
+				FlushScope& operator=(const FlushScope&) = delete;
+			};
+
+			// sticky status bits of the calling thread that indicate denormal
+			// operands or underflowing results. Take returns and clears them.
+			std::uint32_t TakeDenormalFlags();
+			void RaiseDenormalFlags(std::uint32_t);
+		}
+	}
+}
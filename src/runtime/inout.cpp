@@ -5,6 +5,8 @@
 #include "o2driver.h"
 #endif
 
+#include "oscdriver.h"
+
 #include <chrono>
 #include <thread>
 #include <unordered_set>
@@ -198,7 +200,7 @@ namespace Kronos {
 		class Registry : public Broadcaster, public IRegistry, public IConfiguringHierarchy, public IConfigurationDelegate {
 			std::unordered_set<IConfigurationDelegate*> configDelegates;
 			std::unordered_map<std::string, std::string> configSettings;
-            std::unique_ptr<IHierarchy> genericSubject;
+            std::vector<std::unique_ptr<IHierarchy>> genericSubjects;
 		public:
 			Registry(std::initializer_list<Subject::Ref>&& subs) {
 				for (auto &s : subs) {
@@ -231,14 +233,23 @@ namespace Kronos {
 				configDelegates.erase(&del);
 			}
             
-            void SetGenericHandler(std::unique_ptr<IHierarchy> sub) {
-                genericSubject = std::move(sub);
+            void AddGenericHandler(std::unique_ptr<IHierarchy> sub) {
+                if (sub) genericSubjects.emplace_back(std::move(sub));
             }
             
             void UnknownSubject(const Runtime::MethodKey& mk, const ManagedRef& mr, krt_instance inst, krt_process_call proc, void const** slot) override {
-                genericSubject->Subscribe(mk, mr, inst, proc, slot);
+                for (auto &g : genericSubjects) g->Subscribe(mk, mr, inst, proc, slot);
             }
 
+			using Broadcaster::Unsubscribe;
+			void Unsubscribe(const Runtime::MethodKey& mk, krt_instance inst) override {
+				if (GetSymbolIndex(mk.name) < 0) {
+					for (auto &g : genericSubjects) g->Unsubscribe(mk, inst);
+				} else {
+					Broadcaster::Unsubscribe(mk, inst);
+				}
+			}
+
 			void Set(const std::string& key, const std::string& value) override {
 				if (configSettings[key] != value) {
 					configSettings[key] = value;
@@ -254,8 +265,9 @@ namespace Kronos {
 			MIDI::Setup(*reg);
 
  #ifdef HAS_O2
-            reg->SetGenericHandler(o2::Setup(*reg, reg.get()));
+            reg->AddGenericHandler(o2::Setup(*reg, reg.get()));
  #endif
+            reg->AddGenericHandler(osc::Setup(*reg, reg.get()));
 
             return std::move(reg);
 		}
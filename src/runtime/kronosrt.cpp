@@ -12,6 +12,7 @@
 #include "config/system.h"
 
 #include "paf/PAF.h"
+#include "fpenv.h"
 
 #include <xmmintrin.h>
 
@@ -232,12 +233,13 @@ namespace Kronos {
 			}
 		}
 
-		Runtime::Instance::Ref Environment::BuildInstance(std::int64_t uid, const Runtime::BlobView& blob) {
+		Runtime::Instance::Ref Environment::BuildInstance(std::int64_t uid, const Runtime::BlobView& blob, bool holdStream) {
 			auto class_ = builder([this](Runtime::ClassCode& cc) mutable {
 				this->Finalize(cc);
 			}, 0, uid, OmitEvaluate | (deterministicBuild ? UserFlag1 : 0)).get();
 
-			const int align = 32;
+			// cache line aligned so that instances never share a line
+			const int align = 64;
 
 			size_t sz = (size_t)(*class_)->get_size();
 			sz = (sz + align - 1) & -align;
@@ -246,10 +248,14 @@ namespace Kronos {
 			auto instanceMemory = memory;
 			auto closureMemory = (char*)memory + sz;
 
-			pcoll::detail::ref<Instance> metaData = new Instance(class_, instanceMemory, closureMemory);
+			pcoll::detail::ref<Instance> metaData = new Instance(class_, instanceMemory, closureMemory, uid, std::get<size_t>(blob));
 
 			memcpy(metaData->Closure(), std::get<const void*>(blob), std::get<size_t>(blob));
 
+			if (holdStream && audioHost && class_->hasStreamClock) {
+				audioHost->Hold(instanceMemory);
+			}
+
 			Connect(*class_, instanceMemory, metaData);
 
 			(*class_)->construct(instanceMemory, closureMemory);
@@ -388,7 +394,8 @@ namespace Kronos {
 
 	            writeFile->TrySet(PAF::BitDepth, 24);
 				writeFile->TrySet(PAF::BitRate, 128000 * numCh);
-                
+
+                IO::FPEnv::FlushScope flushDenormals;
                 while(numFrames > 0) {
                     auto todo = std::min(numFrames, blockFrames);
                     
@@ -419,6 +426,45 @@ namespace Kronos {
 			}
 		}
 
+		int64_t Environment::Replace(int64_t instanceId, int64_t closureTy, const void* closureArg, size_t closureSz) {
+			auto old = instances.get((void*)instanceId);
+			// the instance map only holds objects made by BuildInstance
+			auto oldInst = static_cast<Instance*>(old.get());
+
+			if (!oldInst || !oldInst->HasStreamClock() || !audioHost) {
+				auto id = Environment::Start(closureTy, closureArg, closureSz);
+				Stop(instanceId);
+				return id;
+			}
+
+			// retire and replace at the same virtual time point
+			std::unique_ptr<ScriptContext> freeze;
+			if (TimingContext() == Realtime) {
+				VirtualTimePoint() = TimePointTy(MicroSecTy(Now()));
+				freeze = std::make_unique<ScriptContext>(Frozen);
+			}
+
+			auto instRef = BuildInstance(closureTy, BlobView{ closureArg, closureSz }, true);
+			if (instRef.empty()) return instanceId;
+			auto newInst = static_cast<Instance*>(instRef.get());
+
+			// carry state over only if both classes share the state layout
+			size_t migrate = 0;
+			auto oldLayout = oldInst->Class()->state_layout;
+			if (oldLayout && oldLayout == newInst->Class()->state_layout &&
+				oldInst->StateSize() == newInst->StateSize()) {
+				migrate = newInst->StateSize();
+			}
+
+			audioHost->Replace(newInst->Memory(), oldInst->Memory(), migrate);
+
+			instances.update_in(instRef->Id(), [&](const auto&) {
+				return instRef;
+			});
+			Stop(instanceId);
+			return (int64_t)instRef->Id();
+		}
+
 		bool Environment::Stop(int64_t instanceId) {
 			IObject::Ref outGoing;
 			instances.update_in((void*)instanceId, [&outGoing](const pcoll::optional<IObject::Ref> oref) {
@@ -432,6 +478,19 @@ namespace Kronos {
 			return !outGoing.empty();
 		}
         
+		int Environment::ReplaceAll(int64_t closureTy) {
+			std::vector<IObject::Ref> matching;
+			instances.for_each([&](void*, const IObject::Ref& obj) {
+				if (static_cast<Instance*>(obj.get())->ClosureType() == closureTy) matching.emplace_back(obj);
+			});
+			// the old instance keeps its closure alive until Replace has copied it
+			for (auto& obj : matching) {
+				auto inst = static_cast<Instance*>(obj.get());
+				Replace((int64_t)inst->Id(), closureTy, inst->Closure(), inst->ClosureSize());
+			}
+			return (int)matching.size();
+		}
+
         int Environment::StopAll() {
             int count = 0;
             InstanceMapTy tmp;
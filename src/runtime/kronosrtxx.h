@@ -56,6 +56,7 @@ namespace Kronos {
 			virtual void ToOut(const char* pipe, const char* type, const void* blob, bool newline = false) = 0;
 			virtual void Run(int64_t timestamp, int64_t closureTy, const void* closureArg, int64_t closureSz) = 0;
 			virtual int64_t Start(int64_t closureType, const void *closureData, size_t closureSz) = 0;
+			virtual int64_t Replace(int64_t instanceId, int64_t closureType, const void *closureData, size_t closureSz) = 0;
 			virtual void DispatchTo(IObject* child, int symIdx, const void* blob, size_t blobSz, void* res) = 0;
 			virtual bool Stop(int64_t id) = 0;
             virtual int StopAll() = 0;
@@ -110,9 +111,12 @@ namespace Kronos {
 			ClassRef myClass;
 			krt_instance instance;
 			void *closure;
+			std::int64_t closureTy;
+			size_t closureSz;
 		public:
 			~Instance();
-			Instance(ClassRef c, krt_instance instance, void *cls) :myClass(c), instance(instance), closure(cls) {}
+			Instance(ClassRef c, krt_instance instance, void *cls, std::int64_t closureTy, size_t closureSz)
+				:myClass(c), instance(instance), closure(cls), closureTy(closureTy), closureSz(closureSz) {}
 			Instance(const Instance&) = delete;
 			Instance& operator=(const Instance&) = delete;
 			void Dispatch(int symIndex, const void*, size_t, void*) override;
@@ -126,10 +130,22 @@ namespace Kronos {
 				return closure;
 			}
 
+			std::int64_t ClosureType() const { return closureTy; }
+			size_t ClosureSize() const { return closureSz; }
+
 			void *Id() const {
 				return Class()->var(instance, 0);
 			}
 
+			krt_instance Memory() const {
+				return instance;
+			}
+
+			// state region precedes the symbol table in instance memory
+			size_t StateSize() const {
+				return (size_t)((char*)Id() - (char*)instance);
+			}
+
 			bool HasStreamClock() const {
 				return myClass->hasStreamClock;
 			}
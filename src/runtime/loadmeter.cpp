@@ -0,0 +1,186 @@
+#include "loadmeter.h"
+
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define HAS_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_RDTSC 1
+#endif
+
+namespace Kronos {
+	namespace IO {
+		namespace LoadMeter {
+			static Cycles SteadyNanoseconds() {
+				return (Cycles)std::chrono::duration_cast<std::chrono::nanoseconds>(
+					std::chrono::steady_clock::now().time_since_epoch()).count();
+			}
+
+			Cycles Now() {
+#ifdef HAS_RDTSC
+				return __rdtsc();
+#else
+				return SteadyNanoseconds();
+#endif
+			}
+
+			double CyclesPerSecond() {
+#ifdef HAS_RDTSC
+				static const double calibrated = []() {
+					auto ns = SteadyNanoseconds();
+					auto tsc = Now();
+					std::this_thread::sleep_for(std::chrono::milliseconds(20));
+					auto dns = SteadyNanoseconds() - ns;
+					auto dtsc = Now() - tsc;
+					return dns ? (double)dtsc * 1e9 / (double)dns : 1e9;
+				}();
+				return calibrated;
+#else
+				return 1e9;
+#endif
+			}
+
+			Cycles Budget(int numFrames, double sampleRate) {
+				if (sampleRate <= 0) return 0;
+				return (Cycles)(numFrames / sampleRate * CyclesPerSecond());
+			}
+
+			Cycles BudgetFromTicksPerMicrosecond(int numFrames, double ticksPerMicrosecond) {
+				return Budget(numFrames, ticksPerMicrosecond * 1e6);
+			}
+
+			Meter::Meter(std::string subject, const void* instance)
+				:calls(0), cycles(0), budget(0), peak(0), overruns(0), denormals(0)
+				,subject(std::move(subject)), instance(instance) {
+				for (auto& b : buckets) b.store(0, std::memory_order_relaxed);
+			}
+
+			void Meter::Record(Cycles used, Cycles allowed, bool denormal) {
+				int bucket = 0;
+				while (bucket < NumBuckets - 1 && (used >> bucket)) ++bucket;
+				buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+				calls.fetch_add(1, std::memory_order_relaxed);
+				cycles.fetch_add(used, std::memory_order_relaxed);
+				budget.fetch_add(allowed, std::memory_order_relaxed);
+				if (used > peak.load(std::memory_order_relaxed)) peak.store(used, std::memory_order_relaxed);
+				if (allowed && used > allowed) overruns.fetch_add(1, std::memory_order_relaxed);
+				if (denormal) denormals.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			Meter::Snapshot Meter::Read() const {
+				Snapshot s;
+				s.subject = subject;
+				s.instance = instance;
+				for (int i = 0; i < NumBuckets; ++i) s.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+				s.calls = calls.load(std::memory_order_relaxed);
+				s.cycles = cycles.load(std::memory_order_relaxed);
+				s.budget = budget.load(std::memory_order_relaxed);
+				s.peak = peak.load(std::memory_order_relaxed);
+				s.overruns = overruns.load(std::memory_order_relaxed);
+				s.denormals = denormals.load(std::memory_order_relaxed);
+				return s;
+			}
+
+			static struct {
+				std::mutex lock;
+				std::vector<std::weak_ptr<Meter>> meters;
+			} Registry;
+
+			std::shared_ptr<Meter> Create(std::string subject, const void* instance) {
+				// calibrate outside the realtime thread
+				CyclesPerSecond();
+				auto m = std::make_shared<Meter>(std::move(subject), instance);
+				std::lock_guard<std::mutex> lg{ Registry.lock };
+				Registry.meters.emplace_back(m);
+				return m;
+			}
+
+			std::vector<Meter::Snapshot> Collect() {
+				std::vector<Meter::Snapshot> result;
+				std::lock_guard<std::mutex> lg{ Registry.lock };
+				for (auto i = Registry.meters.begin(); i != Registry.meters.end();) {
+					if (auto m = i->lock()) {
+						result.emplace_back(m->Read());
+						++i;
+					} else {
+						i = Registry.meters.erase(i);
+					}
+				}
+				return result;
+			}
+
+			// label values may not contain a raw backslash, quote or newline
+			static void LabelValue(std::ostream& os, const std::string& v) {
+				os << '"';
+				for (auto c : v) {
+					switch (c) {
+					case '\\': os << "\\\\"; break;
+					case '"': os << "\\\""; break;
+					case '\n': os << "\\n"; break;
+					default: os << c; break;
+					}
+				}
+				os << '"';
+			}
+
+			static void Labels(std::ostream& os, const Meter::Snapshot& s) {
+				os << "subject="; LabelValue(os, s.subject);
+				if (s.instance) {
+					std::ostringstream instance;
+					instance << s.instance;
+					os << ",instance="; LabelValue(os, instance.str());
+				}
+			}
+
+			void WriteOpenMetrics(std::ostream& os) {
+				auto meters = Collect();
+				auto cps = CyclesPerSecond();
+
+				os << "# TYPE kronos_dsp_cycles histogram\n"
+				   << "# HELP kronos_dsp_cycles Cycles spent per callback.\n";
+				for (auto& m : meters) {
+					std::uint64_t cumulative = 0;
+					for (int i = 0; i < NumBuckets - 1; ++i) {
+						cumulative += m.buckets[i];
+						os << "kronos_dsp_cycles_bucket{"; Labels(os, m);
+						os << ",le=\"" << (1ull << i) << "\"} " << cumulative << "\n";
+					}
+					os << "kronos_dsp_cycles_bucket{"; Labels(os, m); os << ",le=\"+Inf\"} " << m.calls << "\n";
+					os << "kronos_dsp_cycles_count{"; Labels(os, m); os << "} " << m.calls << "\n";
+					os << "kronos_dsp_cycles_sum{"; Labels(os, m); os << "} " << m.cycles << "\n";
+				}
+
+				os << "# TYPE kronos_dsp_load gauge\n"
+				   << "# HELP kronos_dsp_load Fraction of the buffer period used on average.\n";
+				for (auto& m : meters) {
+					os << "kronos_dsp_load{"; Labels(os, m); os << "} " << m.Load() << "\n";
+				}
+
+				os << "# TYPE kronos_dsp_peak_seconds gauge\n"
+				   << "# UNIT kronos_dsp_peak_seconds seconds\n"
+				   << "# HELP kronos_dsp_peak_seconds Longest single callback.\n";
+				for (auto& m : meters) {
+					os << "kronos_dsp_peak_seconds{"; Labels(os, m); os << "} " << m.peak / cps << "\n";
+				}
+
+				os << "# TYPE kronos_dsp_overruns counter\n"
+				   << "# HELP kronos_dsp_overruns Callbacks that exceeded their buffer period.\n";
+				for (auto& m : meters) {
+					os << "kronos_dsp_overruns_total{"; Labels(os, m); os << "} " << m.overruns << "\n";
+				}
+
+				os << "# TYPE kronos_dsp_denormal_blocks counter\n"
+				   << "# HELP kronos_dsp_denormal_blocks Callbacks that met denormal operands or underflowed.\n";
+				for (auto& m : meters) {
+					os << "kronos_dsp_denormal_blocks_total{"; Labels(os, m); os << "} " << m.denormals << "\n";
+				}
+				os << "# EOF\n";
+			}
+		}
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "fpenv.h"
+
+namespace Kronos {
+	namespace IO {
+		namespace LoadMeter {
+			using Cycles = std::uint64_t;
+
+			// time stamp counter where available, otherwise steady clock nanoseconds
+			Cycles Now();
+			double CyclesPerSecond();
+			Cycles Budget(int numFrames, double sampleRate);
+			// for activation rates expressed in frames per microsecond, as stream subjects see them
+			Cycles BudgetFromTicksPerMicrosecond(int numFrames, double ticksPerMicrosecond);
+
+			// log2 buckets; bucket i holds samples below 2^i cycles
+			static const int NumBuckets = 40;
+
+			// written only from the realtime thread that owns it; readers take relaxed snapshots
+			class Meter {
+				std::atomic<std::uint64_t> buckets[NumBuckets];
+				std::atomic<std::uint64_t> calls, cycles, budget, peak, overruns, denormals;
+			public:
+				const std::string subject;
+				const void* const instance;
+
+				Meter(std::string subject, const void* instance);
+				// 'denormal' marks a callback that touched denormal operands or underflowed
+				void Record(Cycles used, Cycles budget, bool denormal = false);
+
+				struct Snapshot {
+					std::string subject;
+					const void* instance;
+					std::uint64_t buckets[NumBuckets];
+					std::uint64_t calls, cycles, budget, peak, overruns, denormals;
+					double Load() const { return budget ? (double)cycles / (double)budget : 0.0; }
+				};
+				Snapshot Read() const;
+			};
+
+			struct Scope {
+				Meter* meter;
+				Cycles start, budget;
+				// denormal status raised before the scope, set aside so nested scopes stay exact
+				std::uint32_t outer;
+				Scope(Meter* m, Cycles budget) :meter(m), start(m ? Now() : 0), budget(budget)
+					,outer(m ? FPEnv::TakeDenormalFlags() : 0) {}
+				~Scope() {
+					if (meter) {
+						auto raised = FPEnv::TakeDenormalFlags();
+						FPEnv::RaiseDenormalFlags(outer | raised);
+						meter->Record(Now() - start, budget, raised != 0);
+					}
+				}
+			};
+
+			// registers a meter for as long as the returned reference is held
+			std::shared_ptr<Meter> Create(std::string subject, const void* instance = nullptr);
+			std::vector<Meter::Snapshot> Collect();
+			void WriteOpenMetrics(std::ostream&);
+		}
+	}
+}
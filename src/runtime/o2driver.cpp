@@ -18,8 +18,7 @@
 #define EXPAND_PARAMS \
 F(o2, o2, std::string(""), "<name>", "Listen to O2 messages within O2 ensemble <name>") \
 F(o2_service, o2s, std::string("kronos"), "<name>", "O2 service name, 'kronos' by default") \
-F(o2_master, o2m, false, "", "Act as O2 clock master") \
-F(osc_port, op, 7777, "<port>", "Listen to OSC events on UDP <port>")
+F(o2_master, o2m, false, "", "Act as O2 clock master")
 
 namespace CL {
     using namespace CmdLine;
@@ -84,13 +83,14 @@ namespace Kronos {
                 
 
                 struct Slot {
-                    std::unique_ptr<char> slotMemory;
+                    std::unique_ptr<char[]> slotMemory;
                     size_t bufferSize;
                     krt_instance instance;
                     krt_process_call callback;
                     O2Subject *subject;
                     ManagedRef keepAlive;
                     std::string o2method;
+                    void const** target;
                 };
 
                 std::thread pollThread;
@@ -136,6 +136,7 @@ namespace Kronos {
                         ptr += sz;
                     }
 
+                    if (s->target) *s->target = s->slotMemory.get();
                     s->callback(s->instance, s->subject->scratch.data(), 1);
                 }
                 
@@ -178,7 +179,6 @@ namespace Kronos {
                     }
                     
                     o2_service_new(serviceName.c_str());
-                    o2_osc_port_new(serviceName.c_str(), CL::osc_port(), 0);
 
                     while(stopFlag.test_and_set()) { {
                             std::lock_guard<std::recursive_mutex> lg { contextLock };
@@ -259,10 +259,10 @@ namespace Kronos {
                     auto key = std::string(mk.name) + " " + mk.signature;
                                                           
                     methodSlots[key] = Slot {
-                        std::make_unique<char>(size),
+                        std::make_unique<char[]>(size),
                         (size_t)size,
                         inst, callback,
-                        this, mr, o2method
+                        this, mr, o2method, slot
                     };
                     
                     *slot = (void*)methodSlots[key].slotMemory.get();
@@ -283,7 +283,8 @@ namespace Kronos {
                     auto method = methodSlots.find(key);
                     if (method != methodSlots.end()) {
                         std::lock_guard<std::recursive_mutex> lg { contextLock };
-                        RunOnO2Thread([=] () { o2_method_free(method->second.o2method.c_str()); });
+                        auto o2method = method->second.o2method;
+                        RunOnO2Thread([=] () { o2_method_free(o2method.c_str()); });
                         methodSlots.erase(method);
                     }
                 }
@@ -0,0 +1,564 @@
+#include "oscdriver.h"
+#include "common/PlatformUtils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "pcoll/hamt.h"
+#include "driver/CmdLineOpts.h"
+
+#define EXPAND_PARAMS \
+F(osc_port, op, 7777, "<port>", "Listen to OSC events on UDP <port>, 0 to disable")
+
+namespace CL {
+	using namespace CmdLine;
+#define F(LONG, SHORT, DEFAULT, LABEL, DESCRIPTION) Option<decltype(DEFAULT)> LONG(DEFAULT, "--" #LONG, "-" #SHORT, LABEL, DESCRIPTION);
+	EXPAND_PARAMS
+#undef F
+}
+
+namespace Kronos {
+	namespace IO {
+		namespace osc {
+			static std::uint32_t ReadBE32(const char* p) {
+				auto u = (const unsigned char*)p;
+				return (std::uint32_t)u[0] << 24 | (std::uint32_t)u[1] << 16 | (std::uint32_t)u[2] << 8 | u[3];
+			}
+
+			static std::uint64_t ReadBE64(const char* p) {
+				return (std::uint64_t)ReadBE32(p) << 32 | ReadBE32(p + 4);
+			}
+
+			static void WriteBE32(char* p, std::uint32_t v) {
+				for (int i = 3; i >= 0; --i, v >>= 8) p[i] = (char)(v & 0xff);
+			}
+
+			static void WriteBE64(char* p, std::uint64_t v) {
+				WriteBE32(p, (std::uint32_t)(v >> 32));
+				WriteBE32(p + 4, (std::uint32_t)v);
+			}
+
+			static size_t Pad4(size_t sz) {
+				return (sz + 3) & ~size_t(3);
+			}
+
+			// size of the padded OSC string at p, or 0 if it is not terminated before end
+			static size_t StringSize(const char* p, const char* end) {
+				if (p >= end) return 0;
+				auto nul = (const char*)memchr(p, 0, end - p);
+				if (!nul) return 0;
+				return Pad4(nul - p + 1);
+			}
+
+			static size_t OSCSignature(std::string& types, const char* kronosTypeSig) {
+				struct LoopStack {
+					const char *top;
+					size_t counter;
+				};
+
+				std::vector<LoopStack> loops;
+
+				size_t size = 0;
+				while (*kronosTypeSig) {
+					if (*kronosTypeSig++ == '%') {
+						switch (*kronosTypeSig++) {
+						default: break;
+						case 'f': types.push_back('f'); size += sizeof(float); break;
+						case 'd': types.push_back('d'); size += sizeof(double); break;
+						case 'q': types.push_back('h'); size += sizeof(std::int64_t); break;
+						case 'i': types.push_back('i'); size += sizeof(std::int32_t); break;
+						case '[': {
+								char *loop_start = nullptr;
+								auto loop_count = strtoull(kronosTypeSig, &loop_start, 10);
+								kronosTypeSig = ++loop_start;
+								loops.push_back(LoopStack{ loop_start, loop_count });
+							}
+							break;
+						case ']':
+							if (--loops.back().counter < 1) {
+								loops.pop_back();
+							} else {
+								kronosTypeSig = loops.back().top;
+							}
+							break;
+						}
+					}
+				}
+				return size;
+			}
+
+			struct Message {
+				const char* address;
+				const char* types;
+				const char* args;
+				const char* end;
+
+				bool Parse(const char* p, const char* e) {
+					auto addrSz = StringSize(p, e);
+					if (addrSz == 0 || *p != '/') return false;
+					address = p;
+					types = p + addrSz;
+					auto typeSz = StringSize(types, e);
+					if (typeSz == 0 || *types != ',') return false;
+					args = types + typeSz;
+					end = e;
+					return true;
+				}
+
+				// writes the numeric arguments into <out>, converted to the layout
+				// given by <want>. non-numeric arguments are skipped.
+				bool Coerce(const std::string& want, char* out) const {
+					const char* arg = args;
+					size_t w = 0;
+					for (auto t = types + 1; *t; ++t) {
+						std::int64_t iv = 0;
+						double dv = 0;
+						bool isInt = true;
+						size_t advance = 0;
+						switch (*t) {
+						case 'i': advance = 4; break;
+						case 'h': advance = 8; break;
+						case 'f': advance = 4; isInt = false; break;
+						case 'd': advance = 8; isInt = false; break;
+						case 's': case 'S':
+							advance = StringSize(arg, end);
+							if (advance == 0) return false;
+							arg += advance;
+							continue;
+						case 'b': {
+								// the size comes from the packet, so it is checked against the bytes left
+								if (end - arg < 4) return false;
+								auto blobSz = Pad4(ReadBE32(arg));
+								if (blobSz > (size_t)(end - arg) - 4) return false;
+								arg += 4 + blobSz;
+							}
+							continue;
+						case 't':
+							if (end - arg < 8) return false;
+							arg += 8;
+							continue;
+						case 'c': case 'r': case 'm':
+							if (end - arg < 4) return false;
+							arg += 4;
+							continue;
+						case 'T': case 'F': case 'N': case 'I': continue;
+						default: return false;
+						}
+
+						if (arg + advance > end) return false;
+						if (w >= want.size()) return false;
+
+						switch (*t) {
+						case 'i': iv = (std::int32_t)ReadBE32(arg); break;
+						case 'h': iv = (std::int64_t)ReadBE64(arg); break;
+						case 'f': {
+								float f; std::uint32_t bits = ReadBE32(arg);
+								memcpy(&f, &bits, 4); dv = f;
+							}
+							break;
+						case 'd': {
+								std::uint64_t bits = ReadBE64(arg);
+								memcpy(&dv, &bits, 8);
+							}
+							break;
+						}
+						arg += advance;
+
+						switch (want[w++]) {
+						case 'f': {
+								float f = isInt ? (float)iv : (float)dv;
+								memcpy(out, &f, 4); out += 4;
+							}
+							break;
+						case 'd': {
+								double d = isInt ? (double)iv : dv;
+								memcpy(out, &d, 8); out += 8;
+							}
+							break;
+						case 'i': {
+								std::int32_t i = isInt ? (std::int32_t)iv : (std::int32_t)dv;
+								memcpy(out, &i, 4); out += 4;
+							}
+							break;
+						case 'h': {
+								std::int64_t i = isInt ? iv : (std::int64_t)dv;
+								memcpy(out, &i, 8); out += 8;
+							}
+							break;
+						}
+					}
+					return w == want.size();
+				}
+			};
+
+			class OSCSubject : public IHierarchy {
+				struct Sink {
+					krt_instance instance;
+					krt_process_call callback;
+					ManagedRef keepAlive;
+					// other generic handlers may share the slot, so it is rebound on dispatch
+					void const** slot;
+				};
+
+				// routes are replaced wholesale on (un)subscription, so that the
+				// receive thread can read them without synchronization
+				struct Binding {
+					std::string types;
+					std::shared_ptr<std::vector<char>> slot;
+					std::vector<Sink> sinks;
+				};
+
+				struct Route {
+					std::vector<Binding> bindings;
+				};
+
+				using RouteRef = std::shared_ptr<const Route>;
+
+				static const int BatchSize = 32;
+				static const size_t MaxDatagram = 8192;
+
+				pcoll::hamt<std::string, RouteRef> routes;
+				std::multimap<TimePointTy, std::vector<char>> pending;
+				std::vector<char> scratch, staging;
+
+				std::mutex lifecycleLock;
+				std::thread receiver;
+				std::atomic<bool> running;
+				bool listenFailed = false;
+				int socketFd = -1;
+				int port;
+
+				void Dispatch(const char* data, const char* end, TimePointTy when) {
+					Message msg;
+					if (!msg.Parse(data, end)) return;
+
+					auto route = routes[msg.address];
+					if (!route.has_value || !route.value) return;
+
+					GetCurrentActivationTime() = when;
+					for (auto& b : route.value->bindings) {
+						// stage the arguments so that a malformed message leaves the slot intact
+						staging.resize(b.slot->size());
+						if (!msg.Coerce(b.types, staging.data())) continue;
+						std::copy(staging.begin(), staging.end(), b.slot->begin());
+						for (auto& s : b.sinks) {
+							if (s.slot) *s.slot = b.slot->data();
+							s.callback(s.instance, scratch.data(), 1);
+						}
+					}
+				}
+
+				static TimePointTy TimetagToLocal(std::uint64_t timetag, TimePointTy now, std::chrono::system_clock::time_point wallNow) {
+					// timetag 1 means 'immediately'
+					if (timetag <= 1) return now;
+					const std::int64_t NTPToUnixEpoch = 2208988800ll;
+					std::int64_t seconds = (std::int64_t)(timetag >> 32) - NTPToUnixEpoch;
+					std::int64_t micros = (std::int64_t)(((timetag & 0xffffffffull) * 1000000ull) >> 32);
+					std::chrono::system_clock::time_point wallStamp{
+						std::chrono::duration_cast<std::chrono::system_clock::duration>(
+							std::chrono::seconds(seconds) + std::chrono::microseconds(micros)) };
+					auto delta = std::chrono::duration_cast<MicroSecTy>(wallStamp - wallNow);
+					return delta.count() > 0 ? now + delta : now;
+				}
+
+				void DecodeBundle(const char* data, const char* end, TimePointTy now, std::chrono::system_clock::time_point wallNow) {
+					auto when = TimetagToLocal(ReadBE64(data + 8), now, wallNow);
+					data += 16;
+					while (data + 4 <= end) {
+						size_t elementSz = ReadBE32(data);
+						data += 4;
+						if (elementSz > (size_t)(end - data)) break;
+						auto element = data;
+						data += elementSz;
+
+						if (elementSz >= 16 && !memcmp(element, "#bundle", 8)) {
+							DecodeBundle(element, element + elementSz, now, wallNow);
+						} else if (when <= now) {
+							Dispatch(element, element + elementSz, when);
+						} else {
+							pending.emplace(when, std::vector<char>(element, element + elementSz));
+						}
+					}
+				}
+
+				void Decode(const char* data, size_t size, TimePointTy now, std::chrono::system_clock::time_point wallNow) {
+					if (size >= 16 && !memcmp(data, "#bundle", 8)) {
+						DecodeBundle(data, data + size, now, wallNow);
+					} else {
+						Dispatch(data, data + size, now);
+					}
+				}
+
+				void DispatchDue(TimePointTy now) {
+					while (!pending.empty() && pending.begin()->first <= now) {
+						auto when = pending.begin()->first;
+						auto msg = std::move(pending.begin()->second);
+						pending.erase(pending.begin());
+						Dispatch(msg.data(), msg.data() + msg.size(), when);
+					}
+				}
+
+				void Receive() {
+					std::vector<char> buffers(BatchSize * MaxDatagram);
+#ifdef __linux__
+					mmsghdr msgs[BatchSize];
+					iovec iov[BatchSize];
+					for (int i = 0; i < BatchSize; ++i) {
+						iov[i].iov_base = buffers.data() + i * MaxDatagram;
+						iov[i].iov_len = MaxDatagram;
+						memset(&msgs[i], 0, sizeof(mmsghdr));
+						msgs[i].msg_hdr.msg_iov = iov + i;
+						msgs[i].msg_hdr.msg_iovlen = 1;
+					}
+#endif
+					while (running.load(std::memory_order_acquire)) {
+						// wake up for the next timetagged event, or periodically to observe shutdown
+						int timeoutMs = 50;
+						if (!pending.empty()) {
+							auto wait = std::chrono::duration_cast<MicroSecTy>(pending.begin()->first - IO::Now()).count();
+							timeoutMs = (int)std::max<std::int64_t>(0, std::min<std::int64_t>(timeoutMs, (wait + 999) / 1000));
+						}
+
+						pollfd pfd{ socketFd, POLLIN, 0 };
+						if (poll(&pfd, 1, timeoutMs) > 0 && (pfd.revents & POLLIN)) {
+							auto now = IO::Now();
+							auto wallNow = std::chrono::system_clock::now();
+#ifdef __linux__
+							int n = recvmmsg(socketFd, msgs, BatchSize, MSG_DONTWAIT, nullptr);
+							for (int i = 0; i < n; ++i) {
+								if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) continue;
+								Decode((const char*)iov[i].iov_base, msgs[i].msg_len, now, wallNow);
+							}
+#else
+							for (int i = 0; i < BatchSize; ++i) {
+								auto got = recv(socketFd, buffers.data(), MaxDatagram, MSG_DONTWAIT);
+								if (got < 0) break;
+								Decode(buffers.data(), (size_t)got, now, wallNow);
+							}
+#endif
+						}
+
+						DispatchDue(IO::Now());
+					}
+				}
+
+			public:
+				OSCSubject(int port) :scratch(16384), running(false), port(port) {}
+
+				~OSCSubject() {
+					Stop();
+				}
+
+				int Port() const {
+					return port;
+				}
+
+				bool Listen(bool loopbackOnly = false) {
+					std::lock_guard<std::mutex> lg{ lifecycleLock };
+					if (socketFd >= 0) return true;
+					if (listenFailed) return false;
+
+					socketFd = socket(AF_INET, SOCK_DGRAM, 0);
+					if (socketFd >= 0) {
+						int reuse = 1, rcvbuf = 1 << 20;
+						setsockopt(socketFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+						setsockopt(socketFd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+						sockaddr_in addr;
+						memset(&addr, 0, sizeof(addr));
+						addr.sin_family = AF_INET;
+						addr.sin_addr.s_addr = htonl(loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+						addr.sin_port = htons((std::uint16_t)port);
+						socklen_t addrLen = sizeof(addr);
+						if (bind(socketFd, (sockaddr*)&addr, sizeof(addr)) == 0 &&
+							getsockname(socketFd, (sockaddr*)&addr, &addrLen) == 0) {
+							port = ntohs(addr.sin_port);
+							std::clog << "[OSC] Listening on UDP port " << port << std::endl;
+							running.store(true, std::memory_order_release);
+							receiver = std::thread([this]() { Receive(); });
+							return true;
+						}
+						close(socketFd);
+						socketFd = -1;
+					}
+
+					std::clog << "[OSC] Could not listen on UDP port " << port << ": " << strerror(errno) << std::endl;
+					listenFailed = true;
+					return false;
+				}
+
+				void Stop() {
+					std::lock_guard<std::mutex> lg{ lifecycleLock };
+					running.store(false, std::memory_order_release);
+					if (receiver.joinable()) receiver.join();
+					if (socketFd >= 0) {
+						close(socketFd);
+						socketFd = -1;
+					}
+				}
+
+				void Subscribe(const Runtime::MethodKey& mk, const ManagedRef& mr, krt_instance inst, krt_process_call callback, void const** slot) override {
+					if (mk.signature == nullptr) return;
+
+					std::string types;
+					auto size = OSCSignature(types, mk.signature);
+					if (types.empty()) return;
+
+					auto fresh = std::make_shared<std::vector<char>>(size);
+					std::shared_ptr<std::vector<char>> slotMemory;
+
+					routes.update_in("/" + std::string(mk.name), [&](const pcoll::optional<RouteRef>& prev) -> pcoll::optional<RouteRef> {
+						auto next = std::make_shared<Route>();
+						if (prev.has_value && prev.value) *next = *prev.value;
+
+						auto b = std::find_if(next->bindings.begin(), next->bindings.end(), [&](const Binding& b) { return b.types == types; });
+						if (b == next->bindings.end()) {
+							next->bindings.emplace_back(Binding{ types, fresh, {} });
+							b = next->bindings.end() - 1;
+						}
+
+						b->sinks.erase(std::remove_if(b->sinks.begin(), b->sinks.end(), [inst](const Sink& s) { return s.instance == inst; }), b->sinks.end());
+						b->sinks.emplace_back(Sink{ inst, callback, mr, slot });
+						slotMemory = b->slot;
+						return RouteRef(next);
+					});
+
+					if (slot) *slot = slotMemory->data();
+					Listen();
+				}
+
+				void Unsubscribe(const Runtime::MethodKey& mk, krt_instance inst) override {
+					if (mk.signature == nullptr) return;
+
+					std::string types;
+					OSCSignature(types, mk.signature);
+					if (types.empty()) return;
+
+					routes.update_in("/" + std::string(mk.name), [&](const pcoll::optional<RouteRef>& prev) -> pcoll::optional<RouteRef> {
+						if (!prev.has_value || !prev.value) return pcoll::none();
+						auto next = std::make_shared<Route>(*prev.value);
+						for (auto& b : next->bindings) {
+							if (b.types == types) {
+								b.sinks.erase(std::remove_if(b.sinks.begin(), b.sinks.end(), [inst](const Sink& s) { return s.instance == inst; }), b.sinks.end());
+							}
+						}
+						next->bindings.erase(std::remove_if(next->bindings.begin(), next->bindings.end(), [](const Binding& b) { return b.sinks.empty(); }), next->bindings.end());
+						if (next->bindings.empty()) return pcoll::none();
+						return RouteRef(next);
+					});
+				}
+
+				bool HasActiveSubjects() const override {
+					return !routes.empty();
+				}
+			};
+
+			std::unique_ptr<IHierarchy> Setup(IRegistry&, IConfigurationDelegate*) {
+				if (CL::osc_port() <= 0) return nullptr;
+				return std::make_unique<OSCSubject>(CL::osc_port());
+			}
+
+			int LoopbackBenchmark(std::ostream& report, int msgsPerSecond, int seconds) {
+				using namespace std::chrono;
+
+				auto steadyNanos = []() {
+					return (std::int64_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+				};
+
+				struct Probe {
+					const void* slot = nullptr;
+					std::int64_t (*clock)();
+					std::vector<std::int64_t> latency;
+				} probe;
+
+				probe.clock = steadyNanos;
+				probe.latency.reserve((size_t)msgsPerSecond * seconds);
+
+				OSCSubject subject{ 0 };
+				if (!subject.Listen(true)) return -1;
+
+				subject.Subscribe({ "osc-benchmark", "%q" }, ManagedRef(), &probe, [](krt_instance inst, void*, std::int32_t) {
+					auto p = (Probe*)inst;
+					std::int64_t sent;
+					memcpy(&sent, p->slot, sizeof(sent));
+					p->latency.push_back(p->clock() - sent);
+				}, &probe.slot);
+
+				int sender = socket(AF_INET, SOCK_DGRAM, 0);
+				sockaddr_in to;
+				memset(&to, 0, sizeof(to));
+				to.sin_family = AF_INET;
+				to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+				to.sin_port = htons((std::uint16_t)subject.Port());
+
+				// "/osc-benchmark" ",h" <int64 send time>
+				char packet[28] = "/osc-benchmark";
+				memcpy(packet + 16, ",h\0\0", 4);
+
+				const std::int64_t total = (std::int64_t)msgsPerSecond * seconds;
+				auto start = steady_clock::now();
+				for (std::int64_t i = 0; i < total; ++i) {
+					std::this_thread::sleep_until(start + nanoseconds(i * 1000000000ll / msgsPerSecond));
+					WriteBE64(packet + 20, (std::uint64_t)steadyNanos());
+					sendto(sender, packet, sizeof(packet), 0, (sockaddr*)&to, sizeof(to));
+				}
+				close(sender);
+
+				std::this_thread::sleep_for(milliseconds(200));
+				subject.Stop();
+
+				auto& lat(probe.latency);
+				report << "OSC loopback: " << total << " messages at " << msgsPerSecond << " msgs/s, "
+					<< lat.size() << " dispatched\n";
+				if (lat.empty()) return -1;
+
+				std::sort(lat.begin(), lat.end());
+				double sum = 0;
+				for (auto l : lat) sum += (double)l;
+				auto pct = [&](double p) {
+					return lat[std::min(lat.size() - 1, (size_t)(p * lat.size()))] * 0.001;
+				};
+
+				report << "message-to-dispatch latency (us): mean " << sum / lat.size() * 0.001
+					<< ", p50 " << pct(0.5) << ", p99 " << pct(0.99)
+					<< ", p99.9 " << pct(0.999) << ", max " << lat.back() * 0.001 << "\n";
+				return 0;
+			}
+		}
+	}
+}
+
+#else
+
+namespace Kronos {
+	namespace IO {
+		namespace osc {
+			std::unique_ptr<IHierarchy> Setup(IRegistry&, IConfigurationDelegate*) {
+				return nullptr;
+			}
+
+			int LoopbackBenchmark(std::ostream& report, int, int) {
+				report << "OSC reception is not available on this platform\n";
+				return -1;
+			}
+		}
+	}
+}
+
+#endif
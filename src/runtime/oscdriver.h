@@ -0,0 +1,19 @@
+#pragma once
+
+#include "inout.h"
+#include "kronos.h"
+
+#include <ostream>
+
+namespace Kronos {
+	namespace IO {
+		namespace osc {
+			// returns nullptr when OSC reception is not available on this platform
+			std::unique_ptr<IHierarchy> Setup(IRegistry&, IConfigurationDelegate*);
+
+			// sends <msgsPerSecond> OSC messages over loopback for <seconds> and
+			// reports the message-to-dispatch latency distribution to <report>
+			int LoopbackBenchmark(std::ostream& report, int msgsPerSecond, int seconds);
+		}
+	}
+}
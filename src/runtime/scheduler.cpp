@@ -1,5 +1,6 @@
 #include "scheduler.h"
 #include <cmath> // kludge
+#include <algorithm>
 
 namespace Kronos {
 	namespace Runtime {
@@ -135,9 +136,11 @@ namespace Kronos {
 			runCollector.test_and_set();
 			collector = std::thread([this]() {
 				using namespace std::chrono_literals;
-				while (runCollector.test_and_set()) {
-					SweepSchedule();
-					std::this_thread::sleep_for(100ms);
+				for (int tick = 0; runCollector.test_and_set(); ++tick) {
+					Prefetch();
+					Migrate();
+					if (tick % 10 == 0) SweepSchedule();
+					std::this_thread::sleep_for(10ms);
 				}
 			});
 		}
@@ -151,15 +154,24 @@ namespace Kronos {
 				delete cur;
 				cur = next;
 			}
+			for (auto& m : migrating) {
+				for (auto cur = m.load(); cur; ) {
+					auto next = cur->next;
+					delete cur;
+					cur = next;
+				}
+			}
 		}
 
 
 		int StreamSubject::SweepSchedule() {
-			auto hold = eventQueue; 
-			// hang on to the version we're mutating to stop audio thread from having to delete
-			eventQueue.remove_from([](const auto& evt) {
-				return evt->kind == Event::Stale;
-			});
+			{
+				// release consumed events so their payloads aren't held until the ring wraps
+				std::lock_guard<std::mutex> lg(prefetchLock);
+				for (size_t i = 0; i < PrefetchSlots; ++i) {
+					if (prefetch[i] && prefetch[i]->kind == Event::Stale) prefetch[i].reset();
+				}
+			}
 
 			std::lock_guard<std::mutex> lg(subscriberLock);
 			for (auto i = subscribers.begin();i != subscribers.end();) {
@@ -176,18 +188,79 @@ namespace Kronos {
 			return 0;
 		}
 
-	
+		static TimeTy ToSampleTime(TimePointTy t, TimePointTy epoch, double samplesPerMicrosecond) {
+			return t > epoch ? (TimeTy)std::llround((t - epoch).count() * samplesPerMicrosecond) : 0;
+		}
+
+		bool StreamSubject::Stage(const Event::Ref& evt) {
+			auto w = prefetchWrite;
+			if (w - prefetchRead.load(std::memory_order_acquire) >= PrefetchSlots) return false;
+			auto& slot = prefetch[w & (PrefetchSlots - 1)];
+			// the audio thread may still point to a slot until it has gone stale
+			if (slot && slot->kind != Event::Stale) return false;
+			// converted here so that the audio thread only compares sample times
+			evt->anchor = clockAnchor.load(std::memory_order_acquire);
+			evt->frame = ToSampleTime(evt->timestamp, 
+									  sampleEpoch.load(std::memory_order_relaxed), 
+									  samplesPerMicrosecond.load(std::memory_order_relaxed));
+			slot = evt;
+			++outstanding;
+			prefetchWrite = w + 1;
+			prefetchPublished.store(prefetchWrite, std::memory_order_release);
+			return true;
+		}
+
+		void StreamSubject::PrefetchLocked(TimePointTy upTo) {
+			auto boundary = upTo;
+			bool full = false;
+			eventQueue.pop_up_to(upTo).for_each([&](const Event::Ref& evt) {
+				if (!full && Stage(evt)) return true;
+				if (!full) {
+					full = true;
+					boundary = evt->timestamp;
+				}
+				eventQueue.insert_into(evt);
+				return true;
+			});
+			if (!full) boundary = std::max(boundary, prefetchedUpTo.load());
+			prefetchedUpTo.store(boundary, std::memory_order_release);
+		}
+
+		void StreamSubject::Prefetch() {
+			std::lock_guard<std::mutex> lg(prefetchLock);
+			PrefetchLocked(prefetchHorizon.load(std::memory_order_acquire));
+		}
+
+		void StreamSubject::Enqueue(Event::Ref evt) {
+			std::lock_guard<std::mutex> lg(prefetchLock);
+			if (evt->timestamp < prefetchedUpTo.load()) {
+				// already inside the sliced window
+				if (Stage(evt)) return;
+				prefetchedUpTo.store(evt->timestamp, std::memory_order_release);
+			}
+			eventQueue.insert_into(evt);
+		}
+
 		void StreamSubject::Subscribe(const Runtime::MethodKey& mk, const IO::ManagedRef& handle, krt_instance instance, krt_process_call callback, void const** slot) {
 			std::unique_lock<std::mutex> lg(subscriberLock);
 			auto sub = UnsafeSubscribe(mk, handle, instance, callback, slot);
-			lg.unlock();
 
-			auto on = std::make_unique<ObjectNode>(ObjectNode{ sub, instance });
+			auto on = std::make_unique<ObjectNode>();
+			on->subData = sub;
+			on->instance = instance;
+			on->meter = IO::LoadMeter::Create(mk.name ? mk.name : "stream", instance);
+
+			auto h = held.find(instance);
+			if (h != held.end()) {
+				h->second.emplace_back(std::move(on));
+				return;
+			}
+			lg.unlock();
 
 			auto tp = VirtualTimePoint();
 //			std::clog << "sub at " << tp.time_since_epoch().count() << "\n";
 
-			eventQueue.insert_into(std::make_shared<Event>(
+			Enqueue(std::make_shared<Event>(
 				Event::Subscribe,
 				tp,
 				0,
@@ -196,11 +269,116 @@ namespace Kronos {
 			));
 		}
 
+		void StreamSubject::Hold(krt_instance instance) {
+			std::lock_guard<std::mutex> lg(subscriberLock);
+			held[instance];
+		}
+
+		bool StreamSubject::Replace(krt_instance instance, krt_instance old, size_t stateBytes) {
+			std::vector<ObjectNode::URef> nodes;
+			{
+				std::lock_guard<std::mutex> lg(subscriberLock);
+				auto h = held.find(instance);
+				if (h == held.end()) return false;
+				nodes = std::move(h->second);
+				held.erase(h);
+			}
+
+			if (nodes.empty()) return false;
+
+			// every subscription of the new instance goes live at once, as one chain
+			for (size_t i = nodes.size() - 1; i > 0; --i) {
+				nodes[i - 1]->next = nodes[i].release();
+			}
+			auto on = std::move(nodes.front());
+			on->replaces = old;
+			on->migrateBytes = stateBytes;
+
+			Enqueue(std::make_shared<Event>(
+				Event::Subscribe,
+				VirtualTimePoint(),
+				0,
+				BlobRef(),
+				std::move(on)
+			));
+			return true;
+		}
+
+		void StreamSubject::Link(ObjectNode* chain) {
+			auto tail = chain;
+			while (tail->next) tail = tail->next;
+			tail->next = subscriberList.next;
+			subscriberList.next = chain;
+		}
+
+		void StreamSubject::Retire(krt_instance old) {
+			auto i = subscribers.find(old);
+			if (i != subscribers.end() && i->second.callback != StreamObjectTombstone) {
+				i->second.garbage = true;
+			}
+		}
+
+		bool StreamSubject::BeginMigration(ObjectNode* chain) {
+			for (auto& m : migrating) {
+				if (!m.load(std::memory_order_relaxed)) {
+					m.store(chain, std::memory_order_release);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool StreamSubject::IsMigrating(krt_instance old) const {
+			for (auto& m : migrating) {
+				auto chain = m.load(std::memory_order_relaxed);
+				if (chain && chain->replaces == old) return true;
+			}
+			return false;
+		}
+
+		void StreamSubject::CompleteMigrations(std::uint64_t seq) {
+			// a snapshot taken while the stream was idle at 'seq' is the state
+			// the old instance would start this block with
+			for (auto& m : migrating) {
+				auto chain = m.load(std::memory_order_relaxed);
+				if (chain && chain->snapshotAt.load(std::memory_order_acquire) == seq) {
+					Retire(chain->replaces);
+					Link(chain);
+					m.store(nullptr, std::memory_order_release);
+				}
+			}
+		}
+
+		void StreamSubject::Migrate() {
+			// the sweep that frees retired instances runs on this thread, so a
+			// 'replaces' present in subscribers stays valid until we return
+			std::lock_guard<std::mutex> lg(subscriberLock);
+			for (auto& m : migrating) {
+				for (int attempt = 0; attempt < 64; ++attempt) {
+					auto seq = blockSeq.load(std::memory_order_acquire);
+					if (seq & 1) {
+						std::this_thread::yield();
+						continue;
+					}
+					auto chain = m.load(std::memory_order_acquire);
+					if (!chain || chain->snapshotAt.load(std::memory_order_relaxed) == seq) break;
+					if (subscribers.count(chain->replaces)) {
+						memcpy(chain->instance, chain->replaces, chain->migrateBytes);
+					}
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (blockSeq.load(std::memory_order_relaxed) == seq) {
+						chain->snapshotAt.store(seq, std::memory_order_release);
+						break;
+					}
+				}
+			}
+		}
+
 		void StreamSubject::Unsubscribe(const Runtime::MethodKey&, krt_instance instance) {
 			auto tp = VirtualTimePoint();
 //			std::clog << "unsub at " << tp.time_since_epoch().count() << "\n";
 
-			eventQueue.insert_into(std::make_shared<Event>(
+			Enqueue(std::make_shared<Event>(
 				Event::Unsubscribe,
 				tp,
 				(int64_t)instance,
@@ -210,7 +388,7 @@ namespace Kronos {
 		}
 
 		void StreamSubject::TimedDispatch(TimePointTy time, IObject* child, int sym, const void* data, size_t sz) {
-			eventQueue.insert_into(std::make_shared<Event>(
+			Enqueue(std::make_shared<Event>(
 				(Event::Kind)sym,
 				time,
 				(std::int64_t)child,
@@ -225,16 +403,34 @@ namespace Kronos {
 			auto streamTime = IO::GetCurrentActivationTime(); 
 			auto ticks_us = IO::GetCurrentActivationRate(); 
 			auto upToSampleTime = Rendered + numFrames;
+			IO::FPEnv::FlushScope flushDenormals;
+			IO::LoadMeter::Scope measureSubject(meter.get(), IO::LoadMeter::BudgetFromTicksPerMicrosecond(numFrames, ticks_us));
 
+			// instance state is in flux until blockSeq is even again
+			auto seq = blockSeq.load(std::memory_order_relaxed);
+			blockSeq.store(seq + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			CompleteMigrations(seq);
+
+			bool clockJumped = ExpectedStreamTime == TimePointTy{} || ticks_us != samplesPerMicrosecond.load(std::memory_order_relaxed);
 			if (ExpectedStreamTime != TimePointTy{}) {
 				auto drift = streamTime - ExpectedStreamTime;
 				if (drift > -1ms && drift < 1ms) {
 					streamTime = ExpectedStreamTime;
+				} else {
+					clockJumped = true;
 				}
 			}
+
+			sampleEpoch.store(streamTime - MicroSecTy((std::int64_t)round(Rendered / ticks_us)), std::memory_order_relaxed);
+			samplesPerMicrosecond.store(ticks_us, std::memory_order_relaxed);
+			auto anchor = clockAnchor.load(std::memory_order_relaxed);
+			if (clockJumped) clockAnchor.store(++anchor, std::memory_order_release);
             
 			auto sliceDuration = std::chrono::microseconds((int)round(numFrames / ticks_us));
             ExpectedStreamTime = streamTime + sliceDuration;
+			prefetchHorizon.store(ExpectedStreamTime + std::max<TimePointTy::duration>(sliceDuration * 8, 40ms),
+								  std::memory_order_release);
 
 			scriptExecutionEnvironment->RenderEvents(
 				streamTime + sliceDuration, 
@@ -245,17 +441,96 @@ namespace Kronos {
             TimingContextTy old = Frozen;
             std::swap(TimingContext(), old);
             
-			auto ts2StreamTime = [&](TimePointTy us) {
-				auto nsOffset = us > streamTime ? us - streamTime : 0ns;
-//				std::clog << us.time_since_epoch().count() << " <- " << streamTime.time_since_epoch().count() << "\n";
-				auto smpOffset = int64_t(round(nsOffset.count() * ticks_us * 0.001));
-				auto smpTime = Rendered + smpOffset;
-				return smpTime;
+			// events staged before a clock jump are converted again against this block
+			auto sampleTime = [&](const Event& evt) {
+				auto smpTime = evt.anchor == anchor 
+					? evt.frame 
+					: (TimeTy)Rendered + ToSampleTime(evt.timestamp, streamTime, ticks_us);
+				return std::max(smpTime, (TimeTy)Rendered);
 			};
 
 			char *outPtr = (char *)output;
 			int64_t didRenderNow = 0;
 
+			auto retire = [&](Event& evt) {
+				evt.kind = Event::Stale;
+				--outstanding;
+			};
+
+			auto applyControl = [&](Event& evt) {
+				auto stamp = evt.timestamp;
+				std::swap(stamp, VirtualTimePoint());
+				auto child = (IObject*)evt.param;
+				child->Dispatch((int)evt.kind, evt.data.blob->data(), evt.data.blob->size(), nullptr);
+				std::swap(stamp, VirtualTimePoint());
+				retire(evt);
+			};
+
+			// move freshly staged events into the pending heap; capacity is
+			// reserved up front, so this never allocates
+			auto drain = [&]() {
+				auto published = prefetchPublished.load(std::memory_order_acquire);
+				auto read = prefetchRead.load(std::memory_order_relaxed);
+				for (; read != published && pending.size() < pending.capacity(); ++read) {
+					auto evt = prefetch[read & (PrefetchSlots - 1)].get();
+					pending.push_back(PendingEvent{ evt->timestamp, pendingOrder++, evt });
+					std::push_heap(pending.begin(), pending.end(), PendingEvent::Later{});
+				}
+				prefetchRead.store(read, std::memory_order_release);
+			};
+
+			drain();
+			auto blockEnd = streamTime + sliceDuration;
+			if (prefetchedUpTo.load(std::memory_order_acquire) < blockEnd + sliceDuration) {
+				// the collector hasn't caught up with this block yet; slice it here
+				// unless a non-realtime thread holds the queue. Whatever is already
+				// staged plays, the rest waits for the collector.
+				std::unique_lock<std::mutex> lg(prefetchLock, std::try_to_lock);
+				if (lg.owns_lock()) PrefetchLocked(blockEnd + sliceDuration + sliceDuration);
+			}
+			drain();
+
+			// stale events may be reclaimed by the collector, so 'done' is tracked here
+			auto applyDue = [&](TimeTy to) {
+				for (auto& d : deferred) {
+					if (!d.done && d.frame <= to) {
+						applyControl(*d.evt);
+						d.done = true;
+					}
+				}
+				deferred.erase(std::remove_if(deferred.begin(), deferred.end(), [](const Deferred& d) {
+					return d.done;
+				}), deferred.end());
+			};
+
+			auto isTarget = [](ObjectNode* node, const Event& evt) {
+				return node->subData->handle.get() == static_cast<IO::ManagedObject*>((IObject*)evt.param);
+			};
+
+			// whether a control event will be met while rendering one of our subscribers
+			auto hasSubscriber = [&](const Event& evt) {
+				for (auto cur = subscriberList.next; cur; cur = cur->next) {
+					if (!cur->subData->garbage && cur->subData->callback != StreamObjectTombstone &&
+						isTarget(cur, evt)) return true;
+				}
+				return false;
+			};
+
+			// render one subscriber, splitting its span only at its own control events
+			auto processSpan = [&](ObjectNode* node, TimeTy from, TimeTy to, char* out) {
+				for (auto& d : deferred) {
+					if (d.done || d.frame >= to || !isTarget(node, *d.evt)) continue;
+					if (d.frame > from) {
+						node->subData->callback(node->instance, out, (int)(d.frame - from));
+						out += (d.frame - from) * outputFrameSize;
+						from = d.frame;
+					}
+					applyControl(*d.evt);
+					d.done = true;
+				}
+				if (to > from) node->subData->callback(node->instance, out, (int)(to - from));
+			};
+
 			auto stepTo = [&](TimeTy to) {
 				auto streamPos = Rendered + didRenderNow;
 				if (to > streamPos) {
@@ -279,7 +554,12 @@ namespace Kronos {
 							}
 
 							if (cur->subData->callback) {
-								cur->subData->callback(cur->instance, outPtr, (int)toDo);
+								IO::LoadMeter::Scope measureInstance(cur->meter.get(), IO::LoadMeter::BudgetFromTicksPerMicrosecond((int)toDo, ticks_us));
+								if (deferred.empty()) {
+									cur->subData->callback(cur->instance, outPtr, (int)toDo);
+								} else {
+									processSpan(cur, streamPos, to, outPtr);
+								}
 							}
 
 						}
@@ -291,73 +571,82 @@ namespace Kronos {
 			};
 
 
-			for (bool loop = true; loop; ) {
-				volatile auto eventQueueVersion = eventQueue.identity();
-				
-				loop = false;
+			// events beyond the sliced window wait, so a late arrival can't be overtaken
+			auto window = prefetchedUpTo.load(std::memory_order_acquire);
+			while (!pending.empty()) {
+				auto evt = pending.front().evt;
+				if (evt->timestamp >= window) break;
 
-				if (eventQueue.for_each([&](auto& evt) {
-					if (evt->kind == Event::Stale) return true;
+				auto evtSampleTime = sampleTime(*evt);
+				if (evtSampleTime > (TimeTy)upToSampleTime) break;
 
-					loop = true;
+				std::pop_heap(pending.begin(), pending.end(), PendingEvent::Later{});
+				pending.pop_back();
 
-					auto evtSampleTime = ts2StreamTime(evt->timestamp);
-
-					if (evtSampleTime > upToSampleTime) {
-						loop = false;
-						return false;
-					}
+				// control events only touch their target, so they are applied inside
+				// its span instead of splitting the block for every subscriber. Targets
+				// that don't render on this stream are applied on time at a barrier.
+				if (evt->kind >= Event::Dispatch && deferred.size() < deferred.capacity() && hasSubscriber(*evt)) {
+					deferred.push_back(Deferred{ evt, (TimeTy)evtSampleTime, false });
+					continue;
+				}
 
-					stepTo(evtSampleTime);
-
-					switch (evt->kind) {
-					case Event::Subscribe:
-							//std::clog << "audio sub " << evtSampleTime << "\n";
-							evt->node->next = subscriberList.next;
-							subscriberList.next = evt->node.release();
-							break;
-					case Event::Unsubscribe:
-                        {
-							//std::clog << "audio unsub " << evtSampleTime << "\n";
-							auto i = subscribers.find((krt_instance)evt->param);
-                            if (i != subscribers.end()) {
-                                i->second.garbage = true;
-                            } 
-                        }
-						break;
-					case Event::Script:
-						{
-							auto stamp = evt->timestamp;
-							std::swap(stamp, VirtualTimePoint());
-							scriptExecutionEnvironment
-								->Run(InteropTimestamp(VirtualTimePoint()), evt->param,
-									  evt->data.blob->data(), evt->data.blob->size());
-							std::swap(stamp, VirtualTimePoint());
+				stepTo(evtSampleTime);
+				applyDue(evtSampleTime);
+
+				switch (evt->kind) {
+				case Event::Subscribe:
+						//std::clog << "audio sub " << evtSampleTime << "\n";
+						if (evt->node->replaces && evt->node->migrateBytes) {
+							// the old instance keeps rendering until the collector has copied its state
+							auto i = subscribers.find(evt->node->replaces);
+							if (i != subscribers.end() && i->second.callback != StreamObjectTombstone &&
+								BeginMigration(evt->node.get())) {
+								evt->node.release();
+								retire(*evt);
+								break;
+							}
 						}
+						if (evt->node->replaces) Retire(evt->node->replaces);
+						Link(evt->node.release());
+						retire(*evt);
 						break;
-					default:
-						assert(evt->kind >= Event::Dispatch);
-						{
-							auto stamp = evt->timestamp;
-							std::swap(stamp, VirtualTimePoint());
-							auto child = (IObject*)evt->param;
-							int symIdx = (int)evt->kind;
-//							float *tmp = (float*)evt->data.blob->data();
-//							std::cout << symIdx << " <== " << *tmp << "\n";
-							child->Dispatch(symIdx, evt->data.blob->data(), evt->data.blob->size(), nullptr);
-							std::swap(stamp, VirtualTimePoint());
-							break;
-						}
+				case Event::Unsubscribe:
+                    {
+						//std::clog << "audio unsub " << evtSampleTime << "\n";
+						// a migrating replacement retires its predecessor when it goes live
+						auto i = subscribers.find((krt_instance)evt->param);
+                        if (i != subscribers.end() && !IsMigrating(i->first)) {
+                            i->second.garbage = true;
+                        } 
+                    }
+					retire(*evt);
+					break;
+				case Event::Script:
+					{
+						auto stamp = evt->timestamp;
+						std::swap(stamp, VirtualTimePoint());
+						scriptExecutionEnvironment
+							->Run(InteropTimestamp(VirtualTimePoint()), evt->param,
+								  evt->data.blob->data(), evt->data.blob->size());
+						std::swap(stamp, VirtualTimePoint());
 					}
-
-					evt->kind = Event::Stale;
-
-					return eventQueueVersion == eventQueue.identity();
-				})) break;			
+					retire(*evt);
+					// the script may have scheduled more events for this block
+					drain();
+					window = prefetchedUpTo.load(std::memory_order_acquire);
+					break;
+				default:
+					assert(evt->kind >= Event::Dispatch);
+					applyControl(*evt);
+					break;
+				}
 			}
 			stepTo(upToSampleTime);
+			applyDue(upToSampleTime);
 			Rendered = upToSampleTime;
 			std::swap(TimingContext(), old);
+			blockSeq.store(seq + 2, std::memory_order_release);
 		}
 	}
 }
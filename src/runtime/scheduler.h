@@ -4,6 +4,7 @@
 #include <cstring>
 #include "pcoll/treap.h"
 #include "kronosrtxx.h"
+#include "loadmeter.h"
 
 namespace Kronos {
 	namespace Runtime {
@@ -151,6 +152,13 @@ namespace Kronos {
 				Subscription* subData = nullptr;
 				krt_instance instance = nullptr;
 				ObjectNode* next = nullptr;
+				std::shared_ptr<IO::LoadMeter::Meter> meter;
+				// hot swap: instance retired when this node is linked, and
+				// the number of state bytes carried over from it
+				krt_instance replaces = nullptr;
+				size_t migrateBytes = 0;
+				// block sequence number the migrated state was copied at; odd when none
+				std::atomic<std::uint64_t> snapshotAt{ 1 };
                 using URef = std::unique_ptr<ObjectNode>;
 			};
 
@@ -167,6 +175,10 @@ namespace Kronos {
 
 				std::unique_ptr<ObjectNode> node;
 
+				// sample time, converted when staged under stream clock 'anchor'
+				TimeTy frame = 0;
+				std::uint64_t anchor = 0;
+
 				Event(Kind kind, TimePointTy time, int64_t param, BlobRef blob, ObjectNode::URef node)
 					:TimePoint(TimePoint{ time, param, std::move(blob) }),
 					kind(kind), node(std::move(node)) {}
@@ -177,7 +189,73 @@ namespace Kronos {
 
 			ObjectNode subscriberList;
 
+			// control events of the current block, in time order; preallocated
+			// so the audio thread never allocates
+			struct Deferred {
+				Event* evt;
+				TimeTy frame;
+				bool done;
+			};
+			std::vector<Deferred> deferred;
+
+			// events are sliced out of eventQueue ahead of the audio thread into a
+			// ring of slots. Slots are filled under prefetchLock by non-realtime
+			// threads and recycled once the audio thread has marked their event Stale.
+			// The audio thread only ever try_locks prefetchLock.
+			static const size_t PrefetchSlots = 1024;
+			std::unique_ptr<Event::Ref[]> prefetch;
+			size_t prefetchWrite = 0;
+			std::atomic<size_t> prefetchPublished{ 0 };
+			std::atomic<size_t> prefetchRead{ 0 };
+			std::atomic<size_t> outstanding{ 0 };
+			// eventQueue holds nothing earlier than prefetchedUpTo
+			std::atomic<TimePointTy> prefetchedUpTo;
+			// how far ahead of the stream the audio thread wants events sliced
+			std::atomic<TimePointTy> prefetchHorizon;
+			// stream time of sample zero and the sample rate, published by the audio
+			// thread for Stage. clockAnchor changes when the stream clock jumps.
+			std::atomic<TimePointTy> sampleEpoch;
+			std::atomic<double> samplesPerMicrosecond{ 0 };
+			std::atomic<std::uint64_t> clockAnchor{ 0 };
+			std::mutex prefetchLock;
+			// fetched by the audio thread and not yet reached; a min-heap on
+			// time, then arrival, so simultaneous events keep their order
+			struct PendingEvent {
+				TimePointTy at;
+				std::uint64_t order;
+				Event* evt;
+				struct Later {
+					bool operator()(const PendingEvent& a, const PendingEvent& b) const {
+						return a.at > b.at || (a.at == b.at && a.order > b.order);
+					}
+				};
+			};
+			std::vector<PendingEvent> pending;
+			std::uint64_t pendingOrder = 0;
+
+			bool Stage(const Event::Ref& evt);
+			void Enqueue(Event::Ref evt);
+			void PrefetchLocked(TimePointTy upTo);
+
+			// subscriptions withheld from the audio thread until Replace
+			std::unordered_map<krt_instance, std::vector<ObjectNode::URef>> held;
+
+			// odd while Fire is rendering; instance state is only stable when even
+			std::atomic<std::uint64_t> blockSeq{ 0 };
+			// replacements waiting for the collector to copy their state over,
+			// set and cleared by the audio thread
+			static const size_t MigrationSlots = 16;
+			std::atomic<ObjectNode*> migrating[MigrationSlots];
+
+			void Link(ObjectNode* chain);
+			void Retire(krt_instance old);
+			bool BeginMigration(ObjectNode* chain);
+			void CompleteMigrations(std::uint64_t seq);
+			bool IsMigrating(krt_instance old) const;
+			void Migrate();
+
 			IEnvironment* scriptExecutionEnvironment;
+			std::shared_ptr<IO::LoadMeter::Meter> meter;
 
 		protected:
 			size_t outputFrameSize;
@@ -190,7 +268,15 @@ namespace Kronos {
 		public:
 			StreamSubject(IEnvironment *scriptHost, size_t outputFrameSize)
 				: scriptExecutionEnvironment(scriptHost)
+				, meter(IO::LoadMeter::Create("stream", this))
 				, outputFrameSize(outputFrameSize) {
+				deferred.reserve(PrefetchSlots);
+				pending.reserve(PrefetchSlots);
+				prefetch.reset(new Event::Ref[PrefetchSlots]);
+				for (auto& m : migrating) m.store(nullptr);
+				prefetchedUpTo.store(TimePointTy{});
+				prefetchHorizon.store(TimePointTy{});
+				sampleEpoch.store(TimePointTy{});
 				StartCollectorThread();
 			}
 
@@ -200,6 +286,13 @@ namespace Kronos {
 			void Subscribe(const Runtime::MethodKey&, const IO::ManagedRef& handle, krt_instance instance, krt_process_call callback, void const** slot) override;
 			void Unsubscribe(const Runtime::MethodKey&, krt_instance) override;
 
+			// withhold the next subscription of 'instance' until Replace
+			void Hold(krt_instance instance);
+			// atomically swap a held instance in place of 'old' on the audio thread,
+			// copying 'stateBytes' of instance state over first. The copy is made
+			// by the collector between blocks; the swap lands on a block boundary.
+			bool Replace(krt_instance instance, krt_instance old, size_t stateBytes);
+
 			IEnvironment& Environment() {
 				return *scriptExecutionEnvironment;
 			}
@@ -207,9 +300,10 @@ namespace Kronos {
 			void StopCollectorThread();
 			void StartCollectorThread();
 			int SweepSchedule();
+			void Prefetch();
 
 			bool Pending() const {
-				return !eventQueue.empty();
+				return !eventQueue.empty() || outstanding.load() > 0;
 			}
 
 			void TimedDispatch(TimePointTy timePoint, IObject* target, int symbol, const void* data, size_t sz);
@@ -0,0 +1,51 @@
+#include "loadmeter.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#define test_assert(cond, msg) if(!(cond)) { std::cerr << "** Failed: " #cond ", " << msg << "\n"; exit(-1); }
+
+using namespace Kronos::IO;
+
+static void BusyWait(std::chrono::microseconds duration) {
+	auto until = std::chrono::steady_clock::now() + duration;
+	while (std::chrono::steady_clock::now() < until);
+}
+
+int main() {
+	const double sampleRate = 44100.0;
+	const int frames = 176; // ~4ms
+
+	auto hz = LoadMeter::Budget(frames, sampleRate);
+	auto ticks = LoadMeter::BudgetFromTicksPerMicrosecond(frames, sampleRate / 1e6);
+	test_assert(std::fabs((double)ticks - (double)hz) <= 0.01 * (double)hz,
+				"budget from ticks per microsecond " << ticks << " differs from " << hz);
+
+	auto expected = std::chrono::microseconds(frames * 1000000 / (int)sampleRate);
+
+	// half the buffer period
+	auto halfLoad = LoadMeter::Create("half");
+	for (int i = 0; i < 50; ++i) {
+		LoadMeter::Scope measure(halfLoad.get(), ticks);
+		BusyWait(expected / 2);
+	}
+	auto half = halfLoad->Read();
+	test_assert(half.calls == 50, "calls " << half.calls);
+	test_assert(half.Load() > 0.35 && half.Load() < 0.9, "load " << half.Load() << " for a half period busy-wait");
+	test_assert(half.overruns < 5, "overruns " << half.overruns << " for a half period busy-wait");
+
+	// twice the buffer period
+	auto overload = LoadMeter::Create("overload");
+	for (int i = 0; i < 10; ++i) {
+		LoadMeter::Scope measure(overload.get(), ticks);
+		BusyWait(expected * 2);
+	}
+	auto over = overload->Read();
+	test_assert(over.Load() > 1.5, "load " << over.Load() << " for a double period busy-wait");
+	test_assert(over.overruns == 10, "overruns " << over.overruns << " for a double period busy-wait");
+
+	std::cout << "load " << half.Load() << " / " << over.Load() << "\n";
+	return 0;
+}